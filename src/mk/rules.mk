@@ -44,7 +44,7 @@ OC=${OSDROOT}/src/oc
 OC_INCLUDE += \
 	-I $(OSDROOT)/src/pl
 
-OC_SUBDIRS = crt ds utl bpt xt
+OC_SUBDIRS = crt ds utl bpt xt fs ljl pm img
 
 OC_INCLUDE += $(OC_SUBDIRS:%=-I $(OC)/%)
 
@@ -60,6 +60,18 @@ $(OBJDIR)/%.o: ${OC}/bpt/%.c
 $(OBJDIR)/%.o: ${OC}/xt/%.c
 	$(CC) -c $(CFLAGS) $(OC_INCLUDE) $< -o $@
 
+$(OBJDIR)/%.o: ${OC}/fs/%.c
+	$(CC) -c $(CFLAGS) $(OC_INCLUDE) $< -o $@
+
+$(OBJDIR)/%.o: ${OC}/ljl/%.c
+	$(CC) -c $(CFLAGS) $(OC_INCLUDE) $< -o $@
+
+$(OBJDIR)/%.o: ${OC}/pm/%.c
+	$(CC) -c $(CFLAGS) $(OC_INCLUDE) $< -o $@
+
+$(OBJDIR)/%.o: ${OC}/img/%.c
+	$(CC) -c $(CFLAGS) $(OC_INCLUDE) $< -o $@
+
 $(OBJDIR)/%.o: ${OC}/%.c
 	$(CC) -c $(CFLAGS) $(OC_INCLUDE) $< -o $@
 
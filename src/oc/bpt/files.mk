@@ -44,4 +44,6 @@ BPT_OBJECTS = \
 	${OBJDIR}/oc_bpt_op_lookup_range.o \
 	${OBJDIR}/oc_bpt_op_insert_range.o \
 	${OBJDIR}/oc_bpt_op_remove_range.o \
+	${OBJDIR}/oc_bpt_op_compact.o \
+	${OBJDIR}/oc_bpt_op_dump.o \
 	${OBJDIR}/oc_bpt_trace.o 
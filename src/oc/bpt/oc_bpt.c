@@ -57,6 +57,8 @@
 #include "oc_bpt_op_output_dot.h"
 #include "oc_bpt_op_output_clones_dot.h"
 #include "oc_bpt_op_stat.h"
+#include "oc_bpt_op_compact.h"
+#include "oc_bpt_op_dump.h"
 
 // needed for the query function
 #include "oc_rm_s.h"
@@ -239,11 +241,32 @@ uint64 oc_bpt_create_b(
     return s_p->root_node_p->disk_addr;
 }
 
+void oc_bpt_open_b(
+    struct Oc_wu *wu_p,
+    Oc_bpt_state *s_p,
+    uint64 addr)
+{
+    oc_utl_assert(NULL == s_p->root_node_p);
+    oc_utl_debugassert(s_p->cfg_p->initialized);
+
+    oc_utl_trk_crt_lock_write(wu_p, &s_p->lock);
+    {
+        s_p->root_node_p = s_p->cfg_p->node_get_sl(wu_p, addr);
+        oc_utl_trk_crt_unlock(wu_p, &s_p->root_node_p->lock);
+    }
+    oc_utl_trk_crt_unlock(wu_p, &s_p->lock);
+}
+
 uint64 oc_bpt_get_tid(struct Oc_bpt_state *s_p)
 {
     return s_p->tid;
 }
 
+bool oc_bpt_node_is_leaf(Oc_bpt_node *node_p)
+{
+    return oc_bpt_nd_is_leaf(NULL, node_p);
+}
+
 /// Create a b-tree whose root is in address [addr]
 void oc_bpt_init_map(
     struct Oc_wu *wu_p,
@@ -702,6 +725,84 @@ uint64 oc_bpt_clone_b(
     return trg_p->root_node_p->disk_addr;
 }
 
+uint64 oc_bpt_compact_copy_b(
+    struct Oc_wu *wu_p,
+    Oc_bpt_state *src_p,
+    Oc_bpt_state *trg_p)
+{
+    oc_utl_assert(trg_p->cfg_p->key_size == src_p->cfg_p->key_size);
+    oc_utl_assert(trg_p->cfg_p->data_size == src_p->cfg_p->data_size);
+
+    oc_bpt_trace_wu_lvl(2, OC_EV_BPT_COMPACT, wu_p,
+                        "tid=%Lu -> tid=%Lu",
+                        src_p->tid, trg_p->tid);
+
+    oc_utl_debugassert(src_p->cfg_p->initialized);
+    oc_utl_debugassert(trg_p->cfg_p->initialized);
+    oc_utl_assert(NULL == trg_p->root_node_p);
+
+    oc_utl_trk_crt_lock_read(wu_p, &src_p->lock);
+    oc_utl_trk_crt_lock_write(wu_p, &trg_p->lock);
+    oc_bpt_op_compact_copy_b(wu_p, src_p, trg_p);
+    oc_utl_trk_crt_unlock(wu_p, &trg_p->lock);
+    oc_utl_trk_crt_unlock(wu_p, &src_p->lock);
+
+    return trg_p->root_node_p->disk_addr;
+}
+
+Oc_bpt_dump_rc oc_bpt_dump_b(
+    struct Oc_wu *wu_p,
+    Oc_bpt_state *s_p,
+    int fd,
+    uint64 *num_entries_po)
+{
+    Oc_bpt_dump_rc rc;
+
+    oc_bpt_trace_wu_lvl(2, OC_EV_BPT_DUMP, wu_p, "tid=%Lu", s_p->tid);
+    oc_utl_debugassert(s_p->cfg_p->initialized);
+
+    oc_utl_trk_crt_lock_read(wu_p, &s_p->lock);
+    rc = oc_bpt_op_dump_b(wu_p, s_p, fd, num_entries_po);
+    oc_utl_trk_crt_unlock(wu_p, &s_p->lock);
+
+    return rc;
+}
+
+Oc_bpt_dump_rc oc_bpt_restore_b(
+    struct Oc_wu *wu_p,
+    Oc_bpt_state *trg_p,
+    int fd)
+{
+    Oc_bpt_dump_rc rc;
+
+    oc_bpt_trace_wu_lvl(2, OC_EV_BPT_RESTORE, wu_p, "tid=%Lu", trg_p->tid);
+    oc_utl_debugassert(trg_p->cfg_p->initialized);
+    oc_utl_assert(NULL == trg_p->root_node_p);
+
+    oc_utl_trk_crt_lock_write(wu_p, &trg_p->lock);
+    rc = oc_bpt_op_restore_b(wu_p, trg_p, fd);
+    oc_utl_trk_crt_unlock(wu_p, &trg_p->lock);
+
+    return rc;
+}
+
+#define CASE(s) case s: return #s ; break
+
+const char *oc_bpt_string_of_dump_rc(Oc_bpt_dump_rc rc)
+{
+    switch (rc) {
+        CASE(OC_BPT_DUMP_OK);
+        CASE(OC_BPT_DUMP_IO_ERR);
+        CASE(OC_BPT_DUMP_TRUNCATED);
+        CASE(OC_BPT_DUMP_CORRUPT);
+        CASE(OC_BPT_DUMP_MISMATCH);
+
+    default:
+        ERR(("sanity"));
+    }
+}
+#undef CASE
+
 /**********************************************************************/
 
 void oc_bpt_iter_b(
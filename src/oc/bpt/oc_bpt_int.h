@@ -176,6 +176,11 @@ void oc_bpt_destroy_state(
  */
 uint64 oc_bpt_get_tid(struct Oc_bpt_state *s_p);
 
+/* Return TRUE if node [node_p] is a leaf. The node is not locked, node
+ * stores use this to tell index nodes apart.
+ */
+bool oc_bpt_node_is_leaf(Oc_bpt_node *node_p);
+
 
 /* basic operations
  */
@@ -188,6 +193,14 @@ uint64 oc_bpt_create_b(
     struct Oc_wu *wu_p,
     struct Oc_bpt_state *s_p);
 
+/* Open the existing b-tree whose root is in address [addr]. The
+ * state has to be initialized, and not hold a tree.
+ */
+void oc_bpt_open_b(
+    struct Oc_wu *wu_p,
+    struct Oc_bpt_state *s_p,
+    uint64 addr);
+
 /* Create a b-tree whose root is in address [addr]
  *
  * The assumption is that the caller makes sure no concurrent operations
@@ -391,6 +404,63 @@ uint64 oc_bpt_clone_b(
     struct Oc_bpt_state *src_p,
     struct Oc_bpt_state *trg_p);
 
+/* copy the keys and data of b-tree [src_p] into a new tree [trg_p],
+ * built bottom-up from nearly full nodes. The source is locked for
+ * read during this operation. The two trees may be kept by different
+ * node stores, but they must have the same key and data sizes.
+ *
+ * Return the address on disk of the root of [trg_p].
+ *
+ * pre-requisit: a fresh b-tree state [trg_p] has to be created
+ *   and initialized.
+ */
+uint64 oc_bpt_compact_copy_b(
+    struct Oc_wu *wu_p,
+    struct Oc_bpt_state *src_p,
+    struct Oc_bpt_state *trg_p);
+
+// The outcome of a dump or a restore
+typedef enum Oc_bpt_dump_rc {
+    OC_BPT_DUMP_OK,
+    OC_BPT_DUMP_IO_ERR,          // a read or a write of [fd] failed
+    OC_BPT_DUMP_TRUNCATED,       // the dump ended early
+    OC_BPT_DUMP_CORRUPT,         // a checksum or an encoding is wrong
+    OC_BPT_DUMP_MISMATCH,        // another version, or key and data sizes
+} Oc_bpt_dump_rc;
+
+/* write the keys and data of b-tree [s_p] to file descriptor [fd], in
+ * key order, as a stream of checksummed blocks. The tree is locked for
+ * read during this operation; to let writers go on, dump a clone of
+ * the tree, and delete the clone afterwards.
+ *
+ * Return OC_BPT_DUMP_OK and the number of entries written in
+ * [*num_entries_po], or OC_BPT_DUMP_IO_ERR if a write failed.
+ */
+Oc_bpt_dump_rc oc_bpt_dump_b(
+    struct Oc_wu *wu_p,
+    struct Oc_bpt_state *s_p,
+    int fd,
+    uint64 *num_entries_po);
+
+/* read a dump written by oc_bpt_dump_b from [fd] into a new tree
+ * [trg_p]. The tree is built bottom-up, as by oc_bpt_compact_copy_b.
+ * The key and data sizes of [trg_p] have to be those of the dump.
+ *
+ * Return OC_BPT_DUMP_OK once the tree is built. Any other code means
+ * the dump could not be read; the part of [trg_p] built so far has
+ * been deleted, and [trg_p] has no root.
+ *
+ * pre-requisit: a fresh b-tree state [trg_p] has to be created
+ *   and initialized.
+ */
+Oc_bpt_dump_rc oc_bpt_restore_b(
+    struct Oc_wu *wu_p,
+    struct Oc_bpt_state *trg_p,
+    int fd);
+
+// A string representation of a dump return code
+const char *oc_bpt_string_of_dump_rc(Oc_bpt_dump_rc rc);
+
 /******************************************************************/
 /* Traverse the set of nodes in tree [s_p] and apply
  * function [iter_f] to them. 
@@ -285,6 +285,11 @@ static void oc_bpt_nd_inc_children_refcnt(struct Oc_wu *wu_p,
 
 /* grabs write lock; if child address has changed due to COW,
  * father's entr pointing to child is updated.
+ *
+ * A node made writable earlier in the current generation of the work
+ * unit is not shared, and has already been marked dirty. The ref-count
+ * and mark-dirty calls are skipped for it. A node store that does not
+ * support generations leaves [wu_p->generation] at zero.
  */
 Oc_bpt_node *oc_bpt_nd_get_for_write(
     Oc_wu *wu_p,
@@ -299,13 +304,23 @@ Oc_bpt_node *oc_bpt_nd_get_for_write(
 
     node_p = s_p->cfg_p->node_get_xl(wu_p, addr);
 
-    fs_refcnt = s_p->cfg_p->fs_get_refcount(wu_p, node_p->disk_addr);
-    if (fs_refcnt > 1) {
-        if (!oc_bpt_nd_is_leaf(s_p, node_p))
-            oc_bpt_nd_inc_children_refcnt(wu_p, s_p, node_p);
+    if (wu_p &&
+        wu_p->generation != 0 &&
+        node_p->generation == wu_p->generation) {
+        // already shadowed in this generation
+        oc_utl_debugassert(
+            s_p->cfg_p->fs_get_refcount(wu_p, node_p->disk_addr) == 1);
+    }
+    else {
+        fs_refcnt = s_p->cfg_p->fs_get_refcount(wu_p, node_p->disk_addr);
+        if (fs_refcnt > 1) {
+            if (!oc_bpt_nd_is_leaf(s_p, node_p))
+                oc_bpt_nd_inc_children_refcnt(wu_p, s_p, node_p);
+        }
+        
+        s_p->cfg_p->node_mark_dirty(wu_p, node_p, (fs_refcnt > 1));
+        node_p->generation = wu_p ? wu_p->generation : 0;
     }
-
-    s_p->cfg_p->node_mark_dirty(wu_p, node_p, (fs_refcnt > 1));
 
     /* make sure that the correct ordering is maintained between
      * father and son.
@@ -2152,3 +2167,59 @@ void oc_bpt_nd_clone_root(struct Oc_wu *wu_p,
 }
 
 /**********************************************************************/
+// used by compact-copy
+
+void oc_bpt_nd_init_empty(
+    struct Oc_bpt_state *s_p,
+    Oc_bpt_node *node_p,
+    bool root,
+    bool leaf)
+{
+    Oc_bpt_nd_hdr *hdr_p = get_hdr(node_p);
+    int i;
+
+    // erase the page except for the header
+    memset(node_p->data + sizeof(Oc_meta_data_page_hdr),
+           0,
+           s_p->cfg_p->node_size - sizeof(Oc_meta_data_page_hdr));
+    hdr_p->flags.root = root;
+    hdr_p->flags.leaf = leaf;
+    hdr_p->num_used_entries = 0;
+
+    // entries are appended in order, the directory is the identity
+    for (i=0; i<256; i++)
+        hdr_p->entry_dir[i] = i;
+}
+
+void oc_bpt_nd_leaf_append(
+    struct Oc_wu *wu_p,
+    struct Oc_bpt_state *s_p,
+    Oc_bpt_node *node_p,
+    struct Oc_bpt_key *key_p,
+    struct Oc_bpt_data *data_p)
+{
+    Oc_bpt_nd_hdr *hdr_p = get_hdr(node_p);
+
+    oc_utl_debugassert(0 == num_entries(hdr_p) ||
+                       s_p->cfg_p->key_compare(
+                           oc_bpt_nd_max_key(s_p, node_p), key_p) == 1);
+    alloc_new_leaf_entry(wu_p, s_p, hdr_p, get_start_array(s_p, node_p),
+                         key_p, data_p);
+}
+
+void oc_bpt_nd_index_append(
+    struct Oc_bpt_state *s_p,
+    Oc_bpt_node *node_p,
+    struct Oc_bpt_key *key_p,
+    uint64 addr)
+{
+    Oc_bpt_nd_hdr *hdr_p = get_hdr(node_p);
+
+    oc_utl_debugassert(0 == num_entries(hdr_p) ||
+                       s_p->cfg_p->key_compare(
+                           oc_bpt_nd_max_key(s_p, node_p), key_p) == 1);
+    alloc_new_index_entry(s_p, hdr_p, get_start_array(s_p, node_p),
+                          key_p, &addr);
+}
+
+/**********************************************************************/
@@ -478,6 +478,35 @@ void oc_bpt_nd_clone_root(struct Oc_wu *wu_p,
                           struct Oc_bpt_state *src_p,
                           struct Oc_bpt_state *trg_p);
 
+/**********************************************************************/
+// used by compact-copy, which builds a tree bottom-up
+
+/* Initialize [node_p] as an empty node. If [root] is TRUE it has the
+ * root format, [leaf] chooses between a leaf and an index node.
+ */
+void oc_bpt_nd_init_empty(
+    struct Oc_bpt_state *s_p,
+    Oc_bpt_node *node_p,
+    bool root,
+    bool leaf);
+
+/* Append a (key,data) pair to leaf [node_p]. The key has to be larger
+ * than all the keys in the node, and the node cannot be full.
+ */
+void oc_bpt_nd_leaf_append(
+    struct Oc_wu *wu_p,
+    struct Oc_bpt_state *s_p,
+    Oc_bpt_node *node_p,
+    struct Oc_bpt_key *key_p,
+    struct Oc_bpt_data *data_p);
+
+// Same as [oc_bpt_nd_leaf_append], for a (key,child) pair of an index node
+void oc_bpt_nd_index_append(
+    struct Oc_bpt_state *s_p,
+    Oc_bpt_node *node_p,
+    struct Oc_bpt_key *key_p,
+    uint64 addr);
+
 /**********************************************************************/
 
 #endif
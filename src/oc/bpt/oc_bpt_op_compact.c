@@ -0,0 +1,327 @@
+/**************************************************************/
+/*
+ * Copyright (c) 2014-2015, Ohad Rodeh, IBM Research
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer. 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution. 
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies, 
+ * either expressed or implied, of IBM Research.
+ * 
+ */
+/**************************************************************/
+/**********************************************************************/
+/* OC_BPT_OP_COMPACT.C
+ *
+ * Copy a b+-tree into a new, compact, tree
+ */
+/**********************************************************************/
+/*
+ * The target tree is built bottom-up, instead of by inserts. A first
+ * pass counts the keys in the source tree, which determines the shape
+ * of the target: the number of nodes at each level is the minimal one,
+ * and the entries of a level are spread evenly between its nodes. A
+ * second pass walks the leaves of the source in key order, and appends
+ * each entry to the leaf being filled. A node that receives all its
+ * entries is released, and its smallest key is appended to the node
+ * being filled one level up. The root is allocated first, and is filled
+ * last.
+ *
+ * Except in small trees, the nodes of the target are nearly full. This
+ * suits trees that are no longer modified; an insert into the target
+ * is likely to split a node.
+ *
+ * The builder only needs the number of entries in advance, and the
+ * entries in key order. It is also used to restore a dump.
+ */
+/**********************************************************************/
+#include <string.h>
+
+#include "pl_mm_int.h"
+#include "oc_utl.h"
+#include "oc_utl_trk.h"
+#include "oc_bpt_int.h"
+#include "oc_bpt_nd.h"
+#include "oc_bpt_utl.h"
+#include "oc_bpt_op_compact.h"
+/**********************************************************************/
+
+// A level of the target tree, the leaves are at level zero
+typedef struct Compact_level {
+    uint64 num_ent;               // the entries in all the nodes of the level
+    uint64 num_nodes;
+    uint64 cur;                   // the index of the node being filled
+    Oc_bpt_node *node_p;          // the node being filled, NULL if none
+    int target;                   // the number of entries it will hold
+    struct Oc_bpt_key *key_p;     // buffer for the smallest key of a node
+} Compact_level;
+
+typedef struct Oc_bpt_op_compact {
+    struct Oc_bpt_state *trg_p;
+    int height;                   // the level of the root
+    Compact_level lvl[OC_BPT_MAX_HEIGHT];
+} Compact;
+
+/**********************************************************************/
+
+static uint64 count_keys(
+    struct Oc_wu *wu_p,
+    struct Oc_bpt_state *s_p,
+    Oc_bpt_node *node_p)
+{
+    int i, num_entries = oc_bpt_nd_num_entries(s_p, node_p);
+    Oc_bpt_node *child_node_p;
+    struct Oc_bpt_key *dummy_key_p;
+    uint64 child_addr, sum = 0;
+
+    if (oc_bpt_nd_is_leaf(s_p, node_p))
+        return num_entries;
+
+    for (i=0; i<num_entries; i++) {
+        oc_bpt_nd_index_get_kth(s_p, node_p, i, &dummy_key_p, &child_addr);
+        child_node_p = oc_bpt_nd_get_for_read(wu_p, s_p, child_addr);
+        sum += count_keys(wu_p, s_p, child_node_p);
+        oc_bpt_nd_release(wu_p, s_p, child_node_p);
+    }
+    return sum;
+}
+
+uint64 oc_bpt_op_compact_count_keys(
+    struct Oc_wu *wu_p,
+    struct Oc_bpt_state *s_p)
+{
+    return count_keys(wu_p, s_p, s_p->root_node_p);
+}
+
+/* Compute the shape of a tree holding [num_keys] keys. Going up, each
+ * level has as few nodes as possible, until the entries fit in the
+ * root. A root index node needs at least two children.
+ */
+static void plan(Compact *c_p, uint64 num_keys)
+{
+    Oc_bpt_cfg *cfg_p = c_p->trg_p->cfg_p;
+    Compact_level *lvl_p;
+    uint64 num = num_keys, cap;
+
+    c_p->height = 0;
+    while (num > (uint64) cfg_p->max_num_ent_root_node) {
+        if (OC_BPT_MAX_HEIGHT - 1 == c_p->height)
+            ERR(("%Lu keys do not fit in a tree of height %d",
+                 num_keys, OC_BPT_MAX_HEIGHT));
+        cap = (0 == c_p->height) ?
+            cfg_p->max_num_ent_leaf_node : cfg_p->max_num_ent_index_node;
+        lvl_p = &c_p->lvl[c_p->height];
+        lvl_p->num_ent = num;
+        lvl_p->num_nodes = MAX((num + cap - 1) / cap, 2);
+        num = lvl_p->num_nodes;
+        c_p->height++;
+    }
+    c_p->lvl[c_p->height].num_ent = num;
+    c_p->lvl[c_p->height].num_nodes = 1;
+}
+
+// Return the node being filled at [level], allocate it if needed
+static Oc_bpt_node *open_node(
+    struct Oc_wu *wu_p,
+    Compact *c_p,
+    int level)
+{
+    Compact_level *lvl_p = &c_p->lvl[level];
+
+    if (level == c_p->height)
+        return c_p->trg_p->root_node_p;
+    if (NULL == lvl_p->node_p) {
+        oc_utl_assert(lvl_p->cur < lvl_p->num_nodes);
+        lvl_p->node_p = c_p->trg_p->cfg_p->node_alloc(wu_p);
+        oc_bpt_nd_init_empty(c_p->trg_p, lvl_p->node_p, FALSE, 0 == level);
+        lvl_p->target = (int) (
+            lvl_p->num_ent * (lvl_p->cur + 1) / lvl_p->num_nodes -
+            lvl_p->num_ent * lvl_p->cur / lvl_p->num_nodes);
+    }
+    return lvl_p->node_p;
+}
+
+static void add_child(struct Oc_wu *wu_p,
+                      Compact *c_p,
+                      int level,
+                      struct Oc_bpt_key *key_p,
+                      uint64 addr);
+
+/* Release the node being filled at [level] once it holds all its
+ * entries, and add it to its father.
+ */
+static void close_if_done(
+    struct Oc_wu *wu_p,
+    Compact *c_p,
+    int level)
+{
+    Compact_level *lvl_p = &c_p->lvl[level];
+    struct Oc_bpt_state *s_p = c_p->trg_p;
+    uint64 addr;
+
+    if (level == c_p->height ||
+        oc_bpt_nd_num_entries(s_p, lvl_p->node_p) < lvl_p->target)
+        return;
+
+    // the node may not be accessible after it is released
+    memcpy((char*)lvl_p->key_p, oc_bpt_nd_min_key(s_p, lvl_p->node_p),
+           s_p->cfg_p->key_size);
+    addr = lvl_p->node_p->disk_addr;
+    oc_bpt_nd_release(wu_p, s_p, lvl_p->node_p);
+    lvl_p->node_p = NULL;
+    lvl_p->cur++;
+
+    add_child(wu_p, c_p, level + 1, lvl_p->key_p, addr);
+}
+
+static void add_child(
+    struct Oc_wu *wu_p,
+    Compact *c_p,
+    int level,
+    struct Oc_bpt_key *key_p,
+    uint64 addr)
+{
+    Oc_bpt_node *node_p = open_node(wu_p, c_p, level);
+
+    oc_bpt_nd_index_append(c_p->trg_p, node_p, key_p, addr);
+    close_if_done(wu_p, c_p, level);
+}
+
+/**********************************************************************/
+
+Compact *oc_bpt_op_compact_start(
+    struct Oc_wu *wu_p,
+    struct Oc_bpt_state *trg_p,
+    uint64 num_keys)
+{
+    Compact *c_p;
+    int i;
+
+    c_p = (Compact*) pl_mm_malloc(sizeof(Compact));
+    memset(c_p, 0, sizeof(Compact));
+    c_p->trg_p = trg_p;
+    plan(c_p, num_keys);
+    for (i=0; i<c_p->height; i++)
+        c_p->lvl[i].key_p = (struct Oc_bpt_key*)
+            pl_mm_malloc(trg_p->cfg_p->key_size);
+
+    trg_p->root_node_p = trg_p->cfg_p->node_alloc(wu_p);
+    oc_bpt_nd_init_empty(trg_p, trg_p->root_node_p, TRUE, 0 == c_p->height);
+    return c_p;
+}
+
+void oc_bpt_op_compact_append(
+    struct Oc_wu *wu_p,
+    Compact *c_p,
+    struct Oc_bpt_key *key_p,
+    struct Oc_bpt_data *data_p)
+{
+    oc_bpt_nd_leaf_append(wu_p, c_p->trg_p, open_node(wu_p, c_p, 0),
+                          key_p, data_p);
+    close_if_done(wu_p, c_p, 0);
+}
+
+void oc_bpt_op_compact_end(struct Oc_wu *wu_p, Compact *c_p)
+{
+    struct Oc_bpt_state *trg_p = c_p->trg_p;
+    int i;
+
+    // all the nodes were filled
+    for (i=0; i<c_p->height; i++) {
+        oc_utl_assert(NULL == c_p->lvl[i].node_p);
+        oc_utl_assert(c_p->lvl[i].cur == c_p->lvl[i].num_nodes);
+        pl_mm_free(c_p->lvl[i].key_p);
+    }
+    oc_utl_assert(oc_bpt_nd_num_entries(trg_p, trg_p->root_node_p) ==
+                  (int) c_p->lvl[c_p->height].num_ent);
+    pl_mm_free(c_p);
+
+    // Release the lock on the root
+    oc_utl_trk_crt_unlock(wu_p, &trg_p->root_node_p->lock);
+}
+
+/* Give up on the build, and delete the part of tree [trg_p] built so
+ * far. The nodes being filled are not in their fathers yet, so each is
+ * deleted along with the sub-tree under it.
+ */
+void oc_bpt_op_compact_abort_b(struct Oc_wu *wu_p, Compact *c_p)
+{
+    struct Oc_bpt_state *trg_p = c_p->trg_p;
+    int i;
+
+    for (i=0; i<c_p->height; i++) {
+        if (c_p->lvl[i].node_p != NULL)
+            oc_bpt_utl_delete_subtree_b(wu_p, trg_p, c_p->lvl[i].node_p);
+        pl_mm_free(c_p->lvl[i].key_p);
+    }
+    pl_mm_free(c_p);
+
+    // the root is still locked, the delete releases it
+    oc_bpt_utl_delete_subtree_b(wu_p, trg_p, trg_p->root_node_p);
+    trg_p->root_node_p = NULL;
+}
+
+/**********************************************************************/
+
+// Append the entries of the leaves under [node_p] to the target
+static void copy_leaves(
+    struct Oc_wu *wu_p,
+    struct Oc_bpt_state *s_p,
+    Compact *c_p,
+    Oc_bpt_node *node_p)
+{
+    int i, num_entries = oc_bpt_nd_num_entries(s_p, node_p);
+    Oc_bpt_node *child_node_p;
+    struct Oc_bpt_key *key_p;
+    struct Oc_bpt_data *data_p;
+    uint64 child_addr;
+
+    if (oc_bpt_nd_is_leaf(s_p, node_p)) {
+        for (i=0; i<num_entries; i++) {
+            oc_bpt_nd_leaf_get_kth(s_p, node_p, i, &key_p, &data_p);
+            oc_bpt_op_compact_append(wu_p, c_p, key_p, data_p);
+        }
+        return;
+    }
+
+    for (i=0; i<num_entries; i++) {
+        oc_bpt_nd_index_get_kth(s_p, node_p, i, &key_p, &child_addr);
+        child_node_p = oc_bpt_nd_get_for_read(wu_p, s_p, child_addr);
+        copy_leaves(wu_p, s_p, c_p, child_node_p);
+        oc_bpt_nd_release(wu_p, s_p, child_node_p);
+    }
+}
+
+void oc_bpt_op_compact_copy_b(
+    struct Oc_wu *wu_p,
+    struct Oc_bpt_state *src_p,
+    struct Oc_bpt_state *trg_p)
+{
+    Compact *c_p;
+
+    c_p = oc_bpt_op_compact_start(
+        wu_p, trg_p, oc_bpt_op_compact_count_keys(wu_p, src_p));
+    copy_leaves(wu_p, src_p, c_p, src_p->root_node_p);
+    oc_bpt_op_compact_end(wu_p, c_p);
+}
+
+/**********************************************************************/
@@ -0,0 +1,77 @@
+/**************************************************************/
+/*
+ * Copyright (c) 2014-2015, Ohad Rodeh, IBM Research
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer. 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution. 
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies, 
+ * either expressed or implied, of IBM Research.
+ * 
+ */
+/**************************************************************/
+/**********************************************************************/
+/* OC_BPT_OP_COMPACT.H
+ *
+ * Copy a b+-tree into a new, compact, tree
+ */
+/**********************************************************************/
+#ifndef OC_BPT_OP_COMPACT_H
+#define OC_BPT_OP_COMPACT_H
+
+struct Oc_bpt_op_compact;
+
+void oc_bpt_op_compact_copy_b(
+    struct Oc_wu *wu_p,
+    struct Oc_bpt_state *src_p,
+    struct Oc_bpt_state *trg_p);
+
+// The number of keys in tree [s_p]
+uint64 oc_bpt_op_compact_count_keys(
+    struct Oc_wu *wu_p,
+    struct Oc_bpt_state *s_p);
+
+/* Build tree [trg_p] bottom-up. Exactly [num_keys] entries have to be
+ * appended, in increasing key order, before the end. The root is
+ * locked until the end.
+ */
+struct Oc_bpt_op_compact *oc_bpt_op_compact_start(
+    struct Oc_wu *wu_p,
+    struct Oc_bpt_state *trg_p,
+    uint64 num_keys);
+
+void oc_bpt_op_compact_append(
+    struct Oc_wu *wu_p,
+    struct Oc_bpt_op_compact *c_p,
+    struct Oc_bpt_key *key_p,
+    struct Oc_bpt_data *data_p);
+
+void oc_bpt_op_compact_end(
+    struct Oc_wu *wu_p,
+    struct Oc_bpt_op_compact *c_p);
+
+// Stop before the end, and delete what was built of the tree
+void oc_bpt_op_compact_abort_b(
+    struct Oc_wu *wu_p,
+    struct Oc_bpt_op_compact *c_p);
+
+#endif
@@ -0,0 +1,493 @@
+/**************************************************************/
+/*
+ * Copyright (c) 2014-2015, Ohad Rodeh, IBM Research
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer. 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution. 
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies, 
+ * either expressed or implied, of IBM Research.
+ * 
+ */
+/**************************************************************/
+/**********************************************************************/
+/* OC_BPT_OP_DUMP.C
+ *
+ * Dump a b+-tree into a stream, and restore it
+ */
+/**********************************************************************/
+/*
+ * A dump starts with a header, which records the key and data sizes,
+ * and the number of entries. The entries follow in key order, packed
+ * into blocks of at most OC_BPT_DUMP_BLOCK_SIZE bytes. Each block has
+ * its own header, with the number of entries it holds and a CRC32C
+ * checksum of the block. Blocks are written as soon as they fill, so a
+ * dump is written, and read, sequentially.
+ *
+ * A key is encoded relative to the previous key of its block: the
+ * number of leading bytes they share, the number of trailing bytes
+ * they share, and then the bytes in between. Data is encoded the same
+ * way, relative to the previous data. The counts are varints. The
+ * first entry of a block is encoded relative to zeros, so that each
+ * block can be decoded on its own.
+ *
+ * The restore knows the number of entries from the header, and hands
+ * them to the bottom-up builder of compact-copy. A dump is external
+ * data, so a stream that is corrupt or ends early is reported to the
+ * caller; the part of the tree built until then is deleted.
+ */
+/**********************************************************************/
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "pl_mm_int.h"
+#include "oc_utl.h"
+#include "oc_bpt_int.h"
+#include "oc_bpt_nd.h"
+#include "oc_bpt_trace.h"
+#include "oc_bpt_op_compact.h"
+#include "oc_bpt_op_dump.h"
+/**********************************************************************/
+
+#define OC_BPT_DUMP_HDR_EYE "BTDH"
+#define OC_BPT_DUMP_BLK_EYE "BTDB"
+#define OC_BPT_DUMP_VERSION (1)
+
+// The size of a block, including its header
+#define OC_BPT_DUMP_BLOCK_SIZE (64 * 1024)
+
+// The longest varint of a uint32
+#define OC_BPT_DUMP_MAX_VARINT (5)
+
+typedef struct Oc_bpt_dump_hdr {
+    char eye_catcher[4];
+    uint32 crc;
+    uint32 version;
+    uint32 key_size;
+    uint32 data_size;
+    uint32 block_size;
+    uint64 num_entries;
+} OC_PACKED Oc_bpt_dump_hdr;
+
+typedef struct Oc_bpt_dump_blk {
+    char eye_catcher[4];
+    uint32 crc;                // of the header and the entries
+    uint32 len;                // of the entries
+    uint32 num_entries;
+} OC_PACKED Oc_bpt_dump_blk;
+
+typedef struct Dump {
+    struct Oc_bpt_state *s_p;
+    int fd;
+    char *blk_p;               // the block being filled
+    int len;                   // bytes in the block, with its header
+    int num;                   // entries in the block
+    int max_ent_len;           // the longest encoded entry
+    char *prev_key_p;
+    char *prev_data_p;
+    uint64 num_entries;
+    Oc_bpt_dump_rc rc;         // the first failure, writing stops there
+} Dump;
+
+/**********************************************************************/
+
+static Oc_bpt_dump_rc write_all(int fd, char *buf_p, int len)
+{
+    ssize_t rc;
+
+    while (len > 0) {
+        rc = write(fd, buf_p, len);
+        if (rc < 0) {
+            if (EINTR == errno) continue;
+            oc_bpt_trace_wu_lvl(1, OC_EV_BPT_DUMP, NULL,
+                                "write of %d bytes failed, errno=%d",
+                                len, errno);
+            return OC_BPT_DUMP_IO_ERR;
+        }
+        buf_p += rc;
+        len -= rc;
+    }
+    return OC_BPT_DUMP_OK;
+}
+
+static Oc_bpt_dump_rc read_all(int fd, char *buf_p, int len)
+{
+    ssize_t rc;
+
+    while (len > 0) {
+        rc = read(fd, buf_p, len);
+        if (rc < 0) {
+            if (EINTR == errno) continue;
+            oc_bpt_trace_wu_lvl(1, OC_EV_BPT_RESTORE, NULL,
+                                "read of %d bytes failed, errno=%d",
+                                len, errno);
+            return OC_BPT_DUMP_IO_ERR;
+        }
+        if (0 == rc)
+            return OC_BPT_DUMP_TRUNCATED;
+        buf_p += rc;
+        len -= rc;
+    }
+    return OC_BPT_DUMP_OK;
+}
+
+static int put_varint(char *buf_p, uint32 val)
+{
+    int n = 0;
+
+    while (val >= 0x80) {
+        buf_p[n++] = (char) (0x80 | (val & 0x7f));
+        val >>= 7;
+    }
+    buf_p[n++] = (char) val;
+    return n;
+}
+
+// Return the number of bytes read, or zero if [buf_p] ends first
+static int get_varint(const char *buf_p, int len, uint32 *val_po)
+{
+    uint32 val = 0;
+    int n;
+
+    for (n=0; n<len && n<OC_BPT_DUMP_MAX_VARINT; n++) {
+        val |= (uint32) (buf_p[n] & 0x7f) << (7 * n);
+        if (0 == (buf_p[n] & 0x80)) {
+            *val_po = val;
+            return n + 1;
+        }
+    }
+    return 0;
+}
+
+/* Encode [cur_p], [size] bytes long, relative to [prev_p] into
+ * [buf_p]. Return the length of the encoding.
+ */
+static int encode(char *buf_p, const char *prev_p, const char *cur_p, int size)
+{
+    int pfx, sfx, n;
+
+    for (pfx=0; pfx<size && prev_p[pfx] == cur_p[pfx]; pfx++);
+    for (sfx=0;
+         sfx < size - pfx && prev_p[size-1-sfx] == cur_p[size-1-sfx];
+         sfx++);
+
+    n = put_varint(buf_p, pfx);
+    n += put_varint(buf_p + n, sfx);
+    memcpy(buf_p + n, cur_p + pfx, size - pfx - sfx);
+    return n + size - pfx - sfx;
+}
+
+/* Decode an encoding in [buf_p], at most [len] bytes long, into
+ * [cur_p], which holds the previous value. Return the length of the
+ * encoding, or zero if it is not valid.
+ */
+static int decode(const char *buf_p, int len, char *cur_p, int size)
+{
+    uint32 pfx, sfx;
+    int n, m;
+
+    if (0 == (n = get_varint(buf_p, len, &pfx)) ||
+        0 == (m = get_varint(buf_p + n, len - n, &sfx)))
+        return 0;
+    n += m;
+    if (pfx > (uint32) size || sfx > size - pfx ||
+        len - n < (int) (size - pfx - sfx))
+        return 0;
+
+    memcpy(cur_p + pfx, buf_p + n, size - pfx - sfx);
+    return n + size - pfx - sfx;
+}
+
+static uint32 blk_crc(char *blk_p, int len)
+{
+    Oc_bpt_dump_blk *bh_p = (Oc_bpt_dump_blk*) blk_p;
+    uint32 crc, saved = bh_p->crc;
+
+    bh_p->crc = 0;
+    crc = oc_utl_crc32c_update(oc_utl_crc32c_init(), blk_p, len);
+    bh_p->crc = saved;
+    return crc;
+}
+
+/**********************************************************************/
+// Dump
+
+static void dump_flush(Dump *d_p)
+{
+    Oc_bpt_dump_blk *bh_p = (Oc_bpt_dump_blk*) d_p->blk_p;
+    Oc_bpt_cfg *cfg_p = d_p->s_p->cfg_p;
+
+    if (0 == d_p->num || d_p->rc != OC_BPT_DUMP_OK)
+        return;
+    memcpy(bh_p->eye_catcher, OC_BPT_DUMP_BLK_EYE, 4);
+    bh_p->len = d_p->len - sizeof(Oc_bpt_dump_blk);
+    bh_p->num_entries = d_p->num;
+    bh_p->crc = blk_crc(d_p->blk_p, d_p->len);
+    d_p->rc = write_all(d_p->fd, d_p->blk_p, d_p->len);
+
+    d_p->len = sizeof(Oc_bpt_dump_blk);
+    d_p->num = 0;
+    memset(d_p->prev_key_p, 0, cfg_p->key_size);
+    memset(d_p->prev_data_p, 0, cfg_p->data_size);
+}
+
+static void dump_entry(Dump *d_p,
+                       struct Oc_bpt_key *key_p,
+                       struct Oc_bpt_data *data_p)
+{
+    Oc_bpt_cfg *cfg_p = d_p->s_p->cfg_p;
+
+    if (d_p->len + d_p->max_ent_len > OC_BPT_DUMP_BLOCK_SIZE)
+        dump_flush(d_p);
+
+    d_p->len += encode(d_p->blk_p + d_p->len, d_p->prev_key_p,
+                       (char*) key_p, cfg_p->key_size);
+    d_p->len += encode(d_p->blk_p + d_p->len, d_p->prev_data_p,
+                       (char*) data_p, cfg_p->data_size);
+    memcpy(d_p->prev_key_p, key_p, cfg_p->key_size);
+    memcpy(d_p->prev_data_p, data_p, cfg_p->data_size);
+    d_p->num++;
+    d_p->num_entries++;
+}
+
+// Dump the entries of the leaves under [node_p]
+static void dump_leaves(
+    struct Oc_wu *wu_p,
+    Dump *d_p,
+    Oc_bpt_node *node_p)
+{
+    struct Oc_bpt_state *s_p = d_p->s_p;
+    int i, num_entries = oc_bpt_nd_num_entries(s_p, node_p);
+    Oc_bpt_node *child_node_p;
+    struct Oc_bpt_key *key_p;
+    struct Oc_bpt_data *data_p;
+    uint64 child_addr;
+
+    if (oc_bpt_nd_is_leaf(s_p, node_p)) {
+        for (i=0; i<num_entries; i++) {
+            oc_bpt_nd_leaf_get_kth(s_p, node_p, i, &key_p, &data_p);
+            dump_entry(d_p, key_p, data_p);
+        }
+        return;
+    }
+
+    for (i=0; i<num_entries && OC_BPT_DUMP_OK == d_p->rc; i++) {
+        oc_bpt_nd_index_get_kth(s_p, node_p, i, &key_p, &child_addr);
+        child_node_p = oc_bpt_nd_get_for_read(wu_p, s_p, child_addr);
+        dump_leaves(wu_p, d_p, child_node_p);
+        oc_bpt_nd_release(wu_p, s_p, child_node_p);
+    }
+}
+
+Oc_bpt_dump_rc oc_bpt_op_dump_b(
+    struct Oc_wu *wu_p,
+    struct Oc_bpt_state *s_p,
+    int fd,
+    uint64 *num_entries_po)
+{
+    Oc_bpt_cfg *cfg_p = s_p->cfg_p;
+    Oc_bpt_dump_hdr hdr;
+    Dump d;
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.eye_catcher, OC_BPT_DUMP_HDR_EYE, 4);
+    hdr.version = OC_BPT_DUMP_VERSION;
+    hdr.key_size = cfg_p->key_size;
+    hdr.data_size = cfg_p->data_size;
+    hdr.block_size = OC_BPT_DUMP_BLOCK_SIZE;
+    hdr.num_entries = oc_bpt_op_compact_count_keys(wu_p, s_p);
+    hdr.crc = oc_utl_crc32c_update(oc_utl_crc32c_init(),
+                                   (char*) &hdr, sizeof(hdr));
+    *num_entries_po = 0;
+    if (write_all(fd, (char*) &hdr, sizeof(hdr)) != OC_BPT_DUMP_OK)
+        return OC_BPT_DUMP_IO_ERR;
+
+    memset(&d, 0, sizeof(d));
+    d.s_p = s_p;
+    d.fd = fd;
+    d.blk_p = (char*) pl_mm_malloc(OC_BPT_DUMP_BLOCK_SIZE);
+    d.len = sizeof(Oc_bpt_dump_blk);
+    d.max_ent_len = 4 * OC_BPT_DUMP_MAX_VARINT +
+        cfg_p->key_size + cfg_p->data_size;
+    oc_utl_assert(d.len + d.max_ent_len <= OC_BPT_DUMP_BLOCK_SIZE);
+    d.prev_key_p = (char*) pl_mm_malloc(cfg_p->key_size);
+    d.prev_data_p = (char*) pl_mm_malloc(cfg_p->data_size);
+    memset(d.prev_key_p, 0, cfg_p->key_size);
+    memset(d.prev_data_p, 0, cfg_p->data_size);
+
+    dump_leaves(wu_p, &d, s_p->root_node_p);
+    dump_flush(&d);
+    if (OC_BPT_DUMP_OK == d.rc) {
+        oc_utl_assert(d.num_entries == hdr.num_entries);
+        *num_entries_po = d.num_entries;
+    }
+
+    pl_mm_free(d.blk_p);
+    pl_mm_free(d.prev_key_p);
+    pl_mm_free(d.prev_data_p);
+    return d.rc;
+}
+
+/**********************************************************************/
+// Restore
+
+// Check the header of a dump against tree [trg_p]
+static Oc_bpt_dump_rc check_hdr(
+    struct Oc_wu *wu_p,
+    struct Oc_bpt_state *trg_p,
+    Oc_bpt_dump_hdr *hdr_p)
+{
+    Oc_bpt_cfg *cfg_p = trg_p->cfg_p;
+    uint32 crc = hdr_p->crc;
+
+    hdr_p->crc = 0;
+    if (memcmp(hdr_p->eye_catcher, OC_BPT_DUMP_HDR_EYE, 4) != 0 ||
+        oc_utl_crc32c_update(oc_utl_crc32c_init(),
+                             (char*) hdr_p, sizeof(*hdr_p)) != crc ||
+        hdr_p->block_size < sizeof(Oc_bpt_dump_blk)) {
+        oc_bpt_trace_wu_lvl(1, OC_EV_BPT_RESTORE, wu_p,
+                            "the header of the dump is corrupt");
+        return OC_BPT_DUMP_CORRUPT;
+    }
+    if (hdr_p->version != OC_BPT_DUMP_VERSION ||
+        hdr_p->key_size != (uint32) cfg_p->key_size ||
+        hdr_p->data_size != (uint32) cfg_p->data_size) {
+        oc_bpt_trace_wu_lvl(1, OC_EV_BPT_RESTORE, wu_p,
+                            "dump version %lu with keys of %lu bytes and "
+                            "data of %lu bytes, the tree has %d and %d",
+                            hdr_p->version, hdr_p->key_size,
+                            hdr_p->data_size,
+                            cfg_p->key_size, cfg_p->data_size);
+        return OC_BPT_DUMP_MISMATCH;
+    }
+    return OC_BPT_DUMP_OK;
+}
+
+/* Read the next block of the dump into [blk_p], and append its entries
+ * to the builder. [prev_key_p] holds the last key appended, and
+ * [*num_entries_p] counts the entries appended.
+ */
+static Oc_bpt_dump_rc restore_block(
+    struct Oc_wu *wu_p,
+    struct Oc_bpt_state *trg_p,
+    struct Oc_bpt_op_compact *c_p,
+    int fd,
+    Oc_bpt_dump_hdr *hdr_p,
+    char *blk_p,
+    char *key_p,
+    char *data_p,
+    char *prev_key_p,
+    uint64 *num_entries_p)
+{
+    Oc_bpt_cfg *cfg_p = trg_p->cfg_p;
+    Oc_bpt_dump_blk *bh_p = (Oc_bpt_dump_blk*) blk_p;
+    Oc_bpt_dump_rc rc;
+    uint32 i;
+    int pos, n, m;
+
+    if ((rc = read_all(fd, blk_p, sizeof(Oc_bpt_dump_blk))) != OC_BPT_DUMP_OK)
+        return rc;
+    if (memcmp(bh_p->eye_catcher, OC_BPT_DUMP_BLK_EYE, 4) != 0 ||
+        bh_p->len > hdr_p->block_size - sizeof(Oc_bpt_dump_blk) ||
+        0 == bh_p->num_entries ||
+        bh_p->num_entries > hdr_p->num_entries - *num_entries_p)
+        return OC_BPT_DUMP_CORRUPT;
+    if ((rc = read_all(fd, blk_p + sizeof(Oc_bpt_dump_blk), bh_p->len)) !=
+        OC_BPT_DUMP_OK)
+        return rc;
+    if (blk_crc(blk_p, sizeof(Oc_bpt_dump_blk) + bh_p->len) != bh_p->crc)
+        return OC_BPT_DUMP_CORRUPT;
+
+    memset(key_p, 0, cfg_p->key_size);
+    memset(data_p, 0, cfg_p->data_size);
+    pos = sizeof(Oc_bpt_dump_blk);
+    for (i=0; i<bh_p->num_entries; i++) {
+        n = decode(blk_p + pos, sizeof(Oc_bpt_dump_blk) + bh_p->len - pos,
+                   key_p, cfg_p->key_size);
+        m = (0 == n) ? 0 :
+            decode(blk_p + pos + n,
+                   sizeof(Oc_bpt_dump_blk) + bh_p->len - pos - n,
+                   data_p, cfg_p->data_size);
+        if (0 == m)
+            return OC_BPT_DUMP_CORRUPT;
+        pos += n + m;
+
+        // the builder relies on the order
+        if (*num_entries_p > 0 &&
+            cfg_p->key_compare((struct Oc_bpt_key*) prev_key_p,
+                               (struct Oc_bpt_key*) key_p) <= 0)
+            return OC_BPT_DUMP_CORRUPT;
+        oc_bpt_op_compact_append(wu_p, c_p,
+                                 (struct Oc_bpt_key*) key_p,
+                                 (struct Oc_bpt_data*) data_p);
+        memcpy(prev_key_p, key_p, cfg_p->key_size);
+        (*num_entries_p)++;
+    }
+    if (pos != (int) (sizeof(Oc_bpt_dump_blk) + bh_p->len))
+        return OC_BPT_DUMP_CORRUPT;
+    return OC_BPT_DUMP_OK;
+}
+
+Oc_bpt_dump_rc oc_bpt_op_restore_b(
+    struct Oc_wu *wu_p,
+    struct Oc_bpt_state *trg_p,
+    int fd)
+{
+    Oc_bpt_cfg *cfg_p = trg_p->cfg_p;
+    struct Oc_bpt_op_compact *c_p;
+    Oc_bpt_dump_hdr hdr;
+    Oc_bpt_dump_rc rc;
+    char *blk_p, *key_p, *data_p, *prev_key_p;
+    uint64 num_entries = 0;
+
+    if ((rc = read_all(fd, (char*) &hdr, sizeof(hdr))) != OC_BPT_DUMP_OK ||
+        (rc = check_hdr(wu_p, trg_p, &hdr)) != OC_BPT_DUMP_OK)
+        return rc;
+
+    blk_p = (char*) pl_mm_malloc(hdr.block_size);
+    key_p = (char*) pl_mm_malloc(cfg_p->key_size);
+    data_p = (char*) pl_mm_malloc(cfg_p->data_size);
+    prev_key_p = (char*) pl_mm_malloc(cfg_p->key_size);
+
+    c_p = oc_bpt_op_compact_start(wu_p, trg_p, hdr.num_entries);
+    while (num_entries < hdr.num_entries &&
+           OC_BPT_DUMP_OK == rc)
+        rc = restore_block(wu_p, trg_p, c_p, fd, &hdr,
+                           blk_p, key_p, data_p, prev_key_p, &num_entries);
+    if (OC_BPT_DUMP_OK == rc)
+        oc_bpt_op_compact_end(wu_p, c_p);
+    else {
+        oc_bpt_trace_wu_lvl(1, OC_EV_BPT_RESTORE, wu_p,
+                            "failed with %s, at entry %Lu",
+                            oc_bpt_string_of_dump_rc(rc), num_entries);
+        oc_bpt_op_compact_abort_b(wu_p, c_p);
+    }
+
+    pl_mm_free(blk_p);
+    pl_mm_free(key_p);
+    pl_mm_free(data_p);
+    pl_mm_free(prev_key_p);
+    return rc;
+}
+
+/**********************************************************************/
@@ -88,6 +88,9 @@ const char *oc_bpt_string_of_trace_event(int ev_i)
         CASE(OC_EV_BPT_CLONE);
         CASE(OC_EV_BPT_INIT_STATE);
         CASE(OC_EV_BPT_ITER);
+        CASE(OC_EV_BPT_COMPACT);
+        CASE(OC_EV_BPT_DUMP);
+        CASE(OC_EV_BPT_RESTORE);
         
     default:
         ERR(("no such case"));
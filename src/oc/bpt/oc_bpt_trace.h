@@ -79,6 +79,9 @@ typedef enum Oc_bpt_trace_event {
     OC_EV_BPT_CLONE,
     OC_EV_BPT_INIT_STATE,
     OC_EV_BPT_ITER, 
+    OC_EV_BPT_COMPACT,
+    OC_EV_BPT_DUMP,
+    OC_EV_BPT_RESTORE,
 } Oc_bpt_trace_event;
 
 #if LODESTONE_DEBUG
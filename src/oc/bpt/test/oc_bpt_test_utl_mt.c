@@ -42,7 +42,7 @@
 
 #include "pl_trace_base.h"
 #include "pl_int.h"
-#include "oc_utl_htbl.h"
+#include "oc_utl_rhtbl.h"
 #include "oc_utl_trk.h"
 #include "oc_bpt_int.h"
 #include "oc_bpt_nd.h"
@@ -106,7 +106,7 @@ static bool (*validate_fun)(void) = NULL;
 static uint64 get_tid(Oc_bpt_test_state *s_p);
 
 // virtual-disk section
-static uint32 vd_hash(void *_key, int num_buckets, int dummy);
+static uint64 vd_hash(void *_key);
 static bool vd_compare(void *_elem, void *_key);
 static void vd_create(void);
 static void vd_node_remove(uint64 addr);
@@ -153,13 +153,11 @@ static void *wrap_malloc(int size)
  *   [Oc_bpt_test_node]
  */
 
-static Oc_utl_htbl vd_htbl;
+static Oc_utl_rhtbl vd_htbl;
 
-static uint32 vd_hash(void *_key, int num_buckets, int dummy)
+static uint64 vd_hash(void *_key)
 {
-    uint64 lba = *((uint64*) _key);
-
-    return (lba * 1069597 + 1066133) & (num_buckets-1);
+    return oc_utl_rhtbl_hash_u64(*((uint64*) _key));
 }
 
 static bool vd_compare(void *_elem, void *_key)
@@ -173,10 +171,10 @@ static bool vd_compare(void *_elem, void *_key)
 // create a hashtable
 static void vd_create(void)
 {
-    oc_utl_htbl_create(
+    oc_utl_rhtbl_create(
         &vd_htbl,
         2048,
-        NULL,
+        TRUE,
         vd_hash,
         vd_compare);
 }
@@ -186,19 +184,19 @@ static void vd_node_remove(uint64 addr)
 {
     bool rc;
 
-    rc = oc_utl_htbl_remove(&vd_htbl, (void*)&addr);
+    rc = oc_utl_rhtbl_remove(&vd_htbl, (void*)&addr);
     oc_utl_assert(rc);
 }
 
 // insert a node
 static void vd_node_insert(Oc_bpt_test_node *tnode_p)
 {
-    oc_utl_htbl_insert(&vd_htbl, (void*)&tnode_p->node.disk_addr, (void*)tnode_p);
+    oc_utl_rhtbl_insert(&vd_htbl, (void*)&tnode_p->node.disk_addr, (void*)tnode_p);
 }
 
 static Oc_bpt_test_node *vd_node_lookup(uint64 addr)
 {
-    return (Oc_bpt_test_node*)oc_utl_htbl_lookup(&vd_htbl, (void*)&addr);
+    return (Oc_bpt_test_node*)oc_utl_rhtbl_lookup(&vd_htbl, (void*)&addr);
 }
 
 /**********************************************************************/
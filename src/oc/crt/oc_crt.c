@@ -30,172 +30,637 @@
  */
 /**************************************************************/
 /******************************************************************/
-// OC_XT_TEST_DUMMY_CRT.C
-// dummy implementation of CRT
+// OC_CRT.C
+// co-routine implementation of CRT
+/******************************************************************/
+/*
+ * Co-routines are multiplexed over a small set of worker pthreads
+ * (M:N). Each co-routine runs on its own small, mmap-ed, stack with a
+ * guard area below it, and switches are done with swapcontext. Each
+ * worker has a private run-queue; a worker that runs out of work
+ * steals from the queues of the other workers, and goes to sleep
+ * only when all queues are empty.
+ *
+ * RW-locks and semaphores never block the worker pthread. A
+ * co-routine that has to wait is put on the wait-queue of the lock,
+ * and the worker switches to another co-routine. The co-routine is
+ * put back on a run-queue by the unlock/post that hands it the lock.
+ * A node-get callback that performs real I/O should wait for the
+ * completion on an Oc_crt_sema; the completion may be posted from
+ * any pthread.
+ *
+ * The guard of a lock is released only after the waiting co-routine
+ * is completely off its stack. This is done by the worker, after the
+ * switch, so that another worker cannot resume a co-routine whose
+ * context has not been saved yet.
+ *
+ * Callers that are not co-routines (for example, single threaded
+ * tests that never call oc_crt_init_full) may use locks and
+ * semaphores as well; they poll instead of blocking.
+ */
 /******************************************************************/
 #include "oc_crt_int.h"
 
 #include <pthread.h>
-#include <semaphore.h>
 #include <sched.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <ucontext.h>
+#include <sys/mman.h>
+
+#define OC_CRT_PAGE_SIZE           (4096)
+#define OC_CRT_DEFAULT_STACK_PAGES (16)
+#define OC_CRT_MAX_WORKERS         (64)
+
+// how long an idle worker sleeps before re-checking the queues
+#define OC_CRT_IDLE_NSEC           (10 * 1000 * 1000)
+
+typedef enum Oc_crt_task_state {
+    CRT_TASK_READY,
+    CRT_TASK_YIELD,
+    CRT_TASK_BLOCKED,
+    CRT_TASK_DONE,
+} Oc_crt_task_state;
+
+typedef struct Oc_crt_task {
+    ucontext_t ctx;
+    const char *name_p;
+    int id;
+    void *(*start_routine) (void *);
+    void *arg_p;
+    char *map_p;                 // the stack mapping, including the guard area
+    size_t map_size;
+    Oc_crt_task_state state;
+    Oc_crt_rw_mode wait_mode;    // the lock-mode a blocked task is waiting for
+    struct Oc_crt_task *next_p;  // link in a run-queue or a wait-queue
+} Oc_crt_task;
+
+typedef struct Oc_crt_worker {
+    int idx;
+    pthread_t pid;
+    volatile int guard;          // protects [run_q]
+    Oc_crt_wait_q run_q;
+    ucontext_t sched_ctx;        // the worker's own (scheduler) context
+    Oc_crt_task *cur_p;          // the co-routine currently running
+    volatile int *release_p;     // a guard to release once [cur_p] is switched out
+} Oc_crt_worker;
 
 static Oc_crt_config config;
-/******************************************************************/
+static Oc_crt_worker *workers_p = NULL;
+static int num_workers = 0;
+
+static volatile int num_ready = 0;
+static volatile int num_idle = 0;
+static volatile int next_id = 0;
+static volatile int next_worker = 0;
+static pthread_mutex_t idle_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t idle_cond = PTHREAD_COND_INITIALIZER;
 
-// pthread-based implementation
+// finished tasks are kept, with their stacks, for reuse
+static volatile int free_guard = 0;
+static Oc_crt_wait_q free_tasks;
 
-void oc_crt_init_rw_lock(Oc_crt_rw_lock * lock)
+static __thread Oc_crt_worker *self_p = NULL;
+
+// the start of time, for oc_crt_get_time_millis
+static struct timespec start_ts;
+/******************************************************************/
+
+static void guard_take(volatile int *guard_p)
 {
-    int ern;
+    int spin = 0;
 
-    ern = pthread_rwlock_init(&lock->lock, NULL);
-    if (ern) {
-        printf("pthread_rwlock_init: (%d) %s", ern, strerror(ern)) ;
-        exit(1);
+    while (__sync_lock_test_and_set(guard_p, 1)) {
+        if (++spin == 100) {
+            spin = 0;
+            sched_yield();
+        }
     }
 }
 
-void oc_crt_lock_read(Oc_crt_rw_lock * lock)
+static void guard_drop(volatile int *guard_p)
 {
-    int ern;
+    __sync_lock_release(guard_p);
+}
 
-    ern = pthread_rwlock_rdlock(&lock->lock);
-    if (ern) {
-        printf("pthread_rwlock_rdlock: (%d) %s\n", ern, strerror(ern));
-        exit(1);
-    }
+static void q_push(Oc_crt_wait_q *q_p, Oc_crt_task *task_p)
+{
+    task_p->next_p = NULL;
+    if (NULL == q_p->tail_p)
+        q_p->head_p = task_p;
+    else
+        q_p->tail_p->next_p = task_p;
+    q_p->tail_p = task_p;
 }
 
-void oc_crt_lock_write(Oc_crt_rw_lock * lock)
+static Oc_crt_task *q_pop(Oc_crt_wait_q *q_p)
 {
-    int ern;
+    Oc_crt_task *task_p = q_p->head_p;
+
+    if (NULL == task_p)
+        return NULL;
+    q_p->head_p = task_p->next_p;
+    if (NULL == q_p->head_p)
+        q_p->tail_p = NULL;
+    task_p->next_p = NULL;
+    return task_p;
+}
 
-    ern = pthread_rwlock_wrlock(&lock->lock);
-    if (ern) {
-        printf("pthread_rwlock_wrlock: (%d) %s", ern, strerror(ern)) ;
-        exit(1);
-    }
+/* A co-routine may migrate between workers whenever it is switched
+ * out. The worker must therefore be re-read from thread-local storage
+ * every time, and never cached across a switch.
+ */
+static __attribute__((noinline)) Oc_crt_worker *current_worker(void)
+{
+    return *(Oc_crt_worker * volatile *)&self_p;
 }
 
-void oc_crt_unlock(Oc_crt_rw_lock * lock)
+static Oc_crt_task *current_task(void)
 {
-    int ern;
+    Oc_crt_worker *w_p = current_worker();
+
+    if (NULL == w_p)
+        return NULL;
+    return w_p->cur_p;
+}
+
+/******************************************************************/
+// run-queues
 
-    ern = pthread_rwlock_unlock(&lock->lock);
-    if (ern) {
-        printf("pthread_rwlock_unlock: (%d) %s", ern, strerror(ern)) ;
-        exit(1);
+static void make_ready(Oc_crt_task *task_p)
+{
+    Oc_crt_worker *w_p = current_worker();
+
+    if (NULL == w_p)
+        w_p = &workers_p[__sync_fetch_and_add(&next_worker, 1) % num_workers];
+
+    task_p->state = CRT_TASK_READY;
+    guard_take(&w_p->guard);
+    q_push(&w_p->run_q, task_p);
+    guard_drop(&w_p->guard);
+
+    // a full barrier; pairs with the one in worker_park
+    __sync_fetch_and_add(&num_ready, 1);
+    if (num_idle > 0) {
+        pthread_mutex_lock(&idle_mutex);
+        pthread_cond_signal(&idle_cond);
+        pthread_mutex_unlock(&idle_mutex);
     }
 }
 
-bool oc_crt_rw_is_locked_write(Oc_crt_rw_lock * lock)
+static Oc_crt_task *rq_pop(Oc_crt_worker *w_p)
 {
-    return TRUE;
+    Oc_crt_task *task_p;
+
+    // an unlocked peek, avoid taking the guard of an empty queue
+    if (NULL == *(Oc_crt_task * volatile *)&w_p->run_q.head_p)
+        return NULL;
+
+    guard_take(&w_p->guard);
+    task_p = q_pop(&w_p->run_q);
+    guard_drop(&w_p->guard);
+
+    if (task_p)
+        __sync_fetch_and_sub(&num_ready, 1);
+    return task_p;
 }
 
-bool oc_crt_rw_is_locked_read(Oc_crt_rw_lock * lock_p)
+// Take work from the local queue, and if it is empty, steal from the others
+static Oc_crt_task *next_task(Oc_crt_worker *w_p)
 {
-    return TRUE;
+    Oc_crt_task *task_p;
+    int i;
+
+    task_p = rq_pop(w_p);
+    for (i=1; NULL == task_p && i < num_workers; i++)
+        task_p = rq_pop(&workers_p[(w_p->idx + i) % num_workers]);
+
+    return task_p;
 }
 
-bool oc_crt_lock_check(Oc_crt_rw_lock * lock_p)
+static void worker_park(void)
 {
-    return TRUE;
+    struct timespec ts;
+
+    pthread_mutex_lock(&idle_mutex);
+    __sync_fetch_and_add(&num_idle, 1);
+    if (0 == num_ready) {
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += OC_CRT_IDLE_NSEC;
+        if (ts.tv_nsec >= 1000000000) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000;
+        }
+        pthread_cond_timedwait(&idle_cond, &idle_mutex, &ts);
+    }
+    __sync_fetch_and_sub(&num_idle, 1);
+    pthread_mutex_unlock(&idle_mutex);
 }
 
+/******************************************************************/
+// tasks
 
-void oc_crt_init_full(Oc_crt_config * config_p)
+static void task_free(Oc_crt_task *task_p)
 {
-    pthread_t id;
+    guard_take(&free_guard);
+    q_push(&free_tasks, task_p);
+    guard_drop(&free_guard);
+}
 
-    config = *config_p;
+static Oc_crt_task *task_alloc(void)
+{
+    Oc_crt_task *task_p;
+    size_t guard_size;
+
+    guard_take(&free_guard);
+    task_p = q_pop(&free_tasks);
+    guard_drop(&free_guard);
+    if (task_p)
+        return task_p;
+
+    task_p = (Oc_crt_task*) malloc(sizeof(Oc_crt_task));
+    if (NULL == task_p)
+        ERR(("out of memory allocating a task"));
+    memset(task_p, 0, sizeof(Oc_crt_task));
+
+    guard_size = config.stack_guard_size * OC_CRT_PAGE_SIZE;
+    task_p->map_size = guard_size + config.stack_size;
+    task_p->map_p = (char*) mmap(NULL, task_p->map_size,
+                                 PROT_READ | PROT_WRITE,
+                                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK,
+                                 -1, 0);
+    if (MAP_FAILED == task_p->map_p)
+        ERR(("could not map a stack of %lu bytes", task_p->map_size));
+
+    // stacks grow downward, an overflow hits the guard area
+    if (guard_size > 0 &&
+        mprotect(task_p->map_p, guard_size, PROT_NONE) != 0)
+        ERR(("could not protect the stack guard"));
+
+    return task_p;
+}
+
+/* Switch from the current co-routine back to its worker. If
+ * [release_p] is not NULL, the worker releases it once the
+ * co-routine is off its stack.
+ */
+static void task_switch_out(Oc_crt_task_state state, volatile int *release_p)
+{
+    Oc_crt_worker *w_p = current_worker();
+    Oc_crt_task *task_p = w_p->cur_p;
 
-    printf("sizeof(oc_crt_rwlock) = %ld\n", sizeof(Oc_crt_rw_lock));
-    printf("sizeof(pthread_rwlock_t) = %ld\n", sizeof(pthread_rwlock_t));
-    printf("sizeof(oc_crt_sema) = %ld\n", sizeof(Oc_crt_sema));
-    printf("sizeof(sem_t) = %ld\n", sizeof(sem_t));
+    task_p->state = state;
+    w_p->release_p = release_p;
+    swapcontext(&task_p->ctx, &w_p->sched_ctx);
+}
 
-    oc_utl_assert(sizeof(Oc_crt_rw_lock) >= sizeof(pthread_rwlock_t));
-    oc_utl_assert(sizeof(Oc_crt_sema) >= sizeof(sem_t));
+static void task_trampoline(void)
+{
+    Oc_crt_task *task_p = current_task();
 
-    pthread_attr_t attr;
-    pthread_attr_init(&attr);
-    if (pthread_create(&id, &attr, config_p->init_fun, NULL) != 0)
-        ERR(("could not open main thread"));
-    pthread_attr_destroy(&attr);
+    task_p->start_routine(task_p->arg_p);
+    task_switch_out(CRT_TASK_DONE, NULL);
 }
 
-void oc_crt_default_config(Oc_crt_config *config_p)
+static void *worker_main(void *arg_p)
 {
-    memset(config_p, 0, sizeof(Oc_crt_config));
+    Oc_crt_worker *w_p = (Oc_crt_worker*) arg_p;
+    Oc_crt_task *task_p;
+    Oc_crt_task_state state;
+
+    self_p = w_p;
+    while (1) {
+        task_p = next_task(w_p);
+        if (NULL == task_p) {
+            worker_park();
+            continue;
+        }
+
+        w_p->cur_p = task_p;
+        swapcontext(&w_p->sched_ctx, &task_p->ctx);
+        w_p->cur_p = NULL;
+
+        /* Read the state before releasing the guard. Once it is
+         * released, a blocked task may be resumed by another worker.
+         */
+        state = task_p->state;
+        if (w_p->release_p) {
+            guard_drop(w_p->release_p);
+            w_p->release_p = NULL;
+        }
+
+        switch (state) {
+        case CRT_TASK_YIELD:
+            make_ready(task_p);
+            break;
+        case CRT_TASK_DONE:
+            task_free(task_p);
+            break;
+        case CRT_TASK_BLOCKED:
+            // sitting on a wait-queue
+            break;
+        default:
+            ERR(("bad task state %d", state));
+        }
+    }
+    return NULL;
 }
 
-void oc_crt_init(void)
+/******************************************************************/
+// RW locks
+
+static bool rw_grantable(Oc_crt_rw_lock *lock_p, Oc_crt_rw_mode mode)
 {
-    oc_crt_init_full(&config);
+    if (lock_p->writer)
+        return FALSE;
+    if (CRT_RWSTATE_WRITE == mode)
+        return (0 == lock_p->num_readers);
+
+    // readers are preferred over waiting writers, as with pthread rwlocks
+    return TRUE;
 }
 
-void oc_crt_yield_task(void)
+static void rw_grant(Oc_crt_rw_lock *lock_p, Oc_crt_rw_mode mode)
 {
-    sched_yield ();
+    if (CRT_RWSTATE_WRITE == mode)
+        lock_p->writer = TRUE;
+    else
+        lock_p->num_readers++;
 }
 
-void oc_crt_assert(void)
+static void rw_acquire(Oc_crt_rw_lock *lock_p, Oc_crt_rw_mode mode)
 {
+    Oc_crt_task *task_p;
+
+    while (1) {
+        guard_take(&lock_p->guard);
+        if (rw_grantable(lock_p, mode)) {
+            rw_grant(lock_p, mode);
+            guard_drop(&lock_p->guard);
+            return;
+        }
+
+        task_p = current_task();
+        if (NULL == task_p) {
+            // not a co-routine, poll
+            guard_drop(&lock_p->guard);
+            sched_yield();
+            continue;
+        }
+
+        task_p->wait_mode = mode;
+        q_push(&lock_p->wait_q, task_p);
+        task_switch_out(CRT_TASK_BLOCKED, &lock_p->guard);
+
+        // the lock has been handed to us by oc_crt_unlock
+        return;
+    }
 }
 
-int oc_crt_get_thread(void)
+void oc_crt_init_rw_lock(Oc_crt_rw_lock * lock_p)
 {
-    return (int)pthread_self ();
+    memset(lock_p, 0, sizeof(Oc_crt_rw_lock));
 }
 
+void oc_crt_lock_read(Oc_crt_rw_lock * lock_p)
+{
+    rw_acquire(lock_p, CRT_RWSTATE_READ);
+}
 
-void oc_crt_sema_init(Oc_crt_sema * sema_p, int value)
+void oc_crt_lock_write(Oc_crt_rw_lock * lock_p)
 {
-    int ern;
+    rw_acquire(lock_p, CRT_RWSTATE_WRITE);
+}
+
+bool oc_crt_try_lock_read(Oc_crt_rw_lock * lock_p)
+{
+    bool rc = FALSE;
 
-    ern = sem_init(&sema_p->sem, 0, value);
-    if (ern) {
-        ERR(("sem_init: (%d) %s", ern, strerror(ern))) ;
+    guard_take(&lock_p->guard);
+    if (rw_grantable(lock_p, CRT_RWSTATE_READ)) {
+        rw_grant(lock_p, CRT_RWSTATE_READ);
+        rc = TRUE;
     }
+    guard_drop(&lock_p->guard);
+    return rc;
+}
+
+void oc_crt_unlock(Oc_crt_rw_lock * lock_p)
+{
+    Oc_crt_wait_q wake_q;
+    Oc_crt_task *task_p;
+
+    memset(&wake_q, 0, sizeof(wake_q));
+    guard_take(&lock_p->guard);
+    if (lock_p->writer)
+        lock_p->writer = FALSE;
+    else if (lock_p->num_readers > 0)
+        lock_p->num_readers--;
+    else
+        ERR(("unlocking a lock that is not taken"));
+
+    // hand the lock over to waiters at the head of the queue
+    while (lock_p->wait_q.head_p &&
+           rw_grantable(lock_p, lock_p->wait_q.head_p->wait_mode)) {
+        task_p = q_pop(&lock_p->wait_q);
+        rw_grant(lock_p, task_p->wait_mode);
+        q_push(&wake_q, task_p);
+    }
+    guard_drop(&lock_p->guard);
+
+    while ((task_p = q_pop(&wake_q)))
+        make_ready(task_p);
+}
+
+bool oc_crt_rw_is_locked_write(Oc_crt_rw_lock * lock_p)
+{
+    return lock_p->writer;
+}
+
+bool oc_crt_rw_is_locked_read(Oc_crt_rw_lock * lock_p)
+{
+    return (lock_p->num_readers > 0);
+}
+
+bool oc_crt_lock_check(Oc_crt_rw_lock * lock_p)
+{
+    return !(lock_p->writer && lock_p->num_readers > 0);
+}
+
+/******************************************************************/
+// Semaphores
+
+void oc_crt_sema_init(Oc_crt_sema * sema_p, int value)
+{
+    memset(sema_p, 0, sizeof(Oc_crt_sema));
+    sema_p->value = value;
 }
 
 void oc_crt_sema_post(Oc_crt_sema * sema_p)
 {
-    int ern;
+    Oc_crt_task *task_p;
 
-    ern = sem_post (&sema_p->sem);
-    if (ern) {
-        ERR(("sem_post: (%d) %s", ern, strerror(ern))) ;
-    }
+    guard_take(&sema_p->guard);
+    task_p = q_pop(&sema_p->wait_q);
+    if (NULL == task_p)
+        sema_p->value++;
+    guard_drop(&sema_p->guard);
+
+    // the unit is handed directly to the first waiter
+    if (task_p)
+        make_ready(task_p);
 }
 
 void oc_crt_sema_wait(Oc_crt_sema * sema_p)
 {
-    int ern;
-
-    ern = sem_wait(&sema_p->sem);
-    if (ern) {
-        ERR(("sem_wait: (%d) %s", ern, strerror(ern))) ;
+    Oc_crt_task *task_p;
+
+    while (1) {
+        guard_take(&sema_p->guard);
+        if (sema_p->value > 0) {
+            sema_p->value--;
+            guard_drop(&sema_p->guard);
+            return;
+        }
+
+        task_p = current_task();
+        if (NULL == task_p) {
+            // not a co-routine, poll
+            guard_drop(&sema_p->guard);
+            sched_yield();
+            continue;
+        }
+
+        q_push(&sema_p->wait_q, task_p);
+        task_switch_out(CRT_TASK_BLOCKED, &sema_p->guard);
+        return;
     }
 }
 
-int oc_crt_create_task(const char * name_p,
-                        void *(*start_routine) (void *),
-                        void * arg_p)
+int oc_crt_sema_get_val(Oc_crt_sema * sema_p)
+{
+    return sema_p->value;
+}
+
+/******************************************************************/
+
+void oc_crt_init_full(Oc_crt_config * config_p)
 {
-    int id;
     pthread_attr_t attr;
+    int i;
+
+    config = *config_p;
+    clock_gettime(CLOCK_MONOTONIC, &start_ts);
+    if (0 == config.stack_page_size)
+        config.stack_page_size = OC_CRT_DEFAULT_STACK_PAGES;
+    if (0 == config.stack_guard_size)
+        config.stack_guard_size = 1;
+    config.stack_size = config.stack_page_size * OC_CRT_PAGE_SIZE;
+
+    if (config.deterministic_run)
+        num_workers = 1;
+    else if (config.num_workers > 0)
+        num_workers = config.num_workers;
+    else
+        num_workers = sysconf(_SC_NPROCESSORS_ONLN);
+    if (num_workers < 1)
+        num_workers = 1;
+    if (num_workers > OC_CRT_MAX_WORKERS)
+        num_workers = OC_CRT_MAX_WORKERS;
+    config.num_workers = num_workers;
+
+    workers_p = (Oc_crt_worker*) malloc(num_workers * sizeof(Oc_crt_worker));
+    if (NULL == workers_p)
+        ERR(("out of memory allocating workers"));
+    memset(workers_p, 0, num_workers * sizeof(Oc_crt_worker));
+
+    // queue the start-up function before any worker runs
+    if (config.init_fun)
+        oc_crt_create_task("init", config.init_fun, NULL);
 
     pthread_attr_init(&attr);
-    if (pthread_create((pthread_t *)&id, &attr, start_routine, arg_p) != 0)
-        ERR(("could not create a thread"));
+    for (i=0; i<num_workers; i++) {
+        workers_p[i].idx = i;
+        if (pthread_create(&workers_p[i].pid, &attr,
+                           worker_main, &workers_p[i]) != 0)
+            ERR(("could not create a worker thread"));
+    }
     pthread_attr_destroy(&attr);
+}
+
+void oc_crt_default_config(Oc_crt_config *config_p)
+{
+    memset(config_p, 0, sizeof(Oc_crt_config));
+}
+
+void oc_crt_init(void)
+{
+    oc_crt_init_full(&config);
+}
+
+Oc_crt_config *oc_crt_get_config(void)
+{
+    return &config;
+}
+
+void oc_crt_yield_task(void)
+{
+    if (NULL == current_task()) {
+        sched_yield();
+        return;
+    }
+    task_switch_out(CRT_TASK_YIELD, NULL);
+}
 
-    return id;
+void oc_crt_assert(void)
+{
+}
+
+uint64 oc_crt_get_time_millis(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64) (ts.tv_sec - start_ts.tv_sec) * 1000 +
+        (ts.tv_nsec - start_ts.tv_nsec) / (1000 * 1000);
+}
+
+int oc_crt_get_thread(void)
+{
+    // with several workers, co-routines are not bound to a single pthread
+    if (num_workers > 1)
+        return 0;
+    return (int)pthread_self ();
+}
+
+int oc_crt_create_task(const char * name_p,
+                       void *(*start_routine) (void *),
+                       void * arg_p)
+{
+    Oc_crt_task *task_p;
+
+    if (NULL == workers_p)
+        ERR(("oc_crt_create_task called before oc_crt_init_full"));
+
+    task_p = task_alloc();
+    task_p->name_p = name_p;
+    task_p->id = __sync_add_and_fetch(&next_id, 1);
+    task_p->start_routine = start_routine;
+    task_p->arg_p = arg_p;
+
+    if (getcontext(&task_p->ctx) != 0)
+        ERR(("getcontext failed"));
+    task_p->ctx.uc_stack.ss_sp =
+        task_p->map_p + config.stack_guard_size * OC_CRT_PAGE_SIZE;
+    task_p->ctx.uc_stack.ss_size = config.stack_size;
+    task_p->ctx.uc_link = NULL;
+    makecontext(&task_p->ctx, task_trampoline, 0);
+
+    make_ready(task_p);
+    return task_p->id;
 }
 
 /******************************************************************/
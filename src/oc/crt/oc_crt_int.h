@@ -44,7 +44,9 @@ Oc_crt_config *oc_crt_get_config(void);
 // assert that the caller is on a co-routine stack
 void oc_crt_assert(void);
 
-// Return the pthread-id used by the co-routines
+/* Return the pthread-id used by the co-routines. When co-routines are
+ * spread over several worker pthreads this returns zero.
+ */
 int oc_crt_get_thread (void);
 
 /* The CRT uses virtual time in Harness mode, therefore,
@@ -56,7 +58,8 @@ uint64 oc_crt_get_time_millis(void);
 
 /* Fork a new task to run function [run_p]. 
  *
- * can -only- be called from the pthread running co-routines.
+ * The task is queued on one of the worker pthreads, it may be called
+ * from any pthread after oc_crt_init_full.
  */
 int oc_crt_create_task(const char * name_p,
                         void *(*start_routine) (void *),
@@ -69,12 +72,19 @@ void oc_crt_yield_task();
 // kills all tasks except current one
 //void oc_crt_kill_all();
 
-// RW locks
+/* RW locks. A co-routine that cannot take the lock is switched out,
+ * the worker pthread is not blocked.
+ */
 void oc_crt_init_rw_lock(Oc_crt_rw_lock * lock);
 void oc_crt_lock_read(Oc_crt_rw_lock * lock);
 void oc_crt_lock_write(Oc_crt_rw_lock * lock);
 void oc_crt_unlock(Oc_crt_rw_lock * lock);
 
+/* Take the lock for read if this can be done without waiting. Return
+ * TRUE if the lock was taken.
+ */
+bool oc_crt_try_lock_read(Oc_crt_rw_lock * lock);
+
 // return TRUE if lock is taken for write, FALSE otherwise
 bool oc_crt_rw_is_locked_write(Oc_crt_rw_lock * lock);
 bool oc_crt_rw_is_locked_read(Oc_crt_rw_lock * lock_p);
@@ -38,13 +38,16 @@
 
 #include "pl_base.h"
 
+struct Oc_crt_task;
+
 typedef struct Oc_crt_config {
     uint32 num_tasks;
     uint32 max_cycle_count;
     uint32 stack_page_size;  // how many 4K pages to use for a stack?
-    uint32 stack_guard_size;
+    uint32 stack_guard_size; // how many 4K guard pages below a stack?
     uint32 stack_size;       // computed internally
-    bool deterministic_run;
+    uint32 num_workers;      // how many pthreads run co-routines? 0 means one per core
+    bool deterministic_run;  // run all co-routines on a single pthread
 
     void *(*init_fun) (void*);  // function to execute after start-up
 } Oc_crt_config;
@@ -55,13 +58,24 @@ typedef enum Oc_crt_rw_mode {
     CRT_RWSTATE_WRITE,
 } Oc_crt_rw_mode;
 
+// A FIFO of co-routines blocked on a lock or a semaphore
+typedef struct Oc_crt_wait_q {
+    struct Oc_crt_task *head_p;
+    struct Oc_crt_task *tail_p;
+} Oc_crt_wait_q;
+
 // semaphore
 typedef struct Oc_crt_sema {
-    sem_t sem;
+    volatile int guard;      // spin-lock protecting the fields below
+    int value;
+    Oc_crt_wait_q wait_q;
 } Oc_crt_sema;
 
 typedef struct Oc_crt_rw_lock {
-    pthread_rwlock_t lock;
+    volatile int guard;      // spin-lock protecting the fields below
+    int num_readers;
+    bool writer;
+    Oc_crt_wait_q wait_q;
 } Oc_crt_rw_lock;
 
 #endif
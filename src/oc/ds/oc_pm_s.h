@@ -0,0 +1,64 @@
+/**************************************************************/
+/*
+ * Copyright (c) 2014-2015, Ohad Rodeh, IBM Research
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer. 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution. 
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies, 
+ * either expressed or implied, of IBM Research.
+ * 
+ */
+/**************************************************************/
+#ifndef OC_PM_S_H
+#define OC_PM_S_H
+
+#include "pl_base.h"
+
+// The most blocks a work-unit reserves, and the most frees it buffers
+#define OC_PM_RESV_MAX (32)
+
+struct Oc_pm_page;
+
+/* The blocks reserved by a work-unit. A node allocation takes a page
+ * from the reservation and a free is buffered, neither takes the
+ * lock of the page manager. The reservation is refilled, and the frees
+ * are applied, in batches under the lock.
+ */
+typedef struct Oc_pm_rm {
+    // pages of reserved blocks, in the hashtable and not handed out yet
+    struct Oc_pm_page *resv_arr[OC_PM_RESV_MAX];
+    int num_resv;
+
+    // addresses of freed nodes, still allocated in the block map
+    uint64 freed_arr[OC_PM_RESV_MAX];
+    int num_freed;
+
+    // the work-units holding blocks are linked, so a checkpoint finds them
+    struct Oc_pm_rm *next;
+    bool linked;
+
+    uint64 num_allocs;         // nodes allocated by the work-unit
+    uint64 num_locked;         // allocations and frees that took the lock
+} Oc_pm_rm;
+
+#endif
@@ -33,6 +33,7 @@
 #define OC_RM_S_H
 
 #include "oc_utl_s.h"
+#include "oc_pm_s.h"
 
 typedef struct Oc_rm_resource {
     uint32 pm_pages;    // Maximum number of in-memory pages 
@@ -45,8 +46,11 @@ typedef struct Oc_rm_ticket {
     Oc_rm_resource rm_resource_i;
     uint32   fs_ticket_o;
 
+    // the last journal record appended by this work-unit
+    uint64 ljl_lsn;
+
     Oc_utl_rm utl_rm;
-  //Oc_pm_rm pm_rm;
+    Oc_pm_rm pm_rm;
 } Oc_rm_ticket;
 
 #endif
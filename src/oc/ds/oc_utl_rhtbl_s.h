@@ -0,0 +1,83 @@
+/**************************************************************/
+/*
+ * Copyright (c) 2014-2015, Ohad Rodeh, IBM Research
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer. 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution. 
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies, 
+ * either expressed or implied, of IBM Research.
+ * 
+ */
+/**************************************************************/
+#ifndef OC_RHTBL_S_H
+#define OC_RHTBL_S_H
+
+#include "pl_base.h"
+#include "oc_utl_htbl_s.h"
+
+/* A hash function for the open-addressing table. It returns a full
+ * 64-bit hash of the key, the table decides on the slot.
+ */
+typedef uint64 (*Oc_utl_rhtbl_hash)(void *key);
+
+typedef struct Oc_utl_rhtbl_slot {
+    uint32 dib;     // distance from the home slot plus one, zero for an empty slot
+    uint32 hash;    // the low bits of the hash
+    void *elem;
+} Oc_utl_rhtbl_slot;
+
+/* A table is split into shards by the high bits of the hash. Each shard
+ * is a separate Robin-Hood table, that is resized separately.
+ */
+typedef struct Oc_utl_rhtbl_shard {
+    volatile int guard;        // taken by writers in concurrent mode
+    volatile uint32 seq;       // odd while a writer modifies the shard
+    Oc_utl_rhtbl_slot *arr;
+    uint32 len;                // the length of the array, a power of two
+    uint32 size;               // the number of elements in [arr]
+
+    /* While the shard grows, elements are moved gradually from the old
+     * array into [arr].
+     */
+    Oc_utl_rhtbl_slot *old_arr;
+    uint32 old_len;
+    uint32 old_size;
+    uint32 mig_pos;
+
+    // arrays that lock-free readers may still be looking at
+    Oc_utl_rhtbl_slot *retired;
+} Oc_utl_rhtbl_shard;
+
+typedef struct Oc_utl_rhtbl {
+    Oc_utl_rhtbl_shard *shards;
+    uint32 num_shards;
+    int shard_shift;
+    bool concurrent;
+
+    /* Functions given by the user. 
+     */
+    Oc_utl_rhtbl_hash     hash;
+    Oc_utl_htbl_compare   compare;
+} Oc_utl_rhtbl;
+
+#endif
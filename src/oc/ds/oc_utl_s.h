@@ -46,7 +46,7 @@
  */
 typedef struct Oc_meta_data_page_hdr {
     char eye_catcher[4];
-    uint32 lrc;
+    uint32 crc;
     uint16 component_id; // same as Oc_subcomponent_id
     uint16 version;
 
@@ -63,6 +63,12 @@ typedef struct Oc_meta_data_page_hndl {
 
     // address of this node on disk, in bytes (not sectors).
     uint64 disk_addr;          
+
+    /* The generation in which the node was last made writable, zero if
+     * unknown. Set by the tree, and cleared by the node store when the
+     * ref-count of the node is incremented.
+     */
+    uint64 generation;
 } Oc_meta_data_page_hndl;
 
 typedef struct Oc_utl_config {
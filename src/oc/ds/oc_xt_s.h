@@ -34,6 +34,7 @@
 
 #include "oc_crt_s.h"
 #include "oc_utl_s.h"
+#include "pl_dstru.h"
 
 struct Oc_xt_cfg;
 
@@ -42,6 +43,15 @@ typedef struct Oc_xt_state {
     Oc_crt_rw_lock lock; // this lock is used internall. -do not- lock it externally
     struct Oc_xt_cfg *cfg_p;
     Oc_meta_data_page_hndl *root_node_p;
+
+    // sub-trees cut out by a lazy remove-range, waiting to be deleted
+    Ss_slist detached;
+
+    /* bumped by the updates done under the write lock, which may cut
+     * nodes out of the tree. A cursor holding a leaf descends again
+     * when it changes.
+     */
+    uint64 gen;
 } Oc_xt_state;
 
 #endif
@@ -34,6 +34,10 @@ include ${OCROOT}/crt/files.mk
 include ${OCROOT}/utl/files.mk
 include ${OCROOT}/bpt/files.mk
 include ${OCROOT}/xt/files.mk
+include ${OCROOT}/fs/files.mk
+include ${OCROOT}/ljl/files.mk
+include ${OCROOT}/pm/files.mk
+include ${OCROOT}/img/files.mk
 
 #*************************************************************#
 
@@ -0,0 +1,1170 @@
+/**************************************************************/
+/*
+ * Copyright (c) 2014-2015, Ohad Rodeh, IBM Research
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer. 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution. 
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies, 
+ * either expressed or implied, of IBM Research.
+ * 
+ */
+/**************************************************************/
+/**********************************************************************/
+/* OC_FS.C
+ *
+ * A free-space allocator built on top of the x-tree and the b-tree.
+ *
+ * Every run of free blocks [start .. start+len-1] appears in each of
+ * the two indexes:
+ *   - the offset x-tree, as extent (start, {len, base=start, run_len=len})
+ *   - the length b-tree, as key (len, start)
+ *
+ * Runs are always inserted and removed whole, and free runs are
+ * never adjacent. The x-tree may cut a run into several records, for
+ * example along index-node boundaries, and chops records when returning
+ * a partial overlap. The [base] and [run_len] fields survive cutting, so
+ * any piece of a run describes the whole of it.
+ *
+ * Allocated blocks have an implicit ref-count of one. Higher counts
+ * are kept in a separate b-tree, block -> count.
+ */
+/**********************************************************************/
+#include <string.h>
+#include <stdio.h>
+#include <alloca.h>
+
+#include "oc_utl.h"
+#include "oc_utl_trk.h"
+#include "oc_crt_int.h"
+#include "oc_fs_int.h"
+
+/**********************************************************************/
+// The number of extents examined by a near-hint allocation
+#define OC_FS_NEAR_BATCH (16)
+
+// The number of entries read at a time when scanning an index
+#define OC_FS_SCAN_BATCH (32)
+
+// the largest fanout supported by the b-tree and x-tree code
+#define OC_FS_MAX_FANOUT (256)
+
+typedef uint64 Oc_fs_ofs_key;
+
+typedef struct Oc_fs_ofs_rcrd {
+    uint64 len;
+
+    // the free run this record is a piece of
+    uint64 base;
+    uint64 run_len;
+} Oc_fs_ofs_rcrd;
+
+typedef struct Oc_fs_len_key {
+    uint64 len;
+    uint64 start;
+} Oc_fs_len_key;
+
+// the length index carries no data; b-tree data must be non-empty
+typedef uint32 Oc_fs_len_data;
+
+typedef uint64 Oc_fs_ref_key;
+typedef uint32 Oc_fs_ref_data;
+
+// the b-tree node callbacks have no context argument
+static Oc_fs_cfg *g_cfg_p = NULL;
+
+/**********************************************************************/
+// node functions for the b-tree indexes
+
+static Oc_bpt_node* bpt_node_alloc(struct Oc_wu *wu_p)
+{
+    Oc_bpt_node *node_p = g_cfg_p->node_alloc(wu_p);
+
+    // the b-tree expects new nodes to be locked
+    oc_utl_trk_crt_lock_write(wu_p, &node_p->lock);
+    return node_p;
+}
+
+static void bpt_node_dealloc(struct Oc_wu *wu_p, uint64 addr)
+{
+    g_cfg_p->node_dealloc(wu_p, addr);
+}
+
+static Oc_bpt_node* bpt_node_get_sl(struct Oc_wu *wu_p, uint64 addr)
+{
+    return g_cfg_p->node_get_sl(wu_p, addr);
+}
+
+static Oc_bpt_node* bpt_node_get_xl(struct Oc_wu *wu_p, uint64 addr)
+{
+    return g_cfg_p->node_get_xl(wu_p, addr);
+}
+
+static void bpt_node_release(struct Oc_wu *wu_p, Oc_bpt_node *node_p)
+{
+    oc_utl_trk_crt_unlock(wu_p, &node_p->lock);
+    g_cfg_p->node_release(wu_p, node_p);
+}
+
+static void bpt_node_mark_dirty(struct Oc_wu *wu_p,
+                                Oc_bpt_node *node_p,
+                                bool multi_refs)
+{
+    // the index trees are never cloned
+    oc_utl_debugassert(!multi_refs);
+    g_cfg_p->node_mark_dirty(wu_p, node_p);
+}
+
+static void idx_fs_inc_refcount(struct Oc_wu *wu_p, uint64 addr)
+{
+    ERR(("the free-space index trees cannot be cloned"));
+}
+
+static int idx_fs_get_refcount(struct Oc_wu *wu_p, uint64 addr)
+{
+    return 1;
+}
+
+// index entries do not own anything
+static void bpt_data_release(struct Oc_wu *wu_p, struct Oc_bpt_data *data_p)
+{
+}
+
+/**********************************************************************/
+// the offset index
+
+static void xt_node_mark_dirty(struct Oc_wu *wu_p,
+                               Oc_xt_node *node_p,
+                               bool multi_refs)
+{
+    oc_utl_debugassert(!multi_refs);
+    g_cfg_p->node_mark_dirty(wu_p, node_p);
+}
+
+static int ofs_key_compare(struct Oc_xt_key *key1_p,
+                           struct Oc_xt_key *key2_p)
+{
+    Oc_fs_ofs_key key1 = *(Oc_fs_ofs_key*)key1_p;
+    Oc_fs_ofs_key key2 = *(Oc_fs_ofs_key*)key2_p;
+
+    if (key1 == key2) return 0;
+    else if (key1 > key2) return -1;
+    else return 1;
+}
+
+static void ofs_key_inc(struct Oc_xt_key *key_p, struct Oc_xt_key *result_p)
+{
+    *(Oc_fs_ofs_key*)result_p = *(Oc_fs_ofs_key*)key_p + 1;
+}
+
+static uint64 ofs_key_distance(struct Oc_xt_key *key1_p,
+                               struct Oc_xt_key *key2_p)
+{
+    return *(Oc_fs_ofs_key*)key2_p - *(Oc_fs_ofs_key*)key1_p;
+}
+
+static void ofs_key_to_string(struct Oc_xt_key *key_p, char *str_p, int max_len)
+{
+    if (max_len < 2)
+        ERR(("key_to_string: %d is not enough", max_len));
+    snprintf(str_p, max_len, "%Lu", *(Oc_fs_ofs_key*)key_p);
+}
+
+static inline uint64 ofs_end(struct Oc_xt_key *key_p,
+                             struct Oc_xt_rcrd *rcrd_p)
+{
+    return *(Oc_fs_ofs_key*)key_p + ((Oc_fs_ofs_rcrd*)rcrd_p)->len - 1;
+}
+
+// compare extent [key1, end1] against [key2, end2]
+static Oc_xt_cmp ofs_compare_bounds(uint64 key1, uint64 end1,
+                                    uint64 key2, uint64 end2)
+{
+    if (end1 < key2)
+        return OC_XT_CMP_SML;
+    else if (key1 > end2)
+        return OC_XT_CMP_GRT;
+    else if (key1 == key2 && end1 == end2)
+        return OC_XT_CMP_EQUAL;
+    else if (key1 >= key2 && end1 <= end2)
+        return OC_XT_CMP_COVERED;
+    else if (key1 <= key2 && end1 >= end2)
+        return OC_XT_CMP_FULLY_COVERS;
+    else if (key1 < key2)
+        return OC_XT_CMP_PART_OVERLAP_SML;
+    else
+        return OC_XT_CMP_PART_OVERLAP_GRT;
+}
+
+static Oc_xt_cmp ofs_rcrd_compare(
+    struct Oc_xt_key *key1_p,
+    struct Oc_xt_rcrd *rcrd1_p,
+    struct Oc_xt_key *key2_p,
+    struct Oc_xt_rcrd *rcrd2_p)
+{
+    return ofs_compare_bounds(*(Oc_fs_ofs_key*)key1_p, ofs_end(key1_p, rcrd1_p),
+                              *(Oc_fs_ofs_key*)key2_p, ofs_end(key2_p, rcrd2_p));
+}
+
+static int ofs_rcrd_compare0(
+    struct Oc_xt_key *key1_p,
+    struct Oc_xt_key *key2_p,
+    struct Oc_xt_rcrd *rcrd2_p)
+{
+    uint64 key1 = *(Oc_fs_ofs_key*)key1_p;
+
+    if (key1 < *(Oc_fs_ofs_key*)key2_p) return 1;
+    else if (key1 > ofs_end(key2_p, rcrd2_p)) return -1;
+    else return 0;
+}
+
+// write the sub-extent [key .. end] of [rcrd_p] into the target, if non-null
+static void ofs_copy_sub(uint64 key,
+                         uint64 end,
+                         Oc_fs_ofs_rcrd *rcrd_p,
+                         struct Oc_xt_key *trg_key_p,
+                         struct Oc_xt_rcrd *trg_rcrd_p)
+{
+    oc_utl_debugassert(end >= key);
+    if (trg_key_p != NULL)
+        *(Oc_fs_ofs_key*)trg_key_p = key;
+    if (trg_rcrd_p != NULL) {
+        ((Oc_fs_ofs_rcrd*)trg_rcrd_p)->len = end - key + 1;
+        ((Oc_fs_ofs_rcrd*)trg_rcrd_p)->base = rcrd_p->base;
+        ((Oc_fs_ofs_rcrd*)trg_rcrd_p)->run_len = rcrd_p->run_len;
+    }
+}
+
+/* Split extent [key_p, rcrd_p] by the boundaries [lo .. hi].
+ * Boundaries are inclusive, so the whole key space can be described
+ * without overflow.
+ */
+static Oc_xt_cmp ofs_split_by_bounds(
+    struct Oc_xt_key *key_p,
+    struct Oc_xt_rcrd *rcrd_p,
+    uint64 lo,
+    uint64 hi,
+    struct Oc_xt_key *key_array_p[3],
+    struct Oc_xt_rcrd *rcrd_array_p[3])
+{
+    uint64 key = *(Oc_fs_ofs_key*)key_p;
+    uint64 end = ofs_end(key_p, rcrd_p);
+    Oc_fs_ofs_rcrd *r_p = (Oc_fs_ofs_rcrd*)rcrd_p;
+    Oc_xt_cmp rc;
+    bool has[3] = {FALSE, FALSE, FALSE};
+    int i;
+
+    rc = ofs_compare_bounds(key, end, lo, hi);
+    switch (rc) {
+    case OC_XT_CMP_SML:
+        ofs_copy_sub(key, end, r_p, key_array_p[0], rcrd_array_p[0]);
+        has[0] = TRUE;
+        break;
+    case OC_XT_CMP_GRT:
+        ofs_copy_sub(key, end, r_p, key_array_p[2], rcrd_array_p[2]);
+        has[2] = TRUE;
+        break;
+    default:
+        // the extent overlaps the boundaries
+        if (key < lo) {
+            ofs_copy_sub(key, lo-1, r_p, key_array_p[0], rcrd_array_p[0]);
+            has[0] = TRUE;
+        }
+        ofs_copy_sub(MAX(key, lo), MIN(end, hi), r_p,
+                     key_array_p[1], rcrd_array_p[1]);
+        has[1] = TRUE;
+        if (end > hi) {
+            ofs_copy_sub(hi+1, end, r_p, key_array_p[2], rcrd_array_p[2]);
+            has[2] = TRUE;
+        }
+        break;
+    }
+
+    // parts that do not exist are marked with NULL
+    for (i=0; i<3; i++)
+        if (!has[i]) {
+            key_array_p[i] = NULL;
+            rcrd_array_p[i] = NULL;
+        }
+
+    return rc;
+}
+
+static Oc_xt_cmp ofs_rcrd_bound_split(
+    struct Oc_xt_key *key_p,
+    struct Oc_xt_rcrd *rcrd_p,
+    struct Oc_xt_key *min_key_p,
+    struct Oc_xt_key *max_key_p,
+    struct Oc_xt_key *key_array_p[3],
+    struct Oc_xt_rcrd *rcrd_array_p[3])
+{
+    return ofs_split_by_bounds(key_p, rcrd_p,
+                               *(Oc_fs_ofs_key*)min_key_p,
+                               *(Oc_fs_ofs_key*)max_key_p,
+                               key_array_p, rcrd_array_p);
+}
+
+static Oc_xt_cmp ofs_rcrd_split(
+    struct Oc_xt_key *key1_p,
+    struct Oc_xt_rcrd *rcrd1_p,
+    struct Oc_xt_key *key2_p,
+    struct Oc_xt_rcrd *rcrd2_p,
+    struct Oc_xt_key *key_array_p[3],
+    struct Oc_xt_rcrd *rcrd_array_p[3])
+{
+    return ofs_split_by_bounds(key1_p, rcrd1_p,
+                               *(Oc_fs_ofs_key*)key2_p,
+                               ofs_end(key2_p, rcrd2_p),
+                               key_array_p, rcrd_array_p);
+}
+
+static void ofs_rcrd_end_offset(struct Oc_xt_key *key_p,
+                                struct Oc_xt_rcrd *rcrd_p,
+                                struct Oc_xt_key *end_key_po)
+{
+    oc_utl_debugassert(((Oc_fs_ofs_rcrd*)rcrd_p)->len > 0);
+    *(Oc_fs_ofs_key*)end_key_po = ofs_end(key_p, rcrd_p);
+}
+
+static void ofs_rcrd_chop_length(struct Oc_xt_key *key_po,
+                                 struct Oc_xt_rcrd *rcrd_po,
+                                 uint64 len)
+{
+    *(Oc_fs_ofs_key*)key_po += len;
+    ((Oc_fs_ofs_rcrd*)rcrd_po)->len -= len;
+}
+
+static void ofs_rcrd_chop_top(struct Oc_xt_key *key_po,
+                              struct Oc_xt_rcrd *rcrd_po,
+                              struct Oc_xt_key *hi_key_p)
+{
+    uint64 key = *(Oc_fs_ofs_key*)key_po;
+    uint64 top_key = *(Oc_fs_ofs_key*)hi_key_p;
+    Oc_fs_ofs_rcrd *rcrd_p = (Oc_fs_ofs_rcrd*)rcrd_po;
+
+    oc_utl_assert(key < top_key);
+    rcrd_p->len = MIN(top_key - key, rcrd_p->len);
+}
+
+/* Runs are inserted only into holes, so the x-tree never needs to
+ * split one in order to fix an underflow. The function is provided for
+ * completeness.
+ */
+static void ofs_rcrd_split_into_sub(struct Oc_xt_key *key_p,
+                                    struct Oc_xt_rcrd *rcrd_p,
+                                    int num,
+                                    struct Oc_xt_key *_key_array,
+                                    struct Oc_xt_rcrd *_rcrd_array)
+{
+    uint64 key = *(Oc_fs_ofs_key*)key_p;
+    Oc_fs_ofs_rcrd *r_p = (Oc_fs_ofs_rcrd*)rcrd_p;
+    uint64 len = r_p->len;
+    Oc_fs_ofs_key *key_array = (Oc_fs_ofs_key*)_key_array;
+    Oc_fs_ofs_rcrd *rcrd_array = (Oc_fs_ofs_rcrd*)_rcrd_array;
+    uint64 sub_len;
+    int i;
+
+    oc_utl_assert(num > 1);
+    oc_utl_assert(len >= (uint64)num);
+
+    sub_len = len / num;
+    for (i=0; i<num; i++) {
+        key_array[i] = key + i * sub_len;
+        rcrd_array[i].base = r_p->base;
+        rcrd_array[i].run_len = r_p->run_len;
+        if (i < num-1)
+            rcrd_array[i].len = sub_len;
+        else
+            rcrd_array[i].len = len - (num-1) * sub_len;
+    }
+}
+
+static uint64 ofs_rcrd_length(struct Oc_xt_key *key_p,
+                              struct Oc_xt_rcrd *rcrd_p)
+{
+    return ((Oc_fs_ofs_rcrd*)rcrd_p)->len;
+}
+
+// free extents do not own anything
+static void ofs_rcrd_release(struct Oc_wu *wu_p,
+                             struct Oc_xt_key *key_p,
+                             struct Oc_xt_rcrd *rcrd_p)
+{
+}
+
+static void ofs_rcrd_inc_refcount(struct Oc_wu *wu_p,
+                                  struct Oc_xt_key *key_p,
+                                  struct Oc_xt_rcrd *rcrd_p)
+{
+}
+
+static void ofs_rcrd_to_string(struct Oc_xt_key *key_p,
+                               struct Oc_xt_rcrd *rcrd_p,
+                               char *str_p,
+                               int max_len)
+{
+    if (max_len < 2)
+        ERR(("rcrd_to_string: %d is not enough", max_len));
+    snprintf(str_p, max_len, "%Lu-%Lu", *(Oc_fs_ofs_key*)key_p, ofs_end(key_p, rcrd_p));
+}
+
+static void ofs_fs_query(struct Oc_rm_resource *r_p, int n_pages)
+{
+    // releasing a free extent does not touch the free-space
+}
+
+/**********************************************************************/
+// the length index
+
+static int len_key_compare(struct Oc_bpt_key *key1_p,
+                           struct Oc_bpt_key *key2_p)
+{
+    Oc_fs_len_key *k1_p = (Oc_fs_len_key*)key1_p;
+    Oc_fs_len_key *k2_p = (Oc_fs_len_key*)key2_p;
+
+    if (k1_p->len != k2_p->len)
+        return (k1_p->len > k2_p->len) ? -1 : 1;
+    if (k1_p->start != k2_p->start)
+        return (k1_p->start > k2_p->start) ? -1 : 1;
+    return 0;
+}
+
+static void len_key_inc(struct Oc_bpt_key *key_p,
+                        struct Oc_bpt_key *result_p)
+{
+    Oc_fs_len_key *k_p = (Oc_fs_len_key*)key_p;
+    Oc_fs_len_key *r_p = (Oc_fs_len_key*)result_p;
+
+    *r_p = *k_p;
+    r_p->start++;
+    if (0 == r_p->start)
+        r_p->len++;
+}
+
+static void len_key_to_string(struct Oc_bpt_key *key_p,
+                              char *str_p,
+                              int max_len)
+{
+    Oc_fs_len_key *k_p = (Oc_fs_len_key*)key_p;
+
+    if (max_len < 2)
+        ERR(("key_to_string: %d is not enough", max_len));
+    snprintf(str_p, max_len, "%Lu@%Lu", k_p->len, k_p->start);
+}
+
+static void len_data_to_string(struct Oc_bpt_data *data_p,
+                               char *str_p,
+                               int max_len)
+{
+    if (max_len < 2)
+        ERR(("data_to_string: %d is not enough", max_len));
+    snprintf(str_p, max_len, "-");
+}
+
+/**********************************************************************/
+// the ref-count index
+
+static int ref_key_compare(struct Oc_bpt_key *key1_p,
+                           struct Oc_bpt_key *key2_p)
+{
+    Oc_fs_ref_key key1 = *(Oc_fs_ref_key*)key1_p;
+    Oc_fs_ref_key key2 = *(Oc_fs_ref_key*)key2_p;
+
+    if (key1 == key2) return 0;
+    else if (key1 > key2) return -1;
+    else return 1;
+}
+
+static void ref_key_inc(struct Oc_bpt_key *key_p,
+                        struct Oc_bpt_key *result_p)
+{
+    *(Oc_fs_ref_key*)result_p = *(Oc_fs_ref_key*)key_p + 1;
+}
+
+static void ref_key_to_string(struct Oc_bpt_key *key_p,
+                              char *str_p,
+                              int max_len)
+{
+    if (max_len < 2)
+        ERR(("key_to_string: %d is not enough", max_len));
+    snprintf(str_p, max_len, "%Lu", *(Oc_fs_ref_key*)key_p);
+}
+
+static void ref_data_to_string(struct Oc_bpt_data *data_p,
+                               char *str_p,
+                               int max_len)
+{
+    if (max_len < 2)
+        ERR(("data_to_string: %d is not enough", max_len));
+    snprintf(str_p, max_len, "%lu", (unsigned long)*(Oc_fs_ref_data*)data_p);
+}
+
+/**********************************************************************/
+// initialization functions
+
+void oc_fs_init(void)
+{
+    oc_xt_init();
+    oc_bpt_init();
+}
+
+static void init_bpt_cfg(Oc_fs_cfg *cfg_p, Oc_bpt_cfg *bcfg_p)
+{
+    bcfg_p->node_size = cfg_p->node_size;
+    bcfg_p->root_fanout = cfg_p->root_fanout ? cfg_p->root_fanout : OC_FS_MAX_FANOUT;
+    bcfg_p->non_root_fanout = cfg_p->non_root_fanout ? cfg_p->non_root_fanout : OC_FS_MAX_FANOUT;
+    bcfg_p->node_alloc = bpt_node_alloc;
+    bcfg_p->node_dealloc = bpt_node_dealloc;
+    bcfg_p->node_get_sl = bpt_node_get_sl;
+    bcfg_p->node_get_xl = bpt_node_get_xl;
+    bcfg_p->node_release = bpt_node_release;
+    bcfg_p->node_mark_dirty = bpt_node_mark_dirty;
+    bcfg_p->fs_inc_refcount = idx_fs_inc_refcount;
+    bcfg_p->fs_get_refcount = idx_fs_get_refcount;
+    bcfg_p->data_release = bpt_data_release;
+}
+
+void oc_fs_init_config(Oc_fs_cfg *cfg_p)
+{
+    Oc_xt_cfg *xcfg_p = &cfg_p->ofs_cfg;
+
+    oc_utl_assert(cfg_p->node_alloc);
+    oc_utl_assert(cfg_p->node_dealloc);
+    oc_utl_assert(cfg_p->node_get_sl);
+    oc_utl_assert(cfg_p->node_get_xl);
+    oc_utl_assert(cfg_p->node_release);
+    oc_utl_assert(cfg_p->node_mark_dirty);
+
+    if (g_cfg_p != NULL && g_cfg_p != cfg_p)
+        ERR(("only one free-space configuration can be active"));
+    g_cfg_p = cfg_p;
+
+    // the offset index
+    memset(xcfg_p, 0, sizeof(Oc_xt_cfg));
+    xcfg_p->key_size = sizeof(Oc_fs_ofs_key);
+    xcfg_p->rcrd_size = sizeof(Oc_fs_ofs_rcrd);
+    xcfg_p->node_size = cfg_p->node_size;
+    xcfg_p->root_fanout = cfg_p->root_fanout ? cfg_p->root_fanout : OC_FS_MAX_FANOUT;
+    xcfg_p->non_root_fanout = cfg_p->non_root_fanout ? cfg_p->non_root_fanout : OC_FS_MAX_FANOUT;
+    xcfg_p->node_alloc = cfg_p->node_alloc;
+    xcfg_p->node_dealloc = cfg_p->node_dealloc;
+    xcfg_p->node_get_sl = cfg_p->node_get_sl;
+    xcfg_p->node_get_xl = cfg_p->node_get_xl;
+    xcfg_p->node_release = cfg_p->node_release;
+    xcfg_p->node_mark_dirty = xt_node_mark_dirty;
+    xcfg_p->fs_inc_refcount = idx_fs_inc_refcount;
+    xcfg_p->fs_get_refcount = idx_fs_get_refcount;
+    xcfg_p->key_compare = ofs_key_compare;
+    xcfg_p->key_inc = ofs_key_inc;
+    xcfg_p->key_distance = ofs_key_distance;
+    xcfg_p->key_to_string = ofs_key_to_string;
+    xcfg_p->rcrd_compare = ofs_rcrd_compare;
+    xcfg_p->rcrd_compare0 = ofs_rcrd_compare0;
+    xcfg_p->rcrd_bound_split = ofs_rcrd_bound_split;
+    xcfg_p->rcrd_split = ofs_rcrd_split;
+    xcfg_p->rcrd_end_offset = ofs_rcrd_end_offset;
+    xcfg_p->rcrd_chop_length = ofs_rcrd_chop_length;
+    xcfg_p->rcrd_chop_top = ofs_rcrd_chop_top;
+    xcfg_p->rcrd_split_into_sub = ofs_rcrd_split_into_sub;
+    xcfg_p->rcrd_length = ofs_rcrd_length;
+    xcfg_p->rcrd_release = ofs_rcrd_release;
+    xcfg_p->rcrd_inc_refcount = ofs_rcrd_inc_refcount;
+    xcfg_p->rcrd_to_string = ofs_rcrd_to_string;
+    xcfg_p->fs_query_alloc = ofs_fs_query;
+    xcfg_p->fs_query_dealloc = ofs_fs_query;
+    oc_xt_init_config(xcfg_p);
+
+    // the length index
+    memset(&cfg_p->len_cfg, 0, sizeof(Oc_bpt_cfg));
+    init_bpt_cfg(cfg_p, &cfg_p->len_cfg);
+    cfg_p->len_cfg.key_size = sizeof(Oc_fs_len_key);
+    cfg_p->len_cfg.data_size = sizeof(Oc_fs_len_data);
+    cfg_p->len_cfg.key_compare = len_key_compare;
+    cfg_p->len_cfg.key_inc = len_key_inc;
+    cfg_p->len_cfg.key_to_string = len_key_to_string;
+    cfg_p->len_cfg.data_to_string = len_data_to_string;
+    oc_bpt_init_config(&cfg_p->len_cfg);
+
+    // the ref-count index
+    memset(&cfg_p->ref_cfg, 0, sizeof(Oc_bpt_cfg));
+    init_bpt_cfg(cfg_p, &cfg_p->ref_cfg);
+    cfg_p->ref_cfg.key_size = sizeof(Oc_fs_ref_key);
+    cfg_p->ref_cfg.data_size = sizeof(Oc_fs_ref_data);
+    cfg_p->ref_cfg.key_compare = ref_key_compare;
+    cfg_p->ref_cfg.key_inc = ref_key_inc;
+    cfg_p->ref_cfg.key_to_string = ref_key_to_string;
+    cfg_p->ref_cfg.data_to_string = ref_data_to_string;
+    oc_bpt_init_config(&cfg_p->ref_cfg);
+
+    cfg_p->initialized = TRUE;
+}
+
+void oc_fs_init_state_b(struct Oc_wu *wu_pi,
+                        Oc_fs_state *state_po,
+                        Oc_fs_cfg *cfg_p)
+{
+    oc_utl_debugassert(cfg_p->initialized);
+
+    memset(state_po, 0, sizeof(Oc_fs_state));
+    oc_crt_init_rw_lock(&state_po->lock);
+    state_po->cfg_p = cfg_p;
+    oc_xt_init_state_b(wu_pi, &state_po->ofs_s, &cfg_p->ofs_cfg);
+    oc_bpt_init_state_b(wu_pi, &state_po->len_s, &cfg_p->len_cfg, 0);
+    oc_bpt_init_state_b(wu_pi, &state_po->ref_s, &cfg_p->ref_cfg, 0);
+}
+
+/**********************************************************************/
+// run manipulation. The allocator lock is taken by the caller.
+
+static inline uint64 last_block(Oc_fs_state *s_p)
+{
+    return s_p->first_block + s_p->num_blocks - 1;
+}
+
+static void insert_run_b(struct Oc_wu *wu_p,
+                         Oc_fs_state *s_p,
+                         uint64 start,
+                         uint64 len)
+{
+    Oc_fs_ofs_key key = start;
+    Oc_fs_ofs_rcrd rcrd;
+    Oc_fs_len_key len_key;
+    Oc_fs_len_data len_data = 0;
+    uint64 rc;
+    bool replaced;
+
+    oc_utl_debugassert(len > 0);
+    rcrd.len = len;
+    rcrd.base = start;
+    rcrd.run_len = len;
+    rc = oc_xt_insert_range_b(wu_p, &s_p->ofs_s,
+                              (struct Oc_xt_key*)&key,
+                              (struct Oc_xt_rcrd*)&rcrd);
+    if (rc != 0)
+        ERR(("free extent [%Lu-%Lu] overlaps an existing one",
+             start, start + len - 1));
+
+    len_key.len = len;
+    len_key.start = start;
+    replaced = oc_bpt_insert_key_b(wu_p, &s_p->len_s,
+                                   (struct Oc_bpt_key*)&len_key,
+                                   (struct Oc_bpt_data*)&len_data);
+    oc_utl_assert(!replaced);
+}
+
+static void remove_run_b(struct Oc_wu *wu_p,
+                         Oc_fs_state *s_p,
+                         uint64 start,
+                         uint64 len)
+{
+    Oc_fs_ofs_key min_key = start, max_key = start + len - 1;
+    Oc_fs_len_key len_key;
+    uint64 rc;
+    bool found;
+
+    rc = oc_xt_remove_range_b(wu_p, &s_p->ofs_s,
+                              (struct Oc_xt_key*)&min_key,
+                              (struct Oc_xt_key*)&max_key);
+    oc_utl_assert(rc == len);
+
+    len_key.len = len;
+    len_key.start = start;
+    found = oc_bpt_remove_key_b(wu_p, &s_p->len_s,
+                                (struct Oc_bpt_key*)&len_key);
+    oc_utl_assert(found);
+}
+
+/* Take blocks [at .. at+len-1] out of the free run [start .. start+run_len-1].
+ * Whatever is left on either side goes back as separate runs.
+ */
+static void carve_run_b(struct Oc_wu *wu_p,
+                        Oc_fs_state *s_p,
+                        uint64 start,
+                        uint64 run_len,
+                        uint64 at,
+                        uint64 len)
+{
+    oc_utl_debugassert(at >= start);
+    oc_utl_debugassert(at + len <= start + run_len);
+
+    remove_run_b(wu_p, s_p, start, run_len);
+    if (at > start)
+        insert_run_b(wu_p, s_p, start, at - start);
+    if (at + len < start + run_len)
+        insert_run_b(wu_p, s_p, at + len, start + run_len - (at + len));
+    s_p->num_free -= len;
+}
+
+// Lookup the free run containing block [addr]. Return FALSE if [addr] is allocated.
+static bool lookup_run_b(struct Oc_wu *wu_p,
+                         Oc_fs_state *s_p,
+                         uint64 addr,
+                         uint64 *start_po,
+                         uint64 *len_po)
+{
+    Oc_fs_ofs_key min_key = addr, max_key = last_block(s_p), key;
+    Oc_fs_ofs_rcrd rcrd;
+    int n_found;
+
+    // any piece of the run describes all of it
+    oc_xt_lookup_range_b(wu_p, &s_p->ofs_s,
+                         (struct Oc_xt_key*)&min_key,
+                         (struct Oc_xt_key*)&max_key,
+                         1,
+                         (struct Oc_xt_key*)&key,
+                         (struct Oc_xt_rcrd*)&rcrd,
+                         &n_found);
+    if (0 == n_found || key != addr)
+        return FALSE;
+
+    *start_po = rcrd.base;
+    *len_po = rcrd.run_len;
+    return TRUE;
+}
+
+// Return blocks [start .. start+len-1] to the free-space
+static void free_run_b(struct Oc_wu *wu_p,
+                       Oc_fs_state *s_p,
+                       uint64 start,
+                       uint64 len)
+{
+    uint64 nbr_start, nbr_len;
+
+#if OC_DEBUG
+    {
+        Oc_fs_ofs_key min_key = start, max_key = start + len - 1, key;
+        Oc_fs_ofs_rcrd rcrd;
+        int n_found;
+
+        oc_xt_lookup_range_b(wu_p, &s_p->ofs_s,
+                             (struct Oc_xt_key*)&min_key,
+                             (struct Oc_xt_key*)&max_key,
+                             1,
+                             (struct Oc_xt_key*)&key,
+                             (struct Oc_xt_rcrd*)&rcrd,
+                             &n_found);
+        if (n_found > 0)
+            ERR(("block %Lu is freed twice", key));
+    }
+#endif
+
+    s_p->num_free += len;
+
+    // coalesce with the run to the left
+    if (start > s_p->first_block &&
+        lookup_run_b(wu_p, s_p, start - 1, &nbr_start, &nbr_len)) {
+        oc_utl_debugassert(nbr_start + nbr_len == start);
+        remove_run_b(wu_p, s_p, nbr_start, nbr_len);
+        start = nbr_start;
+        len += nbr_len;
+    }
+
+    // coalesce with the run to the right
+    if (start + len - 1 < last_block(s_p) &&
+        lookup_run_b(wu_p, s_p, start + len, &nbr_start, &nbr_len)) {
+        oc_utl_debugassert(nbr_start == start + len);
+        remove_run_b(wu_p, s_p, nbr_start, nbr_len);
+        len += nbr_len;
+    }
+
+    insert_run_b(wu_p, s_p, start, len);
+}
+
+/**********************************************************************/
+
+void oc_fs_create_b(struct Oc_wu *wu_p,
+                    Oc_fs_state *s_p,
+                    uint64 first_block,
+                    uint64 num_blocks)
+{
+    oc_utl_assert(num_blocks > 0);
+    oc_utl_assert(first_block + num_blocks > first_block);
+
+    oc_utl_trk_crt_lock_write(wu_p, &s_p->lock);
+    {
+        s_p->first_block = first_block;
+        s_p->num_blocks = num_blocks;
+        s_p->num_free = num_blocks;
+
+        oc_xt_create_b(wu_p, &s_p->ofs_s);
+        oc_bpt_create_b(wu_p, &s_p->len_s);
+        oc_bpt_create_b(wu_p, &s_p->ref_s);
+        insert_run_b(wu_p, s_p, first_block, num_blocks);
+    }
+    oc_utl_trk_crt_unlock(wu_p, &s_p->lock);
+}
+
+void oc_fs_delete_b(struct Oc_wu *wu_p, Oc_fs_state *s_p)
+{
+    oc_utl_trk_crt_lock_write(wu_p, &s_p->lock);
+    {
+        oc_xt_delete_b(wu_p, &s_p->ofs_s);
+        oc_bpt_delete_b(wu_p, &s_p->len_s);
+        oc_bpt_delete_b(wu_p, &s_p->ref_s);
+        s_p->num_blocks = 0;
+        s_p->num_free = 0;
+    }
+    oc_utl_trk_crt_unlock(wu_p, &s_p->lock);
+}
+
+/**********************************************************************/
+
+// best-fit. The lock is taken by the caller.
+static bool alloc_best_fit_b(struct Oc_wu *wu_p,
+                             Oc_fs_state *s_p,
+                             uint64 len,
+                             uint64 *addr_po)
+{
+    Oc_fs_len_key min_key, max_key, key;
+    Oc_fs_len_data data;
+    int n_found;
+
+    min_key.len = len;
+    min_key.start = 0;
+    max_key.len = s_p->num_blocks;
+    max_key.start = last_block(s_p);
+    oc_bpt_lookup_range_b(wu_p, &s_p->len_s,
+                          (struct Oc_bpt_key*)&min_key,
+                          (struct Oc_bpt_key*)&max_key,
+                          1,
+                          (struct Oc_bpt_key*)&key,
+                          (struct Oc_bpt_data*)&data,
+                          &n_found);
+    if (0 == n_found)
+        return FALSE;
+
+    oc_utl_debugassert(key.len >= len);
+    carve_run_b(wu_p, s_p, key.start, key.len, key.start, len);
+    *addr_po = key.start;
+    return TRUE;
+}
+
+bool oc_fs_alloc_b(struct Oc_wu *wu_p,
+                   Oc_fs_state *s_p,
+                   uint64 len,
+                   uint64 *addr_po)
+{
+    bool rc = FALSE;
+
+    oc_utl_assert(len > 0);
+    oc_utl_trk_crt_lock_write(wu_p, &s_p->lock);
+    if (len <= s_p->num_free)
+        rc = alloc_best_fit_b(wu_p, s_p, len, addr_po);
+    oc_utl_trk_crt_unlock(wu_p, &s_p->lock);
+
+    return rc;
+}
+
+bool oc_fs_alloc_near_b(struct Oc_wu *wu_p,
+                        Oc_fs_state *s_p,
+                        uint64 hint,
+                        uint64 len,
+                        uint64 *addr_po)
+{
+    Oc_fs_ofs_key min_key, max_key;
+    Oc_fs_ofs_key key_array[OC_FS_NEAR_BATCH];
+    Oc_fs_ofs_rcrd rcrd_array[OC_FS_NEAR_BATCH];
+    int i, n_found;
+    bool rc = FALSE;
+
+    oc_utl_assert(len > 0);
+    oc_utl_trk_crt_lock_write(wu_p, &s_p->lock);
+    if (len > s_p->num_free)
+        goto done;
+
+    min_key = MAX(hint, s_p->first_block);
+    max_key = last_block(s_p);
+    if (min_key <= max_key) {
+        oc_xt_lookup_range_b(wu_p, &s_p->ofs_s,
+                             (struct Oc_xt_key*)&min_key,
+                             (struct Oc_xt_key*)&max_key,
+                             OC_FS_NEAR_BATCH,
+                             (struct Oc_xt_key*)key_array,
+                             (struct Oc_xt_rcrd*)rcrd_array,
+                             &n_found);
+
+        /* The usable part of a run starts at the first block returned
+         * for it, which is the hint for the first run.
+         */
+        for (i=0; i<n_found; i++) {
+            uint64 start = rcrd_array[i].base;
+            uint64 run_len = rcrd_array[i].run_len;
+
+            if (start + run_len - key_array[i] >= len) {
+                carve_run_b(wu_p, s_p, start, run_len, key_array[i], len);
+                *addr_po = key_array[i];
+                rc = TRUE;
+                goto done;
+            }
+        }
+    }
+
+    rc = alloc_best_fit_b(wu_p, s_p, len, addr_po);
+
+ done:
+    oc_utl_trk_crt_unlock(wu_p, &s_p->lock);
+    return rc;
+}
+
+/**********************************************************************/
+// ref-counts
+
+void oc_fs_dealloc_b(struct Oc_wu *wu_p,
+                     Oc_fs_state *s_p,
+                     uint64 addr,
+                     uint64 len)
+{
+    Oc_fs_ref_key min_key, max_key;
+    Oc_fs_ref_key key_array[OC_FS_SCAN_BATCH];
+    Oc_fs_ref_data data_array[OC_FS_SCAN_BATCH];
+    uint64 free_start = addr;
+    int i, n_found;
+
+    oc_utl_assert(len > 0);
+    oc_utl_assert(addr >= s_p->first_block);
+    oc_utl_assert(addr + len - 1 <= last_block(s_p));
+
+    oc_utl_trk_crt_lock_write(wu_p, &s_p->lock);
+
+    /* Blocks that are shared only lose a reference. The others, between
+     * them, are freed.
+     */
+    min_key = addr;
+    max_key = addr + len - 1;
+    do {
+        oc_bpt_lookup_range_b(wu_p, &s_p->ref_s,
+                              (struct Oc_bpt_key*)&min_key,
+                              (struct Oc_bpt_key*)&max_key,
+                              OC_FS_SCAN_BATCH,
+                              (struct Oc_bpt_key*)key_array,
+                              (struct Oc_bpt_data*)data_array,
+                              &n_found);
+
+        for (i=0; i<n_found; i++) {
+            oc_utl_debugassert(data_array[i] > 1);
+            if (data_array[i] > 2) {
+                data_array[i]--;
+                oc_bpt_insert_key_b(wu_p, &s_p->ref_s,
+                                    (struct Oc_bpt_key*)&key_array[i],
+                                    (struct Oc_bpt_data*)&data_array[i]);
+            }
+            else
+                oc_bpt_remove_key_b(wu_p, &s_p->ref_s,
+                                    (struct Oc_bpt_key*)&key_array[i]);
+
+            if (key_array[i] > free_start)
+                free_run_b(wu_p, s_p, free_start, key_array[i] - free_start);
+            free_start = key_array[i] + 1;
+        }
+
+        if (n_found > 0)
+            min_key = key_array[n_found-1] + 1;
+    } while (OC_FS_SCAN_BATCH == n_found && min_key <= max_key);
+
+    if (free_start <= max_key)
+        free_run_b(wu_p, s_p, free_start, max_key - free_start + 1);
+
+    oc_utl_trk_crt_unlock(wu_p, &s_p->lock);
+}
+
+// Return TRUE if block [addr] is free. The lock is taken by the caller.
+static bool is_free_b(struct Oc_wu *wu_p, Oc_fs_state *s_p, uint64 addr)
+{
+    uint64 start, len;
+
+    return lookup_run_b(wu_p, s_p, addr, &start, &len);
+}
+
+void oc_fs_inc_refcount_b(struct Oc_wu *wu_p,
+                          Oc_fs_state *s_p,
+                          uint64 addr)
+{
+    Oc_fs_ref_key key = addr;
+    Oc_fs_ref_data data;
+
+    oc_utl_trk_crt_lock_write(wu_p, &s_p->lock);
+
+    oc_utl_debugassert(!is_free_b(wu_p, s_p, addr));
+    if (oc_bpt_lookup_key_b(wu_p, &s_p->ref_s,
+                            (struct Oc_bpt_key*)&key,
+                            (struct Oc_bpt_data*)&data)) {
+        if ((Oc_fs_ref_data)~0 == data)
+            ERR(("ref-count overflow on block %Lu", addr));
+        data++;
+    }
+    else
+        data = 2;
+    oc_bpt_insert_key_b(wu_p, &s_p->ref_s,
+                        (struct Oc_bpt_key*)&key,
+                        (struct Oc_bpt_data*)&data);
+
+    oc_utl_trk_crt_unlock(wu_p, &s_p->lock);
+}
+
+uint32 oc_fs_get_refcount_b(struct Oc_wu *wu_p,
+                            Oc_fs_state *s_p,
+                            uint64 addr)
+{
+    Oc_fs_ref_key key = addr;
+    Oc_fs_ref_data data;
+    uint32 rc;
+
+    oc_utl_trk_crt_lock_read(wu_p, &s_p->lock);
+    if (oc_bpt_lookup_key_b(wu_p, &s_p->ref_s,
+                            (struct Oc_bpt_key*)&key,
+                            (struct Oc_bpt_data*)&data))
+        rc = data;
+    else if (is_free_b(wu_p, s_p, addr))
+        rc = 0;
+    else
+        rc = 1;
+    oc_utl_trk_crt_unlock(wu_p, &s_p->lock);
+
+    return rc;
+}
+
+uint64 oc_fs_num_free(Oc_fs_state *s_p)
+{
+    return s_p->num_free;
+}
+
+/**********************************************************************/
+
+bool oc_fs_dbg_validate_b(struct Oc_wu *wu_p, Oc_fs_state *s_p)
+{
+    Oc_fs_ofs_key min_key, max_key;
+    Oc_fs_ofs_key key_array[OC_FS_SCAN_BATCH];
+    Oc_fs_ofs_rcrd rcrd_array[OC_FS_SCAN_BATCH];
+    Oc_fs_len_key len_min, len_max;
+    Oc_fs_len_key len_array[OC_FS_SCAN_BATCH];
+    Oc_fs_len_data len_data;
+    uint64 total = 0, n_runs = 0, n_len_runs = 0, prev_end = 0, run_start = 0;
+    int i, n_found;
+    bool rc = TRUE;
+
+    oc_utl_trk_crt_lock_write(wu_p, &s_p->lock);
+
+    if (!oc_xt_dbg_validate_b(wu_p, &s_p->ofs_s) ||
+        !oc_bpt_dbg_validate_b(wu_p, &s_p->len_s) ||
+        !oc_bpt_dbg_validate_b(wu_p, &s_p->ref_s)) {
+        rc = FALSE;
+        goto done;
+    }
+
+    // walk the offset index
+    min_key = s_p->first_block;
+    max_key = last_block(s_p);
+    do {
+        oc_xt_lookup_range_b(wu_p, &s_p->ofs_s,
+                             (struct Oc_xt_key*)&min_key,
+                             (struct Oc_xt_key*)&max_key,
+                             OC_FS_SCAN_BATCH,
+                             (struct Oc_xt_key*)key_array,
+                             (struct Oc_xt_rcrd*)rcrd_array,
+                             &n_found);
+
+        for (i=0; i<n_found; i++) {
+            uint64 key = key_array[i];
+            uint64 end = key + rcrd_array[i].len - 1;
+            uint64 base = rcrd_array[i].base;
+            uint64 run_len = rcrd_array[i].run_len;
+
+            if (key < base || end >= base + run_len) {
+                printf("free extent %Lu-%Lu is outside its run %Lu-%Lu\n",
+                       key, end, base, base + run_len - 1);
+                rc = FALSE;
+            }
+
+            if (n_runs > 0 && base == run_start) {
+                // another piece of the current run
+                if (key != prev_end + 1) {
+                    printf("run %Lu has a hole at block %Lu\n", base, key);
+                    rc = FALSE;
+                }
+            }
+            else {
+                Oc_fs_len_key len_key;
+
+                // a new run
+                if (n_runs > 0 && key <= prev_end + 1) {
+                    printf("free extents are not coalesced at block %Lu\n",
+                           key);
+                    rc = FALSE;
+                }
+                if (key != base) {
+                    printf("run %Lu starts at block %Lu\n", base, key);
+                    rc = FALSE;
+                }
+
+                len_key.len = run_len;
+                len_key.start = base;
+                if (!oc_bpt_lookup_key_b(wu_p, &s_p->len_s,
+                                         (struct Oc_bpt_key*)&len_key,
+                                         (struct Oc_bpt_data*)&len_data)) {
+                    printf("free extent %Lu-%Lu is missing from the length index\n",
+                           base, base + run_len - 1);
+                    rc = FALSE;
+                }
+                run_start = base;
+                n_runs++;
+            }
+
+            total += rcrd_array[i].len;
+            prev_end = end;
+        }
+        if (n_found > 0)
+            min_key = prev_end + 1;
+    } while (OC_FS_SCAN_BATCH == n_found && min_key <= max_key);
+
+    // the length index should not have any extra entries
+    memset(&len_min, 0, sizeof(len_min));
+    len_max.len = s_p->num_blocks;
+    len_max.start = last_block(s_p);
+    do {
+        oc_bpt_lookup_range_b(wu_p, &s_p->len_s,
+                              (struct Oc_bpt_key*)&len_min,
+                              (struct Oc_bpt_key*)&len_max,
+                              OC_FS_SCAN_BATCH,
+                              (struct Oc_bpt_key*)len_array,
+                              NULL,
+                              &n_found);
+        n_len_runs += n_found;
+        if (n_found > 0)
+            len_key_inc((struct Oc_bpt_key*)&len_array[n_found-1],
+                        (struct Oc_bpt_key*)&len_min);
+    } while (OC_FS_SCAN_BATCH == n_found);
+
+    if (n_len_runs != n_runs) {
+        printf("the offset index has %Lu extents, the length index has %Lu\n",
+               n_runs, n_len_runs);
+        rc = FALSE;
+    }
+    if (total != s_p->num_free) {
+        printf("the free extents cover %Lu blocks, the counter is %Lu\n",
+               total, s_p->num_free);
+        rc = FALSE;
+    }
+
+ done:
+    oc_utl_trk_crt_unlock(wu_p, &s_p->lock);
+    return rc;
+}
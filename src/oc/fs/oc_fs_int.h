@@ -0,0 +1,197 @@
+/**************************************************************/
+/*
+ * Copyright (c) 2014-2015, Ohad Rodeh, IBM Research
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer. 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution. 
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies, 
+ * either expressed or implied, of IBM Research.
+ * 
+ */
+/**************************************************************/
+/******************************************************************/
+/* OC_FS_INT.H
+ *
+ * A free-space allocator. Free blocks are kept as extents in two
+ * indexes: an x-tree ordered by offset and a b-tree ordered by
+ * (length, offset). Reference counts larger than one are kept in a
+ * third b-tree, keyed by block.
+ */
+/******************************************************************/
+#ifndef OC_FS_INT_H
+#define OC_FS_INT_H
+
+#include "pl_base.h"
+#include "oc_utl_s.h"
+#include "oc_xt_s.h"
+#include "oc_xt_int.h"
+#include "oc_bpt_int.h"
+
+struct Oc_wu;
+
+/******************************************************************/
+
+/* A set of function pointers and data to initialize an allocator.
+ *
+ * The three index trees are stored in the pages provided by the node
+ * functions. These pages must come from a separate metadata area; the
+ * node functions may not call back into the allocator.
+ *
+ * Only one configuration can be active at a time.
+ */
+typedef struct Oc_fs_cfg {
+    bool initialized;
+
+    // size of a node (in bytes)
+    int node_size;
+
+    // A way to limit the fanout of the index nodes. Use 0 for maximum
+    int root_fanout;
+    int non_root_fanout;
+
+    /* working with nodes. The semantics are the same as for an x-tree:
+     * [node_get_sl] and [node_get_xl] take a reference to a node and
+     * lock it, [node_release] drops the reference to an unlocked node.
+     * The indexes are never cloned, so nodes are never shared and
+     * [node_mark_dirty] does not take a multiple-references flag.
+     */
+    Oc_meta_data_page_hndl*  ((*node_alloc)(struct Oc_wu*));
+    void                     ((*node_dealloc)(struct Oc_wu*, uint64));
+    Oc_meta_data_page_hndl*  ((*node_get_sl)(struct Oc_wu*, uint64));
+    Oc_meta_data_page_hndl*  ((*node_get_xl)(struct Oc_wu*, uint64));
+    void                     ((*node_release)(struct Oc_wu*,
+                                              Oc_meta_data_page_hndl*));
+    void                     ((*node_mark_dirty)(struct Oc_wu*,
+                                                 Oc_meta_data_page_hndl*));
+
+    //--------------------------------------------------------
+    // These are computed
+    Oc_xt_cfg ofs_cfg;
+    Oc_bpt_cfg len_cfg;
+    Oc_bpt_cfg ref_cfg;
+    //--------------------------------------------------------
+} Oc_fs_cfg;
+
+// The state of an allocator
+typedef struct Oc_fs_state {
+    // serializes updates to the three indexes. -do not- lock it externally
+    Oc_crt_rw_lock lock;
+    Oc_fs_cfg *cfg_p;
+
+    // the managed blocks are [first_block .. first_block + num_blocks - 1]
+    uint64 first_block;
+    uint64 num_blocks;
+    uint64 num_free;
+
+    Oc_xt_state ofs_s;         // free extents, by offset
+    Oc_bpt_state len_s;        // free extents, by (length, offset)
+    Oc_bpt_state ref_s;        // blocks whose ref-count is larger than one
+} Oc_fs_state;
+
+/******************************************************************/
+
+void oc_fs_init(void);
+
+void oc_fs_init_config(Oc_fs_cfg *cfg_p);
+
+void oc_fs_init_state_b(
+    struct Oc_wu *wu_pi,
+    Oc_fs_state *state_po,
+    Oc_fs_cfg *cfg_p);
+
+/* Create an allocator for blocks [first_block .. first_block+num_blocks-1].
+ * Initially, all the blocks are free.
+ */
+void oc_fs_create_b(
+    struct Oc_wu *wu_p,
+    Oc_fs_state *s_p,
+    uint64 first_block,
+    uint64 num_blocks);
+
+// delete the index trees. The state cannot be used afterwards.
+void oc_fs_delete_b(
+    struct Oc_wu *wu_p,
+    Oc_fs_state *s_p);
+
+/* Allocate [len] contiguous blocks, choosing the smallest free extent
+ * that is large enough. Return TRUE and put the first block in
+ * [addr_po] on success. Return FALSE if there is no free extent of
+ * this length.
+ *
+ * The new blocks have a ref-count of one.
+ */
+bool oc_fs_alloc_b(
+    struct Oc_wu *wu_p,
+    Oc_fs_state *s_p,
+    uint64 len,
+    uint64 *addr_po);
+
+/* Same as [oc_fs_alloc_b], but prefer the first free extent at or
+ * after block [hint]. Passing the address of a neighboring node as
+ * the hint keeps related nodes physically close together.
+ *
+ * Falls back to best-fit if nothing suitable is found near the hint.
+ */
+bool oc_fs_alloc_near_b(
+    struct Oc_wu *wu_p,
+    Oc_fs_state *s_p,
+    uint64 hint,
+    uint64 len,
+    uint64 *addr_po);
+
+/* Decrement the ref-count of blocks [addr .. addr+len-1]. Blocks whose
+ * ref-count drops to zero are returned to the free-space, and are
+ * merged with neighboring free extents.
+ */
+void oc_fs_dealloc_b(
+    struct Oc_wu *wu_p,
+    Oc_fs_state *s_p,
+    uint64 addr,
+    uint64 len);
+
+// Increment the ref-count of allocated block [addr]
+void oc_fs_inc_refcount_b(
+    struct Oc_wu *wu_p,
+    Oc_fs_state *s_p,
+    uint64 addr);
+
+// Return the ref-count of block [addr]. Free blocks have a ref-count of zero.
+uint32 oc_fs_get_refcount_b(
+    struct Oc_wu *wu_p,
+    Oc_fs_state *s_p,
+    uint64 addr);
+
+// Return the number of free blocks
+uint64 oc_fs_num_free(Oc_fs_state *s_p);
+
+/* Validate that the two free-space indexes agree, and that no two
+ * free extents are adjacent.
+ * The allocator is locked during this operation.
+ */
+bool oc_fs_dbg_validate_b(
+    struct Oc_wu *wu_p,
+    Oc_fs_state *s_p);
+
+/******************************************************************/
+
+#endif
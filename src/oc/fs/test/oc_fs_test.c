@@ -0,0 +1,421 @@
+/**************************************************************/
+/*
+ * Copyright (c) 2014-2015, Ohad Rodeh, IBM Research
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer. 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution. 
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies, 
+ * either expressed or implied, of IBM Research.
+ * 
+ */
+/**************************************************************/
+/**********************************************************************/
+/* OC_FS_TEST.C
+ *
+ * Test the free-space allocator against a simple array of ref-counts.
+ */
+/**********************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pl_trace_base.h"
+#include "oc_utl.h"
+#include "oc_utl_rhtbl.h"
+#include "oc_utl_trk.h"
+#include "oc_crt_int.h"
+#include "oc_rm_s.h"
+#include "oc_wu_s.h"
+#include "oc_fs_int.h"
+
+/**********************************************************************/
+// configuration defined on the command line
+static int num_rounds = 20;
+static int num_ops = 2000;
+static uint64 num_blocks = 5000;
+static int fanout = 0;
+static bool verbose = FALSE;
+
+#define NODE_SIZE (4096)
+#define FIRST_BLOCK (100)
+
+// the reference implementation: a ref-count per block
+static uint32 *ref_arr = NULL;
+static uint64 ref_num_free;
+
+static Oc_fs_cfg cfg;
+static Oc_fs_state state;
+
+/**********************************************************************/
+/* An in-memory store for the pages of the index trees. The pages are
+ * kept in a hashtable, indexed by disk-address.
+ */
+static Oc_utl_rhtbl vd_htbl;
+static uint64 vd_next_addr = 1;
+static int vd_refcnt = 0;
+
+static uint64 vd_hash(void *_key)
+{
+    return oc_utl_rhtbl_hash_u64(*((uint64*) _key));
+}
+
+static bool vd_compare(void *_elem, void *_key)
+{
+    Oc_meta_data_page_hndl *node_p = (Oc_meta_data_page_hndl*) _elem;
+
+    return (node_p->disk_addr == *((uint64*) _key));
+}
+
+static void *wrap_malloc(int size)
+{
+    void *p = malloc(size);
+
+    oc_utl_assert(p != NULL);
+    return p;
+}
+
+static Oc_meta_data_page_hndl* node_alloc(Oc_wu *wu_p)
+{
+    Oc_meta_data_page_hndl *node_p;
+
+    node_p = (Oc_meta_data_page_hndl*) wrap_malloc(sizeof(Oc_meta_data_page_hndl));
+    memset(node_p, 0, sizeof(Oc_meta_data_page_hndl));
+    oc_crt_init_rw_lock(&node_p->lock);
+    node_p->data = (char*) wrap_malloc(NODE_SIZE);
+    memset(node_p->data, 0, NODE_SIZE);
+    node_p->disk_addr = vd_next_addr++;
+    oc_utl_rhtbl_insert(&vd_htbl, (void*)&node_p->disk_addr, (void*)node_p);
+    vd_refcnt++;
+
+    return node_p;
+}
+
+static void node_dealloc(Oc_wu *wu_p, uint64 addr)
+{
+    Oc_meta_data_page_hndl *node_p;
+
+    node_p = (Oc_meta_data_page_hndl*) oc_utl_rhtbl_extract(&vd_htbl, (void*)&addr);
+    oc_utl_assert(node_p);
+    free(node_p->data);
+    free(node_p);
+}
+
+static Oc_meta_data_page_hndl* node_get(Oc_wu *wu_p, uint64 addr)
+{
+    Oc_meta_data_page_hndl *node_p;
+
+    node_p = (Oc_meta_data_page_hndl*) oc_utl_rhtbl_lookup(&vd_htbl, (void*)&addr);
+    if (NULL == node_p)
+        ERR(("did not find a node at address=%Lu", addr));
+    vd_refcnt++;
+    return node_p;
+}
+
+// nodes never move in this store, no need to re-check the address
+static Oc_meta_data_page_hndl* node_get_sl(Oc_wu *wu_p, uint64 addr)
+{
+    Oc_meta_data_page_hndl *node_p = node_get(wu_p, addr);
+
+    oc_utl_trk_crt_lock_read(wu_p, &node_p->lock);
+    return node_p;
+}
+
+static Oc_meta_data_page_hndl* node_get_xl(Oc_wu *wu_p, uint64 addr)
+{
+    Oc_meta_data_page_hndl *node_p = node_get(wu_p, addr);
+
+    oc_utl_trk_crt_lock_write(wu_p, &node_p->lock);
+    return node_p;
+}
+
+static void node_release(Oc_wu *wu_p, Oc_meta_data_page_hndl *node_p)
+{
+    vd_refcnt--;
+    oc_utl_assert(vd_refcnt >= 0);
+}
+
+static void node_mark_dirty(Oc_wu *wu_p, Oc_meta_data_page_hndl *node_p)
+{
+}
+
+/**********************************************************************/
+
+static uint32 random_choose(uint32 top)
+{
+    if (0 == top) return 0;
+    return (uint32) (rand() % top);
+}
+
+static void check(Oc_wu *wu_p)
+{
+    uint64 i;
+
+    if (!oc_fs_dbg_validate_b(wu_p, &state))
+        ERR(("the free-space indexes are not valid"));
+    if (oc_fs_num_free(&state) != ref_num_free)
+        ERR(("free blocks=%Lu, expected=%Lu",
+             oc_fs_num_free(&state), ref_num_free));
+
+    for (i=0; i<num_blocks; i++) {
+        uint32 cnt = oc_fs_get_refcount_b(wu_p, &state, FIRST_BLOCK + i);
+
+        if (cnt != ref_arr[i])
+            ERR(("block %Lu has ref-count %lu, expected %lu",
+                 FIRST_BLOCK + i, cnt, ref_arr[i]));
+    }
+}
+
+// record a new allocation in the reference array
+static void mark_alloc(uint64 addr, uint64 len)
+{
+    uint64 i;
+
+    oc_utl_assert(addr >= FIRST_BLOCK);
+    oc_utl_assert(addr + len <= FIRST_BLOCK + num_blocks);
+    for (i=addr-FIRST_BLOCK; i<addr-FIRST_BLOCK+len; i++) {
+        if (ref_arr[i] != 0)
+            ERR(("block %Lu was allocated twice", FIRST_BLOCK + i));
+        ref_arr[i] = 1;
+    }
+    ref_num_free -= len;
+}
+
+// Return TRUE if there is a free run of [len] blocks
+static bool ref_has_run(uint64 len)
+{
+    uint64 i, run = 0;
+
+    for (i=0; i<num_blocks; i++) {
+        run = (0 == ref_arr[i]) ? run + 1 : 0;
+        if (run >= len)
+            return TRUE;
+    }
+    return FALSE;
+}
+
+// choose an allocated block, return FALSE if there are none
+static bool choose_allocated(uint64 *ofs_po)
+{
+    uint64 start = random_choose(num_blocks), i;
+
+    for (i=0; i<num_blocks; i++) {
+        uint64 ofs = (start + i) % num_blocks;
+        if (ref_arr[ofs] > 0) {
+            *ofs_po = ofs;
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+static void test_alloc(Oc_wu *wu_p, bool near)
+{
+    uint64 len = 1 + random_choose(random_choose(4) == 0 ? 64 : 8);
+    uint64 hint = FIRST_BLOCK + random_choose(num_blocks);
+    uint64 addr, i;
+    bool rc, hint_free = (hint + len <= FIRST_BLOCK + num_blocks);
+
+    for (i=hint; hint_free && i<hint+len; i++)
+        if (ref_arr[i - FIRST_BLOCK] != 0)
+            hint_free = FALSE;
+
+    if (near)
+        rc = oc_fs_alloc_near_b(wu_p, &state, hint, len, &addr);
+    else
+        rc = oc_fs_alloc_b(wu_p, &state, len, &addr);
+
+    if (rc) {
+        if (verbose)
+            printf("alloc%s %Lu-%Lu\n", near ? "_near" : "", addr, addr+len-1);
+        mark_alloc(addr, len);
+
+        // a near-hint allocation takes the hint itself when it is free
+        if (near && hint_free && addr != hint)
+            ERR(("blocks %Lu-%Lu are free, but %Lu was allocated",
+                 hint, hint+len-1, addr));
+    }
+    else if (ref_has_run(len))
+        ERR(("allocation of %Lu blocks failed, but there is room", len));
+}
+
+static void test_dealloc(Oc_wu *wu_p)
+{
+    uint64 ofs, end, i;
+
+    if (!choose_allocated(&ofs))
+        return;
+
+    // release a run of allocated blocks
+    end = ofs;
+    while (end + 1 < num_blocks &&
+           ref_arr[end + 1] > 0 &&
+           end - ofs < 32)
+        end++;
+    if (verbose)
+        printf("dealloc %Lu-%Lu\n", FIRST_BLOCK + ofs, FIRST_BLOCK + end);
+
+    oc_fs_dealloc_b(wu_p, &state, FIRST_BLOCK + ofs, end - ofs + 1);
+    for (i=ofs; i<=end; i++) {
+        ref_arr[i]--;
+        if (0 == ref_arr[i])
+            ref_num_free++;
+    }
+}
+
+static void test_inc_refcount(Oc_wu *wu_p)
+{
+    uint64 ofs;
+
+    if (!choose_allocated(&ofs))
+        return;
+    if (verbose)
+        printf("inc_refcount %Lu\n", FIRST_BLOCK + ofs);
+    oc_fs_inc_refcount_b(wu_p, &state, FIRST_BLOCK + ofs);
+    ref_arr[ofs]++;
+}
+
+static void test_round(Oc_wu *wu_p)
+{
+    int i;
+    uint64 addr;
+
+    oc_fs_init_state_b(wu_p, &state, &cfg);
+    oc_fs_create_b(wu_p, &state, FIRST_BLOCK, num_blocks);
+    memset(ref_arr, 0, sizeof(uint32) * num_blocks);
+    ref_num_free = num_blocks;
+
+    for (i=0; i<num_ops; i++) {
+        switch (random_choose(6)) {
+        case 0:
+        case 1:
+            test_alloc(wu_p, FALSE);
+            break;
+        case 2:
+            test_alloc(wu_p, TRUE);
+            break;
+        case 3:
+        case 4:
+            test_dealloc(wu_p);
+            break;
+        case 5:
+            test_inc_refcount(wu_p);
+            break;
+        }
+        if (i % 200 == 0)
+            check(wu_p);
+    }
+    check(wu_p);
+
+    // release everything; the free-space should coalesce back into one extent
+    for (addr=0; addr<num_blocks; addr++)
+        while (ref_arr[addr] > 0) {
+            oc_fs_dealloc_b(wu_p, &state, FIRST_BLOCK + addr, 1);
+            if (0 == --ref_arr[addr])
+                ref_num_free++;
+        }
+    check(wu_p);
+    if (!oc_fs_alloc_b(wu_p, &state, num_blocks, &addr) ||
+        addr != FIRST_BLOCK)
+        ERR(("the free-space did not coalesce"));
+    oc_fs_dealloc_b(wu_p, &state, addr, num_blocks);
+
+    oc_fs_delete_b(wu_p, &state);
+    if (oc_utl_rhtbl_size(&vd_htbl) != 0)
+        ERR(("%lu index pages were not freed", oc_utl_rhtbl_size(&vd_htbl)));
+}
+
+/**********************************************************************/
+
+static void help_msg(void)
+{
+    printf("oc_fs_test: test the free-space allocator\n");
+    printf("    -num_rounds <int>\n");
+    printf("    -num_ops <int>      number of operations in a round\n");
+    printf("    -num_blocks <int>   number of managed blocks\n");
+    printf("    -fanout <int>       maximal fanout of the index nodes\n");
+    printf("    -verbose\n");
+    exit(1);
+}
+
+static void parse_cmd_line(int argc, char *argv[])
+{
+    int i;
+
+    for (i=1; i<argc; i++) {
+        if (strcmp(argv[i], "-verbose") == 0)
+            verbose = TRUE;
+        else if (i+1 >= argc)
+            help_msg();
+        else if (strcmp(argv[i], "-num_rounds") == 0)
+            num_rounds = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-num_ops") == 0)
+            num_ops = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-num_blocks") == 0)
+            num_blocks = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-fanout") == 0)
+            fanout = atoi(argv[++i]);
+        else
+            help_msg();
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    Oc_wu wu;
+    Oc_rm_ticket rm;
+    int i;
+
+    pl_trace_base_init();
+    parse_cmd_line(argc, argv);
+    pl_trace_base_init_done();
+
+    memset(&wu, 0, sizeof(wu));
+    memset(&rm, 0, sizeof(rm));
+    wu.rm_p = &rm;
+
+    oc_utl_rhtbl_create(&vd_htbl, 2048, FALSE, vd_hash, vd_compare);
+    ref_arr = (uint32*) wrap_malloc(sizeof(uint32) * num_blocks);
+
+    oc_fs_init();
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.node_size = NODE_SIZE;
+    cfg.root_fanout = fanout;
+    cfg.non_root_fanout = fanout;
+    cfg.node_alloc = node_alloc;
+    cfg.node_dealloc = node_dealloc;
+    cfg.node_get_sl = node_get_sl;
+    cfg.node_get_xl = node_get_xl;
+    cfg.node_release = node_release;
+    cfg.node_mark_dirty = node_mark_dirty;
+    oc_fs_init_config(&cfg);
+
+    for (i=0; i<num_rounds; i++) {
+        test_round(&wu);
+        printf("// round %d\n", i); fflush(stdout);
+    }
+
+    free(ref_arr);
+    oc_utl_rhtbl_free(&vd_htbl);
+    printf("done fs test\n");
+    return 0;
+}
@@ -0,0 +1,38 @@
+#!/bin/bash -x
+
+#-----------------------------------------------------------------
+# Read command line parameters into -flags-
+flags=$*
+
+ocroot=../../../..
+oc_fs_test=$ocroot/bin/oc_fs_test
+
+if test ! -x $oc_fs_test
+then
+	echo Error: executable $oc_fs_test not found
+	echo aborting
+	exit 1
+fi
+
+#-----------------------------------------------------------------
+# run with small fanouts, so that the index trees grow deep
+
+for fanout in 6 11 0
+  do
+  for num_blocks in 500 5000
+    do
+    exec_flags="-fanout $fanout -num_blocks $num_blocks -num_rounds 5 $flags"
+    echo "Running $oc_fs_test $exec_flags"
+    $oc_fs_test $exec_flags
+
+    if test $? -ne 0
+	then
+	echo "-----------------------------------------------"
+	echo "Failure of test: $oc_fs_test $exec_flags"
+	echo "-----------------------------------------------"
+	exit 1
+    fi
+  done
+done
+
+#-----------------------------------------------------------------
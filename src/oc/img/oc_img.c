@@ -0,0 +1,446 @@
+/**************************************************************/
+/*
+ * Copyright (c) 2014-2015, Ohad Rodeh, IBM Research
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer. 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution. 
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies, 
+ * either expressed or implied, of IBM Research.
+ * 
+ */
+/**************************************************************/
+/**********************************************************************/
+/* OC_IMG.C
+ *
+ * While an image is written, its nodes are kept in private buffers.
+ * Node addresses are handed out sequentially, starting after the
+ * header, and a node is written to its address when the tree releases
+ * it. The tree is built bottom-up, so a node is complete once it is
+ * released. The root is written last, and the header only after all
+ * the nodes are on disk.
+ *
+ * An open image keeps a handle for every node it has handed out, in a
+ * directory indexed by node number. The directory is an anonymous
+ * mapping, so it costs nothing until it is used. A handle points into
+ * the mapping of the file, nodes are never copied. Handles are created
+ * without locking; when two tasks race, one of them discards its
+ * handle.
+ */
+/**********************************************************************/
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "pl_mm_int.h"
+#include "oc_utl.h"
+#include "oc_utl_trk.h"
+#include "oc_crt_int.h"
+#include "oc_wu_s.h"
+#include "oc_img_int.h"
+
+/**********************************************************************/
+#define OC_IMG_HDR_EYE "IMHD"
+#define OC_IMG_ND_EYE "IMND"
+
+// The header, at the beginning of the first block of the file
+typedef struct Oc_img_hdr {
+    Oc_meta_data_page_hdr hdr;
+    uint64 node_size;
+    uint64 key_size;
+    uint64 data_size;
+    uint64 max_num_ent_leaf_node;
+    uint64 max_num_ent_index_node;
+    uint64 max_num_ent_root_node;
+    uint64 num_nodes;          // including the root
+    uint64 root_addr;
+} OC_PACKED Oc_img_hdr;
+
+// The image being written
+typedef struct Oc_img_writer {
+    int fd;
+    Oc_bpt_cfg cfg;
+    uint64 next_addr;
+    uint64 num_nodes;
+} Oc_img_writer;
+
+// The open image
+typedef struct Oc_img {
+    char *base;                // the mapping of the file
+    uint64 size;
+    Oc_img_hdr hdr;
+    Oc_bpt_node **hndl_arr;    // indexed by the node number
+    uint64 nodes_verified;
+} Oc_img;
+
+static Oc_img_writer wr;
+static Oc_img img;
+
+/**********************************************************************/
+
+static void write_all(char *buf_p, int len, uint64 ofs)
+{
+    ssize_t rc;
+
+    while (len > 0) {
+        rc = pwrite(wr.fd, buf_p, len, (off_t) ofs);
+        if (rc < 0) {
+            if (EINTR == errno) continue;
+            ERR(("write of %d bytes at offset %Lu failed, errno=%d",
+                 len, ofs, errno));
+        }
+        buf_p += rc;
+        len -= rc;
+        ofs += rc;
+    }
+}
+
+static void sync_file(void)
+{
+    if (fdatasync(wr.fd) != 0)
+        ERR(("could not sync the image, errno=%d", errno));
+}
+
+/* The checksum of a block, computed as if its crc field was zero. The
+ * block is not modified, it may be part of the mapping.
+ */
+static uint32 block_crc(const char *data_p, int len)
+{
+    Oc_meta_data_page_hdr hdr;
+    uint32 crc;
+
+    memcpy(&hdr, data_p, sizeof(hdr));
+    hdr.crc = 0;
+    crc = oc_utl_crc32c_update(oc_utl_crc32c_init(),
+                               (const char*) &hdr, sizeof(hdr));
+    return oc_utl_crc32c_update(crc, data_p + sizeof(hdr),
+                                len - sizeof(hdr));
+}
+
+// Set the eye-catcher and the checksum of a block
+static void block_seal(char *data_p, int len, const char *eye_p)
+{
+    Oc_meta_data_page_hdr *hdr_p = (Oc_meta_data_page_hdr*) data_p;
+
+    memcpy(hdr_p->eye_catcher, eye_p, 4);
+    hdr_p->crc = block_crc(data_p, len);
+}
+
+static bool block_valid(const char *data_p, int len, const char *eye_p)
+{
+    const Oc_meta_data_page_hdr *hdr_p =
+        (const Oc_meta_data_page_hdr*) data_p;
+
+    return (memcmp(hdr_p->eye_catcher, eye_p, 4) == 0 &&
+            block_crc(data_p, len) == hdr_p->crc);
+}
+
+static Oc_bpt_node *hndl_new(char *data_p, uint64 addr)
+{
+    Oc_bpt_node *node_p;
+
+    node_p = (Oc_bpt_node*) pl_mm_malloc(sizeof(Oc_bpt_node));
+    memset(node_p, 0, sizeof(Oc_bpt_node));
+    oc_crt_init_rw_lock(&node_p->lock);
+    node_p->data = data_p;
+    node_p->disk_addr = addr;
+    return node_p;
+}
+
+// The nodes of an image hold as many entries as they can
+static void set_fanout(Oc_bpt_cfg *cfg_p)
+{
+    // the entry directory of a node has 256 slots
+    cfg_p->root_fanout = 256;
+    cfg_p->non_root_fanout = 256;
+    cfg_p->min_num_ent = 0;
+}
+
+/**********************************************************************/
+// Node functions that are not supported
+
+static Oc_bpt_node* ro_node_alloc(struct Oc_wu *wu_p)
+{
+    ERR(("an image is read-only"));
+    return NULL;
+}
+
+static void ro_node_dealloc(struct Oc_wu *wu_p, uint64 addr)
+{
+    ERR(("an image is read-only"));
+}
+
+static Oc_bpt_node* ro_node_get(struct Oc_wu *wu_p, uint64 addr)
+{
+    ERR(("an image is read-only"));
+    return NULL;
+}
+
+static void ro_node_mark_dirty(struct Oc_wu *wu_p,
+                               Oc_bpt_node *node_p,
+                               bool multiple_refs)
+{
+    ERR(("an image is read-only"));
+}
+
+static void ro_fs_inc_refcount(struct Oc_wu *wu_p, uint64 addr)
+{
+    ERR(("an image is read-only"));
+}
+
+static int ro_fs_get_refcount(struct Oc_wu *wu_p, uint64 addr)
+{
+    ERR(("an image is read-only"));
+    return 0;
+}
+
+/**********************************************************************/
+// Writing an image
+
+static Oc_bpt_node* wr_node_alloc(struct Oc_wu *wu_p)
+{
+    Oc_bpt_node *node_p;
+    char *data_p;
+
+    data_p = (char*) pl_mm_malloc(wr.cfg.node_size);
+    memset(data_p, 0, wr.cfg.node_size);
+    node_p = hndl_new(data_p, wr.next_addr);
+    wr.next_addr += wr.cfg.node_size;
+    wr.num_nodes++;
+
+    oc_utl_trk_crt_lock_write(wu_p, &node_p->lock);
+    return node_p;
+}
+
+static void wr_node_write(Oc_bpt_node *node_p)
+{
+    block_seal(node_p->data, wr.cfg.node_size, OC_IMG_ND_EYE);
+    write_all(node_p->data, wr.cfg.node_size, node_p->disk_addr);
+    pl_mm_free(node_p->data);
+    pl_mm_free(node_p);
+}
+
+// The tree releases a node once it is complete
+static void wr_node_release(struct Oc_wu *wu_p, Oc_bpt_node *node_p)
+{
+    oc_utl_trk_crt_unlock(wu_p, &node_p->lock);
+    wr_node_write(node_p);
+}
+
+void oc_img_write_b(
+    struct Oc_wu *wu_p,
+    struct Oc_bpt_state *s_p,
+    const char *path_p)
+{
+    Oc_bpt_state trg;
+    Oc_img_hdr *hdr_p;
+    char *blk_p;
+
+    if (s_p->cfg_p->node_size % OC_IMG_ALIGN != 0)
+        ERR(("the node size, %d, is not a multiple of %d",
+             s_p->cfg_p->node_size, OC_IMG_ALIGN));
+
+    memset(&wr, 0, sizeof(wr));
+    wr.fd = open(path_p, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (wr.fd < 0)
+        ERR(("could not open %s, errno=%d", path_p, errno));
+
+    // the first block is for the header
+    wr.next_addr = s_p->cfg_p->node_size;
+
+    memcpy(&wr.cfg, s_p->cfg_p, sizeof(Oc_bpt_cfg));
+    set_fanout(&wr.cfg);
+    wr.cfg.node_alloc = wr_node_alloc;
+    wr.cfg.node_dealloc = ro_node_dealloc;
+    wr.cfg.node_get_sl = ro_node_get;
+    wr.cfg.node_get_xl = ro_node_get;
+    wr.cfg.node_release = wr_node_release;
+    wr.cfg.node_mark_dirty = ro_node_mark_dirty;
+    wr.cfg.fs_inc_refcount = ro_fs_inc_refcount;
+    wr.cfg.fs_get_refcount = ro_fs_get_refcount;
+    oc_bpt_init_config(&wr.cfg);
+
+    oc_bpt_init_state_b(wu_p, &trg, &wr.cfg, s_p->tid);
+    oc_bpt_compact_copy_b(wu_p, s_p, &trg);
+
+    // the root is the one node the tree does not release
+    wr_node_write(trg.root_node_p);
+    sync_file();
+
+    blk_p = (char*) pl_mm_malloc(wr.cfg.node_size);
+    memset(blk_p, 0, wr.cfg.node_size);
+    hdr_p = (Oc_img_hdr*) blk_p;
+    hdr_p->node_size = wr.cfg.node_size;
+    hdr_p->key_size = wr.cfg.key_size;
+    hdr_p->data_size = wr.cfg.data_size;
+    hdr_p->max_num_ent_leaf_node = wr.cfg.max_num_ent_leaf_node;
+    hdr_p->max_num_ent_index_node = wr.cfg.max_num_ent_index_node;
+    hdr_p->max_num_ent_root_node = wr.cfg.max_num_ent_root_node;
+    hdr_p->num_nodes = wr.num_nodes;
+    hdr_p->root_addr = trg.root_node_p->disk_addr;
+    block_seal(blk_p, wr.cfg.node_size, OC_IMG_HDR_EYE);
+    write_all(blk_p, wr.cfg.node_size, 0);
+    sync_file();
+    pl_mm_free(blk_p);
+
+    close(wr.fd);
+    memset(&wr, 0, sizeof(wr));
+}
+
+/**********************************************************************/
+// Reading an image
+
+static Oc_bpt_node* img_node_get_sl(struct Oc_wu *wu_p, uint64 addr)
+{
+    uint64 idx = addr / img.hdr.node_size;
+    Oc_bpt_node *node_p;
+
+    if (addr % img.hdr.node_size != 0 ||
+        0 == idx ||
+        idx > img.hdr.num_nodes)
+        ERR(("there is no node at address %Lu in the image", addr));
+
+    node_p = img.hndl_arr[idx];
+    if (node_p != NULL)
+        return node_p;
+
+    // the first time the node is reached
+    if (!block_valid(img.base + addr, img.hdr.node_size, OC_IMG_ND_EYE))
+        ERR(("the node at address %Lu of the image is corrupt", addr));
+    node_p = hndl_new(img.base + addr, addr);
+    if (!__sync_bool_compare_and_swap(&img.hndl_arr[idx], NULL, node_p)) {
+        // another task created the handle first
+        pl_mm_free(node_p);
+        return img.hndl_arr[idx];
+    }
+    __sync_fetch_and_add(&img.nodes_verified, 1);
+    return node_p;
+}
+
+static void img_node_release(struct Oc_wu *wu_p, Oc_bpt_node *node_p)
+{
+}
+
+void oc_img_set_bpt_cfg(Oc_bpt_cfg *cfg_p)
+{
+    set_fanout(cfg_p);
+    cfg_p->node_alloc = ro_node_alloc;
+    cfg_p->node_dealloc = ro_node_dealloc;
+    cfg_p->node_get_sl = img_node_get_sl;
+    cfg_p->node_get_xl = ro_node_get;
+    cfg_p->node_release = img_node_release;
+    cfg_p->node_mark_dirty = ro_node_mark_dirty;
+    cfg_p->fs_inc_refcount = ro_fs_inc_refcount;
+    cfg_p->fs_get_refcount = ro_fs_get_refcount;
+}
+
+void oc_img_init(void)
+{
+    memset(&img, 0, sizeof(img));
+    memset(&wr, 0, sizeof(wr));
+}
+
+void oc_img_open(const char *path_p)
+{
+    struct stat st;
+    Oc_img_hdr *hdr_p;
+    int fd;
+
+    oc_utl_assert(NULL == img.base);
+    fd = open(path_p, O_RDONLY);
+    if (fd < 0)
+        ERR(("could not open %s, errno=%d", path_p, errno));
+    if (fstat(fd, &st) != 0)
+        ERR(("could not get the size of %s, errno=%d", path_p, errno));
+    img.size = (uint64) st.st_size;
+    if (img.size < sizeof(Oc_img_hdr))
+        ERR(("%s is not an image", path_p));
+
+    img.base = (char*) mmap(NULL, img.size, PROT_READ, MAP_SHARED, fd, 0);
+    if (MAP_FAILED == img.base)
+        ERR(("could not map %s, errno=%d", path_p, errno));
+    close(fd);
+
+    // check the header before trusting its sizes
+    hdr_p = (Oc_img_hdr*) img.base;
+    if (memcmp(hdr_p->hdr.eye_catcher, OC_IMG_HDR_EYE, 4) != 0 ||
+        hdr_p->node_size < sizeof(Oc_img_hdr) ||
+        hdr_p->node_size % OC_IMG_ALIGN != 0 ||
+        img.size != (hdr_p->num_nodes + 1) * hdr_p->node_size ||
+        !block_valid(img.base, hdr_p->node_size, OC_IMG_HDR_EYE))
+        ERR(("%s is not a valid image", path_p));
+    memcpy(&img.hdr, hdr_p, sizeof(Oc_img_hdr));
+
+    img.hndl_arr = (Oc_bpt_node**) mmap(
+        NULL, (img.hdr.num_nodes + 1) * sizeof(Oc_bpt_node*),
+        PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED == img.hndl_arr)
+        ERR(("could not allocate the node directory, errno=%d", errno));
+}
+
+void oc_img_open_tree(struct Oc_wu *wu_p, struct Oc_bpt_state *s_p)
+{
+    Oc_bpt_cfg *cfg_p = s_p->cfg_p;
+
+    oc_utl_assert(img.base != NULL);
+    oc_utl_assert(NULL == s_p->root_node_p);
+    oc_utl_assert(img_node_get_sl == cfg_p->node_get_sl);
+    oc_utl_debugassert(cfg_p->initialized);
+
+    if (cfg_p->key_size != (int) img.hdr.key_size ||
+        cfg_p->data_size != (int) img.hdr.data_size ||
+        cfg_p->node_size != (int) img.hdr.node_size)
+        ERR(("the configuration does not match the image"));
+    if (cfg_p->max_num_ent_leaf_node < (int) img.hdr.max_num_ent_leaf_node ||
+        cfg_p->max_num_ent_index_node < (int) img.hdr.max_num_ent_index_node ||
+        cfg_p->max_num_ent_root_node < (int) img.hdr.max_num_ent_root_node)
+        ERR(("the nodes of the image are larger than the configuration allows"));
+
+    // the root is not locked, [oc_bpt_open_b] cannot be used
+    s_p->root_node_p = img_node_get_sl(wu_p, img.hdr.root_addr);
+}
+
+void oc_img_close(void)
+{
+    uint64 idx;
+
+    oc_utl_assert(img.base != NULL);
+    for (idx=1; idx<=img.hdr.num_nodes; idx++)
+        if (img.hndl_arr[idx] != NULL)
+            pl_mm_free(img.hndl_arr[idx]);
+    munmap(img.hndl_arr, (img.hdr.num_nodes + 1) * sizeof(Oc_bpt_node*));
+    munmap(img.base, img.size);
+    oc_img_init();
+}
+
+void oc_img_get_stats(Oc_img_stats *stats_po)
+{
+    stats_po->num_nodes = img.hdr.num_nodes;
+    stats_po->nodes_verified = img.nodes_verified;
+}
+
+/**********************************************************************/
@@ -0,0 +1,107 @@
+/**************************************************************/
+/*
+ * Copyright (c) 2014-2015, Ohad Rodeh, IBM Research
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer. 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution. 
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies, 
+ * either expressed or implied, of IBM Research.
+ * 
+ */
+/**************************************************************/
+/******************************************************************/
+/* OC_IMG_INT.H
+ *
+ * Tree images. An image holds a single b-tree in a file, in a form that
+ * is never modified. It is written once, from an existing tree, and is
+ * then opened by mapping the file into memory, read-only. Opening an
+ * image does not read the tree; a node is brought in by the virtual
+ * memory system when a lookup first reaches it, and its checksum is
+ * verified at that time.
+ *
+ * The tree in an image is built bottom-up, from nodes that hold as
+ * many entries as the node size allows, see [oc_bpt_compact_copy_b].
+ * The first block of the file holds the header, and the nodes follow
+ * it. A node refers to its children by their offset in the file. The
+ * node size has to be a multiple of the cache-line size, so that every
+ * node starts on a cache-line.
+ *
+ * The node functions of an image do not lock the nodes. Lookups still
+ * take the tree lock, for read. Only one image can be open at a time.
+ */
+/******************************************************************/
+#ifndef OC_IMG_INT_H
+#define OC_IMG_INT_H
+
+#include "pl_base.h"
+#include "oc_utl_s.h"
+#include "oc_bpt_int.h"
+
+struct Oc_wu;
+
+/******************************************************************/
+
+// Nodes are aligned on this boundary
+#define OC_IMG_ALIGN (64)
+
+typedef struct Oc_img_stats {
+    uint64 num_nodes;
+    uint64 nodes_verified;     // nodes reached since the image was opened
+} Oc_img_stats;
+
+/******************************************************************/
+
+void oc_img_init(void);
+
+/* Write tree [s_p] into a new image in file [path_p]. The tree is
+ * locked for read during this operation. Its data is copied as is.
+ */
+void oc_img_write_b(
+    struct Oc_wu *wu_p,
+    struct Oc_bpt_state *s_p,
+    const char *path_p);
+
+// Open the image in file [path_p]. Only the header is read.
+void oc_img_open(const char *path_p);
+
+/* Set the node functions of [cfg_p], so that the tree is read from the
+ * open image. The fanouts are set to the largest ones the node size
+ * allows, as in the image. Lookups and scans are supported, operations
+ * that modify the tree fail.
+ */
+void oc_img_set_bpt_cfg(Oc_bpt_cfg *cfg_p);
+
+/* Set the root of [s_p] to that of the tree in the open image. The
+ * state has to be initialized, with a configuration set by
+ * [oc_img_set_bpt_cfg], and not hold a tree.
+ */
+void oc_img_open_tree(struct Oc_wu *wu_p, struct Oc_bpt_state *s_p);
+
+/* Close the image. The trees opened on it cannot be used after this
+ * call.
+ */
+void oc_img_close(void);
+
+void oc_img_get_stats(Oc_img_stats *stats_po);
+
+#endif
@@ -0,0 +1,410 @@
+/**************************************************************/
+/*
+ * Copyright (c) 2014-2015, Ohad Rodeh, IBM Research
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer. 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution. 
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies, 
+ * either expressed or implied, of IBM Research.
+ * 
+ */
+/**************************************************************/
+/**********************************************************************/
+/* OC_IMG_TEST.C
+ *
+ * Test tree images. Each round builds a tree in the page manager, with
+ * a random number of keys, writes an image of it, and closes the page
+ * manager. The image is then opened, and several tasks look up keys
+ * and ranges in it concurrently, and compare them with a model.
+ */
+/**********************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pl_int.h"
+#include "pl_trace_base.h"
+#include "oc_utl.h"
+#include "oc_utl_trk.h"
+#include "oc_crt_int.h"
+#include "oc_rm_s.h"
+#include "oc_wu_s.h"
+#include "oc_bpt_int.h"
+#include "oc_pm_int.h"
+#include "oc_img_int.h"
+
+/**********************************************************************/
+// configuration defined on the command line
+static int num_rounds = 10;
+static int num_ops = 2000;
+static int num_tasks = 8;
+static uint32 max_key = 20000;
+static int fanout = 20;
+static char *dev_p = "/tmp/oc_img_test.dev";
+static char *img_p = "/tmp/oc_img_test.img";
+static bool verbose = FALSE;
+
+/* Small nodes, so that the image has several levels. The page manager
+ * needs a multiple of the sector size.
+ */
+#define BLOCK_SIZE (1024)
+#define NUM_BLOCKS (40000)
+
+// the number of entries compared at a time
+#define CMP_BATCH (64)
+
+static Oc_bpt_cfg pm_cfg, img_cfg;
+static Oc_crt_sema sema;
+
+// The data of each key in the image, zero if the key is absent
+static uint32 *model;
+
+static Oc_bpt_state img_tree;
+
+/**********************************************************************/
+
+static uint32 random_choose(uint32 top)
+{
+    if (0 == top) return 0;
+    return (uint32) (rand() % top);
+}
+
+static void setup_wu(Oc_wu *wu_p, Oc_rm_ticket *rm_p, int po_id)
+{
+    memset(wu_p, 0, sizeof(Oc_wu));
+    memset(rm_p, 0, sizeof(Oc_rm_ticket));
+    wu_p->po_id = po_id;
+    wu_p->rm_p = rm_p;
+}
+
+/**********************************************************************/
+// keys and data are uint32
+
+static int key_compare(struct Oc_bpt_key *key1_p, struct Oc_bpt_key *key2_p)
+{
+    uint32 key1 = *((uint32*) key1_p);
+    uint32 key2 = *((uint32*) key2_p);
+
+    if (key1 == key2) return 0;
+    if (key1 < key2) return 1;
+    return -1;
+}
+
+static void key_inc(struct Oc_bpt_key *key_p, struct Oc_bpt_key *result_p)
+{
+    *((uint32*) result_p) = *((uint32*) key_p) + 1;
+}
+
+static void key_to_string(struct Oc_bpt_key *key_p, char *str_p, int max_len)
+{
+    snprintf(str_p, max_len, "%lu", *((uint32*) key_p));
+}
+
+static void data_release(struct Oc_wu *wu_p, struct Oc_bpt_data *data_p)
+{
+}
+
+static void data_to_string(struct Oc_bpt_data *data_p, char *str_p, int max_len)
+{
+    snprintf(str_p, max_len, "%lu", *((uint32*) data_p));
+}
+
+static void init_cfg(Oc_bpt_cfg *cfg_p)
+{
+    memset(cfg_p, 0, sizeof(Oc_bpt_cfg));
+    cfg_p->key_size = sizeof(uint32);
+    cfg_p->data_size = sizeof(uint32);
+    cfg_p->node_size = BLOCK_SIZE;
+    cfg_p->key_compare = key_compare;
+    cfg_p->key_inc = key_inc;
+    cfg_p->key_to_string = key_to_string;
+    cfg_p->data_release = data_release;
+    cfg_p->data_to_string = data_to_string;
+}
+
+/**********************************************************************/
+
+/* Check the keys of the image in [lo_key, hi_key] against the model.
+ * At most [max_num] keys are looked up at a time.
+ */
+static void compare_range(Oc_wu *wu_p, uint32 lo_key, uint32 hi_key,
+                          int max_num)
+{
+    uint32 keys[CMP_BATCH], data[CMP_BATCH];
+    uint32 min_key = lo_key, key;
+    int i, n;
+
+    oc_utl_assert(max_num <= CMP_BATCH);
+    do {
+        oc_bpt_lookup_range_b(wu_p, &img_tree,
+                              (struct Oc_bpt_key*) &min_key,
+                              (struct Oc_bpt_key*) &hi_key,
+                              max_num,
+                              (struct Oc_bpt_key*) keys,
+                              (struct Oc_bpt_data*) data, &n);
+        for (i=0; i<n; i++) {
+            for (key = min_key; key < keys[i]; key++)
+                if (model[key] != 0)
+                    ERR(("key %lu is missing", key));
+            if (model[keys[i]] != data[i])
+                ERR(("key %lu has data %lu, expected %lu",
+                     keys[i], data[i], model[keys[i]]));
+            min_key = keys[i] + 1;
+        }
+    } while (max_num == n && min_key <= hi_key);
+
+    for (key = min_key; key <= hi_key; key++)
+        if (model[key] != 0)
+            ERR(("key %lu is missing", key));
+}
+
+// Tasks look up keys, and short ranges, in the image
+static void *task_run(void *_arg)
+{
+    int id = (int) (long) _arg;
+    Oc_wu wu;
+    Oc_rm_ticket rm;
+    uint32 key, hi_key, data;
+    int i;
+    bool found;
+
+    setup_wu(&wu, &rm, id + 1);
+    for (i=0; i<num_ops; i++) {
+        key = random_choose(max_key);
+        switch (random_choose(2)) {
+        case 0:
+            found = oc_bpt_lookup_key_b(&wu, &img_tree,
+                                        (struct Oc_bpt_key*) &key,
+                                        (struct Oc_bpt_data*) &data);
+            if (found != (model[key] != 0) ||
+                (found && data != model[key]))
+                ERR(("lookup of key %lu does not match the model", key));
+            break;
+        case 1:
+            hi_key = key + random_choose(500);
+            hi_key = MIN(hi_key, max_key - 1);
+            compare_range(&wu, key, hi_key, 1 + random_choose(CMP_BATCH));
+            break;
+        }
+    }
+
+    oc_crt_sema_post(&sema);
+    return NULL;
+}
+
+static void run_tasks(void)
+{
+    int i;
+
+    for (i=0; i<num_tasks; i++)
+        oc_crt_create_task("img_task", task_run, (void*) (long) i);
+    for (i=0; i<num_tasks; i++)
+        oc_crt_sema_wait(&sema);
+}
+
+/**********************************************************************/
+
+/* Build a tree with about [num_keys] keys in the page manager, and
+ * write its image. Some of the keys are removed again, so that the
+ * nodes of the tree are not full. Return the number of nodes in the
+ * tree.
+ */
+static uint64 build_image(Oc_wu *wu_p, uint32 num_keys)
+{
+    Oc_bpt_state tree;
+    Oc_pm_stats stats;
+    uint64 base_used;
+    uint32 i, key, data;
+
+    oc_pm_create_b(wu_p, dev_p, BLOCK_SIZE, NUM_BLOCKS);
+    oc_pm_get_stats(&stats);
+    base_used = stats.num_used;
+
+    oc_bpt_init_state_b(wu_p, &tree, &pm_cfg, 1);
+    oc_bpt_create_b(wu_p, &tree);
+    oc_pm_tree_add(wu_p, 1, tree.root_node_p->disk_addr);
+
+    memset(model, 0, max_key * sizeof(uint32));
+    for (i=0; i<num_keys; i++) {
+        key = random_choose(max_key);
+        data = 1 + random_choose(100000);
+        oc_bpt_insert_key_b(wu_p, &tree, (struct Oc_bpt_key*) &key,
+                            (struct Oc_bpt_data*) &data);
+        model[key] = data;
+    }
+    for (i=0; i<num_keys/4; i++) {
+        key = random_choose(max_key);
+        oc_bpt_remove_key_b(wu_p, &tree, (struct Oc_bpt_key*) &key);
+        model[key] = 0;
+    }
+
+    oc_img_write_b(wu_p, &tree, img_p);
+
+    // the image does not depend on the page manager
+    oc_pm_get_stats(&stats);
+    oc_pm_close();
+    return stats.num_used - base_used;
+}
+
+static void test_round(Oc_wu *wu_p, int round)
+{
+    Oc_img_stats stats;
+    uint32 num_keys, key, n = 0;
+    uint64 tree_nodes;
+
+    // some rounds use small trees, whose root may be a leaf
+    if (round % 3 == 0)
+        num_keys = random_choose(200);
+    else
+        num_keys = random_choose(max_key);
+    if (verbose)
+        printf("// round %d: inserting %lu keys\n", round, num_keys);
+    tree_nodes = build_image(wu_p, num_keys);
+    for (key=0; key<max_key; key++)
+        if (model[key] != 0)
+            n++;
+
+    // opening the image does not read the tree
+    oc_img_open(img_p);
+    oc_img_get_stats(&stats);
+    if (stats.nodes_verified != 0)
+        ERR(("%Lu nodes were read by open", stats.nodes_verified));
+
+    oc_bpt_init_state_b(wu_p, &img_tree, &img_cfg, 1);
+    oc_img_open_tree(wu_p, &img_tree);
+    if (!oc_bpt_dbg_validate_b(wu_p, &img_tree))
+        ERR(("the tree in the image is not valid"));
+    compare_range(wu_p, 0, max_key - 1, CMP_BATCH);
+
+    // every node of the image is part of the tree
+    oc_img_get_stats(&stats);
+    if (stats.nodes_verified != stats.num_nodes)
+        ERR(("only %Lu of the %Lu nodes are in the tree",
+             stats.nodes_verified, stats.num_nodes));
+
+    run_tasks();
+    oc_img_close();
+
+    printf("// round %d: keys=%lu tree_nodes=%Lu image_nodes=%Lu\n",
+           round, n, tree_nodes, stats.num_nodes);
+}
+
+/**********************************************************************/
+
+static void *test_init_fun(void *dummy)
+{
+    Oc_wu wu;
+    Oc_rm_ticket rm;
+    int i;
+
+    setup_wu(&wu, &rm, 0);
+    oc_crt_sema_init(&sema, 0);
+    model = (uint32*) malloc(max_key * sizeof(uint32));
+
+    oc_bpt_init();
+    oc_pm_init();
+    oc_img_init();
+
+    init_cfg(&pm_cfg);
+    pm_cfg.root_fanout = fanout;
+    pm_cfg.non_root_fanout = fanout;
+    pm_cfg.min_num_ent = 2;
+    oc_pm_set_bpt_cfg(&pm_cfg);
+    oc_bpt_init_config(&pm_cfg);
+
+    init_cfg(&img_cfg);
+    oc_img_set_bpt_cfg(&img_cfg);
+    oc_bpt_init_config(&img_cfg);
+
+    for (i=0; i<num_rounds; i++)
+        test_round(&wu, i);
+
+    unlink(dev_p);
+    unlink(img_p);
+    printf("done img test\n");
+    exit(0);
+    return NULL;
+}
+
+static void help_msg(void)
+{
+    printf("oc_img_test: test tree images\n");
+    printf("    -num_rounds <int>\n");
+    printf("    -num_ops <int>      number of lookups per task, per round\n");
+    printf("    -num_tasks <int>    number of concurrent tasks\n");
+    printf("    -max_key <int>      keys are in the range [0 .. max_key-1]\n");
+    printf("    -fanout <int>       maximal fanout of the tree the image is built from\n");
+    printf("    -dev <file>         where to keep the page manager device\n");
+    printf("    -img <file>         where to keep the image\n");
+    printf("    -verbose\n");
+    exit(1);
+}
+
+static void parse_cmd_line(int argc, char *argv[])
+{
+    int i;
+
+    for (i=1; i<argc; i++) {
+        if (strcmp(argv[i], "-verbose") == 0)
+            verbose = TRUE;
+        else if (i+1 >= argc)
+            help_msg();
+        else if (strcmp(argv[i], "-num_rounds") == 0)
+            num_rounds = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-num_ops") == 0)
+            num_ops = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-num_tasks") == 0)
+            num_tasks = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-max_key") == 0)
+            max_key = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-fanout") == 0)
+            fanout = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-dev") == 0)
+            dev_p = argv[++i];
+        else if (strcmp(argv[i], "-img") == 0)
+            img_p = argv[++i];
+        else
+            help_msg();
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    Oc_crt_config crt_conf;
+
+    pl_trace_base_init();
+    parse_cmd_line(argc, argv);
+    pl_trace_base_init_done();
+
+    pl_init();
+
+    // The test runs as a task, the call below does not return
+    oc_crt_default_config(&crt_conf);
+    crt_conf.init_fun = test_init_fun;
+    crt_conf.stack_page_size = 20;
+    oc_crt_init_full(&crt_conf);
+
+    sleep(10000);
+    return 0;
+}
@@ -0,0 +1,39 @@
+#!/bin/bash -x
+
+#-----------------------------------------------------------------
+# Read command line parameters into -flags-
+flags=$*
+
+ocroot=../../../..
+oc_img_test=$ocroot/bin/oc_img_test
+
+if test ! -x $oc_img_test
+then
+	echo Error: executable $oc_img_test not found
+	echo aborting
+	exit 1
+fi
+
+#-----------------------------------------------------------------
+# the fanout is that of the tree the image is built from, the image
+# itself always uses full nodes
+
+for fanout in 6 11 20
+  do
+  for num_tasks in 1 8 16
+    do
+    exec_flags="-fanout $fanout -num_tasks $num_tasks $flags"
+    echo "Running $oc_img_test $exec_flags"
+    $oc_img_test $exec_flags
+
+    if test $? -ne 0
+	then
+	echo "-----------------------------------------------"
+	echo "Failure of test: $oc_img_test $exec_flags"
+	echo "-----------------------------------------------"
+	exit 1
+    fi
+  done
+done
+
+#-----------------------------------------------------------------
@@ -0,0 +1,728 @@
+/**************************************************************/
+/*
+ * Copyright (c) 2014-2015, Ohad Rodeh, IBM Research
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer. 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution. 
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies, 
+ * either expressed or implied, of IBM Research.
+ * 
+ */
+/**************************************************************/
+/**********************************************************************/
+/* OC_LJL.C
+ *
+ * A logical redo journal for b-tree updates.
+ *
+ * Records are appended to an in-memory buffer, under a short lock,
+ * and given consecutive LSNs. A commit writes the buffer out with a
+ * single write, and syncs the journal. Only one work-unit writes at a
+ * time; work-units that commit while a write is in progress wait for
+ * it, and whatever they appended in the meantime goes out together in
+ * the next write. Under load, many commits share one sync.
+ *
+ * Since every update is in the journal, dirty tree nodes do not need
+ * to be written back on commit. They can be written back in the
+ * background, in bulk, followed by a checkpoint that marks the
+ * journal records up to that point as no longer needed.
+ *
+ * The journal is a header block followed by a circular log of
+ * records with consecutive LSNs. The header records the tail: the
+ * offset and LSN of the oldest record that is still needed. A chain of
+ * records goes from the tail to the head, where the next buffer is
+ * written. A buffer that does not fit before the end of the journal
+ * is written at the beginning, if the tail has moved far enough ahead.
+ *
+ * Each buffer write leaves a mark with its first LSN and its
+ * offset. A checkpoint moves the tail to the last mark at, or before,
+ * the first record that is still needed. When the journal is full,
+ * writes wait for a checkpoint to make room.
+ *
+ * At recovery, the chain is followed from the tail. It ends at the
+ * first record that is torn, fails its lrc, or breaks the LSN
+ * sequence; there, it may go on from the beginning of the journal. Old
+ * records left behind have smaller LSNs, and break the sequence.
+ */
+/**********************************************************************/
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "oc_utl.h"
+#include "oc_utl_trk.h"
+#include "oc_crt_int.h"
+#include "oc_rm_s.h"
+#include "oc_wu_s.h"
+#include "oc_ljl_int.h"
+
+/**********************************************************************/
+#define OC_LJL_REC_EYE "LJLR"
+#define OC_LJL_HDR_EYE "LJLH"
+
+// The header block of the journal
+typedef struct Oc_ljl_hdr {
+    char eye_catcher[4];
+    uint32 lrc;
+    uint64 start_lsn;
+    uint64 size;
+    uint64 tail_ofs;
+    uint64 tail_lsn;
+} OC_PACKED Oc_ljl_hdr;
+
+/* The length of a record with [len] bytes of payload. Records are
+ * padded to a multiple of eight bytes.
+ */
+static inline int rec_length(int len)
+{
+    return (sizeof(Oc_ljl_rec_hdr) + len + 7) & ~7;
+}
+
+/**********************************************************************/
+// Device access
+
+static void write_all(Oc_ljl *ljl_p, char *buf_p, int len, uint64 ofs)
+{
+    ssize_t rc;
+
+    while (len > 0) {
+        rc = pwrite(ljl_p->fd, buf_p, len, (off_t) ofs);
+        if (rc < 0) {
+            if (EINTR == errno) continue;
+            ERR(("journal write of %d bytes at offset %Lu failed, errno=%d",
+                 len, ofs, errno));
+        }
+        buf_p += rc;
+        len -= rc;
+        ofs += rc;
+    }
+}
+
+// Read [len] bytes at [ofs]. Return FALSE if the journal is shorter.
+static bool read_all(Oc_ljl *ljl_p, char *buf_p, int len, uint64 ofs)
+{
+    ssize_t rc;
+
+    while (len > 0) {
+        rc = pread(ljl_p->fd, buf_p, len, (off_t) ofs);
+        if (rc < 0) {
+            if (EINTR == errno) continue;
+            ERR(("journal read of %d bytes at offset %Lu failed, errno=%d",
+                 len, ofs, errno));
+        }
+        if (0 == rc)
+            return FALSE;
+        buf_p += rc;
+        len -= rc;
+        ofs += rc;
+    }
+    return TRUE;
+}
+
+static void sync_dev(Oc_ljl *ljl_p)
+{
+    if (fdatasync(ljl_p->fd) != 0)
+        ERR(("journal sync failed, errno=%d", errno));
+}
+
+static void write_hdr(Oc_ljl *ljl_p)
+{
+    char *blk_p;
+    Oc_ljl_hdr *hdr_p;
+
+    blk_p = (char*) pl_mm_malloc(OC_LJL_HDR_SIZE);
+    memset(blk_p, 0, OC_LJL_HDR_SIZE);
+    hdr_p = (Oc_ljl_hdr*) blk_p;
+    memcpy(hdr_p->eye_catcher, OC_LJL_HDR_EYE, 4);
+    hdr_p->start_lsn = ljl_p->start_lsn;
+    hdr_p->size = ljl_p->size;
+    hdr_p->tail_ofs = ljl_p->tail_ofs;
+    hdr_p->tail_lsn = ljl_p->tail_lsn;
+    hdr_p->lrc = oc_utl_lrc_update(oc_utl_lrc_init(), blk_p, OC_LJL_HDR_SIZE);
+
+    write_all(ljl_p, blk_p, OC_LJL_HDR_SIZE, 0);
+    sync_dev(ljl_p);
+    pl_mm_free(blk_p);
+}
+
+static void read_hdr(Oc_ljl *ljl_p)
+{
+    char *blk_p;
+    Oc_ljl_hdr *hdr_p;
+    uint32 lrc;
+
+    blk_p = (char*) pl_mm_malloc(OC_LJL_HDR_SIZE);
+    hdr_p = (Oc_ljl_hdr*) blk_p;
+    if (!read_all(ljl_p, blk_p, OC_LJL_HDR_SIZE, 0))
+        ERR(("the journal is too short to hold a header"));
+
+    lrc = hdr_p->lrc;
+    hdr_p->lrc = 0;
+    if (memcmp(hdr_p->eye_catcher, OC_LJL_HDR_EYE, 4) != 0 ||
+        oc_utl_lrc_update(oc_utl_lrc_init(), blk_p, OC_LJL_HDR_SIZE) != lrc)
+        ERR(("the journal header is corrupt"));
+
+    ljl_p->start_lsn = hdr_p->start_lsn;
+    ljl_p->size = hdr_p->size;
+    ljl_p->tail_ofs = hdr_p->tail_ofs;
+    ljl_p->tail_lsn = hdr_p->tail_lsn;
+    pl_mm_free(blk_p);
+}
+
+/* Read the record at [ofs] into [rec_p], a buffer of [buf_size]
+ * bytes. Return FALSE if there is no valid record there.
+ */
+static bool read_record(Oc_ljl *ljl_p, uint64 ofs, char *rec_p)
+{
+    Oc_ljl_rec_hdr *hdr_p = (Oc_ljl_rec_hdr*) rec_p;
+    uint32 lrc;
+
+    if (ofs + sizeof(Oc_ljl_rec_hdr) > ljl_p->size)
+        return FALSE;
+    if (!read_all(ljl_p, rec_p, sizeof(Oc_ljl_rec_hdr), ofs))
+        return FALSE;
+    if (memcmp(hdr_p->eye_catcher, OC_LJL_REC_EYE, 4) != 0 ||
+        (sizeof(Oc_ljl_rec_hdr) + hdr_p->len) % 8 != 0 ||
+        hdr_p->len > ljl_p->buf_size - sizeof(Oc_ljl_rec_hdr) ||
+        ofs + sizeof(Oc_ljl_rec_hdr) + hdr_p->len > ljl_p->size)
+        return FALSE;
+    if (!read_all(ljl_p, rec_p + sizeof(Oc_ljl_rec_hdr), hdr_p->len,
+                  ofs + sizeof(Oc_ljl_rec_hdr)))
+        return FALSE;
+
+    lrc = hdr_p->lrc;
+    hdr_p->lrc = 0;
+    return (oc_utl_lrc_update(oc_utl_lrc_init(), rec_p,
+                              sizeof(Oc_ljl_rec_hdr) + hdr_p->len) == lrc);
+}
+
+/**********************************************************************/
+// Space management
+
+/* Return the offset at which [len] bytes can be written, or 0 if the
+ * journal is full. The head never catches up with the tail, so that
+ * the two are equal only when the journal is empty.
+ */
+static uint64 room_for(Oc_ljl *ljl_p, uint64 len)
+{
+    uint64 head = ljl_p->write_ofs;
+    uint64 tail = ljl_p->tail_ofs;
+
+    if (head >= tail) {
+        if (head + len <= ljl_p->size)
+            return head;
+        if (OC_LJL_HDR_SIZE + len < tail)
+            return OC_LJL_HDR_SIZE;
+        return 0;
+    }
+    if (head + len < tail)
+        return head;
+    return 0;
+}
+
+// Remember that the record [lsn] was written at [ofs]
+static void add_mark(Oc_ljl *ljl_p, uint64 lsn, uint64 ofs)
+{
+    Oc_ljl_mark *mark_p;
+
+    /* If there are too many marks, this write has none. The tail then
+     * stays at an earlier mark for a little longer.
+     */
+    if (OC_LJL_MAX_MARKS == ljl_p->num_marks)
+        return;
+    mark_p = &ljl_p->marks[(ljl_p->first_mark + ljl_p->num_marks) %
+                           OC_LJL_MAX_MARKS];
+    mark_p->lsn = lsn;
+    mark_p->ofs = ofs;
+    ljl_p->num_marks++;
+}
+
+// Put the tail at record [lsn], at [ofs], and forget the other marks
+static void reset_marks(Oc_ljl *ljl_p, uint64 lsn, uint64 ofs)
+{
+    ljl_p->first_mark = 0;
+    ljl_p->num_marks = 0;
+    ljl_p->tail_ofs = ofs;
+    ljl_p->tail_lsn = lsn;
+    add_mark(ljl_p, lsn, ofs);
+}
+
+/**********************************************************************/
+// Group commit
+
+/* Write out all the records appended so far, and sync them.
+ *
+ * The caller holds the sync lock. The buffers are swapped under the
+ * buffer lock, so that appends can go on during the write. If the
+ * journal is full, the sync lock is released until a checkpoint makes
+ * room.
+ */
+static void write_out_b(struct Oc_wu *wu_p, Oc_ljl *ljl_p)
+{
+    char *tmp_p;
+    int len;
+    uint64 first_lsn, last_lsn, ofs;
+
+    while (1) {
+        oc_utl_trk_crt_lock_write(wu_p, &ljl_p->buf_lock);
+        len = ljl_p->buf_used;
+        ofs = (0 == len) ? ljl_p->write_ofs : room_for(ljl_p, len);
+        if (ofs != 0)
+            break;
+        oc_utl_trk_crt_unlock(wu_p, &ljl_p->buf_lock);
+
+        ljl_p->stats.num_full++;
+        oc_utl_trk_crt_unlock(wu_p, &ljl_p->sync_lock);
+        oc_crt_yield_task();
+        oc_utl_trk_crt_lock_write(wu_p, &ljl_p->sync_lock);
+    }
+
+    tmp_p = ljl_p->buf_p;
+    ljl_p->buf_p = ljl_p->out_buf_p;
+    ljl_p->out_buf_p = tmp_p;
+    ljl_p->buf_used = 0;
+    first_lsn = ljl_p->durable_lsn + 1;
+    last_lsn = ljl_p->next_lsn - 1;
+    oc_utl_trk_crt_unlock(wu_p, &ljl_p->buf_lock);
+
+    if (len > 0) {
+        if (ofs != ljl_p->write_ofs)
+            ljl_p->stats.num_wraps++;
+        add_mark(ljl_p, first_lsn, ofs);
+        write_all(ljl_p, ljl_p->out_buf_p, len, ofs);
+        sync_dev(ljl_p);
+        ljl_p->write_ofs = ofs + len;
+        ljl_p->stats.num_syncs++;
+        ljl_p->stats.bytes_written += len;
+    }
+    ljl_p->durable_lsn = last_lsn;
+}
+
+// Make the records up to [lsn] durable
+static void sync_b(struct Oc_wu *wu_p, Oc_ljl *ljl_p, uint64 lsn)
+{
+    oc_utl_trk_crt_lock_write(wu_p, &ljl_p->sync_lock);
+    if (ljl_p->durable_lsn < lsn)
+        write_out_b(wu_p, ljl_p);
+    oc_utl_trk_crt_unlock(wu_p, &ljl_p->sync_lock);
+}
+
+/* Append a record for operation [op] on tree [tid]. The payload is
+ * [len1] bytes from [p1] followed by [len2] bytes from [p2].
+ */
+static void append_b(struct Oc_wu *wu_p,
+                     Oc_ljl *ljl_p,
+                     Oc_ljl_op op,
+                     uint64 tid,
+                     uint64 arg,
+                     void *p1, int len1,
+                     void *p2, int len2)
+{
+    Oc_ljl_rec_hdr *hdr_p;
+    char *rec_p;
+    int rec_len;
+    uint64 lsn;
+
+    rec_len = rec_length(len1 + len2);
+    if (rec_len > ljl_p->buf_size)
+        ERR(("a journal record of %d bytes does not fit in the buffer",
+             rec_len));
+
+    while (1) {
+        oc_utl_trk_crt_lock_write(wu_p, &ljl_p->buf_lock);
+        if (ljl_p->buf_used + rec_len <= ljl_p->buf_size)
+            break;
+
+        // The buffer is full, write it out
+        lsn = ljl_p->next_lsn - 1;
+        oc_utl_trk_crt_unlock(wu_p, &ljl_p->buf_lock);
+        sync_b(wu_p, ljl_p, lsn);
+    }
+
+    rec_p = ljl_p->buf_p + ljl_p->buf_used;
+    memset(rec_p, 0, rec_len);
+    hdr_p = (Oc_ljl_rec_hdr*) rec_p;
+    memcpy(hdr_p->eye_catcher, OC_LJL_REC_EYE, 4);
+    hdr_p->lsn = lsn = ljl_p->next_lsn++;
+    hdr_p->tid = tid;
+    hdr_p->arg = arg;
+    hdr_p->op = op;
+    hdr_p->len = rec_len - sizeof(Oc_ljl_rec_hdr);
+    if (len1 > 0)
+        memcpy(rec_p + sizeof(Oc_ljl_rec_hdr), p1, len1);
+    if (len2 > 0)
+        memcpy(rec_p + sizeof(Oc_ljl_rec_hdr) + len1, p2, len2);
+    hdr_p->lrc = oc_utl_lrc_update(oc_utl_lrc_init(), rec_p, rec_len);
+
+    ljl_p->buf_used += rec_len;
+    ljl_p->stats.num_records++;
+    oc_utl_trk_crt_unlock(wu_p, &ljl_p->buf_lock);
+
+    wu_p->rm_p->ljl_lsn = lsn;
+}
+
+void oc_ljl_commit_b(struct Oc_wu *wu_p, Oc_ljl *ljl_p)
+{
+    uint64 lsn = wu_p->rm_p->ljl_lsn;
+
+    if (lsn <= ljl_p->durable_lsn)
+        return;
+
+    oc_utl_trk_crt_lock_write(wu_p, &ljl_p->sync_lock);
+    ljl_p->stats.num_commits++;
+
+    /* If another work-unit wrote the journal while we waited, our
+     * records may have gone out with it.
+     */
+    if (ljl_p->durable_lsn < lsn)
+        write_out_b(wu_p, ljl_p);
+    oc_utl_trk_crt_unlock(wu_p, &ljl_p->sync_lock);
+}
+
+uint64 oc_ljl_last_lsn(Oc_ljl *ljl_p)
+{
+    return ljl_p->next_lsn - 1;
+}
+
+void oc_ljl_checkpoint_b(struct Oc_wu *wu_p, Oc_ljl *ljl_p, uint64 lsn)
+{
+    Oc_ljl_mark *next_p;
+
+    /* The sync lock keeps the head, the marks and [durable_lsn] from
+     * changing. Records appended in the meantime stay in the buffer.
+     */
+    oc_utl_trk_crt_lock_write(wu_p, &ljl_p->sync_lock);
+    oc_utl_assert(lsn < ljl_p->next_lsn);
+    if (lsn >= ljl_p->start_lsn)
+        ljl_p->start_lsn = lsn + 1;
+
+    if (ljl_p->start_lsn > ljl_p->durable_lsn) {
+        /* Nothing on disk follows the checkpoint, the journal is
+         * empty. The records in the buffer go to the head with its
+         * next write.
+         */
+        reset_marks(ljl_p, ljl_p->durable_lsn + 1, ljl_p->write_ofs);
+    }
+    else {
+        // Move the tail to the last write that holds [start_lsn]
+        while (ljl_p->num_marks > 1) {
+            next_p = &ljl_p->marks[(ljl_p->first_mark + 1) % OC_LJL_MAX_MARKS];
+            if (next_p->lsn > ljl_p->start_lsn)
+                break;
+            ljl_p->first_mark = (ljl_p->first_mark + 1) % OC_LJL_MAX_MARKS;
+            ljl_p->num_marks--;
+        }
+        ljl_p->tail_ofs = ljl_p->marks[ljl_p->first_mark].ofs;
+        ljl_p->tail_lsn = ljl_p->marks[ljl_p->first_mark].lsn;
+    }
+
+    write_hdr(ljl_p);
+    oc_utl_trk_crt_unlock(wu_p, &ljl_p->sync_lock);
+}
+
+void oc_ljl_get_stats(Oc_ljl *ljl_p, Oc_ljl_stats *stats_po)
+{
+    memcpy(stats_po, &ljl_p->stats, sizeof(Oc_ljl_stats));
+}
+
+/**********************************************************************/
+// Updates
+
+bool oc_ljl_insert_key_b(
+    struct Oc_wu *wu_p,
+    Oc_ljl *ljl_p,
+    struct Oc_bpt_state *s_p,
+    struct Oc_bpt_key *key_p,
+    struct Oc_bpt_data *data_p)
+{
+    bool rc;
+
+    oc_utl_trk_crt_lock_read(wu_p, &ljl_p->order_lock);
+    rc = oc_bpt_insert_key_b(wu_p, s_p, key_p, data_p);
+    append_b(wu_p, ljl_p, OC_LJL_OP_INSERT_KEY, oc_bpt_get_tid(s_p), 0,
+             key_p, s_p->cfg_p->key_size,
+             data_p, s_p->cfg_p->data_size);
+    oc_utl_trk_crt_unlock(wu_p, &ljl_p->order_lock);
+
+    return rc;
+}
+
+bool oc_ljl_remove_key_b(
+    struct Oc_wu *wu_p,
+    Oc_ljl *ljl_p,
+    struct Oc_bpt_state *s_p,
+    struct Oc_bpt_key *key_p)
+{
+    bool rc;
+
+    oc_utl_trk_crt_lock_read(wu_p, &ljl_p->order_lock);
+    rc = oc_bpt_remove_key_b(wu_p, s_p, key_p);
+    if (rc)
+        append_b(wu_p, ljl_p, OC_LJL_OP_REMOVE_KEY, oc_bpt_get_tid(s_p), 0,
+                 key_p, s_p->cfg_p->key_size, NULL, 0);
+    oc_utl_trk_crt_unlock(wu_p, &ljl_p->order_lock);
+
+    return rc;
+}
+
+int oc_ljl_insert_range_b(
+    struct Oc_wu *wu_p,
+    Oc_ljl *ljl_p,
+    struct Oc_bpt_state *s_p,
+    int length,
+    struct Oc_bpt_key *key_array,
+    struct Oc_bpt_data *data_array)
+{
+    int rc;
+
+    oc_utl_trk_crt_lock_read(wu_p, &ljl_p->order_lock);
+    rc = oc_bpt_insert_range_b(wu_p, s_p, length, key_array, data_array);
+    if (length > 0)
+        append_b(wu_p, ljl_p, OC_LJL_OP_INSERT_RANGE, oc_bpt_get_tid(s_p),
+                 length,
+                 key_array, length * s_p->cfg_p->key_size,
+                 data_array, length * s_p->cfg_p->data_size);
+    oc_utl_trk_crt_unlock(wu_p, &ljl_p->order_lock);
+
+    return rc;
+}
+
+int oc_ljl_remove_range_b(
+    struct Oc_wu *wu_p,
+    Oc_ljl *ljl_p,
+    struct Oc_bpt_state *s_p,
+    struct Oc_bpt_key *min_key_p,
+    struct Oc_bpt_key *max_key_p)
+{
+    int rc;
+
+    // the b-tree locks the whole tree
+    oc_utl_trk_crt_lock_write(wu_p, &ljl_p->order_lock);
+    rc = oc_bpt_remove_range_b(wu_p, s_p, min_key_p, max_key_p);
+    if (rc > 0)
+        append_b(wu_p, ljl_p, OC_LJL_OP_REMOVE_RANGE, oc_bpt_get_tid(s_p), 0,
+                 min_key_p, s_p->cfg_p->key_size,
+                 max_key_p, s_p->cfg_p->key_size);
+    oc_utl_trk_crt_unlock(wu_p, &ljl_p->order_lock);
+
+    return rc;
+}
+
+uint64 oc_ljl_clone_b(
+    struct Oc_wu *wu_p,
+    Oc_ljl *ljl_p,
+    struct Oc_bpt_state *src_p,
+    struct Oc_bpt_state *trg_p)
+{
+    uint64 addr;
+
+    oc_utl_trk_crt_lock_write(wu_p, &ljl_p->order_lock);
+    addr = oc_bpt_clone_b(wu_p, src_p, trg_p);
+    append_b(wu_p, ljl_p, OC_LJL_OP_CLONE, oc_bpt_get_tid(src_p),
+             oc_bpt_get_tid(trg_p), NULL, 0, NULL, 0);
+    oc_utl_trk_crt_unlock(wu_p, &ljl_p->order_lock);
+
+    return addr;
+}
+
+/**********************************************************************/
+// Recovery
+
+static void check_len(Oc_ljl_rec_hdr *hdr_p, int len)
+{
+    if (rec_length(len) != (int) (sizeof(Oc_ljl_rec_hdr) + hdr_p->len))
+        ERR(("journal record lsn=%Lu does not match the configuration of tree %Lu",
+             hdr_p->lsn, hdr_p->tid));
+}
+
+static void replay_record(struct Oc_wu *wu_p,
+                          char *rec_p,
+                          Oc_ljl_tree_fun tree_f,
+                          void *arg)
+{
+    Oc_ljl_rec_hdr *hdr_p = (Oc_ljl_rec_hdr*) rec_p;
+    char *payload_p = rec_p + sizeof(Oc_ljl_rec_hdr);
+    Oc_bpt_state *s_p, *trg_p;
+    int key_size, data_size;
+
+    s_p = tree_f(wu_p, hdr_p->tid, FALSE, arg);
+    if (NULL == s_p)
+        return;
+    key_size = s_p->cfg_p->key_size;
+    data_size = s_p->cfg_p->data_size;
+
+    switch (hdr_p->op) {
+    case OC_LJL_OP_INSERT_KEY:
+        check_len(hdr_p, key_size + data_size);
+        oc_bpt_insert_key_b(wu_p, s_p,
+                            (struct Oc_bpt_key*) payload_p,
+                            (struct Oc_bpt_data*) (payload_p + key_size));
+        break;
+    case OC_LJL_OP_REMOVE_KEY:
+        check_len(hdr_p, key_size);
+        oc_bpt_remove_key_b(wu_p, s_p, (struct Oc_bpt_key*) payload_p);
+        break;
+    case OC_LJL_OP_INSERT_RANGE:
+        check_len(hdr_p, (int) hdr_p->arg * (key_size + data_size));
+        oc_bpt_insert_range_b(
+            wu_p, s_p, (int) hdr_p->arg,
+            (struct Oc_bpt_key*) payload_p,
+            (struct Oc_bpt_data*) (payload_p + hdr_p->arg * key_size));
+        break;
+    case OC_LJL_OP_REMOVE_RANGE:
+        check_len(hdr_p, 2 * key_size);
+        oc_bpt_remove_range_b(wu_p, s_p,
+                              (struct Oc_bpt_key*) payload_p,
+                              (struct Oc_bpt_key*) (payload_p + key_size));
+        break;
+    case OC_LJL_OP_CLONE:
+        trg_p = tree_f(wu_p, hdr_p->arg, TRUE, arg);
+        if (trg_p != NULL)
+            oc_bpt_clone_b(wu_p, s_p, trg_p);
+        break;
+    default:
+        ERR(("journal record lsn=%Lu has a bad operation %lu",
+             hdr_p->lsn, hdr_p->op));
+    }
+}
+
+/* Walk the chain of records from the tail of the journal, and set the
+ * head. If [tree_f] is not NULL, replay the records that follow the
+ * checkpoint.
+ */
+static void scan_b(struct Oc_wu *wu_p,
+                   Oc_ljl *ljl_p,
+                   Oc_ljl_tree_fun tree_f,
+                   void *arg)
+{
+    Oc_ljl_rec_hdr *hdr_p;
+    char *rec_p;
+    uint64 ofs = ljl_p->tail_ofs;
+    uint64 end_ofs = ofs;
+    uint64 lsn = ljl_p->tail_lsn;
+    bool wrapped = FALSE;
+
+    rec_p = (char*) pl_mm_malloc(ljl_p->buf_size);
+    hdr_p = (Oc_ljl_rec_hdr*) rec_p;
+
+    while (1) {
+        if (!read_record(ljl_p, ofs, rec_p) || hdr_p->lsn != lsn) {
+            // the chain may go on from the beginning of the journal
+            if (wrapped || OC_LJL_HDR_SIZE == ofs)
+                break;
+            wrapped = TRUE;
+            ofs = OC_LJL_HDR_SIZE;
+            continue;
+        }
+        if (tree_f != NULL && lsn >= ljl_p->start_lsn)
+            replay_record(wu_p, rec_p, tree_f, arg);
+        lsn++;
+        ofs += sizeof(Oc_ljl_rec_hdr) + hdr_p->len;
+        end_ofs = ofs;
+    }
+    pl_mm_free(rec_p);
+
+    ljl_p->write_ofs = end_ofs;
+    ljl_p->next_lsn = MAX(lsn, ljl_p->start_lsn);
+    ljl_p->durable_lsn = ljl_p->next_lsn - 1;
+}
+
+void oc_ljl_replay_b(
+    struct Oc_wu *wu_p,
+    Oc_ljl *ljl_p,
+    Oc_ljl_tree_fun tree_f,
+    void *arg)
+{
+    oc_utl_assert(0 == ljl_p->buf_used);
+    scan_b(wu_p, ljl_p, tree_f, arg);
+}
+
+/**********************************************************************/
+
+void oc_ljl_open_b(Oc_ljl *ljl_p,
+                   const char *dev_p,
+                   int buf_size,
+                   uint64 size,
+                   bool create)
+{
+    int flags = O_RDWR | O_CREAT;
+
+    if (NULL == dev_p)
+        dev_p = oc_utl_conf_g.ljl_dev;
+    if (0 == buf_size)
+        buf_size = OC_LJL_BUF_SIZE;
+    if (0 == size)
+        size = OC_LJL_SIZE;
+    oc_utl_assert(buf_size % 8 == 0);
+    oc_utl_assert(buf_size > (int) sizeof(Oc_ljl_rec_hdr));
+
+    memset(ljl_p, 0, sizeof(Oc_ljl));
+    if (create)
+        flags |= O_TRUNC;
+    ljl_p->fd = open(dev_p, flags, 0644);
+    if (ljl_p->fd < 0)
+        ERR(("could not open journal %s, errno=%d", dev_p, errno));
+
+    oc_crt_init_rw_lock(&ljl_p->order_lock);
+    oc_crt_init_rw_lock(&ljl_p->buf_lock);
+    oc_crt_init_rw_lock(&ljl_p->sync_lock);
+    ljl_p->buf_size = buf_size;
+    ljl_p->buf_p = (char*) pl_mm_malloc(buf_size);
+    ljl_p->out_buf_p = (char*) pl_mm_malloc(buf_size);
+
+    if (create) {
+        ljl_p->size = size;
+        ljl_p->start_lsn = 1;
+        ljl_p->next_lsn = 1;
+        ljl_p->write_ofs = OC_LJL_HDR_SIZE;
+        reset_marks(ljl_p, 1, OC_LJL_HDR_SIZE);
+        write_hdr(ljl_p);
+    }
+    else {
+        read_hdr(ljl_p);
+        scan_b(NULL, ljl_p, NULL, NULL);
+
+        /* The next record is looked for at the tail. If the checkpoint
+         * is ahead of the records on disk, move the tail to the head.
+         */
+        if (ljl_p->durable_lsn < ljl_p->start_lsn) {
+            reset_marks(ljl_p, ljl_p->next_lsn, ljl_p->write_ofs);
+            write_hdr(ljl_p);
+        }
+        else
+            reset_marks(ljl_p, ljl_p->tail_lsn, ljl_p->tail_ofs);
+    }
+    oc_utl_assert(ljl_p->size >= OC_LJL_HDR_SIZE + 2 * (uint64) buf_size);
+}
+
+void oc_ljl_close(Oc_ljl *ljl_p)
+{
+    close(ljl_p->fd);
+    pl_mm_free(ljl_p->buf_p);
+    pl_mm_free(ljl_p->out_buf_p);
+    memset(ljl_p, 0, sizeof(Oc_ljl));
+}
+
+/**********************************************************************/
@@ -0,0 +1,261 @@
+/**************************************************************/
+/*
+ * Copyright (c) 2014-2015, Ohad Rodeh, IBM Research
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer. 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution. 
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies, 
+ * either expressed or implied, of IBM Research.
+ * 
+ */
+/**************************************************************/
+/******************************************************************/
+/* OC_LJL_INT.H
+ *
+ * A logical redo journal for b-tree updates. Work-units record their
+ * insert, remove, range and clone operations in the journal, and
+ * commit to make them durable. Commits that arrive together share a
+ * single write, and a single sync, of the journal device. At recovery,
+ * the records are replayed into the trees, in order.
+ */
+/******************************************************************/
+#ifndef OC_LJL_INT_H
+#define OC_LJL_INT_H
+
+#include "pl_base.h"
+#include "oc_utl_s.h"
+#include "oc_bpt_int.h"
+
+struct Oc_wu;
+
+/******************************************************************/
+
+// The journal starts with a header block, records follow it
+#define OC_LJL_HDR_SIZE (512)
+
+// The default size of the in-memory record buffer
+#define OC_LJL_BUF_SIZE (1024 * 1024)
+
+// The default capacity of the journal
+#define OC_LJL_SIZE (64 * 1024 * 1024)
+
+// The number of buffer writes whose location is remembered
+#define OC_LJL_MAX_MARKS (256)
+
+typedef enum Oc_ljl_op {
+    OC_LJL_OP_INSERT_KEY = 1,
+    OC_LJL_OP_REMOVE_KEY,
+    OC_LJL_OP_INSERT_RANGE,
+    OC_LJL_OP_REMOVE_RANGE,
+    OC_LJL_OP_CLONE,
+} Oc_ljl_op;
+
+/* The on-disk header of a record. It is followed by [len] bytes of
+ * payload:
+ *   insert-key:   key, data
+ *   remove-key:   key
+ *   insert-range: [arg] keys, followed by [arg] data items
+ *   remove-range: min-key, max-key
+ *   clone:        none, [arg] is the TID of the target tree
+ *
+ * The lrc covers the header, with the lrc field zeroed, and the
+ * payload. The payload is padded so that the record is a multiple
+ * of eight bytes long.
+ */
+typedef struct Oc_ljl_rec_hdr {
+    char eye_catcher[4];
+    uint32 lrc;
+    uint64 lsn;
+    uint64 tid;
+    uint64 arg;
+    uint32 op;
+    uint32 len;
+} OC_PACKED Oc_ljl_rec_hdr;
+
+// The LSN of the first record of a buffer write, and where it landed
+typedef struct Oc_ljl_mark {
+    uint64 lsn;
+    uint64 ofs;
+} Oc_ljl_mark;
+
+typedef struct Oc_ljl_stats {
+    uint64 num_records;
+    uint64 num_commits;        // commits that found their records in memory
+    uint64 num_syncs;          // writes of the buffer, each followed by a sync
+    uint64 bytes_written;
+    uint64 num_wraps;          // writes that went back to the beginning
+    uint64 num_full;           // times a write waited for a checkpoint
+} Oc_ljl_stats;
+
+typedef struct Oc_ljl {
+    int fd;
+
+    /* Operations that lock a whole tree take this lock for write, the
+     * rest take it for read. A whole-tree operation therefore lands in
+     * the journal in the same order it was applied, relative to all
+     * other operations.
+     */
+    Oc_crt_rw_lock order_lock;
+
+    // protects the record buffer and the LSN counter
+    Oc_crt_rw_lock buf_lock;
+
+    /* Held by the work-unit that writes the buffer out and syncs
+     * it. Work-units that commit in the meantime wait here, and their
+     * records go out together in the next write.
+     */
+    Oc_crt_rw_lock sync_lock;
+
+    char *buf_p;               // records appended and not yet written
+    char *out_buf_p;           // the buffer being written
+    int buf_size;
+    int buf_used;
+
+    uint64 size;               // the capacity of the journal, in bytes
+    uint64 start_lsn;          // earlier records have been checkpointed
+    uint64 next_lsn;           // the LSN of the next record
+    uint64 durable_lsn;        // records up to here are on disk
+    uint64 write_ofs;          // the head, where the buffer goes next
+    uint64 tail_ofs;           // the tail, the oldest record still needed
+    uint64 tail_lsn;           // the LSN of the record at the tail
+
+    /* Where each write of the buffer landed, oldest first. The tail
+     * moves from one mark to the next as records are checkpointed.
+     */
+    Oc_ljl_mark marks[OC_LJL_MAX_MARKS];
+    int first_mark;
+    int num_marks;
+
+    Oc_ljl_stats stats;
+} Oc_ljl;
+
+/* Return the state of tree [tid] during replay, or NULL if its
+ * records should be skipped. If [clone_target] is TRUE the tree is
+ * created by a clone: return a state that is initialized, but does
+ * not hold a tree yet.
+ */
+typedef Oc_bpt_state* (*Oc_ljl_tree_fun)(struct Oc_wu *wu_p,
+                                         uint64 tid,
+                                         bool clone_target,
+                                         void *arg);
+
+/******************************************************************/
+
+/* Open the journal stored in [dev_p], or in the configured journal
+ * device if [dev_p] is NULL. If [create] is TRUE the journal is
+ * emptied. Otherwise, the existing records are scanned to find the end
+ * of the journal; a torn record at the end is ignored.
+ *
+ * [buf_size] is the size of the in-memory record buffer, 0 for the
+ * default. A single record must fit in the buffer.
+ *
+ * [size] is the capacity of a new journal, in bytes, 0 for the
+ * default. It must hold at least two buffers. An existing journal
+ * keeps the capacity it was created with.
+ */
+void oc_ljl_open_b(Oc_ljl *ljl_p,
+                   const char *dev_p,
+                   int buf_size,
+                   uint64 size,
+                   bool create);
+
+/* Close the journal. Records that have not been committed are
+ * discarded.
+ */
+void oc_ljl_close(Oc_ljl *ljl_p);
+
+/* Update operations. Each one is applied to the tree, and then
+ * recorded in the journal. The record is durable only once the
+ * work-unit commits.
+ *
+ * Updates of the same key by concurrent work-units must be ordered by
+ * the caller, as for the b-tree itself.
+ */
+bool oc_ljl_insert_key_b(
+    struct Oc_wu *wu_p,
+    Oc_ljl *ljl_p,
+    struct Oc_bpt_state *s_p,
+    struct Oc_bpt_key *key_p,
+    struct Oc_bpt_data *data_p);
+
+bool oc_ljl_remove_key_b(
+    struct Oc_wu *wu_p,
+    Oc_ljl *ljl_p,
+    struct Oc_bpt_state *s_p,
+    struct Oc_bpt_key *key_p);
+
+int oc_ljl_insert_range_b(
+    struct Oc_wu *wu_p,
+    Oc_ljl *ljl_p,
+    struct Oc_bpt_state *s_p,
+    int length,
+    struct Oc_bpt_key *key_array,
+    struct Oc_bpt_data *data_array);
+
+int oc_ljl_remove_range_b(
+    struct Oc_wu *wu_p,
+    Oc_ljl *ljl_p,
+    struct Oc_bpt_state *s_p,
+    struct Oc_bpt_key *min_key_p,
+    struct Oc_bpt_key *max_key_p);
+
+uint64 oc_ljl_clone_b(
+    struct Oc_wu *wu_p,
+    Oc_ljl *ljl_p,
+    struct Oc_bpt_state *src_p,
+    struct Oc_bpt_state *trg_p);
+
+/* Make the records appended by [wu_p] durable. If another work-unit is
+ * syncing the journal, wait for it; the records appended in the
+ * meantime are written and synced together.
+ *
+ * If the journal is full, wait until a checkpoint makes room.
+ */
+void oc_ljl_commit_b(struct Oc_wu *wu_p, Oc_ljl *ljl_p);
+
+// The LSN of the last record appended to the journal
+uint64 oc_ljl_last_lsn(Oc_ljl *ljl_p);
+
+/* The updates recorded up to, and including, [lsn] have been written
+ * back to the trees on disk. Their records are no longer replayed, and
+ * the space they take is reused once the head of the journal wraps
+ * around to it. When nothing on disk follows [lsn], the journal starts
+ * over from the beginning of the device.
+ *
+ * Can run concurrently with updates and commits.
+ */
+void oc_ljl_checkpoint_b(struct Oc_wu *wu_p, Oc_ljl *ljl_p, uint64 lsn);
+
+/* Replay the records that follow the last checkpoint into the trees
+ * provided by [tree_f]. The journal must have been opened without
+ * [create], and no updates may run during replay.
+ */
+void oc_ljl_replay_b(
+    struct Oc_wu *wu_p,
+    Oc_ljl *ljl_p,
+    Oc_ljl_tree_fun tree_f,
+    void *arg);
+
+void oc_ljl_get_stats(Oc_ljl *ljl_p, Oc_ljl_stats *stats_po);
+
+#endif
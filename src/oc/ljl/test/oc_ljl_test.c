@@ -0,0 +1,828 @@
+/**************************************************************/
+/*
+ * Copyright (c) 2014-2015, Ohad Rodeh, IBM Research
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer. 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution. 
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies, 
+ * either expressed or implied, of IBM Research.
+ * 
+ */
+/**************************************************************/
+/**********************************************************************/
+/* OC_LJL_TEST.C
+ *
+ * Test the journal. Several tasks update a set of b-trees through the
+ * journal. The trees are then rebuilt by replaying the journal into
+ * the copies taken at the last checkpoint, and compared with the
+ * originals.
+ *
+ * In the last round the journal is small. A task checkpoints it while
+ * the updates run, and it wraps around several times without growing
+ * past its capacity.
+ */
+/**********************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "pl_int.h"
+#include "pl_trace_base.h"
+#include "oc_utl.h"
+#include "oc_utl_rhtbl.h"
+#include "oc_utl_trk.h"
+#include "oc_crt_int.h"
+#include "oc_rm_s.h"
+#include "oc_wu_s.h"
+#include "oc_bpt_int.h"
+#include "oc_ljl_int.h"
+
+/**********************************************************************/
+// configuration defined on the command line
+static int num_rounds = 5;
+static int num_ops = 500;
+static int num_tasks = 8;
+static uint32 max_key = 1000;
+static int fanout = 20;
+static int buf_size = 0;
+static uint64 jnl_size = 256 * 1024;
+static char *dev_p = "/tmp/oc_ljl_test.jnl";
+static bool verbose = FALSE;
+
+#define NODE_SIZE (4096)
+
+// the number of trees at the start of a round, and the most there can be
+#define NUM_INIT_TREES (2)
+#define MAX_TREES (8)
+
+// the number of entries compared at a time
+#define CMP_BATCH (64)
+
+// the number of consecutive keys owned by a task
+#define KEY_BLOCK (8)
+
+// the longest record the tasks write, an insert-range of a whole block
+#define MAX_REC (sizeof(Oc_ljl_rec_hdr) + 2 * KEY_BLOCK * sizeof(uint32) + 8)
+
+// the buffer size of the wrap round, unless one is given
+#define WRAP_BUF_SIZE (4096)
+
+static Oc_bpt_cfg cfg;
+static Oc_ljl ljl;
+
+// statistics of the journal, summed over its reopenings
+static Oc_ljl_stats tot_stats;
+static Oc_crt_sema sema;
+
+// the checkpointing task of the wrap round runs while this is TRUE
+static volatile bool ckpt_running;
+
+/* The live trees, updated through the journal, and their copies as
+ * of the last checkpoint. Tree [i] has TID i+1.
+ */
+static Oc_bpt_state live_s[MAX_TREES];
+static Oc_bpt_state disk_s[MAX_TREES];
+static bool disk_used[MAX_TREES];
+static int num_trees;
+
+/**********************************************************************/
+/* An in-memory store for the tree nodes, kept in a hashtable indexed by
+ * disk-address. Nodes shared by clones carry a reference count.
+ */
+typedef struct Vd_node {
+    Oc_bpt_node node;
+    int refcnt;
+} Vd_node;
+
+static Oc_utl_rhtbl vd_htbl;
+static uint64 vd_next_addr = 1;
+static Oc_crt_rw_lock vd_lock;
+
+static uint64 vd_hash(void *_key)
+{
+    return oc_utl_rhtbl_hash_u64(*((uint64*) _key));
+}
+
+static bool vd_compare(void *_elem, void *_key)
+{
+    Vd_node *vd_p = (Vd_node*) _elem;
+
+    return (vd_p->node.disk_addr == *((uint64*) _key));
+}
+
+static void *wrap_malloc(int size)
+{
+    void *p = malloc(size);
+
+    oc_utl_assert(p != NULL);
+    return p;
+}
+
+static Vd_node *vd_lookup(uint64 addr)
+{
+    Vd_node *vd_p;
+
+    oc_crt_lock_read(&vd_lock);
+    vd_p = (Vd_node*) oc_utl_rhtbl_lookup(&vd_htbl, (void*)&addr);
+    oc_crt_unlock(&vd_lock);
+    if (NULL == vd_p)
+        ERR(("did not find a node at address=%Lu", addr));
+    return vd_p;
+}
+
+static Oc_bpt_node* node_alloc(Oc_wu *wu_p)
+{
+    Vd_node *vd_p;
+
+    vd_p = (Vd_node*) wrap_malloc(sizeof(Vd_node));
+    memset(vd_p, 0, sizeof(Vd_node));
+    oc_crt_init_rw_lock(&vd_p->node.lock);
+    vd_p->node.data = (char*) wrap_malloc(NODE_SIZE);
+    memset(vd_p->node.data, 0, NODE_SIZE);
+    vd_p->refcnt = 1;
+
+    oc_crt_lock_write(&vd_lock);
+    vd_p->node.disk_addr = vd_next_addr++;
+    oc_utl_rhtbl_insert(&vd_htbl, (void*)&vd_p->node.disk_addr, (void*)vd_p);
+    oc_crt_unlock(&vd_lock);
+
+    oc_utl_trk_crt_lock_write(wu_p, &vd_p->node.lock);
+    return &vd_p->node;
+}
+
+// drop a reference to a node, and free it with the last one
+static void node_dealloc(Oc_wu *wu_p, uint64 addr)
+{
+    Vd_node *vd_p;
+
+    oc_crt_lock_write(&vd_lock);
+    vd_p = (Vd_node*) oc_utl_rhtbl_lookup(&vd_htbl, (void*)&addr);
+    oc_utl_assert(vd_p);
+    if (--vd_p->refcnt > 0) {
+        oc_crt_unlock(&vd_lock);
+        return;
+    }
+    oc_utl_rhtbl_extract(&vd_htbl, (void*)&addr);
+    oc_crt_unlock(&vd_lock);
+
+    free(vd_p->node.data);
+    free(vd_p);
+}
+
+static Oc_bpt_node* node_get_sl(Oc_wu *wu_p, uint64 addr)
+{
+    Vd_node *vd_p = vd_lookup(addr);
+
+    oc_utl_trk_crt_lock_read(wu_p, &vd_p->node.lock);
+    return &vd_p->node;
+}
+
+static Oc_bpt_node* node_get_xl(Oc_wu *wu_p, uint64 addr)
+{
+    Vd_node *vd_p = vd_lookup(addr);
+
+    oc_utl_trk_crt_lock_write(wu_p, &vd_p->node.lock);
+    return &vd_p->node;
+}
+
+static void node_release(Oc_wu *wu_p, Oc_bpt_node *node_p)
+{
+    oc_utl_trk_crt_unlock(wu_p, &node_p->lock);
+}
+
+/* A node shared by several clones is copied on write. The locked node
+ * moves to a new address, and a copy is left in the old address for
+ * the other clones.
+ */
+static void node_mark_dirty(Oc_wu *wu_p, Oc_bpt_node *node_p,
+                            bool multiple_refs)
+{
+    Vd_node *vd_p, *old_vd_p;
+
+    if (!multiple_refs)
+        return;
+
+    old_vd_p = (Vd_node*) wrap_malloc(sizeof(Vd_node));
+    memset(old_vd_p, 0, sizeof(Vd_node));
+    oc_crt_init_rw_lock(&old_vd_p->node.lock);
+    old_vd_p->node.data = (char*) wrap_malloc(NODE_SIZE);
+    memcpy(old_vd_p->node.data, node_p->data, NODE_SIZE);
+    old_vd_p->node.disk_addr = node_p->disk_addr;
+
+    oc_crt_lock_write(&vd_lock);
+    vd_p = (Vd_node*) oc_utl_rhtbl_extract(&vd_htbl, (void*)&node_p->disk_addr);
+    oc_utl_assert(vd_p && vd_p->refcnt > 1);
+    old_vd_p->refcnt = vd_p->refcnt - 1;
+    oc_utl_rhtbl_insert(&vd_htbl, (void*)&old_vd_p->node.disk_addr,
+                        (void*)old_vd_p);
+
+    vd_p->refcnt = 1;
+    vd_p->node.disk_addr = vd_next_addr++;
+    oc_utl_rhtbl_insert(&vd_htbl, (void*)&vd_p->node.disk_addr, (void*)vd_p);
+    oc_crt_unlock(&vd_lock);
+}
+
+static void fs_inc_refcount(Oc_wu *wu_p, uint64 addr)
+{
+    Vd_node *vd_p = vd_lookup(addr);
+
+    oc_crt_lock_write(&vd_lock);
+    vd_p->refcnt++;
+    oc_crt_unlock(&vd_lock);
+}
+
+static int fs_get_refcount(Oc_wu *wu_p, uint64 addr)
+{
+    Vd_node *vd_p = vd_lookup(addr);
+    int refcnt;
+
+    oc_crt_lock_read(&vd_lock);
+    refcnt = vd_p->refcnt;
+    oc_crt_unlock(&vd_lock);
+    return refcnt;
+}
+
+/**********************************************************************/
+// keys and data are uint32
+
+static int key_compare(struct Oc_bpt_key *key1_p, struct Oc_bpt_key *key2_p)
+{
+    uint32 key1 = *((uint32*) key1_p);
+    uint32 key2 = *((uint32*) key2_p);
+
+    if (key1 == key2) return 0;
+    if (key1 < key2) return 1;
+    return -1;
+}
+
+static void key_inc(struct Oc_bpt_key *key_p, struct Oc_bpt_key *result_p)
+{
+    *((uint32*) result_p) = *((uint32*) key_p) + 1;
+}
+
+static void key_to_string(struct Oc_bpt_key *key_p, char *str_p, int max_len)
+{
+    snprintf(str_p, max_len, "%lu", *((uint32*) key_p));
+}
+
+static void data_release(struct Oc_wu *wu_p, struct Oc_bpt_data *data_p)
+{
+}
+
+static void data_to_string(struct Oc_bpt_data *data_p, char *str_p, int max_len)
+{
+    snprintf(str_p, max_len, "%lu", *((uint32*) data_p));
+}
+
+/**********************************************************************/
+
+static uint32 random_choose(uint32 top)
+{
+    if (0 == top) return 0;
+    return (uint32) (rand() % top);
+}
+
+static void setup_wu(Oc_wu *wu_p, Oc_rm_ticket *rm_p, int po_id)
+{
+    memset(wu_p, 0, sizeof(Oc_wu));
+    memset(rm_p, 0, sizeof(Oc_rm_ticket));
+    wu_p->po_id = po_id;
+    wu_p->rm_p = rm_p;
+}
+
+static void init_tree(Oc_wu *wu_p, Oc_bpt_state *s_p, int idx)
+{
+    oc_bpt_init_state_b(wu_p, s_p, &cfg, idx + 1);
+}
+
+// Check that [s2_p] holds the same entries as [s1_p]
+static void compare_trees(Oc_wu *wu_p, Oc_bpt_state *s1_p, Oc_bpt_state *s2_p)
+{
+    uint32 keys1[CMP_BATCH], keys2[CMP_BATCH];
+    uint32 data1[CMP_BATCH], data2[CMP_BATCH];
+    uint32 min_key = 0, top_key = (uint32) -1;
+    int n1, n2;
+
+    if (!oc_bpt_dbg_validate_b(wu_p, s2_p))
+        ERR(("replayed tree %Lu is not valid", oc_bpt_get_tid(s2_p)));
+
+    while (1) {
+        oc_bpt_lookup_range_b(wu_p, s1_p,
+                              (struct Oc_bpt_key*) &min_key,
+                              (struct Oc_bpt_key*) &top_key,
+                              CMP_BATCH,
+                              (struct Oc_bpt_key*) keys1,
+                              (struct Oc_bpt_data*) data1, &n1);
+        oc_bpt_lookup_range_b(wu_p, s2_p,
+                              (struct Oc_bpt_key*) &min_key,
+                              (struct Oc_bpt_key*) &top_key,
+                              CMP_BATCH,
+                              (struct Oc_bpt_key*) keys2,
+                              (struct Oc_bpt_data*) data2, &n2);
+        if (n1 != n2 ||
+            memcmp(keys1, keys2, n1 * sizeof(uint32)) != 0 ||
+            memcmp(data1, data2, n1 * sizeof(uint32)) != 0)
+            ERR(("tree %Lu differs from its replayed copy, from key %lu",
+                 oc_bpt_get_tid(s1_p), min_key));
+        if (n1 < CMP_BATCH)
+            break;
+        min_key = keys1[CMP_BATCH - 1] + 1;
+    }
+}
+
+/**********************************************************************/
+/* A task updates the live trees through the journal. The keys are
+ * split into blocks of KEY_BLOCK consecutive keys, and each task
+ * inserts and removes only the keys in its own blocks; range removals
+ * may cover keys of any task. Range insertions stay inside one block,
+ * the b-tree does not take ranges that straddle existing keys.
+ */
+static void *task_run(void *_arg)
+{
+    int id = (int) (long) _arg;
+    Oc_wu wu;
+    Oc_rm_ticket rm;
+    Oc_bpt_state *s_p;
+    uint32 key, data, hi_key;
+    uint32 key_array[KEY_BLOCK], data_array[KEY_BLOCK];
+    uint32 ofs;
+    int i, j, n;
+
+    setup_wu(&wu, &rm, id + 1);
+    for (i=0; i<num_ops; i++) {
+        s_p = &live_s[random_choose(num_trees)];
+        ofs = random_choose(KEY_BLOCK);
+        key = (id + num_tasks * random_choose(max_key / (KEY_BLOCK * num_tasks)))
+            * KEY_BLOCK + ofs;
+        data = 1 + random_choose(100000);
+
+        switch (random_choose(10)) {
+        case 0:
+        case 1:
+        case 2:
+        case 3:
+            oc_ljl_insert_key_b(&wu, &ljl, s_p,
+                                (struct Oc_bpt_key*) &key,
+                                (struct Oc_bpt_data*) &data);
+            break;
+        case 4:
+        case 5:
+            oc_ljl_remove_key_b(&wu, &ljl, s_p, (struct Oc_bpt_key*) &key);
+            break;
+        case 6:
+        case 7:
+            n = 1 + random_choose(KEY_BLOCK - ofs);
+            for (j=0; j<n; j++) {
+                key_array[j] = key + j;
+                data_array[j] = data + j;
+            }
+            oc_ljl_insert_range_b(&wu, &ljl, s_p, n,
+                                  (struct Oc_bpt_key*) key_array,
+                                  (struct Oc_bpt_data*) data_array);
+            break;
+        case 8:
+            if (random_choose(4) == 0) {
+                hi_key = key + random_choose(max_key / 20);
+                oc_ljl_remove_range_b(&wu, &ljl, s_p,
+                                      (struct Oc_bpt_key*) &key,
+                                      (struct Oc_bpt_key*) &hi_key);
+            }
+            break;
+        case 9:
+            oc_ljl_commit_b(&wu, &ljl);
+            break;
+        }
+    }
+
+    oc_ljl_commit_b(&wu, &ljl);
+    oc_crt_sema_post(&sema);
+    return NULL;
+}
+
+static void run_tasks(void)
+{
+    int i;
+
+    for (i=0; i<num_tasks; i++)
+        oc_crt_create_task("ljl_task", task_run, (void*) (long) i);
+    for (i=0; i<num_tasks; i++)
+        oc_crt_sema_wait(&sema);
+}
+
+static void clone_tree(Oc_wu *wu_p)
+{
+    int src = random_choose(num_trees);
+
+    if (num_trees == MAX_TREES)
+        return;
+    if (verbose)
+        printf("// clone %d -> %d\n", src + 1, num_trees + 1);
+    init_tree(wu_p, &live_s[num_trees], num_trees);
+    oc_ljl_clone_b(wu_p, &ljl, &live_s[src], &live_s[num_trees]);
+    oc_ljl_commit_b(wu_p, &ljl);
+    num_trees++;
+}
+
+/* Write back the live trees, by copying them, and checkpoint the
+ * journal. No updates run concurrently.
+ */
+static void checkpoint(Oc_wu *wu_p)
+{
+    uint32 keys[CMP_BATCH], data[CMP_BATCH];
+    uint32 min_key, top_key = (uint32) -1;
+    int i, j, n;
+
+    if (verbose)
+        printf("// checkpoint lsn=%Lu\n", oc_ljl_last_lsn(&ljl));
+    for (i=0; i<num_trees; i++) {
+        if (disk_used[i])
+            oc_bpt_delete_b(wu_p, &disk_s[i]);
+        init_tree(wu_p, &disk_s[i], i);
+        oc_bpt_create_b(wu_p, &disk_s[i]);
+        disk_used[i] = TRUE;
+
+        min_key = 0;
+        do {
+            oc_bpt_lookup_range_b(wu_p, &live_s[i],
+                                  (struct Oc_bpt_key*) &min_key,
+                                  (struct Oc_bpt_key*) &top_key,
+                                  CMP_BATCH,
+                                  (struct Oc_bpt_key*) keys,
+                                  (struct Oc_bpt_data*) data, &n);
+            for (j=0; j<n; j++)
+                oc_bpt_insert_key_b(wu_p, &disk_s[i],
+                                    (struct Oc_bpt_key*) &keys[j],
+                                    (struct Oc_bpt_data*) &data[j]);
+            if (n > 0)
+                min_key = keys[n-1] + 1;
+        } while (CMP_BATCH == n);
+    }
+
+    oc_ljl_checkpoint_b(wu_p, &ljl, oc_ljl_last_lsn(&ljl));
+}
+
+static Oc_bpt_state *replay_tree(Oc_wu *wu_p, uint64 tid, bool clone_target,
+                                 void *arg)
+{
+    int idx = (int) tid - 1;
+
+    oc_utl_assert(idx >= 0 && idx < MAX_TREES);
+    if (clone_target) {
+        oc_utl_assert(!disk_used[idx]);
+        init_tree(wu_p, &disk_s[idx], idx);
+        disk_used[idx] = TRUE;
+    }
+    oc_utl_assert(disk_used[idx]);
+    return &disk_s[idx];
+}
+
+static void add_stats(void)
+{
+    Oc_ljl_stats stats;
+
+    oc_ljl_get_stats(&ljl, &stats);
+    tot_stats.num_records += stats.num_records;
+    tot_stats.num_commits += stats.num_commits;
+    tot_stats.num_syncs += stats.num_syncs;
+    tot_stats.bytes_written += stats.bytes_written;
+    tot_stats.num_wraps += stats.num_wraps;
+    tot_stats.num_full += stats.num_full;
+}
+
+// Check that the journal did not grow past its capacity
+static void check_bounded(void)
+{
+    struct stat st;
+
+    if (ljl.write_ofs > ljl.size)
+        ERR(("the journal head is at %Lu, past its size %Lu",
+             ljl.write_ofs, ljl.size));
+    if (stat(dev_p, &st) != 0)
+        ERR(("could not stat the journal %s", dev_p));
+    if ((uint64) st.st_size > ljl.size)
+        ERR(("the journal takes %Lu bytes, more than its size %Lu",
+             (uint64) st.st_size, ljl.size));
+}
+
+/* Crash and recover. The journal is closed, and a torn record is left
+ * at its end. It is then reopened and replayed into the copies of the
+ * trees, which should end up the same as the live trees.
+ */
+static void recover(Oc_wu *wu_p)
+{
+    char junk[60];
+    uint64 last_lsn = oc_ljl_last_lsn(&ljl);
+    uint64 head = ljl.write_ofs;
+    uint64 size = ljl.size;
+    int cur_buf_size = ljl.buf_size;
+    int fd, i;
+
+    add_stats();
+    oc_ljl_close(&ljl);
+
+    // leave the torn record at the head, if it fits there
+    if (head + sizeof(junk) <= size) {
+        memcpy(junk, "LJLR", 4);
+        for (i=4; i<(int)sizeof(junk); i++)
+            junk[i] = (char) random_choose(256);
+        fd = open(dev_p, O_WRONLY);
+        oc_utl_assert(fd >= 0);
+        if (pwrite(fd, junk, sizeof(junk), head) != sizeof(junk))
+            ERR(("could not write to the journal"));
+        close(fd);
+    }
+
+    oc_ljl_open_b(&ljl, dev_p, cur_buf_size, 0, FALSE);
+    if (oc_ljl_last_lsn(&ljl) != last_lsn)
+        ERR(("the journal ends at lsn=%Lu, expected %Lu",
+             oc_ljl_last_lsn(&ljl), last_lsn));
+    oc_ljl_replay_b(wu_p, &ljl, replay_tree, NULL);
+
+    for (i=0; i<num_trees; i++)
+        compare_trees(wu_p, &live_s[i], &disk_s[i]);
+
+    // the copies are now up to date
+    oc_ljl_checkpoint_b(wu_p, &ljl, oc_ljl_last_lsn(&ljl));
+}
+
+static void start_round(Oc_wu *wu_p, int round_buf_size, uint64 size)
+{
+    int i;
+
+    memset(&tot_stats, 0, sizeof(tot_stats));
+    oc_ljl_open_b(&ljl, dev_p, round_buf_size, size, TRUE);
+    for (i=0; i<NUM_INIT_TREES; i++) {
+        init_tree(wu_p, &live_s[i], i);
+        oc_bpt_create_b(wu_p, &live_s[i]);
+        init_tree(wu_p, &disk_s[i], i);
+        oc_bpt_create_b(wu_p, &disk_s[i]);
+        disk_used[i] = TRUE;
+    }
+    num_trees = NUM_INIT_TREES;
+}
+
+static void end_round(Oc_wu *wu_p, int round)
+{
+    int i;
+
+    add_stats();
+    oc_ljl_close(&ljl);
+    printf("// round %d: records=%Lu commits=%Lu syncs=%Lu bytes=%Lu"
+           " wraps=%Lu full=%Lu\n",
+           round, tot_stats.num_records, tot_stats.num_commits,
+           tot_stats.num_syncs, tot_stats.bytes_written,
+           tot_stats.num_wraps, tot_stats.num_full);
+
+    for (i=0; i<num_trees; i++) {
+        oc_bpt_delete_b(wu_p, &live_s[i]);
+        oc_bpt_delete_b(wu_p, &disk_s[i]);
+        disk_used[i] = FALSE;
+    }
+    if (oc_utl_rhtbl_size(&vd_htbl) != 0)
+        ERR(("%lu nodes were not freed", oc_utl_rhtbl_size(&vd_htbl)));
+}
+
+static void test_round(Oc_wu *wu_p, int round)
+{
+    start_round(wu_p, buf_size, 0);
+
+    run_tasks();
+    clone_tree(wu_p);
+    if (round % 2)
+        checkpoint(wu_p);
+    run_tasks();
+    clone_tree(wu_p);
+    run_tasks();
+    recover(wu_p);
+
+    // the journal is empty after the checkpoint
+    clone_tree(wu_p);
+    run_tasks();
+    recover(wu_p);
+
+    end_round(wu_p, round);
+}
+
+/**********************************************************************/
+/* The checkpointing task of the wrap round. The copies of the trees
+ * are not updated, so the journal cannot be replayed in the
+ * meantime. Each checkpoint covers the records that were there at the
+ * previous one, so the tail moves from one write to another instead of
+ * always catching up with the head.
+ */
+static void *ckpt_run(void *_arg)
+{
+    Oc_wu wu;
+    Oc_rm_ticket rm;
+    uint64 lsn, prev_lsn = 0;
+
+    setup_wu(&wu, &rm, num_tasks + 1);
+    while (ckpt_running) {
+        lsn = oc_ljl_last_lsn(&ljl);
+        if (prev_lsn > 0)
+            oc_ljl_checkpoint_b(&wu, &ljl, prev_lsn);
+        prev_lsn = lsn;
+        check_bounded();
+        oc_crt_yield_task();
+    }
+
+    oc_crt_sema_post(&sema);
+    return NULL;
+}
+
+// The number of free bytes between the head and the tail
+static uint64 free_space(void)
+{
+    if (ljl.write_ofs >= ljl.tail_ofs)
+        return (ljl.size - ljl.write_ofs) + (ljl.tail_ofs - OC_LJL_HDR_SIZE);
+    return ljl.tail_ofs - ljl.write_ofs;
+}
+
+/* Write a small journal over several times, while it is checkpointed
+ * concurrently. Then crash with a chain of records that wraps around
+ * the end of the journal, and recover.
+ */
+static void wrap_round(Oc_wu *wu_p, int round)
+{
+    Oc_ljl_stats stats;
+    int save_num_ops = num_ops;
+    uint64 pass_bytes;
+
+    start_round(wu_p, (0 == buf_size) ? WRAP_BUF_SIZE : buf_size, jnl_size);
+
+    ckpt_running = TRUE;
+    oc_crt_create_task("ljl_ckpt", ckpt_run, NULL);
+    do {
+        run_tasks();
+        check_bounded();
+        oc_ljl_get_stats(&ljl, &stats);
+    } while (stats.bytes_written < 3 * ljl.size);
+    ckpt_running = FALSE;
+    oc_crt_sema_wait(&sema);
+    if (0 == stats.num_wraps)
+        ERR(("%Lu bytes were written to a journal of %Lu bytes,"
+             " and it did not wrap", stats.bytes_written, ljl.size));
+
+    /* From here on, the tasks run in short passes that cannot fill the
+     * journal by themselves. Take real checkpoints, that leave the
+     * journal empty, until the head is in its second half.
+     */
+    num_ops = (ljl.size / 8) / (num_tasks * MAX_REC);
+    oc_utl_assert(num_ops > 0);
+    pass_bytes = num_ops * num_tasks * MAX_REC + 2 * ljl.buf_size;
+    while (1) {
+        checkpoint(wu_p);
+        if (ljl.write_ofs >= ljl.size / 2)
+            break;
+        run_tasks();
+    }
+
+    // Update until the chain of records wraps around, and crash
+    clone_tree(wu_p);
+    oc_ljl_get_stats(&ljl, &stats);
+    while (ljl.stats.num_wraps == stats.num_wraps &&
+           free_space() > pass_bytes)
+        run_tasks();
+    if (ljl.stats.num_wraps == stats.num_wraps)
+        ERR(("the records that follow the checkpoint did not wrap"));
+    check_bounded();
+    recover(wu_p);
+
+    num_ops = save_num_ops;
+    end_round(wu_p, round);
+}
+
+/**********************************************************************/
+
+static void *test_init_fun(void *dummy)
+{
+    Oc_wu wu;
+    Oc_rm_ticket rm;
+    int i;
+
+    setup_wu(&wu, &rm, 0);
+    oc_crt_sema_init(&sema, 0);
+    oc_crt_init_rw_lock(&vd_lock);
+    oc_utl_rhtbl_create(&vd_htbl, 2048, FALSE, vd_hash, vd_compare);
+
+    oc_bpt_init();
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.key_size = sizeof(uint32);
+    cfg.data_size = sizeof(uint32);
+    cfg.node_size = NODE_SIZE;
+    cfg.root_fanout = fanout;
+    cfg.non_root_fanout = fanout;
+    cfg.min_num_ent = 2;
+    cfg.node_alloc = node_alloc;
+    cfg.node_dealloc = node_dealloc;
+    cfg.node_get_sl = node_get_sl;
+    cfg.node_get_xl = node_get_xl;
+    cfg.node_release = node_release;
+    cfg.node_mark_dirty = node_mark_dirty;
+    cfg.fs_inc_refcount = fs_inc_refcount;
+    cfg.fs_get_refcount = fs_get_refcount;
+    cfg.key_compare = key_compare;
+    cfg.key_inc = key_inc;
+    cfg.key_to_string = key_to_string;
+    cfg.data_release = data_release;
+    cfg.data_to_string = data_to_string;
+    oc_bpt_init_config(&cfg);
+
+    for (i=0; i<num_rounds; i++)
+        test_round(&wu, i);
+    wrap_round(&wu, num_rounds);
+
+    oc_utl_rhtbl_free(&vd_htbl);
+    unlink(dev_p);
+    printf("done ljl test\n");
+    exit(0);
+    return NULL;
+}
+
+static void help_msg(void)
+{
+    printf("oc_ljl_test: test the journal\n");
+    printf("    -num_rounds <int>\n");
+    printf("    -num_ops <int>      number of operations per task\n");
+    printf("    -num_tasks <int>    number of concurrent tasks\n");
+    printf("    -max_key <int>      keys are in the range [0 .. max_key-1]\n");
+    printf("    -fanout <int>       maximal fanout of the tree nodes\n");
+    printf("    -buf_size <int>     size of the journal buffer\n");
+    printf("    -jnl_size <int>     size of the journal in the wrap round\n");
+    printf("    -dev <file>         where to keep the journal\n");
+    printf("    -verbose\n");
+    exit(1);
+}
+
+static void parse_cmd_line(int argc, char *argv[])
+{
+    int i;
+
+    for (i=1; i<argc; i++) {
+        if (strcmp(argv[i], "-verbose") == 0)
+            verbose = TRUE;
+        else if (i+1 >= argc)
+            help_msg();
+        else if (strcmp(argv[i], "-num_rounds") == 0)
+            num_rounds = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-num_ops") == 0)
+            num_ops = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-num_tasks") == 0)
+            num_tasks = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-max_key") == 0)
+            max_key = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-fanout") == 0)
+            fanout = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-buf_size") == 0)
+            buf_size = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-jnl_size") == 0)
+            jnl_size = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-dev") == 0)
+            dev_p = argv[++i];
+        else
+            help_msg();
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    Oc_crt_config crt_conf;
+
+    pl_trace_base_init();
+    parse_cmd_line(argc, argv);
+    pl_trace_base_init_done();
+
+    pl_init();
+
+    // The test runs as a task, the call below does not return
+    oc_crt_default_config(&crt_conf);
+    crt_conf.init_fun = test_init_fun;
+    crt_conf.stack_page_size = 20;
+    oc_crt_init_full(&crt_conf);
+
+    sleep(10000);
+    return 0;
+}
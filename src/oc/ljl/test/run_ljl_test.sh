@@ -0,0 +1,50 @@
+#!/bin/bash -x
+
+#-----------------------------------------------------------------
+# Read command line parameters into -flags-
+flags=$*
+
+ocroot=../../../..
+oc_ljl_test=$ocroot/bin/oc_ljl_test
+
+if test ! -x $oc_ljl_test
+then
+	echo Error: executable $oc_ljl_test not found
+	echo aborting
+	exit 1
+fi
+
+#-----------------------------------------------------------------
+# run with small fanouts, so that the index trees grow deep, and with
+# a small buffer, so that appends have to write it out
+
+for fanout in 6 11 20
+  do
+  for num_tasks in 1 8 16
+    do
+    exec_flags="-fanout $fanout -num_tasks $num_tasks -num_rounds 5 $flags"
+    echo "Running $oc_ljl_test $exec_flags"
+    $oc_ljl_test $exec_flags
+
+    if test $? -ne 0
+	then
+	echo "-----------------------------------------------"
+	echo "Failure of test: $oc_ljl_test $exec_flags"
+	echo "-----------------------------------------------"
+	exit 1
+    fi
+    exec_flags="-fanout $fanout -num_tasks $num_tasks -buf_size 4096 -num_rounds 5 $flags"
+    echo "Running $oc_ljl_test $exec_flags"
+    $oc_ljl_test $exec_flags
+
+    if test $? -ne 0
+	then
+	echo "-----------------------------------------------"
+	echo "Failure of test: $oc_ljl_test $exec_flags"
+	echo "-----------------------------------------------"
+	exit 1
+    fi
+  done
+done
+
+#-----------------------------------------------------------------
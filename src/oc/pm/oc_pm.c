@@ -0,0 +1,2069 @@
+/**************************************************************/
+/*
+ * Copyright (c) 2014-2015, Ohad Rodeh, IBM Research
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer. 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution. 
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies, 
+ * either expressed or implied, of IBM Research.
+ * 
+ */
+/**************************************************************/
+/**********************************************************************/
+/* OC_PM.C
+ *
+ * The page manager keeps every node it has handed out, or read, in a
+ * hashtable indexed by disk address. Nodes are written by checkpoints,
+ * and by flush passes in between.
+ *
+ * Each page carries the generation in which its block was allocated.
+ * Blocks of older generations are part of the last checkpoint, and are
+ * never overwritten: when such a page is first marked dirty it is
+ * moved to a new block, and the old block is queued. Queued blocks are
+ * returned to the free-space only after the next superblock switch,
+ * once nothing on disk refers to them anymore.
+ *
+ * The roots are the exception, the b-tree does not allow them to move.
+ * A checkpoint writes the root of each registered tree to a block that
+ * is not part of the previous checkpoint, alternating between the root
+ * address itself and a second block. The superblock records where the
+ * image of each root is.
+ *
+ * The generation is also handed to the b-tree through the work unit,
+ * when a node is allocated or locked for write. The b-tree stamps a
+ * node with it when the node is made writable, and does not mark it
+ * dirty again until the next checkpoint. Incrementing the ref-count of
+ * a node clears its stamp.
+ *
+ * Free-space is a map holding the ref-count of every block, with zero
+ * for a free block. A checkpoint writes the map to a fresh run of
+ * blocks, followed by the superblock.
+ *
+ * Each work-unit reserves a batch of blocks, sized from the query of
+ * the b-tree operation it is about to run, and allocates nodes out of
+ * it. The nodes it frees are buffered, and returned to the map in
+ * batches. A split thus does not take the lock that protects the map
+ * and the hashtable, except to refill. A checkpoint returns the
+ * reserved blocks, and applies the buffered frees, of all work-units.
+ *
+ * Nodes, the map, and the superblocks carry a CRC32C checksum, set when
+ * they are written and verified when they are read.
+ *
+ * When compression is on, a checkpoint compresses each node it writes.
+ * A node that shrinks by at least a sector is written in compressed
+ * form, and only the sectors it needs are written. It still occupies a
+ * whole block, the b-tree refers to nodes by address before they are
+ * written. A compressed node ends a run of adjacent pages, since the
+ * rest of its block is not written. Nodes are read whole, and the
+ * format of each one is recognized by its eye-catcher.
+ *
+ * In mapped mode the device is mapped into memory, shared, and the
+ * data of a node points into the mapping at its disk address. Reading
+ * a node does not copy it. Shadowing already moves a node of the last
+ * checkpoint to a new block before it is modified, so the mapping is
+ * only written at blocks that no checkpoint refers to; the checkpoint
+ * syncs them with msync. Roots are modified in place, so they are kept
+ * in private memory, as are nodes that were stored compressed until
+ * they move. Mapped nodes are never compressed.
+ *
+ * A flush pass writes the dirty nodes that are not locked for write,
+ * and marks them clean. A dirty node is always in a block of the
+ * current generation, so this never overwrites the last checkpoint.
+ * Its stamp is cleared, the b-tree has to mark it dirty again before
+ * modifying it. The node is copied while it is locked for read, and
+ * the copies are written outside the lock, sorted and coalesced into
+ * vectored writes as in a checkpoint. Mapped nodes are sealed in place,
+ * and their write-back is started with sync_file_range. Passes and
+ * checkpoints are serialized, so that a pass does not write over the
+ * block of a node that has been freed and reused meanwhile by a later
+ * pass.
+ *
+ * The flusher is a task that runs passes when it is woken by writers,
+ * once the number of dirty nodes crosses the soft limit, or some time
+ * after the previous pass. A writer that finds the hard limit crossed
+ * runs a pass itself, waiting for the one in progress if there is one.
+ *
+ * A checkpoint may also write a hot list, the addresses of the nodes
+ * worth reading again after a restart: the index nodes in memory, and
+ * the leaves with the most lookups. Lookups are counted per page, and
+ * halved each time a list is written, so that recent ones weigh more.
+ * The list is sorted by address and referred to by the superblock. A
+ * warm-up reads it back in runs of adjacent blocks, from several tasks.
+ */
+/**********************************************************************/
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+
+#include "pl_mm_int.h"
+#include "oc_utl.h"
+#include "oc_utl_rhtbl.h"
+#include "oc_utl_lz.h"
+#include "oc_utl_trk.h"
+#include "oc_crt_int.h"
+#include "oc_wu_s.h"
+#include "oc_rm_s.h"
+#include "oc_pm_int.h"
+
+/**********************************************************************/
+#define OC_PM_SB_EYE "PMSB"
+#define OC_PM_PG_EYE "PMPG"
+#define OC_PM_ZPG_EYE "PMPZ"
+
+#define OC_PM_SECTOR (512)
+
+// The maximal number of pages written by a single I/O
+#define OC_PM_MAX_RUN (64)
+
+// The blocks reserved by an allocation that finds the reservation empty
+#define OC_PM_RESV_BATCH (8)
+
+typedef struct Oc_pm_sb_tree {
+    uint64 tid;
+    uint64 root_addr;
+    uint64 img_addr;           // where the root was written
+} OC_PACKED Oc_pm_sb_tree;
+
+// A superblock. The registered trees follow it.
+typedef struct Oc_pm_sb {
+    char eye_catcher[4];
+    uint32 crc;
+    uint64 generation;
+    uint64 block_size;
+    uint64 num_blocks;
+    uint64 map_blk;            // the block map, [map_len] blocks long
+    uint64 map_len;
+    uint32 map_crc;
+    uint32 num_trees;
+    uint64 hot_blk;            // the hot list, [hot_len] blocks long
+    uint64 hot_len;
+    uint32 hot_num;            // entries in the hot list
+    uint32 hot_crc;
+} OC_PACKED Oc_pm_sb;
+
+// An entry of the hot list
+typedef struct Oc_pm_hot {
+    uint64 addr;
+    uint32 leaf;
+    uint32 hits;
+} OC_PACKED Oc_pm_hot;
+
+// A compressed node, as it is stored. The compressed data follows it.
+typedef struct Oc_pm_zpage {
+    char eye_catcher[4];
+    uint32 crc;                // of the header and the compressed data
+    uint32 len;                // length of the compressed data
+} OC_PACKED Oc_pm_zpage;
+
+#define OC_PM_MAX_TREES \
+    ((OC_PM_SB_SIZE - sizeof(Oc_pm_sb)) / sizeof(Oc_pm_sb_tree))
+
+typedef struct Oc_pm_page {
+    Oc_meta_data_page_hndl hndl;   // has to be first
+
+    uint64 gen;                // the generation in which the block was allocated
+    bool dirty;
+    bool is_root;
+    bool mapped;               // the data points into the mapping
+    uint32 hits;               // lookups, halved by each hot list
+} Oc_pm_page;
+
+typedef struct Oc_pm_tree {
+    uint64 tid;
+    uint64 root_addr;
+    uint64 img_addr;           // zero if the root has not been written yet
+} Oc_pm_tree;
+
+// A page to be written by a checkpoint
+typedef struct Oc_pm_write {
+    uint64 addr;
+    Oc_pm_page *pg_p;
+} Oc_pm_write;
+
+typedef struct Oc_pm {
+    int fd;
+    int block_size;
+    uint64 num_blocks;
+
+    // the generation of the next checkpoint
+    uint64 gen;
+
+    // protects the hashtable, the block map, and the tree table
+    Oc_crt_rw_lock lock;
+    Oc_utl_rhtbl htbl;
+
+    // the work-units holding reserved blocks or buffered frees
+    Oc_pm_rm *resv_list;
+
+    // serializes flush passes and checkpoints, taken before [lock]
+    Oc_crt_rw_lock io_lock;
+
+    // dirty pages that are not roots, updated outside [lock] as well
+    volatile uint64 num_dirty;
+
+    uint16 *ref_arr;           // the ref-count of each block
+    uint64 num_used;
+    uint64 alloc_cursor;
+
+    // blocks to free after the next superblock switch
+    uint64 *pending_arr;
+    int num_pending;
+    int max_pending;
+
+    // the block map of the last checkpoint
+    uint64 map_blk;
+    uint64 map_len;
+
+    // the hot list of the last checkpoint that wrote one
+    uint64 hot_blk;
+    uint64 hot_len;
+    uint32 hot_num;
+    uint32 hot_crc;
+
+    Oc_pm_tree tree_arr[OC_PM_MAX_TREES];
+    int num_trees;
+
+    bool compress;
+
+    // the mapping of the device, NULL if not in mapped mode
+    char *base;
+
+    // the buffers of pages that are not mapped
+    Pl_mm_op *page_pool;
+
+    Oc_pm_stats stats;
+} Oc_pm;
+
+static Oc_pm pm;
+
+typedef struct Oc_pm_flusher {
+    volatile bool running;
+    volatile bool stop;
+    uint64 soft_limit;
+    uint64 hard_limit;
+    uint64 max_age_ms;
+    volatile uint64 last_pass_ms;  // when the previous pass collected pages
+    volatile int pending;          // a pass was requested
+    Oc_crt_sema wake_sema;
+    Oc_crt_sema done_sema;
+} Oc_pm_flusher;
+
+// The flusher survives the page manager being closed and reopened
+static Oc_pm_flusher flusher;
+
+// Whether the next create, or open, maps the device
+static bool pm_use_mmap = FALSE;
+
+// Whether the page buffers of the next create, or open, use huge pages
+static bool pm_use_huge = FALSE;
+
+// The size of the hot list, and how many checkpoints it is kept for
+static uint32 pm_hot_max = 0;
+static uint32 pm_hot_interval = 1;
+
+// The number of tasks reading in a warm-up
+#define OC_PM_WARM_TASKS (8)
+
+/**********************************************************************/
+// Utilities
+
+static inline uint64 blk_of_addr(uint64 addr)
+{
+    return addr / pm.block_size;
+}
+
+static inline uint64 addr_of_blk(uint64 blk)
+{
+    return blk * pm.block_size;
+}
+
+static uint64 hash_addr(void *_key)
+{
+    return oc_utl_rhtbl_hash_u64(*((uint64*) _key));
+}
+
+static bool compare_addr(void *_elem, void *_key)
+{
+    Oc_pm_page *pg_p = (Oc_pm_page*) _elem;
+
+    return (pg_p->hndl.disk_addr == *((uint64*) _key));
+}
+
+static void write_all(char *buf_p, int len, uint64 ofs)
+{
+    ssize_t rc;
+
+    while (len > 0) {
+        rc = pwrite(pm.fd, buf_p, len, (off_t) ofs);
+        if (rc < 0) {
+            if (EINTR == errno) continue;
+            ERR(("write of %d bytes at offset %Lu failed, errno=%d",
+                 len, ofs, errno));
+        }
+        buf_p += rc;
+        len -= rc;
+        ofs += rc;
+    }
+}
+
+static void read_all(char *buf_p, int len, uint64 ofs)
+{
+    ssize_t rc;
+
+    while (len > 0) {
+        rc = pread(pm.fd, buf_p, len, (off_t) ofs);
+        if (rc < 0) {
+            if (EINTR == errno) continue;
+            ERR(("read of %d bytes at offset %Lu failed, errno=%d",
+                 len, ofs, errno));
+        }
+        if (0 == rc)
+            ERR(("read beyond the end of the device, offset=%Lu", ofs));
+        buf_p += rc;
+        len -= rc;
+        ofs += rc;
+    }
+}
+
+static void sync_dev(void)
+{
+    if (pm.base != NULL &&
+        msync(pm.base, pm.num_blocks * pm.block_size, MS_SYNC) != 0)
+        ERR(("msync failed, errno=%d", errno));
+    if (fdatasync(pm.fd) != 0)
+        ERR(("sync failed, errno=%d", errno));
+}
+
+/* Read into the iovec array [iov] starting at [ofs]. A short read is
+ * completed through [read_all].
+ */
+static void read_vec(struct iovec *iov, int iovcnt, uint64 ofs)
+{
+    ssize_t rc;
+    int i;
+
+    do {
+        rc = preadv(pm.fd, iov, iovcnt, (off_t) ofs);
+    } while (rc < 0 && EINTR == errno);
+    if (rc < 0)
+        ERR(("read at offset %Lu failed, errno=%d", ofs, errno));
+
+    for (i=0; i<iovcnt; i++) {
+        if (rc < (ssize_t) iov[i].iov_len) {
+            read_all((char*) iov[i].iov_base + rc,
+                     iov[i].iov_len - rc,
+                     ofs + rc);
+            rc = 0;
+        }
+        else
+            rc -= iov[i].iov_len;
+        ofs += iov[i].iov_len;
+    }
+}
+
+/* Write the iovec array [iov] starting at [ofs]. A short write is
+ * completed through [write_all].
+ */
+static void write_vec(struct iovec *iov, int iovcnt, uint64 ofs)
+{
+    ssize_t rc;
+    int i;
+
+    do {
+        rc = pwritev(pm.fd, iov, iovcnt, (off_t) ofs);
+    } while (rc < 0 && EINTR == errno);
+    if (rc < 0)
+        ERR(("write at offset %Lu failed, errno=%d", ofs, errno));
+
+    for (i=0; i<iovcnt; i++) {
+        if (rc < (ssize_t) iov[i].iov_len) {
+            write_all((char*) iov[i].iov_base + rc,
+                      iov[i].iov_len - rc,
+                      ofs + rc);
+            rc = 0;
+        }
+        else
+            rc -= iov[i].iov_len;
+        ofs += iov[i].iov_len;
+    }
+}
+
+static inline void dirty_inc(void)
+{
+    __sync_fetch_and_add(&pm.num_dirty, 1);
+}
+
+static inline void dirty_dec(void)
+{
+    __sync_fetch_and_sub(&pm.num_dirty, 1);
+}
+
+static void flush_pass(uint64 min_dirty);
+
+static void flush_request(void)
+{
+    if (__sync_bool_compare_and_swap(&flusher.pending, 0, 1))
+        oc_crt_sema_post(&flusher.wake_sema);
+}
+
+/* Called by a writer that dirtied a node, without holding [pm.lock].
+ * Wake the flusher if a threshold is crossed. Above the hard limit,
+ * the writer flushes.
+ */
+static void flush_check(void)
+{
+    uint64 num = pm.num_dirty;
+
+    if (!flusher.running)
+        return;
+    if (num >= flusher.hard_limit) {
+        __sync_fetch_and_add(&pm.stats.writer_waits, 1);
+        flush_pass(flusher.hard_limit);
+    }
+    else if (flusher.pending)
+        return;
+    else if (num >= flusher.soft_limit ||
+             oc_crt_get_time_millis() - flusher.last_pass_ms >=
+             flusher.max_age_ms)
+        flush_request();
+}
+
+/**********************************************************************/
+// Pages
+
+// A page-aligned buffer for the data of a page
+static char *page_data_alloc(void)
+{
+    void *data_p;
+
+    if (!pl_mm_pool_alloc(pm.page_pool, &data_p))
+        ERR(("out of memory"));
+    return (char*) data_p;
+}
+
+static void page_data_free(char *data_p)
+{
+    pl_mm_pool_free(pm.page_pool, data_p);
+}
+
+static Oc_pm_page *page_new(uint64 addr)
+{
+    Oc_pm_page *pg_p;
+
+    pg_p = (Oc_pm_page*) pl_mm_malloc(sizeof(Oc_pm_page));
+    memset(pg_p, 0, sizeof(Oc_pm_page));
+    oc_crt_init_rw_lock(&pg_p->hndl.lock);
+    pg_p->hndl.data = page_data_alloc();
+    memset(pg_p->hndl.data, 0, pm.block_size);
+    pg_p->hndl.disk_addr = addr;
+    return pg_p;
+}
+
+/* A page whose data is the block at [addr] in the mapping. The block
+ * is not modified.
+ */
+static Oc_pm_page *page_new_mapped(uint64 addr)
+{
+    Oc_pm_page *pg_p;
+
+    pg_p = (Oc_pm_page*) pl_mm_malloc(sizeof(Oc_pm_page));
+    memset(pg_p, 0, sizeof(Oc_pm_page));
+    oc_crt_init_rw_lock(&pg_p->hndl.lock);
+    pg_p->hndl.data = pm.base + addr;
+    pg_p->hndl.disk_addr = addr;
+    pg_p->mapped = TRUE;
+    return pg_p;
+}
+
+static void page_free(Oc_pm_page *pg_p)
+{
+    if (!pg_p->mapped)
+        page_data_free(pg_p->hndl.data);
+    pl_mm_free(pg_p);
+}
+
+// Move the data of a mapped page to private memory
+static void page_unmap(Oc_pm_page *pg_p)
+{
+    char *data_p;
+
+    if (!pg_p->mapped)
+        return;
+    data_p = page_data_alloc();
+    memcpy(data_p, pg_p->hndl.data, pm.block_size);
+    pg_p->hndl.data = data_p;
+    pg_p->mapped = FALSE;
+}
+
+/* The checksum of a page, computed as if its crc field was zero. The
+ * page is not modified, it may be part of a checkpoint in the mapping.
+ */
+static uint32 page_crc(const char *data_p)
+{
+    Oc_meta_data_page_hdr hdr;
+    uint32 crc;
+
+    memcpy(&hdr, data_p, sizeof(hdr));
+    hdr.crc = 0;
+    crc = oc_utl_crc32c_update(oc_utl_crc32c_init(),
+                               (const char*) &hdr, sizeof(hdr));
+    return oc_utl_crc32c_update(crc, data_p + sizeof(hdr),
+                                pm.block_size - sizeof(hdr));
+}
+
+// Set the page header, before the page is written
+static void page_seal(Oc_pm_page *pg_p)
+{
+    Oc_meta_data_page_hdr *hdr_p = (Oc_meta_data_page_hdr*) pg_p->hndl.data;
+
+    memcpy(hdr_p->eye_catcher, OC_PM_PG_EYE, 4);
+    hdr_p->crc = page_crc(pg_p->hndl.data);
+}
+
+// Check the eye-catcher and the checksum of the page in [data_p]
+static bool page_valid(const char *data_p)
+{
+    const Oc_meta_data_page_hdr *hdr_p =
+        (const Oc_meta_data_page_hdr*) data_p;
+
+    return (memcmp(hdr_p->eye_catcher, OC_PM_PG_EYE, 4) == 0 &&
+            page_crc(data_p) == hdr_p->crc);
+}
+
+/* Compress sealed page [pg_p] into [zbuf_p], a block long. Return the
+ * number of bytes to write, or zero if compression does not save a
+ * sector.
+ */
+static int page_compress(Oc_pm_page *pg_p, char *zbuf_p, void *work_p)
+{
+    Oc_pm_zpage *zhdr_p = (Oc_pm_zpage*) zbuf_p;
+    int len;
+
+    len = oc_utl_lz_compress(
+        pg_p->hndl.data, pm.block_size,
+        zbuf_p + sizeof(Oc_pm_zpage),
+        pm.block_size - OC_PM_SECTOR - sizeof(Oc_pm_zpage),
+        work_p);
+    if (0 == len)
+        return 0;
+
+    memcpy(zhdr_p->eye_catcher, OC_PM_ZPG_EYE, 4);
+    zhdr_p->crc = 0;
+    zhdr_p->len = len;
+    zhdr_p->crc = oc_utl_crc32c_update(oc_utl_crc32c_init(), zbuf_p,
+                                       sizeof(Oc_pm_zpage) + len);
+
+    len += sizeof(Oc_pm_zpage);
+    return (len + OC_PM_SECTOR - 1) / OC_PM_SECTOR * OC_PM_SECTOR;
+}
+
+// Replace the compressed image just read into [pg_p] with the page.
+static void page_uncompress(Oc_pm_page *pg_p)
+{
+    Oc_pm_zpage *zhdr_p;
+    char *zbuf_p;
+    uint32 crc;
+
+    zbuf_p = (char*) pl_mm_malloc(pm.block_size);
+    memcpy(zbuf_p, pg_p->hndl.data, pm.block_size);
+    zhdr_p = (Oc_pm_zpage*) zbuf_p;
+
+    crc = zhdr_p->crc;
+    zhdr_p->crc = 0;
+    if (zhdr_p->len > pm.block_size - sizeof(Oc_pm_zpage) ||
+        oc_utl_crc32c_update(oc_utl_crc32c_init(), zbuf_p,
+                             sizeof(Oc_pm_zpage) + zhdr_p->len) != crc ||
+        !oc_utl_lz_decompress(zbuf_p + sizeof(Oc_pm_zpage), zhdr_p->len,
+                              pg_p->hndl.data, pm.block_size))
+        ERR(("the compressed node at address %Lu is corrupt",
+             pg_p->hndl.disk_addr));
+    pl_mm_free(zbuf_p);
+}
+
+/* Check page [pg_p], just read from its block. It belongs to the last
+ * checkpoint.
+ */
+static void page_loaded(Oc_pm_page *pg_p)
+{
+    if (memcmp(pg_p->hndl.data, OC_PM_ZPG_EYE, 4) == 0)
+        page_uncompress(pg_p);
+    if (!page_valid(pg_p->hndl.data))
+        ERR(("the node at address %Lu is corrupt", pg_p->hndl.disk_addr));
+    pg_p->gen = pm.gen - 1;
+}
+
+/* Read the page stored in [addr]. It belongs to the last checkpoint.
+ */
+static Oc_pm_page *page_read(uint64 addr)
+{
+    Oc_pm_page *pg_p;
+
+    pg_p = page_new(addr);
+    read_all(pg_p->hndl.data, pm.block_size, addr);
+    page_loaded(pg_p);
+    return pg_p;
+}
+
+/* Map the page stored in [addr], in mapped mode. A compressed page is
+ * read into private memory.
+ */
+static Oc_pm_page *page_map(uint64 addr)
+{
+    Oc_pm_page *pg_p;
+
+    if (memcmp(pm.base + addr, OC_PM_ZPG_EYE, 4) == 0)
+        return page_read(addr);
+
+    pg_p = page_new_mapped(addr);
+    if (!page_valid(pg_p->hndl.data))
+        ERR(("the node at address %Lu is corrupt", addr));
+    pg_p->gen = pm.gen - 1;
+    return pg_p;
+}
+
+/* Return the page at [addr], reading it from disk if it is not in
+ * memory.
+ */
+static Oc_pm_page *page_get(uint64 addr)
+{
+    Oc_pm_page *pg_p, *new_pg_p;
+
+    oc_crt_lock_read(&pm.lock);
+    pg_p = (Oc_pm_page*) oc_utl_rhtbl_lookup(&pm.htbl, (void*)&addr);
+    if (pg_p != NULL)
+        pg_p->hits++;          // a lost increment does not matter
+    oc_crt_unlock(&pm.lock);
+    if (pg_p != NULL)
+        return pg_p;
+
+    // read outside the lock, someone else may bring the page meanwhile
+    new_pg_p = (pm.base != NULL) ? page_map(addr) : page_read(addr);
+
+    oc_crt_lock_write(&pm.lock);
+    pg_p = (Oc_pm_page*) oc_utl_rhtbl_lookup(&pm.htbl, (void*)&addr);
+    if (NULL == pg_p) {
+        oc_utl_rhtbl_insert(&pm.htbl, (void*)&new_pg_p->hndl.disk_addr,
+                            (void*)new_pg_p);
+        pm.stats.pages_read++;
+        pg_p = new_pg_p;
+        new_pg_p = NULL;
+    }
+    oc_crt_unlock(&pm.lock);
+
+    if (new_pg_p != NULL)
+        page_free(new_pg_p);
+    return pg_p;
+}
+
+/**********************************************************************/
+/* The block map. The caller holds the lock for write.
+ */
+
+static uint64 alloc_block(void)
+{
+    uint64 i, blk;
+
+    if (pm.num_used == pm.num_blocks)
+        ERR(("out of space, all %Lu blocks are in use", pm.num_blocks));
+
+    for (i=0; i<pm.num_blocks; i++) {
+        blk = (pm.alloc_cursor + i) % pm.num_blocks;
+        if (0 == pm.ref_arr[blk])
+            break;
+    }
+    oc_utl_assert(0 == pm.ref_arr[blk]);
+
+    pm.ref_arr[blk] = 1;
+    pm.num_used++;
+    pm.alloc_cursor = blk + 1;
+    return blk;
+}
+
+// Allocate [len] adjacent blocks, return the first one
+static uint64 alloc_run(uint64 len)
+{
+    uint64 blk, run = 0;
+
+    for (blk=0; blk<pm.num_blocks; blk++) {
+        if (pm.ref_arr[blk] != 0) {
+            run = 0;
+            continue;
+        }
+        if (++run < len)
+            continue;
+
+        blk = blk + 1 - len;
+        for (run=0; run<len; run++)
+            pm.ref_arr[blk + run] = 1;
+        pm.num_used += len;
+        return blk;
+    }
+
+    ERR(("out of space, there is no free run of %Lu blocks", len));
+    return 0;
+}
+
+static void release_block(uint64 blk)
+{
+    oc_utl_assert(pm.ref_arr[blk] > 0);
+    pm.ref_arr[blk] = 0;
+    pm.num_used--;
+}
+
+/* Free block [blk], allocated in generation [gen]. If it belongs to the
+ * last checkpoint, it is freed only after the next one.
+ */
+static void free_block(uint64 blk, uint64 gen)
+{
+    uint64 *arr;
+
+    if (gen == pm.gen) {
+        release_block(blk);
+        return;
+    }
+
+    if (pm.num_pending == pm.max_pending) {
+        pm.max_pending = MAX(2 * pm.max_pending, 64);
+        arr = (uint64*) pl_mm_malloc(pm.max_pending * sizeof(uint64));
+        if (pm.pending_arr != NULL) {
+            memcpy(arr, pm.pending_arr, pm.num_pending * sizeof(uint64));
+            pl_mm_free(pm.pending_arr);
+        }
+        pm.pending_arr = arr;
+    }
+    pm.pending_arr[pm.num_pending++] = blk;
+}
+
+/**********************************************************************/
+/* Reservations. A work-unit allocates nodes out of blocks it reserved
+ * in advance, and buffers the nodes it frees, without taking the lock.
+ * The pages of reserved blocks are in the hashtable already, clean;
+ * nobody else knows their addresses. The functions below are called
+ * with the lock held for write.
+ */
+
+static void resv_link(Oc_pm_rm *rm_p)
+{
+    if (rm_p->linked)
+        return;
+    rm_p->next = pm.resv_list;
+    pm.resv_list = rm_p;
+    rm_p->linked = TRUE;
+}
+
+// Reserve blocks until [rm_p] holds [num], or the device is full
+static void resv_fill(Oc_pm_rm *rm_p, int num)
+{
+    Oc_pm_page *pg_p;
+
+    resv_link(rm_p);
+    while (rm_p->num_resv < num && pm.num_used < pm.num_blocks) {
+        if (pm.base != NULL)
+            pg_p = page_new_mapped(addr_of_blk(alloc_block()));
+        else
+            pg_p = page_new(addr_of_blk(alloc_block()));
+        pg_p->gen = pm.gen;
+        oc_utl_rhtbl_insert(&pm.htbl, (void*)&pg_p->hndl.disk_addr,
+                            (void*)pg_p);
+        rm_p->resv_arr[rm_p->num_resv++] = pg_p;
+    }
+}
+
+static void dealloc_locked(uint64 addr)
+{
+    uint64 blk = blk_of_addr(addr);
+    Oc_pm_page *pg_p;
+
+    oc_utl_assert(pm.ref_arr[blk] > 0);
+    if (pm.ref_arr[blk] > 1) {
+        pm.ref_arr[blk]--;
+        return;
+    }
+
+    // pages that are not in memory are not new
+    pg_p = (Oc_pm_page*) oc_utl_rhtbl_extract(&pm.htbl, (void*)&addr);
+    free_block(blk, (pg_p != NULL) ? pg_p->gen : pm.gen - 1);
+    if (pg_p != NULL) {
+        if (pg_p->dirty && !pg_p->is_root)
+            dirty_dec();
+        page_free(pg_p);
+    }
+}
+
+static void resv_apply_frees(Oc_pm_rm *rm_p)
+{
+    int i;
+
+    for (i=0; i<rm_p->num_freed; i++)
+        dealloc_locked(rm_p->freed_arr[i]);
+    rm_p->num_freed = 0;
+}
+
+// Apply the buffered frees of [rm_p], and return its reserved blocks
+static void resv_drain(Oc_pm_rm *rm_p)
+{
+    Oc_pm_page *pg_p;
+    int i;
+
+    resv_apply_frees(rm_p);
+    for (i=0; i<rm_p->num_resv; i++) {
+        pg_p = rm_p->resv_arr[i];
+        oc_utl_rhtbl_extract(&pm.htbl, (void*)&pg_p->hndl.disk_addr);
+        release_block(blk_of_addr(pg_p->hndl.disk_addr));
+        page_free(pg_p);
+    }
+    rm_p->num_resv = 0;
+}
+
+static void resv_drain_all(void)
+{
+    Oc_pm_rm *rm_p;
+
+    for (rm_p = pm.resv_list; rm_p != NULL; rm_p = rm_p->next)
+        resv_drain(rm_p);
+}
+
+void oc_pm_reserve(struct Oc_wu *wu_p,
+                   struct Oc_bpt_cfg *cfg_p,
+                   Oc_bpt_fid fid,
+                   void *param)
+{
+    Oc_pm_rm *rm_p = &wu_p->rm_p->pm_rm;
+    Oc_rm_resource r;
+    int num;
+
+    memset(&r, 0, sizeof(r));
+    oc_bpt_query_b(wu_p, cfg_p, &r, fid, param);
+    num = MIN((int) r.fs_pages, OC_PM_RESV_MAX);
+    if (rm_p->num_resv >= num)
+        return;
+
+    // take twice as many, the following operations need blocks too
+    oc_crt_lock_write(&pm.lock);
+    resv_fill(rm_p, MIN(2 * num, OC_PM_RESV_MAX));
+    oc_crt_unlock(&pm.lock);
+    rm_p->num_locked++;
+}
+
+void oc_pm_release(struct Oc_wu *wu_p)
+{
+    Oc_pm_rm *rm_p = &wu_p->rm_p->pm_rm;
+    Oc_pm_rm **prev_pp;
+
+    if (!rm_p->linked)
+        return;
+
+    oc_crt_lock_write(&pm.lock);
+    resv_drain(rm_p);
+    for (prev_pp = &pm.resv_list; *prev_pp != rm_p;
+         prev_pp = &(*prev_pp)->next)
+        oc_utl_assert(*prev_pp != NULL);
+    *prev_pp = rm_p->next;
+    rm_p->next = NULL;
+    rm_p->linked = FALSE;
+    oc_crt_unlock(&pm.lock);
+}
+
+/**********************************************************************/
+// Node functions
+
+static Oc_bpt_node* pm_node_alloc(struct Oc_wu *wu_p)
+{
+    Oc_pm_rm *rm_p = &wu_p->rm_p->pm_rm;
+    Oc_pm_page *pg_p;
+
+    if (0 == rm_p->num_resv) {
+        oc_crt_lock_write(&pm.lock);
+        resv_fill(rm_p, OC_PM_RESV_BATCH);
+        oc_crt_unlock(&pm.lock);
+        rm_p->num_locked++;
+    }
+    if (0 == rm_p->num_resv)
+        ERR(("out of space, all %Lu blocks are in use", pm.num_blocks));
+
+    /* Lock before the page is dirty, a flush pass must not take it.
+     * It is in the hashtable, but nobody else knows its address yet.
+     */
+    pg_p = rm_p->resv_arr[--rm_p->num_resv];
+    oc_utl_trk_crt_lock_write(wu_p, &pg_p->hndl.lock);
+    if (pm.base != NULL)
+        memset(pg_p->hndl.data, 0, pm.block_size);
+    pg_p->gen = pm.gen;
+    pg_p->dirty = TRUE;
+    pg_p->hndl.generation = pm.gen;
+    dirty_inc();
+    rm_p->num_allocs++;
+
+    wu_p->generation = pm.gen;
+    flush_check();
+    return &pg_p->hndl;
+}
+
+/* A node referenced once is reached only through the tree of the
+ * caller, which has it locked, so its ref-count cannot change. It is
+ * buffered, and freed with a batch of others. A shared node is freed
+ * right away, the ref-count is read by the other trees.
+ */
+static void pm_node_dealloc(struct Oc_wu *wu_p, uint64 addr)
+{
+    Oc_pm_rm *rm_p = &wu_p->rm_p->pm_rm;
+
+    if (rm_p->linked && rm_p->num_freed < OC_PM_RESV_MAX &&
+        1 == pm.ref_arr[blk_of_addr(addr)]) {
+        rm_p->freed_arr[rm_p->num_freed++] = addr;
+        return;
+    }
+
+    oc_crt_lock_write(&pm.lock);
+    resv_link(rm_p);
+    resv_apply_frees(rm_p);
+    dealloc_locked(addr);
+    oc_crt_unlock(&pm.lock);
+    rm_p->num_locked++;
+}
+
+static Oc_bpt_node* pm_node_get_sl(struct Oc_wu *wu_p, uint64 addr)
+{
+    Oc_pm_page *pg_p;
+
+    while (1) {
+        pg_p = page_get(addr);
+        oc_utl_trk_crt_lock_read(wu_p, &pg_p->hndl.lock);
+        if (pg_p->hndl.disk_addr == addr)
+            break;
+
+        // the page moved while we waited for the lock
+        oc_utl_trk_crt_unlock(wu_p, &pg_p->hndl.lock);
+    }
+    return &pg_p->hndl;
+}
+
+static Oc_bpt_node* pm_node_get_xl(struct Oc_wu *wu_p, uint64 addr)
+{
+    Oc_pm_page *pg_p;
+
+    while (1) {
+        pg_p = page_get(addr);
+        oc_utl_trk_crt_lock_write(wu_p, &pg_p->hndl.lock);
+        if (pg_p->hndl.disk_addr == addr)
+            break;
+        oc_utl_trk_crt_unlock(wu_p, &pg_p->hndl.lock);
+    }
+    if (wu_p)
+        wu_p->generation = pm.gen;
+    return &pg_p->hndl;
+}
+
+static void pm_node_release(struct Oc_wu *wu_p, Oc_bpt_node *node_p)
+{
+    oc_utl_trk_crt_unlock(wu_p, &node_p->lock);
+}
+
+/* The caller holds the page locked for write. A page that belongs to
+ * the last checkpoint is moved to a new block. A page shared by several
+ * clones is moved as well, and the other clones get a copy of it in the
+ * old block.
+ */
+static void pm_node_mark_dirty(struct Oc_wu *wu_p,
+                               Oc_bpt_node *node_p,
+                               bool multiple_refs)
+{
+    Oc_pm_page *pg_p = (Oc_pm_page*) node_p;
+    Oc_pm_page *copy_p;
+    uint64 old_addr = node_p->disk_addr;
+    char *old_data_p = node_p->data;
+    bool old_mapped = pg_p->mapped;
+    bool old_dirty = pg_p->dirty;
+
+    if (pg_p->is_root) {
+        // a root is written to a separate block by the checkpoint
+        oc_utl_assert(!multiple_refs);
+        pg_p->dirty = TRUE;
+        return;
+    }
+    if (!multiple_refs && pg_p->gen == pm.gen) {
+        if (!old_dirty) {
+            pg_p->dirty = TRUE;
+            dirty_inc();
+            flush_check();
+        }
+        return;
+    }
+
+    oc_crt_lock_write(&pm.lock);
+    oc_utl_rhtbl_extract(&pm.htbl, (void*)&old_addr);
+    node_p->disk_addr = addr_of_blk(alloc_block());
+    if (pm.base != NULL) {
+        // copy the node to its new block in the mapping
+        node_p->data = pm.base + node_p->disk_addr;
+        memcpy(node_p->data, old_data_p, pm.block_size);
+        pg_p->mapped = TRUE;
+    }
+
+    if (multiple_refs) {
+        if (pm.base != NULL) {
+            // the copy takes over the old data
+            if (old_mapped)
+                copy_p = page_new_mapped(old_addr);
+            else {
+                copy_p = page_new(old_addr);
+                page_data_free(copy_p->hndl.data);
+                copy_p->hndl.data = old_data_p;
+            }
+        }
+        else {
+            copy_p = page_new(old_addr);
+            memcpy(copy_p->hndl.data, node_p->data, pm.block_size);
+        }
+        copy_p->gen = pg_p->gen;
+        copy_p->dirty = pg_p->dirty;
+        if (copy_p->dirty)
+            dirty_inc();
+        oc_utl_rhtbl_insert(&pm.htbl, (void*)&copy_p->hndl.disk_addr,
+                            (void*)copy_p);
+        pm.ref_arr[blk_of_addr(old_addr)]--;
+    }
+    else {
+        free_block(blk_of_addr(old_addr), pg_p->gen);
+        pm.stats.pages_shadowed++;
+        if (pm.base != NULL && !old_mapped)
+            page_data_free(old_data_p);
+    }
+
+    pg_p->gen = pm.gen;
+    pg_p->dirty = TRUE;
+    if (!old_dirty)
+        dirty_inc();
+    oc_utl_rhtbl_insert(&pm.htbl, (void*)&node_p->disk_addr, (void*)pg_p);
+    oc_crt_unlock(&pm.lock);
+
+    flush_check();
+}
+
+/* A shared node must be shadowed again before it is modified, clear
+ * its generation stamp.
+ */
+static void pm_fs_inc_refcount(struct Oc_wu *wu_p, uint64 addr)
+{
+    uint64 blk = blk_of_addr(addr);
+    Oc_pm_page *pg_p;
+
+    oc_crt_lock_write(&pm.lock);
+    oc_utl_assert(pm.ref_arr[blk] > 0);
+    if (0xffff == pm.ref_arr[blk])
+        ERR(("too many references to block %Lu", blk));
+    pm.ref_arr[blk]++;
+    pg_p = (Oc_pm_page*) oc_utl_rhtbl_lookup(&pm.htbl, (void*)&addr);
+    if (pg_p != NULL)
+        pg_p->hndl.generation = 0;
+    oc_crt_unlock(&pm.lock);
+}
+
+static int pm_fs_get_refcount(struct Oc_wu *wu_p, uint64 addr)
+{
+    int refcnt;
+
+    oc_crt_lock_read(&pm.lock);
+    refcnt = pm.ref_arr[blk_of_addr(addr)];
+    oc_crt_unlock(&pm.lock);
+    return refcnt;
+}
+
+void oc_pm_set_bpt_cfg(Oc_bpt_cfg *cfg_p)
+{
+    cfg_p->node_alloc = pm_node_alloc;
+    cfg_p->node_dealloc = pm_node_dealloc;
+    cfg_p->node_get_sl = pm_node_get_sl;
+    cfg_p->node_get_xl = pm_node_get_xl;
+    cfg_p->node_release = pm_node_release;
+    cfg_p->node_mark_dirty = pm_node_mark_dirty;
+    cfg_p->fs_inc_refcount = pm_fs_inc_refcount;
+    cfg_p->fs_get_refcount = pm_fs_get_refcount;
+}
+
+/**********************************************************************/
+// Trees
+
+static Oc_pm_tree *tree_find(uint64 tid)
+{
+    int i;
+
+    for (i=0; i<pm.num_trees; i++)
+        if (pm.tree_arr[i].tid == tid)
+            return &pm.tree_arr[i];
+    return NULL;
+}
+
+void oc_pm_tree_add(struct Oc_wu *wu_p, uint64 tid, uint64 root_addr)
+{
+    Oc_pm_page *pg_p = page_get(root_addr);
+    Oc_pm_tree *t_p;
+
+    oc_crt_lock_write(&pm.lock);
+    if (tree_find(tid) != NULL)
+        ERR(("tree %Lu is already registered", tid));
+    if (pm.num_trees == (int) OC_PM_MAX_TREES)
+        ERR(("cannot register more than %d trees", (int) OC_PM_MAX_TREES));
+
+    t_p = &pm.tree_arr[pm.num_trees++];
+    t_p->tid = tid;
+    t_p->root_addr = root_addr;
+    t_p->img_addr = 0;
+    if (pg_p->dirty && !pg_p->is_root)
+        dirty_dec();
+    pg_p->is_root = TRUE;
+    page_unmap(pg_p);
+    oc_crt_unlock(&pm.lock);
+}
+
+void oc_pm_tree_remove(struct Oc_wu *wu_p, uint64 tid)
+{
+    Oc_pm_tree *t_p;
+    Oc_pm_page *pg_p;
+
+    oc_crt_lock_write(&pm.lock);
+    t_p = tree_find(tid);
+    if (NULL == t_p)
+        ERR(("tree %Lu is not registered", tid));
+
+    // the root image was written by a checkpoint
+    if (t_p->img_addr != 0 && t_p->img_addr != t_p->root_addr)
+        free_block(blk_of_addr(t_p->img_addr), pm.gen - 1);
+
+    // the tree may have been deleted already
+    pg_p = (Oc_pm_page*) oc_utl_rhtbl_lookup(&pm.htbl, (void*)&t_p->root_addr);
+    if (pg_p != NULL && pg_p->is_root) {
+        pg_p->is_root = FALSE;
+        if (pg_p->dirty)
+            dirty_inc();
+    }
+
+    *t_p = pm.tree_arr[--pm.num_trees];
+    oc_crt_unlock(&pm.lock);
+}
+
+bool oc_pm_tree_lookup(uint64 tid, uint64 *root_addr_po)
+{
+    Oc_pm_tree *t_p;
+
+    oc_crt_lock_read(&pm.lock);
+    t_p = tree_find(tid);
+    if (t_p != NULL)
+        *root_addr_po = t_p->root_addr;
+    oc_crt_unlock(&pm.lock);
+
+    return (t_p != NULL);
+}
+
+/**********************************************************************/
+// Checkpoint
+
+typedef struct Oc_pm_collect {
+    Oc_pm_write *arr;
+    int num;
+} Oc_pm_collect;
+
+static void count_dirty(void *_elem, void *_ctx)
+{
+    Oc_pm_page *pg_p = (Oc_pm_page*) _elem;
+
+    if (pg_p->dirty && !pg_p->is_root)
+        (*((int*) _ctx))++;
+}
+
+static void collect_dirty(void *_elem, void *_ctx)
+{
+    Oc_pm_page *pg_p = (Oc_pm_page*) _elem;
+    Oc_pm_collect *col_p = (Oc_pm_collect*) _ctx;
+
+    if (pg_p->dirty && !pg_p->is_root) {
+        col_p->arr[col_p->num].addr = pg_p->hndl.disk_addr;
+        col_p->arr[col_p->num].pg_p = pg_p;
+        col_p->num++;
+    }
+}
+
+static int compare_write(const void *_w1, const void *_w2)
+{
+    const Oc_pm_write *w1_p = (const Oc_pm_write*) _w1;
+    const Oc_pm_write *w2_p = (const Oc_pm_write*) _w2;
+
+    if (w1_p->addr < w2_p->addr) return -1;
+    if (w1_p->addr > w2_p->addr) return 1;
+    return 0;
+}
+
+/* Write the pages in [arr], sorted by address. Adjacent pages are
+ * written together, a run ends after a compressed page. Mapped pages
+ * are only sealed, the sync writes them.
+ */
+static void write_pages(Oc_pm_write *arr, int num)
+{
+    struct iovec iov[OC_PM_MAX_RUN];
+    char *zbuf_p = NULL;
+    void *work_p = NULL;
+    int i, len, zlen = 0;
+    uint64 bytes;
+
+    qsort(arr, num, sizeof(Oc_pm_write), compare_write);
+    if (pm.compress) {
+        zbuf_p = (char*) pl_mm_malloc_aligned(pm.block_size,
+                                              PL_MM_ALIGN_PAGE);
+        work_p = pl_mm_malloc(OC_UTL_LZ_WORK_SIZE);
+    }
+
+    for (i=0; i<num; i+=len) {
+        if (arr[i].pg_p->mapped) {
+            page_seal(arr[i].pg_p);
+            arr[i].pg_p->dirty = FALSE;
+            pm.stats.pages_written++;
+            pm.stats.bytes_written += pm.block_size;
+            len = 1;
+            continue;
+        }
+
+        bytes = 0;
+        for (len=0;
+             len < OC_PM_MAX_RUN && i + len < num &&
+                 arr[i+len].addr == arr[i].addr + (uint64) len * pm.block_size &&
+                 !arr[i+len].pg_p->mapped;
+             len++) {
+            page_seal(arr[i+len].pg_p);
+            arr[i+len].pg_p->dirty = FALSE;
+            if (pm.compress)
+                zlen = page_compress(arr[i+len].pg_p, zbuf_p, work_p);
+            if (zlen > 0) {
+                iov[len].iov_base = zbuf_p;
+                iov[len].iov_len = zlen;
+                pm.stats.pages_compressed++;
+            }
+            else {
+                iov[len].iov_base = arr[i+len].pg_p->hndl.data;
+                iov[len].iov_len = pm.block_size;
+            }
+            bytes += iov[len].iov_len;
+            if (zlen > 0) {
+                len++;
+                break;
+            }
+        }
+        write_vec(iov, len, arr[i].addr);
+        pm.stats.write_ios++;
+        pm.stats.pages_written += len;
+        pm.stats.bytes_written += bytes;
+    }
+
+    if (pm.compress) {
+        pl_mm_free(zbuf_p);
+        pl_mm_free(work_p);
+    }
+}
+
+/* Write the block map into a fresh run of blocks. Blocks that are
+ * waiting for the superblock switch are free in the written map.
+ */
+static uint32 write_map(void)
+{
+    uint16 *map_p;
+    uint64 map_len;
+    uint32 crc;
+    int i;
+
+    map_len = (pm.num_blocks * sizeof(uint16) + pm.block_size - 1) /
+        pm.block_size;
+
+    // the previous map is part of the last checkpoint
+    if (pm.map_len > 0)
+        for (i=0; i<(int)pm.map_len; i++)
+            free_block(pm.map_blk + i, pm.gen - 1);
+    pm.map_blk = alloc_run(map_len);
+    pm.map_len = map_len;
+
+    map_p = (uint16*) pl_mm_malloc_aligned(map_len * pm.block_size,
+                                          PL_MM_ALIGN_PAGE);
+    memset(map_p, 0, map_len * pm.block_size);
+    memcpy(map_p, pm.ref_arr, pm.num_blocks * sizeof(uint16));
+    for (i=0; i<pm.num_pending; i++)
+        map_p[pm.pending_arr[i]] = 0;
+
+    crc = oc_utl_crc32c_update(oc_utl_crc32c_init(), (char*) map_p,
+                               map_len * pm.block_size);
+    write_all((char*) map_p, map_len * pm.block_size,
+              addr_of_blk(pm.map_blk));
+    pl_mm_free(map_p);
+    return crc;
+}
+
+typedef struct Oc_pm_hot_collect {
+    Oc_pm_hot *arr;
+    int num;
+} Oc_pm_hot_collect;
+
+static void collect_hot(void *_elem, void *_ctx)
+{
+    Oc_pm_page *pg_p = (Oc_pm_page*) _elem;
+    Oc_pm_hot_collect *col_p = (Oc_pm_hot_collect*) _ctx;
+
+    // the roots are read by the open
+    if (pg_p->is_root)
+        return;
+    col_p->arr[col_p->num].addr = pg_p->hndl.disk_addr;
+    col_p->arr[col_p->num].leaf = oc_bpt_node_is_leaf(&pg_p->hndl);
+    col_p->arr[col_p->num].hits = pg_p->hits;
+    col_p->num++;
+    pg_p->hits /= 2;
+}
+
+// Index nodes first, then the leaves with the most lookups
+static int compare_hot(const void *_h1, const void *_h2)
+{
+    const Oc_pm_hot *h1_p = (const Oc_pm_hot*) _h1;
+    const Oc_pm_hot *h2_p = (const Oc_pm_hot*) _h2;
+
+    if (h1_p->leaf != h2_p->leaf)
+        return (h1_p->leaf ? 1 : -1);
+    if (h1_p->hits > h2_p->hits) return -1;
+    if (h1_p->hits < h2_p->hits) return 1;
+    return 0;
+}
+
+static int compare_hot_addr(const void *_h1, const void *_h2)
+{
+    const Oc_pm_hot *h1_p = (const Oc_pm_hot*) _h1;
+    const Oc_pm_hot *h2_p = (const Oc_pm_hot*) _h2;
+
+    if (h1_p->addr < h2_p->addr) return -1;
+    if (h1_p->addr > h2_p->addr) return 1;
+    return 0;
+}
+
+/* Write the hot list into a fresh run of blocks, if this checkpoint
+ * replaces it. The pages are written already, so the list refers to
+ * nodes of this checkpoint.
+ */
+static void write_hot(void)
+{
+    Oc_pm_hot_collect col;
+    uint64 i, len;
+    char *buf_p;
+
+    if (pm_hot_max > 0 && pm.gen % pm_hot_interval != 0)
+        return;
+
+    // the previous list is part of the last checkpoint
+    for (i=0; i<pm.hot_len; i++)
+        free_block(pm.hot_blk + i, pm.gen - 1);
+    pm.hot_blk = 0;
+    pm.hot_len = 0;
+    pm.hot_num = 0;
+    pm.hot_crc = 0;
+    if (0 == pm_hot_max)
+        return;
+
+    col.arr = (Oc_pm_hot*) pl_mm_malloc(
+        (oc_utl_rhtbl_size(&pm.htbl) + 1) * sizeof(Oc_pm_hot));
+    col.num = 0;
+    oc_utl_rhtbl_iter(&pm.htbl, collect_hot, &col);
+    if (col.num > (int) pm_hot_max) {
+        qsort(col.arr, col.num, sizeof(Oc_pm_hot), compare_hot);
+        col.num = pm_hot_max;
+    }
+    if (0 == col.num) {
+        pl_mm_free(col.arr);
+        return;
+    }
+    qsort(col.arr, col.num, sizeof(Oc_pm_hot), compare_hot_addr);
+
+    len = (col.num * sizeof(Oc_pm_hot) + pm.block_size - 1) / pm.block_size;
+    buf_p = (char*) pl_mm_malloc_aligned(len * pm.block_size,
+                                         PL_MM_ALIGN_PAGE);
+    memset(buf_p, 0, len * pm.block_size);
+    memcpy(buf_p, col.arr, col.num * sizeof(Oc_pm_hot));
+    pl_mm_free(col.arr);
+
+    pm.hot_blk = alloc_run(len);
+    pm.hot_len = len;
+    pm.hot_num = col.num;
+    pm.hot_crc = oc_utl_crc32c_update(oc_utl_crc32c_init(), buf_p,
+                                      len * pm.block_size);
+    write_all(buf_p, len * pm.block_size, addr_of_blk(pm.hot_blk));
+    pl_mm_free(buf_p);
+}
+
+static void write_sb(uint32 map_crc)
+{
+    char *blk_p;
+    Oc_pm_sb *sb_p;
+    Oc_pm_sb_tree *sbt_p;
+    int i;
+
+    blk_p = (char*) pl_mm_malloc(OC_PM_SB_SIZE);
+    memset(blk_p, 0, OC_PM_SB_SIZE);
+    sb_p = (Oc_pm_sb*) blk_p;
+    memcpy(sb_p->eye_catcher, OC_PM_SB_EYE, 4);
+    sb_p->generation = pm.gen;
+    sb_p->block_size = pm.block_size;
+    sb_p->num_blocks = pm.num_blocks;
+    sb_p->map_blk = pm.map_blk;
+    sb_p->map_len = pm.map_len;
+    sb_p->map_crc = map_crc;
+    sb_p->num_trees = pm.num_trees;
+    sb_p->hot_blk = pm.hot_blk;
+    sb_p->hot_len = pm.hot_len;
+    sb_p->hot_num = pm.hot_num;
+    sb_p->hot_crc = pm.hot_crc;
+
+    sbt_p = (Oc_pm_sb_tree*) (blk_p + sizeof(Oc_pm_sb));
+    for (i=0; i<pm.num_trees; i++) {
+        sbt_p[i].tid = pm.tree_arr[i].tid;
+        sbt_p[i].root_addr = pm.tree_arr[i].root_addr;
+        sbt_p[i].img_addr = pm.tree_arr[i].img_addr;
+    }
+    sb_p->crc = oc_utl_crc32c_update(oc_utl_crc32c_init(),
+                                     blk_p, OC_PM_SB_SIZE);
+
+    write_all(blk_p, OC_PM_SB_SIZE, (pm.gen % OC_PM_NUM_SB) * OC_PM_SB_SIZE);
+    pl_mm_free(blk_p);
+}
+
+void oc_pm_checkpoint_b(struct Oc_wu *wu_p)
+{
+    Oc_pm_collect col;
+    Oc_pm_tree *t_p;
+    Oc_pm_page *pg_p;
+    uint32 map_crc;
+    int i, num = 0;
+
+    oc_crt_lock_write(&pm.io_lock);
+    oc_crt_lock_write(&pm.lock);
+
+    // reserved blocks must not be recorded as in use by the map
+    resv_drain_all();
+
+    oc_utl_rhtbl_iter(&pm.htbl, count_dirty, &num);
+    col.arr = (Oc_pm_write*) pl_mm_malloc(
+        (num + pm.num_trees + 1) * sizeof(Oc_pm_write));
+    col.num = 0;
+    oc_utl_rhtbl_iter(&pm.htbl, collect_dirty, &col);
+    oc_utl_assert(col.num == num);
+    oc_utl_assert(pm.num_dirty == (uint64) num);
+
+    /* Choose a block for the image of each modified root. The root
+     * address is used, unless it holds the image of the last
+     * checkpoint.
+     */
+    for (i=0; i<pm.num_trees; i++) {
+        t_p = &pm.tree_arr[i];
+        pg_p = (Oc_pm_page*) oc_utl_rhtbl_lookup(&pm.htbl,
+                                                  (void*)&t_p->root_addr);
+        oc_utl_assert(pg_p && pg_p->is_root);
+        if (!pg_p->dirty && t_p->img_addr != 0)
+            continue;
+
+        if (t_p->img_addr != 0 && t_p->img_addr != t_p->root_addr)
+            free_block(blk_of_addr(t_p->img_addr), pm.gen - 1);
+        if (t_p->img_addr != t_p->root_addr)
+            t_p->img_addr = t_p->root_addr;
+        else
+            t_p->img_addr = addr_of_blk(alloc_block());
+
+        col.arr[col.num].addr = t_p->img_addr;
+        col.arr[col.num].pg_p = pg_p;
+        col.num++;
+    }
+
+    write_pages(col.arr, col.num);
+    pl_mm_free(col.arr);
+    write_hot();
+    pm.num_dirty = 0;
+    flusher.last_pass_ms = oc_crt_get_time_millis();
+
+    // the superblock is written only when all the rest is on disk
+    map_crc = write_map();
+    sync_dev();
+    write_sb(map_crc);
+    sync_dev();
+
+    for (i=0; i<pm.num_pending; i++)
+        release_block(pm.pending_arr[i]);
+    pm.num_pending = 0;
+    pm.gen++;
+    pm.stats.num_checkpoints++;
+
+    oc_crt_unlock(&pm.lock);
+    oc_crt_unlock(&pm.io_lock);
+}
+
+/**********************************************************************/
+// Flushing
+
+typedef struct Oc_pm_flush {
+    Oc_pm_write *arr;          // copies of the pages in private memory
+    int num;
+    uint64 *mapped_arr;        // addresses of the mapped pages
+    int num_mapped;
+    int max;
+} Oc_pm_flush;
+
+static void flush_collect(void *_elem, void *_ctx)
+{
+    Oc_pm_page *pg_p = (Oc_pm_page*) _elem;
+    Oc_pm_flush *fl_p = (Oc_pm_flush*) _ctx;
+    Oc_pm_page *copy_p;
+
+    // pages dirtied after they were counted are left to the next pass
+    if (!pg_p->dirty || pg_p->is_root ||
+        fl_p->num + fl_p->num_mapped == fl_p->max)
+        return;
+
+    /* The root of a removed tree was modified in place, and may be in a
+     * block of the last checkpoint. It is freed by a buffered delete,
+     * or left to the checkpoint.
+     */
+    if (pg_p->gen != pm.gen)
+        return;
+
+    // a page locked for write is being modified, leave it to the next pass
+    if (!oc_crt_try_lock_read(&pg_p->hndl.lock))
+        return;
+    if (pg_p->dirty) {
+        if (pg_p->mapped) {
+            page_seal(pg_p);
+            fl_p->mapped_arr[fl_p->num_mapped++] = pg_p->hndl.disk_addr;
+        }
+        else {
+            copy_p = page_new(pg_p->hndl.disk_addr);
+            memcpy(copy_p->hndl.data, pg_p->hndl.data, pm.block_size);
+            fl_p->arr[fl_p->num].addr = copy_p->hndl.disk_addr;
+            fl_p->arr[fl_p->num].pg_p = copy_p;
+            fl_p->num++;
+        }
+        pg_p->dirty = FALSE;
+        pg_p->hndl.generation = 0;
+        dirty_dec();
+    }
+    oc_crt_unlock(&pg_p->hndl.lock);
+}
+
+static int compare_u64(const void *_a1, const void *_a2)
+{
+    uint64 a1 = *((const uint64*) _a1);
+    uint64 a2 = *((const uint64*) _a2);
+
+    if (a1 < a2) return -1;
+    if (a1 > a2) return 1;
+    return 0;
+}
+
+/* Start the write-back of the mapped pages at the addresses in [arr],
+ * in runs of adjacent blocks.
+ */
+static void flush_mapped(uint64 *arr, int num)
+{
+    int i, len;
+
+    qsort(arr, num, sizeof(uint64), compare_u64);
+    for (i=0; i<num; i+=len) {
+        for (len=1;
+             i + len < num &&
+                 arr[i+len] == arr[i] + (uint64) len * pm.block_size;
+             len++);
+        if (sync_file_range(pm.fd, (off64_t) arr[i],
+                            (off64_t) len * pm.block_size,
+                            SYNC_FILE_RANGE_WRITE) != 0)
+            ERR(("sync_file_range failed, errno=%d", errno));
+        pm.stats.write_ios++;
+        pm.stats.pages_written += len;
+        pm.stats.bytes_written += (uint64) len * pm.block_size;
+    }
+}
+
+/* Run a flush pass, unless there are fewer than [min_dirty] dirty pages
+ * once the previous pass is done.
+ */
+static void flush_pass(uint64 min_dirty)
+{
+    Oc_pm_flush fl;
+    int i, num = 0;
+
+    oc_crt_lock_write(&pm.io_lock);
+    if (pm.num_dirty < min_dirty) {
+        oc_crt_unlock(&pm.io_lock);
+        return;
+    }
+
+    oc_crt_lock_write(&pm.lock);
+    flusher.last_pass_ms = oc_crt_get_time_millis();
+    oc_utl_rhtbl_iter(&pm.htbl, count_dirty, &num);
+    memset(&fl, 0, sizeof(fl));
+    fl.max = num;
+    if (num > 0) {
+        fl.arr = (Oc_pm_write*) pl_mm_malloc(num * sizeof(Oc_pm_write));
+        fl.mapped_arr = (uint64*) pl_mm_malloc(num * sizeof(uint64));
+        oc_utl_rhtbl_iter(&pm.htbl, flush_collect, &fl);
+    }
+    pm.stats.flush_passes++;
+    pm.stats.pages_flushed += fl.num + fl.num_mapped;
+    oc_crt_unlock(&pm.lock);
+
+    // the copies are private, they are written without the lock
+    if (num > 0) {
+        write_pages(fl.arr, fl.num);
+        for (i=0; i<fl.num; i++)
+            page_free(fl.arr[i].pg_p);
+        flush_mapped(fl.mapped_arr, fl.num_mapped);
+        pl_mm_free(fl.arr);
+        pl_mm_free(fl.mapped_arr);
+    }
+    oc_crt_unlock(&pm.io_lock);
+}
+
+void oc_pm_flush_b(struct Oc_wu *wu_p)
+{
+    flush_pass(0);
+}
+
+static void *flusher_run(void *_arg)
+{
+    while (1) {
+        oc_crt_sema_wait(&flusher.wake_sema);
+        if (flusher.stop)
+            break;
+
+        // writers that dirty pages during the pass may request another
+        flusher.pending = 0;
+        flush_pass(0);
+    }
+    oc_crt_sema_post(&flusher.done_sema);
+    return NULL;
+}
+
+void oc_pm_start_flusher(uint64 soft_limit,
+                         uint64 hard_limit,
+                         uint64 max_age_ms)
+{
+    oc_utl_assert(!flusher.running);
+    oc_utl_assert(soft_limit <= hard_limit);
+
+    memset(&flusher, 0, sizeof(flusher));
+    flusher.soft_limit = soft_limit;
+    flusher.hard_limit = hard_limit;
+    flusher.max_age_ms = max_age_ms;
+    flusher.last_pass_ms = oc_crt_get_time_millis();
+    oc_crt_sema_init(&flusher.wake_sema, 0);
+    oc_crt_sema_init(&flusher.done_sema, 0);
+    flusher.running = TRUE;
+    oc_crt_create_task("pm_flusher", flusher_run, NULL);
+}
+
+void oc_pm_stop_flusher(void)
+{
+    if (!flusher.running)
+        return;
+
+    // writers stop waking it first, a late wake-up is ignored
+    flusher.running = FALSE;
+    flusher.stop = TRUE;
+    oc_crt_sema_post(&flusher.wake_sema);
+    oc_crt_sema_wait(&flusher.done_sema);
+}
+
+/**********************************************************************/
+// Warm-up
+
+typedef struct Oc_pm_warm {
+    uint64 *addr_arr;          // the nodes to read, sorted by address
+    int *run_arr;              // where each run starts, and the end
+    int num_runs;
+    volatile int next_run;     // the next run to read
+    volatile uint64 num_read;
+    Oc_crt_sema done_sema;
+} Oc_pm_warm;
+
+static bool in_run(uint64 blk, uint64 first, uint64 len)
+{
+    return (blk >= first && blk < first + len);
+}
+
+/* Whether hot list entry [addr] is a node that is not in memory. The
+ * caller holds the lock.
+ */
+static bool hot_wanted(uint64 addr)
+{
+    uint64 blk = blk_of_addr(addr);
+    int i;
+
+    if (addr % pm.block_size != 0 ||
+        addr < OC_PM_NUM_SB * OC_PM_SB_SIZE ||
+        blk >= pm.num_blocks ||
+        0 == pm.ref_arr[blk] ||
+        in_run(blk, pm.map_blk, pm.map_len) ||
+        in_run(blk, pm.hot_blk, pm.hot_len))
+        return FALSE;
+
+    // the roots, and their images, are not ordinary nodes
+    for (i=0; i<pm.num_trees; i++)
+        if (addr == pm.tree_arr[i].root_addr ||
+            addr == pm.tree_arr[i].img_addr)
+            return FALSE;
+
+    return !oc_utl_rhtbl_exists(&pm.htbl, (void*)&addr);
+}
+
+/* Read the run of adjacent pages starting at [addr_arr[first]], and
+ * return how many were added. In mapped mode the kernel is asked to
+ * read the run, and the pages are mapped.
+ */
+static int warm_read_run(uint64 *addr_arr, int first, int len)
+{
+    Oc_pm_page *pg_arr[OC_PM_MAX_RUN];
+    struct iovec iov[OC_PM_MAX_RUN];
+    int i, num_read = 0;
+
+    if (pm.base != NULL) {
+        (void) madvise(pm.base + addr_arr[first],
+                       (size_t) len * pm.block_size, MADV_WILLNEED);
+        for (i=0; i<len; i++)
+            pg_arr[i] = page_map(addr_arr[first + i]);
+    }
+    else {
+        for (i=0; i<len; i++) {
+            pg_arr[i] = page_new(addr_arr[first + i]);
+            iov[i].iov_base = pg_arr[i]->hndl.data;
+            iov[i].iov_len = pm.block_size;
+        }
+        read_vec(iov, len, addr_arr[first]);
+        for (i=0; i<len; i++)
+            page_loaded(pg_arr[i]);
+    }
+
+    // someone may have read a page meanwhile
+    oc_crt_lock_write(&pm.lock);
+    for (i=0; i<len; i++) {
+        if (oc_utl_rhtbl_exists(&pm.htbl, (void*)&pg_arr[i]->hndl.disk_addr))
+            continue;
+        oc_utl_rhtbl_insert(&pm.htbl, (void*)&pg_arr[i]->hndl.disk_addr,
+                            (void*)pg_arr[i]);
+        pg_arr[i] = NULL;
+        num_read++;
+    }
+    pm.stats.pages_prefetched += num_read;
+    pm.stats.prefetch_ios++;
+    oc_crt_unlock(&pm.lock);
+
+    for (i=0; i<len; i++)
+        if (pg_arr[i] != NULL)
+            page_free(pg_arr[i]);
+    return num_read;
+}
+
+static void *warm_run(void *_arg)
+{
+    Oc_pm_warm *w_p = (Oc_pm_warm*) _arg;
+    int r, first, len;
+
+    while ((r = __sync_fetch_and_add(&w_p->next_run, 1)) < w_p->num_runs) {
+        first = w_p->run_arr[r];
+        len = w_p->run_arr[r + 1] - first;
+        __sync_fetch_and_add(&w_p->num_read,
+                             warm_read_run(w_p->addr_arr, first, len));
+    }
+    oc_crt_sema_post(&w_p->done_sema);
+    return NULL;
+}
+
+uint64 oc_pm_warm_up_b(struct Oc_wu *wu_p, bool index_only)
+{
+    Oc_pm_warm warm;
+    Oc_pm_hot *hot_arr;
+    uint64 addr;
+    int i, num = 0, num_tasks;
+
+    if (0 == pm.hot_num)
+        return 0;
+
+    hot_arr = (Oc_pm_hot*) pl_mm_malloc(pm.hot_len * pm.block_size);
+    read_all((char*) hot_arr, pm.hot_len * pm.block_size,
+             addr_of_blk(pm.hot_blk));
+    if (oc_utl_crc32c_update(oc_utl_crc32c_init(), (char*) hot_arr,
+                             pm.hot_len * pm.block_size) != pm.hot_crc)
+        ERR(("the hot list is corrupt"));
+
+    memset(&warm, 0, sizeof(warm));
+    warm.addr_arr = (uint64*) pl_mm_malloc(pm.hot_num * sizeof(uint64));
+    warm.run_arr = (int*) pl_mm_malloc((pm.hot_num + 1) * sizeof(int));
+
+    // the list is sorted by address, a run ends at a gap
+    oc_crt_lock_read(&pm.lock);
+    for (i=0; i<(int)pm.hot_num; i++) {
+        addr = hot_arr[i].addr;
+        if ((index_only && hot_arr[i].leaf) || !hot_wanted(addr))
+            continue;
+        if (0 == num ||
+            addr != warm.addr_arr[num - 1] + pm.block_size ||
+            num - warm.run_arr[warm.num_runs - 1] == OC_PM_MAX_RUN)
+            warm.run_arr[warm.num_runs++] = num;
+        warm.addr_arr[num++] = addr;
+    }
+    warm.run_arr[warm.num_runs] = num;
+    oc_crt_unlock(&pm.lock);
+    pl_mm_free(hot_arr);
+
+    num_tasks = MIN(OC_PM_WARM_TASKS, warm.num_runs);
+    oc_crt_sema_init(&warm.done_sema, 0);
+    for (i=0; i<num_tasks; i++)
+        oc_crt_create_task("pm_warm", warm_run, (void*) &warm);
+    for (i=0; i<num_tasks; i++)
+        oc_crt_sema_wait(&warm.done_sema);
+
+    pl_mm_free(warm.addr_arr);
+    pl_mm_free(warm.run_arr);
+    return warm.num_read;
+}
+
+/**********************************************************************/
+
+static void setup(int fd, int block_size, uint64 num_blocks)
+{
+    memset(&pm, 0, sizeof(pm));
+    pm.fd = fd;
+    pm.block_size = block_size;
+    pm.num_blocks = num_blocks;
+    oc_crt_init_rw_lock(&pm.lock);
+    oc_crt_init_rw_lock(&pm.io_lock);
+    oc_utl_rhtbl_create(&pm.htbl, 1024, FALSE, hash_addr, compare_addr);
+    pl_mm_pool_create_pages(block_size, pm_use_huge, &pm.page_pool);
+    pm.ref_arr = (uint16*) pl_mm_malloc(num_blocks * sizeof(uint16));
+    memset(pm.ref_arr, 0, num_blocks * sizeof(uint16));
+
+    if (pm_use_mmap) {
+        pm.base = (char*) mmap(NULL, num_blocks * block_size,
+                               PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (MAP_FAILED == pm.base)
+            ERR(("could not map the device, errno=%d", errno));
+
+        // nodes are reached by following pointers, read-ahead is wasted
+        (void) madvise(pm.base, num_blocks * block_size, MADV_RANDOM);
+    }
+}
+
+static int open_dev(const char *dev_p, int flags)
+{
+    int fd;
+
+    if (NULL == dev_p)
+        dev_p = oc_utl_conf_g.data_dev;
+    fd = open(dev_p, flags, 0644);
+    if (fd < 0)
+        ERR(("could not open %s, errno=%d", dev_p, errno));
+    return fd;
+}
+
+void oc_pm_init(void)
+{
+    memset(&pm, 0, sizeof(pm));
+    pm.fd = -1;
+}
+
+void oc_pm_create_b(
+    struct Oc_wu *wu_p,
+    const char *dev_p,
+    int block_size,
+    uint64 num_blocks)
+{
+    int fd;
+    uint64 i;
+
+    oc_utl_assert(block_size >= (int) sizeof(Oc_meta_data_page_hdr));
+    oc_utl_assert(block_size % 512 == 0);
+    if (num_blocks * block_size <= OC_PM_NUM_SB * OC_PM_SB_SIZE)
+        ERR(("a device of %Lu blocks is too small", num_blocks));
+
+    fd = open_dev(dev_p, O_RDWR | O_CREAT | O_TRUNC);
+    if (ftruncate(fd, (off_t) (num_blocks * block_size)) != 0)
+        ERR(("could not set the size of the device, errno=%d", errno));
+    setup(fd, block_size, num_blocks);
+
+    // reserve the superblocks
+    for (i=0; addr_of_blk(i) < OC_PM_NUM_SB * OC_PM_SB_SIZE; i++) {
+        pm.ref_arr[i] = 1;
+        pm.num_used++;
+    }
+    pm.gen = 1;
+
+    oc_pm_checkpoint_b(wu_p);
+}
+
+// Read superblock [slot]. Return FALSE if it is not valid.
+static bool read_sb(int slot, char *blk_p)
+{
+    Oc_pm_sb *sb_p = (Oc_pm_sb*) blk_p;
+    uint32 crc;
+
+    read_all(blk_p, OC_PM_SB_SIZE, slot * OC_PM_SB_SIZE);
+    crc = sb_p->crc;
+    sb_p->crc = 0;
+    return (memcmp(sb_p->eye_catcher, OC_PM_SB_EYE, 4) == 0 &&
+            oc_utl_crc32c_update(oc_utl_crc32c_init(),
+                                 blk_p, OC_PM_SB_SIZE) == crc);
+}
+
+void oc_pm_open_b(struct Oc_wu *wu_p, const char *dev_p)
+{
+    char *sb_arr[OC_PM_NUM_SB];
+    Oc_pm_sb *sb_p = NULL;
+    Oc_pm_sb_tree *sbt_p;
+    Oc_pm_page *pg_p;
+    char *map_p;
+    int fd, i;
+    uint64 blk;
+
+    fd = open_dev(dev_p, O_RDWR);
+
+    // use the valid superblock with the highest generation
+    pm.fd = fd;
+    for (i=0; i<OC_PM_NUM_SB; i++) {
+        sb_arr[i] = (char*) pl_mm_malloc(OC_PM_SB_SIZE);
+        if (read_sb(i, sb_arr[i]) &&
+            (NULL == sb_p ||
+             ((Oc_pm_sb*) sb_arr[i])->generation > sb_p->generation))
+            sb_p = (Oc_pm_sb*) sb_arr[i];
+    }
+    if (NULL == sb_p)
+        ERR(("there is no valid superblock"));
+    oc_utl_assert(sb_p->num_trees <= OC_PM_MAX_TREES);
+
+    setup(fd, (int) sb_p->block_size, sb_p->num_blocks);
+    pm.gen = sb_p->generation + 1;
+    pm.map_blk = sb_p->map_blk;
+    pm.map_len = sb_p->map_len;
+    pm.hot_blk = sb_p->hot_blk;
+    pm.hot_len = sb_p->hot_len;
+    pm.hot_num = sb_p->hot_num;
+    pm.hot_crc = sb_p->hot_crc;
+
+    map_p = (char*) pl_mm_malloc(pm.map_len * pm.block_size);
+    read_all(map_p, pm.map_len * pm.block_size, addr_of_blk(pm.map_blk));
+    if (oc_utl_crc32c_update(oc_utl_crc32c_init(), map_p,
+                             pm.map_len * pm.block_size) != sb_p->map_crc)
+        ERR(("the block map is corrupt"));
+    memcpy(pm.ref_arr, map_p, pm.num_blocks * sizeof(uint16));
+    pl_mm_free(map_p);
+    for (blk=0; blk<pm.num_blocks; blk++)
+        if (pm.ref_arr[blk] != 0)
+            pm.num_used++;
+
+    // bring the roots into memory, from their images
+    sbt_p = (Oc_pm_sb_tree*) ((char*) sb_p + sizeof(Oc_pm_sb));
+    for (i=0; i<(int)sb_p->num_trees; i++) {
+        pm.tree_arr[i].tid = sbt_p[i].tid;
+        pm.tree_arr[i].root_addr = sbt_p[i].root_addr;
+        pm.tree_arr[i].img_addr = sbt_p[i].img_addr;
+
+        pg_p = page_read(sbt_p[i].img_addr);
+        pg_p->hndl.disk_addr = sbt_p[i].root_addr;
+        pg_p->is_root = TRUE;
+        oc_utl_rhtbl_insert(&pm.htbl, (void*)&pg_p->hndl.disk_addr,
+                            (void*)pg_p);
+    }
+    pm.num_trees = sb_p->num_trees;
+
+    for (i=0; i<OC_PM_NUM_SB; i++)
+        pl_mm_free(sb_arr[i]);
+}
+
+static void free_page(void *_elem, void *_ctx)
+{
+    page_free((Oc_pm_page*) _elem);
+}
+
+void oc_pm_close(void)
+{
+    Oc_pm_rm *rm_p, *next_p;
+
+    oc_pm_stop_flusher();
+
+    // the pages of the reservations are freed with the others
+    for (rm_p = pm.resv_list; rm_p != NULL; rm_p = next_p) {
+        next_p = rm_p->next;
+        rm_p->num_resv = 0;
+        rm_p->num_freed = 0;
+        rm_p->next = NULL;
+        rm_p->linked = FALSE;
+    }
+    oc_utl_rhtbl_iter(&pm.htbl, free_page, NULL);
+    oc_utl_rhtbl_free(&pm.htbl);
+    pl_mm_pool_delete(pm.page_pool, NULL);
+    pl_mm_free(pm.ref_arr);
+    if (pm.pending_arr != NULL)
+        pl_mm_free(pm.pending_arr);
+    if (pm.base != NULL)
+        munmap(pm.base, pm.num_blocks * pm.block_size);
+    close(pm.fd);
+    oc_pm_init();
+}
+
+void oc_pm_set_mmap(bool use_mmap)
+{
+    pm_use_mmap = use_mmap;
+}
+
+void oc_pm_set_huge_pages(bool use_huge)
+{
+    pm_use_huge = use_huge;
+}
+
+void oc_pm_set_hot_list(uint32 max_pages, uint32 interval)
+{
+    oc_utl_assert(interval > 0);
+    pm_hot_max = max_pages;
+    pm_hot_interval = interval;
+}
+
+void oc_pm_set_compress(bool compress)
+{
+    oc_crt_lock_write(&pm.lock);
+    pm.compress = compress;
+    oc_crt_unlock(&pm.lock);
+}
+
+uint64 oc_pm_get_generation(void)
+{
+    return pm.gen;
+}
+
+void oc_pm_get_stats(Oc_pm_stats *stats_po)
+{
+    oc_crt_lock_read(&pm.lock);
+    memcpy(stats_po, &pm.stats, sizeof(Oc_pm_stats));
+    stats_po->num_used = pm.num_used;
+    stats_po->num_dirty = pm.num_dirty;
+    oc_crt_unlock(&pm.lock);
+}
+
+/**********************************************************************/
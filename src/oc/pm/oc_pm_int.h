@@ -0,0 +1,228 @@
+/**************************************************************/
+/*
+ * Copyright (c) 2014-2015, Ohad Rodeh, IBM Research
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer. 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution. 
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies, 
+ * either expressed or implied, of IBM Research.
+ * 
+ */
+/**************************************************************/
+/******************************************************************/
+/* OC_PM_INT.H
+ *
+ * A page manager. It keeps the nodes of the b-trees in memory, and
+ * stores them on a device in fixed-size blocks. The device is updated
+ * only by checkpoints, using shadow paging: a node that is part of the
+ * last checkpoint is moved to a new block the first time it is
+ * modified, so the checkpoint stays intact on disk until the next one
+ * replaces it.
+ *
+ * The device starts with two superblocks. A checkpoint writes the
+ * dirty nodes, then the block map, and then the superblock that
+ * points to them, alternating between the two. After a crash, the
+ * valid superblock with the highest generation is used.
+ */
+/******************************************************************/
+#ifndef OC_PM_INT_H
+#define OC_PM_INT_H
+
+#include "pl_base.h"
+#include "oc_utl_s.h"
+#include "oc_bpt_int.h"
+
+struct Oc_wu;
+
+/******************************************************************/
+
+// The two superblocks are at the beginning of the device
+#define OC_PM_SB_SIZE (4096)
+#define OC_PM_NUM_SB (2)
+
+typedef struct Oc_pm_stats {
+    uint64 num_checkpoints;
+    uint64 pages_read;
+    uint64 pages_written;
+    uint64 write_ios;          // each one writes a run of adjacent pages
+    uint64 bytes_written;      // by the page writes
+    uint64 pages_compressed;   // written in compressed form
+    uint64 pages_shadowed;     // moved to a new block when first modified
+    uint64 flush_passes;
+    uint64 pages_flushed;      // written by flush passes, between checkpoints
+    uint64 writer_waits;       // writers held back by the hard limit
+    uint64 pages_prefetched;   // read by a warm-up
+    uint64 prefetch_ios;       // each one reads a run of adjacent pages
+    uint64 num_used;           // blocks in use, including the superblocks
+    uint64 num_dirty;          // nodes modified since they were last written
+} Oc_pm_stats;
+
+/******************************************************************/
+
+void oc_pm_init(void);
+
+/* Create an empty page manager on device [dev_p], or on the
+ * configured data device if [dev_p] is NULL. The device holds
+ * [num_blocks] blocks of [block_size] bytes; this is also the size of
+ * a node. An initial checkpoint is written.
+ */
+void oc_pm_create_b(
+    struct Oc_wu *wu_p,
+    const char *dev_p,
+    int block_size,
+    uint64 num_blocks);
+
+/* Open the page manager stored in [dev_p]. Its state is that of the
+ * last complete checkpoint.
+ */
+void oc_pm_open_b(struct Oc_wu *wu_p, const char *dev_p);
+
+/* Close the page manager. Modifications made after the last checkpoint
+ * are discarded.
+ */
+void oc_pm_close(void);
+
+/* Set the node functions of [cfg_p], so that the tree is kept by the
+ * page manager. The node size has to be the block size of the device.
+ */
+void oc_pm_set_bpt_cfg(Oc_bpt_cfg *cfg_p);
+
+/* Reserve blocks for the work-unit, enough for the b-tree operation
+ * [fid] with [param], as oc_bpt_query_b counts them. Nodes allocated by
+ * the work-unit come out of its reservation, without taking the lock
+ * of the page manager, and the nodes it frees are buffered. When the
+ * reservation runs out, an allocation reserves a small batch.
+ */
+void oc_pm_reserve(struct Oc_wu *wu_p,
+                   struct Oc_bpt_cfg *cfg_p,
+                   Oc_bpt_fid fid,
+                   void *param);
+
+/* Return the blocks reserved by the work-unit, and free the nodes it
+ * buffered. A work-unit that allocated or freed nodes has to call this
+ * before it goes away. Checkpoints return the blocks of all work-units
+ * as well, and keep them registered.
+ */
+void oc_pm_release(struct Oc_wu *wu_p);
+
+/* Register the tree [tid] whose root is at [root_addr]. The roots of
+ * the registered trees are recorded in the superblock by each
+ * checkpoint. A root never moves, it is written to a separate block
+ * at checkpoint time.
+ *
+ * Every tree kept by the page manager has to be registered once it is
+ * created, or cloned; otherwise its root may be moved.
+ */
+void oc_pm_tree_add(struct Oc_wu *wu_p, uint64 tid, uint64 root_addr);
+
+// Unregister tree [tid]. This does not delete the tree.
+void oc_pm_tree_remove(struct Oc_wu *wu_p, uint64 tid);
+
+/* Put the root address of tree [tid] in [root_addr_po]. Return FALSE
+ * if there is no such tree.
+ */
+bool oc_pm_tree_lookup(uint64 tid, uint64 *root_addr_po);
+
+/* Take a checkpoint. All the nodes modified since the previous one
+ * are written, sorted by address, in runs of adjacent blocks. The
+ * superblock is switched only after they are on disk, and the blocks
+ * freed by shadowing are reused only after the switch.
+ *
+ * The caller makes sure no update operations run concurrently. A
+ * flush pass in progress is waited for.
+ */
+void oc_pm_checkpoint_b(struct Oc_wu *wu_p);
+
+/* Write the dirty nodes now, without waiting for a checkpoint. The
+ * write goes to the new blocks of the nodes, the last checkpoint is not
+ * touched, so this does not make the modifications durable. It keeps
+ * the checkpoint short, and the dirty memory bounded. Nodes that are
+ * locked by someone else, and roots, are skipped. The writes are
+ * sorted by address and adjacent nodes are written together.
+ *
+ * Flush passes may run concurrently with updates.
+ */
+void oc_pm_flush_b(struct Oc_wu *wu_p);
+
+/* Start a task that runs flush passes in the background. A pass is
+ * started when [soft_limit] nodes are dirty, or when a node is dirtied
+ * [max_age_ms] or more after the previous pass. Ages are checked when
+ * nodes are dirtied; nothing wakes the flusher on an idle system. A
+ * writer that dirties a node while [hard_limit] nodes are dirty waits
+ * for a pass to complete.
+ *
+ * The flusher is stopped by oc_pm_close.
+ */
+void oc_pm_start_flusher(uint64 soft_limit,
+                         uint64 hard_limit,
+                         uint64 max_age_ms);
+
+// Stop the flusher, after the pass it is running
+void oc_pm_stop_flusher(void);
+
+/* Keep a list of the hottest nodes: all the index nodes in memory, and
+ * then the leaves that were looked up most often, [max_pages] nodes at
+ * most. Every [interval]-th checkpoint writes the list, the others keep
+ * the previous one. Zero [max_pages] drops the list. It is off by
+ * default, and holds for the following creates and opens.
+ */
+void oc_pm_set_hot_list(uint32 max_pages, uint32 interval);
+
+/* Bring the nodes of the hot list of the last checkpoint into memory,
+ * before taking traffic. They are read in address order, adjacent
+ * nodes by a single read, and several reads are issued in parallel.
+ * With [index_only], leaves are skipped. Return the number of nodes
+ * read.
+ *
+ * A list kept from an older checkpoint may be out of date; entries
+ * whose block is now free, or in memory, are skipped.
+ */
+uint64 oc_pm_warm_up_b(struct Oc_wu *wu_p, bool index_only);
+
+/* Map the device into memory on the following creates and opens.
+ * Nodes then point into the mapping instead of being read into
+ * buffers, and checkpoints write them with msync. Nodes that were
+ * stored compressed are still read, until they move. Mapped nodes are
+ * not compressed. It is off by default.
+ */
+void oc_pm_set_mmap(bool use_mmap);
+
+/* Carve the buffers of nodes, on the following creates and opens, out
+ * of slabs that are each a huge page. The buffers are page aligned in
+ * any case. It is off by default.
+ */
+void oc_pm_set_huge_pages(bool use_huge);
+
+/* Compress the nodes written by the following checkpoints. A node is
+ * written compressed only if this saves at least a sector. Nodes are
+ * readable whether compression is on or not. It is off after create,
+ * and after open.
+ */
+void oc_pm_set_compress(bool compress);
+
+// The generation of the next checkpoint
+uint64 oc_pm_get_generation(void);
+
+void oc_pm_get_stats(Oc_pm_stats *stats_po);
+
+#endif
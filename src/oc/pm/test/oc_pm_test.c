@@ -0,0 +1,788 @@
+/**************************************************************/
+/*
+ * Copyright (c) 2014-2015, Ohad Rodeh, IBM Research
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer. 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution. 
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies, 
+ * either expressed or implied, of IBM Research.
+ * 
+ */
+/**************************************************************/
+/**********************************************************************/
+/* OC_PM_TEST.C
+ *
+ * Test the page manager. Several tasks update a set of b-trees kept by
+ * the page manager, and checkpoints are taken in between. The test then
+ * crashes, by dropping everything in memory, and checks that the trees
+ * on disk match the last checkpoint. To check that the superblock
+ * switch is atomic, the last superblock is sometimes destroyed, in
+ * which case the trees have to match the checkpoint before it.
+ *
+ * With -flush, the flusher runs with small limits while the tasks
+ * update the trees, and flush passes are also run between steps.
+ *
+ * Between steps, trees are cloned, trimmed, or copied by dumping a
+ * clone to a file and restoring it.
+ *
+ * With -warm, checkpoints write a hot list, and each recovery reads it
+ * back before the trees are compared.
+ */
+/**********************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "pl_int.h"
+#include "pl_trace_base.h"
+#include "oc_utl.h"
+#include "oc_utl_trk.h"
+#include "oc_crt_int.h"
+#include "oc_rm_s.h"
+#include "oc_wu_s.h"
+#include "oc_bpt_int.h"
+#include "oc_pm_int.h"
+
+/**********************************************************************/
+// configuration defined on the command line
+static int num_rounds = 5;
+static int num_steps = 10;
+static int num_ops = 300;
+static int num_tasks = 8;
+static uint32 max_key = 2000;
+static int fanout = 20;
+static uint64 num_blocks = 20000;
+static char *dev_p = "/tmp/oc_pm_test.dev";
+static char dump_path[256];
+static bool compress = FALSE;
+static bool use_mmap = FALSE;
+static bool flush = FALSE;
+static bool warm = FALSE;
+static bool verbose = FALSE;
+
+#define BLOCK_SIZE (4096)
+
+// the flusher limits, in nodes, and its maximal age in milliseconds
+#define FLUSH_SOFT (16)
+#define FLUSH_HARD (64)
+#define FLUSH_AGE (2)
+
+// the size of the hot list, small enough to leave out some leaves
+#define HOT_MAX (300)
+#define HOT_INTERVAL (2)
+
+// the number of trees at the start of a round, and the most there can be
+#define NUM_INIT_TREES (2)
+#define MAX_TREES (6)
+
+// the number of entries compared at a time
+#define CMP_BATCH (64)
+
+// the entries of the tree whose dump is damaged, enough for a few blocks
+#define DAMAGE_KEYS (16000)
+
+// the number of consecutive keys owned by a task
+#define KEY_BLOCK (8)
+
+static Oc_bpt_cfg cfg;
+static Oc_crt_sema sema;
+
+/* The trees, and a model of each. A model holds the data of each key,
+ * zero if the key is absent. Tree [i] has TID i+1.
+ */
+typedef struct Model {
+    int num_trees;
+    uint32 *data[MAX_TREES];
+    uint64 num_used;           // blocks in use right after the checkpoint
+} Model;
+
+static Oc_bpt_state tree_s[MAX_TREES];
+static Model live, ckpt, prev_ckpt;
+
+// statistics of the page manager, summed over its reopenings
+static Oc_pm_stats tot_stats;
+
+// nodes allocated by single-key inserts, out of the reservations
+static uint64 split_allocs;
+
+/**********************************************************************/
+
+static uint32 random_choose(uint32 top)
+{
+    if (0 == top) return 0;
+    return (uint32) (rand() % top);
+}
+
+static void setup_wu(Oc_wu *wu_p, Oc_rm_ticket *rm_p, int po_id)
+{
+    memset(wu_p, 0, sizeof(Oc_wu));
+    memset(rm_p, 0, sizeof(Oc_rm_ticket));
+    wu_p->po_id = po_id;
+    wu_p->rm_p = rm_p;
+}
+
+static void model_copy(Model *trg_p, Model *src_p)
+{
+    int i;
+
+    trg_p->num_trees = src_p->num_trees;
+    trg_p->num_used = src_p->num_used;
+    for (i=0; i<MAX_TREES; i++)
+        memcpy(trg_p->data[i], src_p->data[i], max_key * sizeof(uint32));
+}
+
+static uint64 num_used(void)
+{
+    Oc_pm_stats stats;
+
+    oc_pm_get_stats(&stats);
+    return stats.num_used;
+}
+
+static void close_pm(void)
+{
+    Oc_pm_stats stats;
+
+    oc_pm_get_stats(&stats);
+    tot_stats.num_checkpoints += stats.num_checkpoints;
+    tot_stats.pages_read += stats.pages_read;
+    tot_stats.pages_written += stats.pages_written;
+    tot_stats.write_ios += stats.write_ios;
+    tot_stats.bytes_written += stats.bytes_written;
+    tot_stats.pages_compressed += stats.pages_compressed;
+    tot_stats.pages_shadowed += stats.pages_shadowed;
+    tot_stats.flush_passes += stats.flush_passes;
+    tot_stats.pages_flushed += stats.pages_flushed;
+    tot_stats.writer_waits += stats.writer_waits;
+    tot_stats.pages_prefetched += stats.pages_prefetched;
+    tot_stats.prefetch_ios += stats.prefetch_ios;
+    oc_pm_close();
+}
+
+static void start_flusher(void)
+{
+    if (flush)
+        oc_pm_start_flusher(FLUSH_SOFT, FLUSH_HARD, FLUSH_AGE);
+}
+
+/**********************************************************************/
+// keys and data are uint32
+
+static int key_compare(struct Oc_bpt_key *key1_p, struct Oc_bpt_key *key2_p)
+{
+    uint32 key1 = *((uint32*) key1_p);
+    uint32 key2 = *((uint32*) key2_p);
+
+    if (key1 == key2) return 0;
+    if (key1 < key2) return 1;
+    return -1;
+}
+
+static void key_inc(struct Oc_bpt_key *key_p, struct Oc_bpt_key *result_p)
+{
+    *((uint32*) result_p) = *((uint32*) key_p) + 1;
+}
+
+static void key_to_string(struct Oc_bpt_key *key_p, char *str_p, int max_len)
+{
+    snprintf(str_p, max_len, "%lu", *((uint32*) key_p));
+}
+
+static void data_release(struct Oc_wu *wu_p, struct Oc_bpt_data *data_p)
+{
+}
+
+static void data_to_string(struct Oc_bpt_data *data_p, char *str_p, int max_len)
+{
+    snprintf(str_p, max_len, "%lu", *((uint32*) data_p));
+}
+
+/**********************************************************************/
+
+static void create_tree(Oc_wu *wu_p, int idx)
+{
+    oc_bpt_init_state_b(wu_p, &tree_s[idx], &cfg, idx + 1);
+    oc_bpt_create_b(wu_p, &tree_s[idx]);
+    oc_pm_tree_add(wu_p, idx + 1, tree_s[idx].root_node_p->disk_addr);
+    memset(live.data[idx], 0, max_key * sizeof(uint32));
+}
+
+// Check that tree [idx] holds the same entries as its model
+static void compare_tree(Oc_wu *wu_p, int idx)
+{
+    uint32 keys[CMP_BATCH], data[CMP_BATCH];
+    uint32 min_key = 0, top_key = max_key - 1;
+    uint32 key;
+    int i, n;
+
+    if (!oc_bpt_dbg_validate_b(wu_p, &tree_s[idx]))
+        ERR(("tree %d is not valid", idx + 1));
+
+    do {
+        oc_bpt_lookup_range_b(wu_p, &tree_s[idx],
+                              (struct Oc_bpt_key*) &min_key,
+                              (struct Oc_bpt_key*) &top_key,
+                              CMP_BATCH,
+                              (struct Oc_bpt_key*) keys,
+                              (struct Oc_bpt_data*) data, &n);
+        for (i=0; i<n; i++) {
+            for (key = min_key; key < keys[i]; key++)
+                if (live.data[idx][key] != 0)
+                    ERR(("tree %d: key %lu is missing", idx + 1, key));
+            if (live.data[idx][keys[i]] != data[i])
+                ERR(("tree %d: key %lu has data %lu, expected %lu",
+                     idx + 1, keys[i], data[i], live.data[idx][keys[i]]));
+            min_key = keys[i] + 1;
+        }
+    } while (CMP_BATCH == n);
+
+    for (key = min_key; key < max_key; key++)
+        if (live.data[idx][key] != 0)
+            ERR(("tree %d: key %lu is missing", idx + 1, key));
+}
+
+/**********************************************************************/
+/* A task updates the trees. The keys are split into blocks of KEY_BLOCK
+ * consecutive keys, and each task updates only the keys in its own
+ * blocks, so it can update the models without locking.
+ *
+ * Blocks are reserved before each operation. An insert of a single key
+ * must then split nodes without taking the lock of the page manager.
+ */
+static void *task_run(void *_arg)
+{
+    int id = (int) (long) _arg;
+    Oc_wu wu;
+    Oc_rm_ticket rm;
+    int idx, i, j, n;
+    uint32 key, data, ofs;
+    uint32 key_array[KEY_BLOCK], data_array[KEY_BLOCK];
+    uint64 num_locked, num_allocs;
+
+    setup_wu(&wu, &rm, id + 1);
+    for (i=0; i<num_ops; i++) {
+        idx = random_choose(live.num_trees);
+        ofs = random_choose(KEY_BLOCK);
+        key = (id + num_tasks * random_choose(max_key / (KEY_BLOCK * num_tasks)))
+            * KEY_BLOCK + ofs;
+        data = 1 + random_choose(100000);
+
+        switch (random_choose(3)) {
+        case 0:
+            oc_pm_reserve(&wu, &cfg, OC_BPT_FN_INSERT_KEY, NULL);
+            num_locked = rm.pm_rm.num_locked;
+            num_allocs = rm.pm_rm.num_allocs;
+            oc_bpt_insert_key_b(&wu, &tree_s[idx],
+                                (struct Oc_bpt_key*) &key,
+                                (struct Oc_bpt_data*) &data);
+            if (rm.pm_rm.num_locked != num_locked)
+                ERR(("an insert took the lock to allocate nodes"));
+            __sync_fetch_and_add(&split_allocs,
+                                 rm.pm_rm.num_allocs - num_allocs);
+            live.data[idx][key] = data;
+            break;
+        case 1:
+            oc_pm_reserve(&wu, &cfg, OC_BPT_FN_REMOVE_KEY, NULL);
+            oc_bpt_remove_key_b(&wu, &tree_s[idx], (struct Oc_bpt_key*) &key);
+            live.data[idx][key] = 0;
+            break;
+        case 2:
+            n = 1 + random_choose(KEY_BLOCK - ofs);
+            for (j=0; j<n; j++) {
+                key_array[j] = key + j;
+                data_array[j] = data + j;
+            }
+            oc_pm_reserve(&wu, &cfg, OC_BPT_FN_INSERT_RANGE, &n);
+            oc_bpt_insert_range_b(&wu, &tree_s[idx], n,
+                                  (struct Oc_bpt_key*) key_array,
+                                  (struct Oc_bpt_data*) data_array);
+            for (j=0; j<n; j++)
+                live.data[idx][key + j] = data + j;
+            break;
+        }
+    }
+
+    oc_pm_release(&wu);
+    oc_crt_sema_post(&sema);
+    return NULL;
+}
+
+static void run_tasks(void)
+{
+    int i;
+
+    for (i=0; i<num_tasks; i++)
+        oc_crt_create_task("pm_task", task_run, (void*) (long) i);
+    for (i=0; i<num_tasks; i++)
+        oc_crt_sema_wait(&sema);
+}
+
+/* Copy tree [src] into tree [idx] by a dump and a restore. The dump is
+ * taken from a clone, as a backup would be.
+ */
+static void dump_restore(Oc_wu *wu_p, int src, int idx)
+{
+    Oc_bpt_state snap_s;
+    uint64 num, expected = 0;
+    uint32 key;
+    int fd;
+
+    oc_bpt_init_state_b(wu_p, &snap_s, &cfg, MAX_TREES + 1);
+    oc_bpt_clone_b(wu_p, &tree_s[src], &snap_s);
+    fd = open(dump_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        ERR(("could not create %s", dump_path));
+    if (oc_bpt_dump_b(wu_p, &snap_s, fd, &num) != OC_BPT_DUMP_OK)
+        ERR(("the dump of tree %d failed", src + 1));
+    oc_bpt_delete_b(wu_p, &snap_s);
+
+    for (key=0; key<max_key; key++)
+        if (live.data[src][key] != 0)
+            expected++;
+    if (num != expected)
+        ERR(("the dump of tree %d has %Lu entries, expected %Lu",
+             src + 1, num, expected));
+
+    if (lseek(fd, 0, SEEK_SET) != 0)
+        ERR(("could not rewind %s", dump_path));
+    oc_bpt_init_state_b(wu_p, &tree_s[idx], &cfg, idx + 1);
+    if (oc_bpt_restore_b(wu_p, &tree_s[idx], fd) != OC_BPT_DUMP_OK)
+        ERR(("the restore into tree %d failed", idx + 1));
+    close(fd);
+    oc_pm_tree_add(wu_p, idx + 1, tree_s[idx].root_node_p->disk_addr);
+    memcpy(live.data[idx], live.data[src], max_key * sizeof(uint32));
+    compare_tree(wu_p, idx);
+}
+
+/* Restore the dump in [fd], which is damaged. The restore has to fail
+ * with [expected], without a tree and without blocks left behind. The
+ * blocks reserved by the work-unit count as used, they are returned
+ * before counting.
+ */
+static void restore_damaged(Oc_wu *wu_p, int fd, Oc_bpt_dump_rc expected)
+{
+    Oc_bpt_state trg_s;
+    Oc_bpt_dump_rc rc;
+    uint64 used;
+
+    oc_pm_release(wu_p);
+    used = num_used();
+
+    if (lseek(fd, 0, SEEK_SET) != 0)
+        ERR(("could not rewind %s", dump_path));
+    oc_bpt_init_state_b(wu_p, &trg_s, &cfg, MAX_TREES + 2);
+    rc = oc_bpt_restore_b(wu_p, &trg_s, fd);
+    if (rc != expected)
+        ERR(("the restore of a damaged dump returned %s, expected %s",
+             oc_bpt_string_of_dump_rc(rc),
+             oc_bpt_string_of_dump_rc(expected)));
+    if (trg_s.root_node_p != NULL)
+        ERR(("a failed restore left a tree"));
+    oc_pm_release(wu_p);
+    if (num_used() != used)
+        ERR(("%Lu blocks are in use after a failed restore, expected %Lu",
+             num_used(), used));
+}
+
+/* Dump a tree of a few blocks, then restore it with a byte of its last
+ * block flipped, and cut short in its last blocks. Both are found after
+ * part of the target is built.
+ */
+static void dump_damage(Oc_wu *wu_p)
+{
+    Oc_bpt_state big_s;
+    uint32 keys[CMP_BATCH], data[CMP_BATCH];
+    uint64 num;
+    off_t size, ofs;
+    char c, flipped;
+    int fd, i, j;
+
+    oc_bpt_init_state_b(wu_p, &big_s, &cfg, MAX_TREES + 1);
+    oc_bpt_create_b(wu_p, &big_s);
+    for (i=0; i<DAMAGE_KEYS; i += CMP_BATCH) {
+        for (j=0; j<CMP_BATCH; j++) {
+            keys[j] = i + j;
+            data[j] = (uint32) rand();
+        }
+        oc_bpt_insert_range_b(wu_p, &big_s, CMP_BATCH,
+                              (struct Oc_bpt_key*) keys,
+                              (struct Oc_bpt_data*) data);
+    }
+    fd = open(dump_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        ERR(("could not create %s", dump_path));
+    if (oc_bpt_dump_b(wu_p, &big_s, fd, &num) != OC_BPT_DUMP_OK ||
+        num != DAMAGE_KEYS)
+        ERR(("the dump of %d entries failed", DAMAGE_KEYS));
+    oc_bpt_delete_b(wu_p, &big_s);
+    size = lseek(fd, 0, SEEK_END);
+
+    ofs = size - 1 - random_choose(256);
+    if (verbose)
+        printf("// restore a dump of %Lu bytes, flipped at %Lu\n",
+               (uint64) size, (uint64) ofs);
+    if (pread(fd, &c, 1, ofs) != 1)
+        ERR(("could not read %s", dump_path));
+    flipped = c ^ (char) (1 + random_choose(255));
+    if (pwrite(fd, &flipped, 1, ofs) != 1)
+        ERR(("could not write %s", dump_path));
+    restore_damaged(wu_p, fd, OC_BPT_DUMP_CORRUPT);
+    if (pwrite(fd, &c, 1, ofs) != 1)
+        ERR(("could not write %s", dump_path));
+
+    ofs = size - 1 - random_choose(size / 4);
+    if (verbose)
+        printf("// restore a dump of %Lu bytes, cut at %Lu\n",
+               (uint64) size, (uint64) ofs);
+    if (ftruncate(fd, ofs) != 0)
+        ERR(("could not truncate %s", dump_path));
+    restore_damaged(wu_p, fd, OC_BPT_DUMP_TRUNCATED);
+    close(fd);
+}
+
+// Whole-tree operations, run while no tasks are active
+static void tree_step(Oc_wu *wu_p)
+{
+    int src = random_choose(live.num_trees);
+    int idx = live.num_trees;
+    uint32 lo_key, hi_key, key;
+
+    if (live.num_trees == MAX_TREES) {
+        // delete the last tree
+        idx = live.num_trees - 1;
+        if (verbose)
+            printf("// delete %d\n", idx + 1);
+        oc_pm_tree_remove(wu_p, idx + 1);
+        oc_bpt_delete_b(wu_p, &tree_s[idx]);
+        live.num_trees--;
+        return;
+    }
+
+    switch (random_choose(3)) {
+    case 0:
+        if (verbose)
+            printf("// clone %d -> %d\n", src + 1, idx + 1);
+        oc_bpt_init_state_b(wu_p, &tree_s[idx], &cfg, idx + 1);
+        oc_bpt_clone_b(wu_p, &tree_s[src], &tree_s[idx]);
+        oc_pm_tree_add(wu_p, idx + 1, tree_s[idx].root_node_p->disk_addr);
+        memcpy(live.data[idx], live.data[src], max_key * sizeof(uint32));
+        live.num_trees++;
+        break;
+    case 1:
+        lo_key = random_choose(max_key);
+        hi_key = lo_key + random_choose(max_key / 10);
+        if (hi_key >= max_key)
+            hi_key = max_key - 1;
+        if (verbose)
+            printf("// remove_range %d [%lu,%lu]\n", src + 1, lo_key, hi_key);
+        oc_bpt_remove_range_b(wu_p, &tree_s[src],
+                              (struct Oc_bpt_key*) &lo_key,
+                              (struct Oc_bpt_key*) &hi_key);
+        for (key = lo_key; key <= hi_key; key++)
+            live.data[src][key] = 0;
+        break;
+    case 2:
+        if (verbose)
+            printf("// dump %d, restore -> %d\n", src + 1, idx + 1);
+        dump_restore(wu_p, src, idx);
+        live.num_trees++;
+        break;
+    }
+}
+
+static void checkpoint(Oc_wu *wu_p)
+{
+    if (verbose)
+        printf("// checkpoint generation=%Lu\n", oc_pm_get_generation());
+    oc_pm_checkpoint_b(wu_p);
+    live.num_used = num_used();
+    model_copy(&prev_ckpt, &ckpt);
+    model_copy(&ckpt, &live);
+}
+
+/* Crash, dropping everything in memory, and reopen. If [torn] is TRUE
+ * the superblock of the last checkpoint is destroyed as well.
+ */
+static void crash_and_recover(Oc_wu *wu_p, bool torn)
+{
+    char junk[64];
+    uint64 slot;
+    int fd, i;
+    uint64 root_addr, n;
+
+    if (verbose)
+        printf("// crash%s\n", torn ? ", with a torn superblock" : "");
+    slot = (oc_pm_get_generation() - 1) % OC_PM_NUM_SB;
+    close_pm();
+
+    if (torn) {
+        for (i=0; i<(int)sizeof(junk); i++)
+            junk[i] = (char) random_choose(256);
+        fd = open(dev_p, O_WRONLY);
+        oc_utl_assert(fd >= 0);
+        if (pwrite(fd, junk, sizeof(junk), slot * OC_PM_SB_SIZE) !=
+            sizeof(junk))
+            ERR(("could not write to the device"));
+        close(fd);
+        model_copy(&ckpt, &prev_ckpt);
+    }
+    model_copy(&live, &ckpt);
+
+    /* With both options, switch between mapped and unmapped mode, so
+     * compressed nodes are also found by the mapped mode.
+     */
+    if (use_mmap && compress)
+        oc_pm_set_mmap(random_choose(2) == 0);
+    oc_pm_set_huge_pages(random_choose(2) == 0);
+    oc_pm_open_b(wu_p, dev_p);
+    oc_pm_set_compress(compress);
+    start_flusher();
+    if (num_used() != live.num_used)
+        ERR(("%Lu blocks are in use after recovery, expected %Lu",
+             num_used(), live.num_used));
+    if (warm) {
+        n = oc_pm_warm_up_b(wu_p, random_choose(2) == 0);
+        if (verbose)
+            printf("// warm-up read %Lu nodes\n", n);
+    }
+
+    for (i=0; i<live.num_trees; i++) {
+        if (!oc_pm_tree_lookup(i + 1, &root_addr))
+            ERR(("tree %d is missing after recovery", i + 1));
+        oc_bpt_init_state_b(wu_p, &tree_s[i], &cfg, i + 1);
+        oc_bpt_open_b(wu_p, &tree_s[i], root_addr);
+        compare_tree(wu_p, i);
+    }
+    if (oc_pm_tree_lookup(live.num_trees + 1, &root_addr))
+        ERR(("tree %d should not exist after recovery", live.num_trees + 1));
+
+    // the checkpoint before the torn one is gone
+    model_copy(&prev_ckpt, &ckpt);
+}
+
+static void test_round(Oc_wu *wu_p, int round)
+{
+    uint64 base_used;
+    int i, step;
+
+    memset(&tot_stats, 0, sizeof(tot_stats));
+    split_allocs = 0;
+    oc_pm_create_b(wu_p, dev_p, BLOCK_SIZE, num_blocks);
+    oc_pm_set_compress(compress);
+    start_flusher();
+    base_used = num_used();
+
+    live.num_trees = 0;
+    for (i=0; i<NUM_INIT_TREES; i++) {
+        create_tree(wu_p, i);
+        live.num_trees++;
+    }
+    checkpoint(wu_p);
+    checkpoint(wu_p);
+    dump_damage(wu_p);
+
+    for (step=0; step<num_steps; step++) {
+        run_tasks();
+        tree_step(wu_p);
+        switch (random_choose(5)) {
+        case 0:
+            // lose the updates since the last checkpoint
+            crash_and_recover(wu_p, FALSE);
+            break;
+        case 1:
+            checkpoint(wu_p);
+            crash_and_recover(wu_p, random_choose(2) == 0);
+            break;
+        case 2:
+            // keep updating in the same generation, after clones too
+            if (flush)
+                oc_pm_flush_b(wu_p);
+            break;
+        default:
+            checkpoint(wu_p);
+            break;
+        }
+    }
+    for (i=0; i<live.num_trees; i++)
+        compare_tree(wu_p, i);
+    if (0 == split_allocs)
+        ERR(("no insert split a node"));
+
+    // remove everything, no block should remain in use
+    for (i=0; i<live.num_trees; i++) {
+        oc_pm_tree_remove(wu_p, i + 1);
+        oc_bpt_delete_b(wu_p, &tree_s[i]);
+    }
+    live.num_trees = 0;
+
+    // a hot list may be kept from an earlier checkpoint, drop it
+    if (warm)
+        oc_pm_set_hot_list(0, 1);
+    checkpoint(wu_p);
+    if (warm)
+        oc_pm_set_hot_list(HOT_MAX, HOT_INTERVAL);
+    if (num_used() != base_used)
+        ERR(("%Lu blocks are in use, expected %Lu", num_used(), base_used));
+
+    close_pm();
+    printf("// round %d: checkpoints=%Lu pages_written=%Lu write_ios=%Lu "
+           "kbytes_written=%Lu compressed=%Lu shadowed=%Lu read=%Lu\n",
+           round, tot_stats.num_checkpoints, tot_stats.pages_written,
+           tot_stats.write_ios, tot_stats.bytes_written / 1024,
+           tot_stats.pages_compressed, tot_stats.pages_shadowed,
+           tot_stats.pages_read);
+    if (flush)
+        printf("// round %d: flush_passes=%Lu pages_flushed=%Lu "
+               "writer_waits=%Lu\n",
+               round, tot_stats.flush_passes, tot_stats.pages_flushed,
+               tot_stats.writer_waits);
+    if (warm)
+        printf("// round %d: pages_prefetched=%Lu prefetch_ios=%Lu\n",
+               round, tot_stats.pages_prefetched, tot_stats.prefetch_ios);
+}
+
+/**********************************************************************/
+
+static void *test_init_fun(void *dummy)
+{
+    Oc_wu wu;
+    Oc_rm_ticket rm;
+    int i;
+
+    setup_wu(&wu, &rm, 0);
+    oc_crt_sema_init(&sema, 0);
+    for (i=0; i<MAX_TREES; i++) {
+        live.data[i] = (uint32*) malloc(max_key * sizeof(uint32));
+        ckpt.data[i] = (uint32*) malloc(max_key * sizeof(uint32));
+        prev_ckpt.data[i] = (uint32*) malloc(max_key * sizeof(uint32));
+    }
+
+    oc_bpt_init();
+    oc_pm_init();
+    oc_pm_set_mmap(use_mmap);
+    if (warm)
+        oc_pm_set_hot_list(HOT_MAX, HOT_INTERVAL);
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.key_size = sizeof(uint32);
+    cfg.data_size = sizeof(uint32);
+    cfg.root_fanout = fanout;
+    cfg.non_root_fanout = fanout;
+    cfg.min_num_ent = 2;
+    cfg.key_compare = key_compare;
+    cfg.key_inc = key_inc;
+    cfg.key_to_string = key_to_string;
+    cfg.data_release = data_release;
+    cfg.data_to_string = data_to_string;
+    cfg.node_size = BLOCK_SIZE;
+    oc_pm_set_bpt_cfg(&cfg);
+    oc_bpt_init_config(&cfg);
+
+    for (i=0; i<num_rounds; i++)
+        test_round(&wu, i);
+
+    unlink(dev_p);
+    unlink(dump_path);
+    printf("done pm test\n");
+    exit(0);
+    return NULL;
+}
+
+static void help_msg(void)
+{
+    printf("oc_pm_test: test the page manager\n");
+    printf("    -num_rounds <int>\n");
+    printf("    -num_steps <int>    number of checkpoints, or crashes, per round\n");
+    printf("    -num_ops <int>      number of operations per task, per step\n");
+    printf("    -num_tasks <int>    number of concurrent tasks\n");
+    printf("    -max_key <int>      keys are in the range [0 .. max_key-1]\n");
+    printf("    -fanout <int>       maximal fanout of the tree nodes\n");
+    printf("    -num_blocks <int>   size of the device, in blocks\n");
+    printf("    -dev <file>         where to keep the device\n");
+    printf("    -compress           compress the nodes when they are written\n");
+    printf("    -mmap               map the device into memory\n");
+    printf("    -flush              run the flusher, with small limits\n");
+    printf("    -warm               keep a hot list, and warm up after recovery\n");
+    printf("    -verbose\n");
+    exit(1);
+}
+
+static void parse_cmd_line(int argc, char *argv[])
+{
+    int i;
+
+    for (i=1; i<argc; i++) {
+        if (strcmp(argv[i], "-verbose") == 0)
+            verbose = TRUE;
+        else if (strcmp(argv[i], "-compress") == 0)
+            compress = TRUE;
+        else if (strcmp(argv[i], "-mmap") == 0)
+            use_mmap = TRUE;
+        else if (strcmp(argv[i], "-flush") == 0)
+            flush = TRUE;
+        else if (strcmp(argv[i], "-warm") == 0)
+            warm = TRUE;
+        else if (i+1 >= argc)
+            help_msg();
+        else if (strcmp(argv[i], "-num_rounds") == 0)
+            num_rounds = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-num_steps") == 0)
+            num_steps = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-num_ops") == 0)
+            num_ops = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-num_tasks") == 0)
+            num_tasks = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-max_key") == 0)
+            max_key = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-fanout") == 0)
+            fanout = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-num_blocks") == 0)
+            num_blocks = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-dev") == 0)
+            dev_p = argv[++i];
+        else
+            help_msg();
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    Oc_crt_config crt_conf;
+
+    pl_trace_base_init();
+    parse_cmd_line(argc, argv);
+    snprintf(dump_path, sizeof(dump_path), "%s.dump", dev_p);
+    pl_trace_base_init_done();
+
+    pl_init();
+
+    // The test runs as a task, the call below does not return
+    oc_crt_default_config(&crt_conf);
+    crt_conf.init_fun = test_init_fun;
+    crt_conf.stack_page_size = 20;
+    oc_crt_init_full(&crt_conf);
+
+    sleep(10000);
+    return 0;
+}
@@ -0,0 +1,127 @@
+#!/bin/bash -x
+
+#-----------------------------------------------------------------
+# Read command line parameters into -flags-
+flags=$*
+
+ocroot=../../../..
+oc_pm_test=$ocroot/bin/oc_pm_test
+
+if test ! -x $oc_pm_test
+then
+	echo Error: executable $oc_pm_test not found
+	echo aborting
+	exit 1
+fi
+
+#-----------------------------------------------------------------
+# run with small fanouts, so that the index trees grow deep, and with
+# few operations between checkpoints, so that most of them are small
+
+for fanout in 6 11 20
+  do
+  for num_tasks in 1 8 16
+    do
+    exec_flags="-fanout $fanout -num_tasks $num_tasks -num_rounds 5 $flags"
+    echo "Running $oc_pm_test $exec_flags"
+    $oc_pm_test $exec_flags
+
+    if test $? -ne 0
+	then
+	echo "-----------------------------------------------"
+	echo "Failure of test: $oc_pm_test $exec_flags"
+	echo "-----------------------------------------------"
+	exit 1
+    fi
+    exec_flags="-fanout $fanout -num_tasks $num_tasks -num_ops 50 -num_rounds 5 $flags"
+    echo "Running $oc_pm_test $exec_flags"
+    $oc_pm_test $exec_flags
+
+    if test $? -ne 0
+	then
+	echo "-----------------------------------------------"
+	echo "Failure of test: $oc_pm_test $exec_flags"
+	echo "-----------------------------------------------"
+	exit 1
+    fi
+    exec_flags="-fanout $fanout -num_tasks $num_tasks -num_rounds 5 -compress $flags"
+    echo "Running $oc_pm_test $exec_flags"
+    $oc_pm_test $exec_flags
+
+    if test $? -ne 0
+	then
+	echo "-----------------------------------------------"
+	echo "Failure of test: $oc_pm_test $exec_flags"
+	echo "-----------------------------------------------"
+	exit 1
+    fi
+    exec_flags="-fanout $fanout -num_tasks $num_tasks -num_rounds 5 -mmap $flags"
+    echo "Running $oc_pm_test $exec_flags"
+    $oc_pm_test $exec_flags
+
+    if test $? -ne 0
+	then
+	echo "-----------------------------------------------"
+	echo "Failure of test: $oc_pm_test $exec_flags"
+	echo "-----------------------------------------------"
+	exit 1
+    fi
+    exec_flags="-fanout $fanout -num_tasks $num_tasks -num_rounds 5 -mmap -compress $flags"
+    echo "Running $oc_pm_test $exec_flags"
+    $oc_pm_test $exec_flags
+
+    if test $? -ne 0
+	then
+	echo "-----------------------------------------------"
+	echo "Failure of test: $oc_pm_test $exec_flags"
+	echo "-----------------------------------------------"
+	exit 1
+    fi
+    exec_flags="-fanout $fanout -num_tasks $num_tasks -num_rounds 5 -flush $flags"
+    echo "Running $oc_pm_test $exec_flags"
+    $oc_pm_test $exec_flags
+
+    if test $? -ne 0
+	then
+	echo "-----------------------------------------------"
+	echo "Failure of test: $oc_pm_test $exec_flags"
+	echo "-----------------------------------------------"
+	exit 1
+    fi
+    exec_flags="-fanout $fanout -num_tasks $num_tasks -num_rounds 5 -mmap -flush $flags"
+    echo "Running $oc_pm_test $exec_flags"
+    $oc_pm_test $exec_flags
+
+    if test $? -ne 0
+	then
+	echo "-----------------------------------------------"
+	echo "Failure of test: $oc_pm_test $exec_flags"
+	echo "-----------------------------------------------"
+	exit 1
+    fi
+    exec_flags="-fanout $fanout -num_tasks $num_tasks -num_rounds 5 -warm $flags"
+    echo "Running $oc_pm_test $exec_flags"
+    $oc_pm_test $exec_flags
+
+    if test $? -ne 0
+	then
+	echo "-----------------------------------------------"
+	echo "Failure of test: $oc_pm_test $exec_flags"
+	echo "-----------------------------------------------"
+	exit 1
+    fi
+    exec_flags="-fanout $fanout -num_tasks $num_tasks -num_rounds 5 -mmap -compress -warm $flags"
+    echo "Running $oc_pm_test $exec_flags"
+    $oc_pm_test $exec_flags
+
+    if test $? -ne 0
+	then
+	echo "-----------------------------------------------"
+	echo "Failure of test: $oc_pm_test $exec_flags"
+	echo "-----------------------------------------------"
+	exit 1
+    fi
+  done
+done
+
+#-----------------------------------------------------------------
@@ -30,10 +30,12 @@
 #*************************************************************#
 UTL_OBJECTS = \
 	${OBJDIR}/oc_utl_htbl.o 	\
+	${OBJDIR}/oc_utl_rhtbl.o 	\
 	${OBJDIR}/oc_utl.o 		\
 	${OBJDIR}/oc_utl_trace_base.o 	\
 	${OBJDIR}/oc_utl_trace.o 	\
-	${OBJDIR}/oc_utl_trk.o 		
+	${OBJDIR}/oc_utl_trk.o 		\
+	${OBJDIR}/oc_utl_lz.o
 
 UTL_SHIM_OBJECTS = ${UTL_OBJECTS}
 
@@ -37,6 +37,11 @@
 #include <string.h>
 #include <stdlib.h>
 #include <signal.h>
+#include <pthread.h>
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <nmmintrin.h>
+#define OC_UTL_CRC32C_HW
+#endif
 
 #include "oc_utl.h"
 #include "oc_crt_int.h"
@@ -52,8 +57,8 @@ Oc_utl_config oc_utl_conf_g;
 uint32 oc_utl_lrc_update(uint32 lrc, char * buf, int len)
 {
     int n, non_align_len;
-    uint32 zero_buf = 0;
-    uint32 * p;
+    unsigned int zero_buf = 0;
+    unsigned int * p;
 
     /* must be aligned on a 32-bit boundary */
     oc_utl_assert(((uint32)buf & 3) == 0);
@@ -61,7 +66,10 @@ uint32 oc_utl_lrc_update(uint32 lrc, char * buf, int len)
     /* must be multiple of 32 bits */
     //oc_utl_assert((len & 3) == 0);
 
-    p = (uint32 *) buf;
+    /* Walk the buffer in 32-bit words. Note that uint32 is not
+     * necessarily 32 bits wide.
+     */
+    p = (unsigned int *) buf;
     for (n = 0; n < len / 4; n++) {
         lrc ^= *p++;
     }
@@ -76,6 +84,126 @@ uint32 oc_utl_lrc_update(uint32 lrc, char * buf, int len)
     return lrc;
 }
 
+/**************************************************************/
+/* CRC32C (Castagnoli), reflected polynomial 0x82F63B78.
+ *
+ * The portable version processes eight bytes per step with eight
+ * lookup tables (slicing-by-8). On x86-64 processors with SSE4.2 the
+ * crc32 instruction is used instead. The choice is made once, when the
+ * tables are built.
+ */
+
+#define CRC32C_POLY 0x82F63B78
+
+static uint32_t crc32c_tbl[8][256];
+static pthread_once_t crc32c_once = PTHREAD_ONCE_INIT;
+static uint32_t (*crc32c_fun)(uint32_t crc, const unsigned char *p, size_t len);
+
+static uint32_t crc32c_sw(uint32_t crc, const unsigned char *p, size_t len)
+{
+    uint32_t lo, hi;
+
+    while (len > 0 && ((uintptr_t)p & 7) != 0) {
+        crc = crc32c_tbl[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+        len--;
+    }
+
+    while (len >= 8) {
+        lo = crc ^ ((uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+                    ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24));
+        hi = ((uint32_t)p[4] | ((uint32_t)p[5] << 8) |
+              ((uint32_t)p[6] << 16) | ((uint32_t)p[7] << 24));
+        crc = crc32c_tbl[7][lo & 0xff] ^
+            crc32c_tbl[6][(lo >> 8) & 0xff] ^
+            crc32c_tbl[5][(lo >> 16) & 0xff] ^
+            crc32c_tbl[4][lo >> 24] ^
+            crc32c_tbl[3][hi & 0xff] ^
+            crc32c_tbl[2][(hi >> 8) & 0xff] ^
+            crc32c_tbl[1][(hi >> 16) & 0xff] ^
+            crc32c_tbl[0][hi >> 24];
+        p += 8;
+        len -= 8;
+    }
+
+    while (len > 0) {
+        crc = crc32c_tbl[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+        len--;
+    }
+    return crc;
+}
+
+#ifdef OC_UTL_CRC32C_HW
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_hw(uint32_t crc, const unsigned char *p, size_t len)
+{
+    uint64_t crc64;
+
+    while (len > 0 && ((uintptr_t)p & 7) != 0) {
+        crc = _mm_crc32_u8(crc, *p++);
+        len--;
+    }
+
+    crc64 = crc;
+    while (len >= 8) {
+        crc64 = _mm_crc32_u64(crc64, *(const uint64_t*)p);
+        p += 8;
+        len -= 8;
+    }
+    crc = (uint32_t) crc64;
+
+    while (len > 0) {
+        crc = _mm_crc32_u8(crc, *p++);
+        len--;
+    }
+    return crc;
+}
+#endif
+
+static void crc32c_init_tables(void)
+{
+    uint32_t crc;
+    int i, j;
+
+    for (i = 0; i < 256; i++) {
+        crc = i;
+        for (j = 0; j < 8; j++)
+            crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+        crc32c_tbl[0][i] = crc;
+    }
+    for (i = 0; i < 256; i++) {
+        crc = crc32c_tbl[0][i];
+        for (j = 1; j < 8; j++) {
+            crc = crc32c_tbl[0][crc & 0xff] ^ (crc >> 8);
+            crc32c_tbl[j][i] = crc;
+        }
+    }
+
+    crc32c_fun = crc32c_sw;
+#ifdef OC_UTL_CRC32C_HW
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2"))
+        crc32c_fun = crc32c_hw;
+#endif
+}
+
+/** Update a CRC32C. The checksum of a buffer can be computed in several
+ * pieces, passing the result of each piece to the next.
+ */
+uint32 oc_utl_crc32c_update(uint32 crc, const char * buf, int len)
+{
+    pthread_once(&crc32c_once, crc32c_init_tables);
+    return ~crc32c_fun(~(uint32_t)crc,
+                       (const unsigned char*) buf, (size_t) len);
+}
+
+/** Same as [oc_utl_crc32c_update], always using the portable version */
+uint32 oc_utl_crc32c_update_sw(uint32 crc, const char * buf, int len)
+{
+    pthread_once(&crc32c_once, crc32c_init_tables);
+    return ~crc32c_sw(~(uint32_t)crc,
+                      (const unsigned char*) buf, (size_t) len);
+}
+
 /**************************************************************/
 
 #define CASE(s) case s: return #s ; break
@@ -123,6 +123,18 @@ static inline uint32 oc_utl_lrc_init(void)
 /** Update a 32-bit Linear Redundancy Check */
 uint32 oc_utl_lrc_update(uint32 lrc, char * buf, int len);
 
+/** Initialize a CRC32C checksum */
+static inline uint32 oc_utl_crc32c_init(void)
+{
+    return 0;
+}
+
+/** Update a CRC32C checksum, uses SSE4.2 when the processor has it */
+uint32 oc_utl_crc32c_update(uint32 crc, const char * buf, int len);
+
+/** Update a CRC32C checksum, portable version */
+uint32 oc_utl_crc32c_update_sw(uint32 crc, const char * buf, int len);
+
 const char *oc_utl_string_of_subcomponent_id(Oc_subcomponent_id id);
 
 uint64 oc_query_input_lun_size(uint32 lun);
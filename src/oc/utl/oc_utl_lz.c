@@ -0,0 +1,215 @@
+/**************************************************************/
+/*
+ * Copyright (c) 2014-2015, Ohad Rodeh, IBM Research
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer. 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution. 
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies, 
+ * either expressed or implied, of IBM Research.
+ * 
+ */
+/**************************************************************/
+/**************************************************************/
+/* Description: A small LZ77 compressor.
+ *
+ * The compressor hashes the four bytes at each position, and keeps the
+ * last position seen for each hash value. A candidate whose four bytes
+ * match is extended as far as possible. There is no search for a
+ * longer match; the decompressor checks all its bounds, so corrupt
+ * input is detected rather than trusted.
+ */
+#include <string.h>
+
+#include "oc_utl.h"
+#include "oc_utl_lz.h"
+
+/**************************************************************/
+
+#define LZ_HASH_BITS (12)
+#define LZ_MIN_MATCH (4)
+#define LZ_MAX_OFS (65535)
+
+static inline unsigned int lz_read32(const unsigned char *p)
+{
+    unsigned int v;
+
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static inline unsigned int lz_hash(unsigned int v)
+{
+    return (v * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+// Write the extension bytes of a length. Return NULL if out of space.
+static unsigned char *put_len(unsigned char *op, unsigned char *oend, int len)
+{
+    while (len >= 255) {
+        if (op >= oend) return NULL;
+        *op++ = 255;
+        len -= 255;
+    }
+    if (op >= oend) return NULL;
+    *op++ = (unsigned char) len;
+    return op;
+}
+
+/* Write a sequence. [match_len] is zero for the last sequence, which
+ * has no match.
+ */
+static unsigned char *put_seq(unsigned char *op, unsigned char *oend,
+                              const unsigned char *lit_p, int lit_len,
+                              int match_len, int ofs)
+{
+    unsigned char token;
+
+    token = (unsigned char) ((lit_len >= 15 ? 15 : lit_len) << 4);
+    if (match_len > 0)
+        token |= (match_len - LZ_MIN_MATCH >= 15 ?
+                  15 : match_len - LZ_MIN_MATCH);
+    if (op >= oend) return NULL;
+    *op++ = token;
+
+    if (lit_len >= 15 &&
+        NULL == (op = put_len(op, oend, lit_len - 15)))
+        return NULL;
+    if (oend - op < lit_len) return NULL;
+    memcpy(op, lit_p, lit_len);
+    op += lit_len;
+
+    if (0 == match_len)
+        return op;
+    if (oend - op < 2) return NULL;
+    *op++ = (unsigned char) (ofs & 0xff);
+    *op++ = (unsigned char) (ofs >> 8);
+    if (match_len - LZ_MIN_MATCH >= 15 &&
+        NULL == (op = put_len(op, oend, match_len - LZ_MIN_MATCH - 15)))
+        return NULL;
+    return op;
+}
+
+int oc_utl_lz_compress(const char *src_p, int len,
+                       char *dst_p, int dst_len,
+                       void *work_p)
+{
+    const unsigned char *src = (const unsigned char*) src_p;
+    unsigned char *op = (unsigned char*) dst_p;
+    unsigned char *oend = op + dst_len;
+    int *tbl = (int*) work_p;
+    int ip = 0, anchor = 0, cand, match_len;
+    unsigned int h;
+
+    // positions are kept plus one, zero is an empty slot
+    memset(tbl, 0, OC_UTL_LZ_WORK_SIZE);
+
+    while (ip + LZ_MIN_MATCH <= len) {
+        h = lz_hash(lz_read32(src + ip));
+        cand = tbl[h] - 1;
+        tbl[h] = ip + 1;
+
+        if (cand < 0 ||
+            ip - cand > LZ_MAX_OFS ||
+            lz_read32(src + cand) != lz_read32(src + ip)) {
+            ip++;
+            continue;
+        }
+
+        match_len = LZ_MIN_MATCH;
+        while (ip + match_len < len &&
+               src[cand + match_len] == src[ip + match_len])
+            match_len++;
+
+        op = put_seq(op, oend, src + anchor, ip - anchor,
+                     match_len, ip - cand);
+        if (NULL == op)
+            return 0;
+        ip += match_len;
+        anchor = ip;
+    }
+
+    op = put_seq(op, oend, src + anchor, len - anchor, 0, 0);
+    if (NULL == op)
+        return 0;
+    return (int) (op - (unsigned char*) dst_p);
+}
+
+// Read the extension bytes of a length. Return -1 if out of input.
+static int get_len(const unsigned char **ip_p, const unsigned char *iend)
+{
+    const unsigned char *ip = *ip_p;
+    int len = 0;
+
+    do {
+        if (ip >= iend) return -1;
+        len += *ip;
+    } while (*ip++ == 255);
+    *ip_p = ip;
+    return len;
+}
+
+bool oc_utl_lz_decompress(const char *src_p, int len,
+                          char *dst_p, int dst_len)
+{
+    const unsigned char *ip = (const unsigned char*) src_p;
+    const unsigned char *iend = ip + len;
+    unsigned char *dst = (unsigned char*) dst_p;
+    int op = 0, lit_len, match_len, ofs, ext;
+    unsigned char token;
+
+    while (ip < iend) {
+        token = *ip++;
+
+        lit_len = token >> 4;
+        if (15 == lit_len) {
+            if ((ext = get_len(&ip, iend)) < 0) return FALSE;
+            lit_len += ext;
+        }
+        if (iend - ip < lit_len || dst_len - op < lit_len)
+            return FALSE;
+        memcpy(dst + op, ip, lit_len);
+        ip += lit_len;
+        op += lit_len;
+
+        // the last sequence has no match
+        if (ip == iend)
+            break;
+
+        if (iend - ip < 2) return FALSE;
+        ofs = ip[0] | (ip[1] << 8);
+        ip += 2;
+        match_len = (token & 15) + LZ_MIN_MATCH;
+        if (15 + LZ_MIN_MATCH == match_len) {
+            if ((ext = get_len(&ip, iend)) < 0) return FALSE;
+            match_len += ext;
+        }
+        if (0 == ofs || ofs > op || dst_len - op < match_len)
+            return FALSE;
+
+        // the match may overlap the bytes it produces
+        for (; match_len > 0; match_len--, op++)
+            dst[op] = dst[op - ofs];
+    }
+
+    return (op == dst_len);
+}
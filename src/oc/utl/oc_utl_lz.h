@@ -0,0 +1,70 @@
+/**************************************************************/
+/*
+ * Copyright (c) 2014-2015, Ohad Rodeh, IBM Research
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer. 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution. 
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies, 
+ * either expressed or implied, of IBM Research.
+ * 
+ */
+/**************************************************************/
+/**************************************************************/
+/* Description: A small LZ77 compressor for meta-data pages.
+ *
+ * It is meant for pages of a few kilobytes, where speed matters more
+ * than the compression ratio: repeated bytes, runs of zeros, and
+ * similar keys and records. The format is a sequence of
+ *   token, literal length extension, literals, offset, match length
+ *   extension
+ * The token holds the literal length in its high four bits and the
+ * match length, minus four, in its low four bits. A value of 15 is
+ * followed by extension bytes, added together until a byte smaller
+ * than 255. The offset is two bytes, little-endian. The last sequence
+ * has literals only.
+ */
+
+#ifndef OC_UTL_LZ_H
+#define OC_UTL_LZ_H
+
+#include "pl_base.h"
+
+// The size of the work area the compressor needs
+#define OC_UTL_LZ_WORK_SIZE (4096 * sizeof(int))
+
+/* Compress [len] bytes from [src_p] into [dst_p], using [work_p] as a
+ * scratch area. Return the compressed length, or zero if it does not
+ * fit in [dst_len] bytes.
+ */
+int oc_utl_lz_compress(const char *src_p, int len,
+                       char *dst_p, int dst_len,
+                       void *work_p);
+
+/* Decompress [len] bytes from [src_p] into [dst_p]. Return FALSE if
+ * the input is malformed, or does not decompress to exactly [dst_len]
+ * bytes.
+ */
+bool oc_utl_lz_decompress(const char *src_p, int len,
+                          char *dst_p, int dst_len);
+
+#endif
@@ -0,0 +1,576 @@
+/**************************************************************/
+/*
+ * Copyright (c) 2014-2015, Ohad Rodeh, IBM Research
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer. 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution. 
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies, 
+ * either expressed or implied, of IBM Research.
+ * 
+ */
+/**************************************************************/
+/* Description: An open-addressing (Robin-Hood) hashtable.
+ *
+ * Each slot records its distance from its home slot (dib). An insert
+ * displaces any element that is closer to its home than the element
+ * being inserted, so the probe sequences stay short even when the
+ * table is nearly full. A lookup stops as soon as it meets a slot
+ * whose dib is smaller than the current probe distance. Removal
+ * shifts the rest of the cluster back by one slot, so there are no
+ * tombstones.
+ *
+ * A shard that becomes 7/8 full allocates an array twice as large.
+ * The old array is drained into the new one a few slots at a time, on
+ * each insert and remove, so a single operation never pays for the
+ * whole resize. Lookups search the new array and then the old one.
+ */
+
+#include "oc_utl_rhtbl.h"
+#include "oc_utl.h"
+#include <memory.h>
+#include <stdio.h>
+
+// number of shards in concurrent mode, a power of two
+#define OC_UTL_RHTBL_SHARDS      (16)
+
+// minimal length of a shard array, a power of two
+#define OC_UTL_RHTBL_MIN_LEN     (16)
+
+// how many slots of the old array to migrate in each update
+#define OC_UTL_RHTBL_MIGRATE     (16)
+
+/*********************************************************************************/
+
+static void guard_take(volatile int *guard_p)
+{
+    while (__sync_lock_test_and_set(guard_p, 1))
+        while (*guard_p)
+            ;
+}
+
+static void guard_drop(volatile int *guard_p)
+{
+    __sync_lock_release(guard_p);
+}
+
+static void write_begin(Oc_utl_rhtbl *h_i, Oc_utl_rhtbl_shard *sh_p)
+{
+    if (!h_i->concurrent)
+        return;
+    guard_take(&sh_p->guard);
+    sh_p->seq++;
+    __sync_synchronize();
+}
+
+static void write_end(Oc_utl_rhtbl *h_i, Oc_utl_rhtbl_shard *sh_p)
+{
+    if (!h_i->concurrent)
+        return;
+    __sync_synchronize();
+    sh_p->seq++;
+    guard_drop(&sh_p->guard);
+}
+
+static Oc_utl_rhtbl_shard *get_shard(Oc_utl_rhtbl *h_i, uint64 hash)
+{
+    if (1 == h_i->num_shards)
+        return &h_i->shards[0];
+    return &h_i->shards[hash >> h_i->shard_shift];
+}
+
+/*********************************************************************************/
+// arrays
+
+/* An array is allocated with one extra slot in front of it. The extra
+ * slot records the length of the array, so that a concurrent lookup
+ * never pairs an array with the length of another, and links retired
+ * arrays together.
+ */
+static Oc_utl_rhtbl_slot *arr_alloc(uint32 len)
+{
+    Oc_utl_rhtbl_slot *base_p;
+
+    base_p = (Oc_utl_rhtbl_slot*) pl_mm_malloc((len+1) * sizeof(Oc_utl_rhtbl_slot));
+    memset(base_p, 0, (len+1) * sizeof(Oc_utl_rhtbl_slot));
+    base_p->hash = len;
+    return base_p + 1;
+}
+
+static uint32 arr_len(Oc_utl_rhtbl_slot *arr)
+{
+    return (arr - 1)->hash;
+}
+
+static void arr_free(Oc_utl_rhtbl_slot *arr)
+{
+    pl_mm_free((char*)(arr - 1));
+}
+
+/* Release an array that is no longer part of the shard. In concurrent
+ * mode a lookup may still be reading it, it is kept until the table
+ * is freed. The retired arrays add up to less than the current array.
+ */
+static void arr_retire(Oc_utl_rhtbl *h_i,
+                       Oc_utl_rhtbl_shard *sh_p,
+                       Oc_utl_rhtbl_slot *arr)
+{
+    if (!h_i->concurrent) {
+        arr_free(arr);
+        return;
+    }
+    (arr - 1)->elem = (void*) sh_p->retired;
+    sh_p->retired = arr;
+}
+
+// Return the location of [key_i] in [arr], or -1 if it is not there.
+static int arr_find(Oc_utl_rhtbl *h_i,
+                    Oc_utl_rhtbl_slot *arr,
+                    uint32 len,
+                    uint32 hash,
+                    void *key_i)
+{
+    uint32 mask = len - 1;
+    uint32 i = hash & mask;
+    uint32 dib;
+
+    /* The bound on [dib] protects a concurrent lookup that sees a
+     * partially updated array.
+     */
+    for (dib = 1; dib <= len; dib++) {
+        Oc_utl_rhtbl_slot *slot_p = &arr[i];
+        void *elem = slot_p->elem;
+
+        if (slot_p->dib < dib)
+            return -1;
+        if (slot_p->hash == hash &&
+            elem != NULL &&
+            h_i->compare(elem, key_i) == TRUE)
+            return i;
+        i = (i + 1) & mask;
+    }
+    return -1;
+}
+
+static void arr_insert(Oc_utl_rhtbl_slot *arr,
+                       uint32 len,
+                       uint32 hash,
+                       void *elem)
+{
+    uint32 mask = len - 1;
+    uint32 i = hash & mask;
+    Oc_utl_rhtbl_slot cur, tmp;
+
+    cur.dib = 1;
+    cur.hash = hash;
+    cur.elem = elem;
+    while (1) {
+        if (0 == arr[i].dib) {
+            arr[i] = cur;
+            return;
+        }
+
+        // rob from the rich: displace an element that is closer to home
+        if (arr[i].dib < cur.dib) {
+            tmp = arr[i];
+            arr[i] = cur;
+            cur = tmp;
+        }
+        i = (i + 1) & mask;
+        cur.dib++;
+    }
+}
+
+// Remove the element at location [i], and shift the rest of the cluster back
+static void arr_delete(Oc_utl_rhtbl_slot *arr, uint32 len, uint32 i)
+{
+    uint32 mask = len - 1;
+    uint32 next = (i + 1) & mask;
+
+    while (arr[next].dib > 1) {
+        arr[i] = arr[next];
+        arr[i].dib--;
+        i = next;
+        next = (next + 1) & mask;
+    }
+    memset(&arr[i], 0, sizeof(Oc_utl_rhtbl_slot));
+}
+
+/*********************************************************************************/
+// incremental resizing
+
+// Move up to [n] slots of the old array into the new one
+static void migrate(Oc_utl_rhtbl *h_i, Oc_utl_rhtbl_shard *sh_p, uint32 n)
+{
+    while (sh_p->old_arr != NULL && n-- > 0) {
+        Oc_utl_rhtbl_slot *slot_p;
+
+        if (0 == sh_p->old_size) {
+            arr_retire(h_i, sh_p, sh_p->old_arr);
+            sh_p->old_arr = NULL;
+            sh_p->old_len = 0;
+            sh_p->mig_pos = 0;
+            break;
+        }
+
+        /* Removing an element shifts its successor into [mig_pos], so
+         * the position advances only past empty slots.
+         */
+        slot_p = &sh_p->old_arr[sh_p->mig_pos];
+        if (0 == slot_p->dib) {
+            sh_p->mig_pos = (sh_p->mig_pos + 1) & (sh_p->old_len - 1);
+            continue;
+        }
+        arr_insert(sh_p->arr, sh_p->len, slot_p->hash, slot_p->elem);
+        sh_p->size++;
+        arr_delete(sh_p->old_arr, sh_p->old_len, sh_p->mig_pos);
+        sh_p->old_size--;
+    }
+}
+
+static void grow_if_needed(Oc_utl_rhtbl *h_i, Oc_utl_rhtbl_shard *sh_p)
+{
+    uint32 total = sh_p->size + sh_p->old_size + 1;
+
+    if (total * 8 <= sh_p->len * 7)
+        return;
+
+    // complete the previous resize before starting a new one
+    while (sh_p->old_arr != NULL)
+        migrate(h_i, sh_p, sh_p->old_len + 1);
+
+    sh_p->old_arr = sh_p->arr;
+    sh_p->old_len = sh_p->len;
+    sh_p->old_size = sh_p->size;
+    sh_p->mig_pos = 0;
+
+    sh_p->len *= 2;
+    sh_p->arr = arr_alloc(sh_p->len);
+    sh_p->size = 0;
+}
+
+/*********************************************************************************/
+
+static void shard_init(Oc_utl_rhtbl_shard *sh_p, uint32 len)
+{
+    memset(sh_p, 0, sizeof(Oc_utl_rhtbl_shard));
+    sh_p->len = len;
+    sh_p->arr = arr_alloc(len);
+}
+
+static void shard_free(Oc_utl_rhtbl_shard *sh_p)
+{
+    Oc_utl_rhtbl_slot *arr, *next;
+
+    arr_free(sh_p->arr);
+    if (sh_p->old_arr)
+        arr_free(sh_p->old_arr);
+    for (arr = sh_p->retired; arr != NULL; arr = next) {
+        next = (Oc_utl_rhtbl_slot*) (arr - 1)->elem;
+        arr_free(arr);
+    }
+    memset(sh_p, 0, sizeof(Oc_utl_rhtbl_shard));
+}
+
+void oc_utl_rhtbl_create(
+    Oc_utl_rhtbl *htbl,
+    int size,
+    bool concurrent,
+    Oc_utl_rhtbl_hash     hash,
+    Oc_utl_htbl_compare   compare)
+{
+    uint32 i, len;
+
+    memset(htbl, 0, sizeof(Oc_utl_rhtbl));
+    htbl->concurrent = concurrent;
+    htbl->hash = hash;
+    htbl->compare = compare;
+    if (concurrent) {
+        htbl->num_shards = OC_UTL_RHTBL_SHARDS;
+        htbl->shard_shift = 64 - 4;
+    } else {
+        htbl->num_shards = 1;
+        htbl->shard_shift = 64;
+    }
+
+    // size the shards so that [size] elements fit without a resize
+    len = OC_UTL_RHTBL_MIN_LEN;
+    while (len * 7 < (size / htbl->num_shards + 1) * 8)
+        len *= 2;
+
+    htbl->shards = (Oc_utl_rhtbl_shard*)
+        pl_mm_malloc(htbl->num_shards * sizeof(Oc_utl_rhtbl_shard));
+    for (i=0; i<htbl->num_shards; i++)
+        shard_init(&htbl->shards[i], len);
+}
+
+void oc_utl_rhtbl_free(Oc_utl_rhtbl *htbl)
+{
+    uint32 i;
+
+    for (i=0; i<htbl->num_shards; i++)
+        shard_free(&htbl->shards[i]);
+    pl_mm_free((char*)htbl->shards);
+    memset(htbl, 0, sizeof(Oc_utl_rhtbl));
+}
+
+/* The hash is folded into 64-bits by the multiplicative finalizer of
+ * SplitMix64, so that both the low bits (slot) and the high bits
+ * (shard) are well distributed.
+ */
+uint64 oc_utl_rhtbl_hash_u64(uint64 key)
+{
+    key ^= key >> 30;
+    key *= 0xbf58476d1ce4e5b9ULL;
+    key ^= key >> 27;
+    key *= 0x94d049bb133111ebULL;
+    key ^= key >> 31;
+    return key;
+}
+
+/*********************************************************************************/
+
+static void *shard_lookup(Oc_utl_rhtbl *h_i,
+                          Oc_utl_rhtbl_shard *sh_p,
+                          uint32 hash,
+                          void *key_i)
+{
+    Oc_utl_rhtbl_slot *arr;
+    int loc;
+
+    // read each array pointer once, a writer may replace it
+    arr = *(Oc_utl_rhtbl_slot * volatile *)&sh_p->arr;
+    loc = arr_find(h_i, arr, arr_len(arr), hash, key_i);
+    if (loc >= 0)
+        return arr[loc].elem;
+
+    arr = *(Oc_utl_rhtbl_slot * volatile *)&sh_p->old_arr;
+    if (arr != NULL) {
+        loc = arr_find(h_i, arr, arr_len(arr), hash, key_i);
+        if (loc >= 0)
+            return arr[loc].elem;
+    }
+    return NULL;
+}
+
+/** lookup in the table.
+ */
+void* oc_utl_rhtbl_lookup(Oc_utl_rhtbl *h_i, void *key_i)
+{
+    uint64 hash = h_i->hash(key_i);
+    Oc_utl_rhtbl_shard *sh_p = get_shard(h_i, hash);
+    uint32 seq;
+    void *elem;
+
+    if (!h_i->concurrent)
+        return shard_lookup(h_i, sh_p, (uint32)hash, key_i);
+
+    // an optimistic read, retry if a writer got in the way
+    while (1) {
+        seq = sh_p->seq;
+        __sync_synchronize();
+        if (seq & 1)
+            continue;
+
+        elem = shard_lookup(h_i, sh_p, (uint32)hash, key_i);
+
+        __sync_synchronize();
+        if (seq == sh_p->seq)
+            return elem;
+    }
+}
+
+int oc_utl_rhtbl_exists(Oc_utl_rhtbl *h_i, void *key_i)
+{
+    return (oc_utl_rhtbl_lookup(h_i, key_i) != NULL);
+}
+
+uint32 oc_utl_rhtbl_size(Oc_utl_rhtbl *h_i)
+{
+    uint32 i, size = 0;
+
+    for (i=0; i<h_i->num_shards; i++)
+        size += h_i->shards[i].size + h_i->shards[i].old_size;
+    return size;
+}
+
+void oc_utl_rhtbl_insert(Oc_utl_rhtbl *h_i, void *key_i, void* elem)
+{
+    uint64 hash = h_i->hash(key_i);
+    Oc_utl_rhtbl_shard *sh_p = get_shard(h_i, hash);
+
+    oc_utl_assert(elem != NULL);
+    write_begin(h_i, sh_p);
+#if OC_DEBUG
+    if (shard_lookup(h_i, sh_p, (uint32)hash, key_i) != NULL)
+        ERR(("Trying to add an element to the hash-table twice"));
+#endif
+    grow_if_needed(h_i, sh_p);
+    migrate(h_i, sh_p, OC_UTL_RHTBL_MIGRATE);
+    arr_insert(sh_p->arr, sh_p->len, (uint32)hash, elem);
+    sh_p->size++;
+    write_end(h_i, sh_p);
+}
+
+/* lookup in the table, and extract the item if it exists
+ */
+void* oc_utl_rhtbl_extract(Oc_utl_rhtbl *h_i, void *key_i)
+{
+    uint64 hash = h_i->hash(key_i);
+    Oc_utl_rhtbl_shard *sh_p = get_shard(h_i, hash);
+    void *elem = NULL;
+    int loc;
+
+    write_begin(h_i, sh_p);
+    migrate(h_i, sh_p, OC_UTL_RHTBL_MIGRATE);
+
+    loc = arr_find(h_i, sh_p->arr, sh_p->len, (uint32)hash, key_i);
+    if (loc >= 0) {
+        elem = sh_p->arr[loc].elem;
+        arr_delete(sh_p->arr, sh_p->len, loc);
+        sh_p->size--;
+    }
+    else if (sh_p->old_arr != NULL) {
+        loc = arr_find(h_i, sh_p->old_arr, sh_p->old_len, (uint32)hash, key_i);
+        if (loc >= 0) {
+            elem = sh_p->old_arr[loc].elem;
+            arr_delete(sh_p->old_arr, sh_p->old_len, loc);
+            sh_p->old_size--;
+        }
+    }
+    write_end(h_i, sh_p);
+
+    return elem;
+}
+
+bool oc_utl_rhtbl_remove(Oc_utl_rhtbl *h_i, void *key_i)
+{
+    return (oc_utl_rhtbl_extract(h_i, key_i) != NULL);
+}
+
+/*********************************************************************************/
+// iteration
+
+/* Go over all the elements of [arr]. If [fun] returns TRUE for an
+ * element, remove it and, if [list_pi] is not NULL, add it to the list.
+ *
+ * The scan starts right after an empty slot. A removal shifts
+ * elements back by one slot, but never across an empty slot, so each
+ * element is seen exactly once.
+ */
+static uint32 arr_iter(Oc_utl_rhtbl_slot *arr,
+                       uint32 len,
+                       bool (*fun)(void *elem, void *data),
+                       void *additional_data,
+                       Ss_slist *list_pi)
+{
+    uint32 mask = len - 1;
+    uint32 i, n, num_removed = 0;
+
+    for (i=0; i<len && arr[i].dib != 0; i++)
+        ;
+    if (i == len)
+        ERR(("a full hashtable array"));
+
+    i = (i + 1) & mask;
+    for (n=0; n<len; ) {
+        void *elem = arr[i].elem;
+
+        if (arr[i].dib != 0 && fun(elem, additional_data) == TRUE) {
+            arr_delete(arr, len, i);
+            num_removed++;
+            if (list_pi) {
+                ((Ss_slist_node*)elem)->next = NULL;
+                ssslist_add_tail(list_pi, (Ss_slist_node*)elem);
+            }
+            continue;
+        }
+        i = (i + 1) & mask;
+        n++;
+    }
+    return num_removed;
+}
+
+static void iter_all(Oc_utl_rhtbl *h_i,
+                     bool (*fun)(void *elem, void *data),
+                     void *additional_data,
+                     Ss_slist *list_pi)
+{
+    uint32 i;
+
+    for (i=0; i<h_i->num_shards; i++) {
+        Oc_utl_rhtbl_shard *sh_p = &h_i->shards[i];
+
+        write_begin(h_i, sh_p);
+        sh_p->size -= arr_iter(sh_p->arr, sh_p->len,
+                               fun, additional_data, list_pi);
+        if (sh_p->old_arr != NULL)
+            sh_p->old_size -= arr_iter(sh_p->old_arr, sh_p->old_len,
+                                       fun, additional_data, list_pi);
+        write_end(h_i, sh_p);
+    }
+}
+
+typedef struct Iter_ctx {
+    void (*fun)(void *elem, void *ctx);
+    void *ctx;
+} Iter_ctx;
+
+static bool iter_keep(void *elem, void *data)
+{
+    Iter_ctx *ictx_p = (Iter_ctx*) data;
+
+    ictx_p->fun(elem, ictx_p->ctx);
+    return FALSE;
+}
+
+void oc_utl_rhtbl_iter(Oc_utl_rhtbl *h_i,
+                       void (*fun)(void *elem, void *ctx),
+                       void *ctx)
+{
+    Iter_ctx ictx;
+
+    ictx.fun = fun;
+    ictx.ctx = ctx;
+    iter_all(h_i, iter_keep, &ictx, NULL);
+}
+
+/* Same as above, but throw out any items that [fun] returns TRUE for.
+ */
+void oc_utl_rhtbl_iter_discard(Oc_utl_rhtbl *h_i,
+                               bool (*fun)(void *elem, void *data),
+                               void *additional_data )
+{
+    iter_all(h_i, fun, additional_data, NULL);
+}
+
+/* Same as above, but move any items that [fun] returns TRUE for into [list]
+ */
+void oc_utl_rhtbl_iter_mv_to_list(Oc_utl_rhtbl *h_i,
+                                  bool (*fun)(void *elem, void *data),
+                                  void *additional_data,
+                                  Ss_slist *list_pi)
+{
+    iter_all(h_i, fun, additional_data, list_pi);
+}
+
+/*********************************************************************************/
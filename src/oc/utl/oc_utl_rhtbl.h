@@ -0,0 +1,111 @@
+/**************************************************************/
+/*
+ * Copyright (c) 2014-2015, Ohad Rodeh, IBM Research
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer. 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution. 
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies, 
+ * either expressed or implied, of IBM Research.
+ * 
+ */
+/**************************************************************/
+/* Description: An open-addressing hashtable.
+ *
+ * A Robin-Hood hashtable that grows incrementally. Unlike
+ * oc_utl_htbl, the elements do not need to be linked through an
+ * Ss_slist_node, and the number of slots does not need to be chosen
+ * in advance. All operations do not consume the cell memory.
+ *
+ * In concurrent mode, the table is split into shards, each with its
+ * own writer lock. Lookups take no locks, they retry if a writer
+ * modified the shard under their feet. Note that a lookup may call
+ * [compare] on an element that is being removed concurrently, an
+ * element should not be released while lookups may be running.
+ */
+
+#ifndef OC_UTL_RHTBL_H
+#define OC_UTL_RHTBL_H
+
+#include "oc_utl_rhtbl_s.h"
+
+/* Create a hashtable. User needs to provide two functions: hash, and
+ * compare. [size] is a hint for the expected number of elements.
+ */
+void oc_utl_rhtbl_create(
+    Oc_utl_rhtbl *htbl,
+    int size,
+    bool concurrent,
+    Oc_utl_rhtbl_hash     hash,
+    Oc_utl_htbl_compare   compare
+    );
+
+// abruptly free up memory of htbl
+void oc_utl_rhtbl_free(Oc_utl_rhtbl *htbl);
+
+// A hash function for 64-bit keys, such as disk addresses
+uint64 oc_utl_rhtbl_hash_u64(uint64 key);
+
+/** lookup in the table.
+ */
+void* oc_utl_rhtbl_lookup(Oc_utl_rhtbl *h_i, void *key_i);
+
+int oc_utl_rhtbl_exists(Oc_utl_rhtbl *h_i, void *key_i);
+
+// return the number of elements in the table
+uint32 oc_utl_rhtbl_size(Oc_utl_rhtbl *h_i);
+
+/*
+ *  insert: Insert an item into the hash table. In a debugging build,
+ * first check if the item already exists. 
+ *
+ */
+void oc_utl_rhtbl_insert(Oc_utl_rhtbl *h_i, void *key_i, void* elem);
+
+bool oc_utl_rhtbl_remove(Oc_utl_rhtbl *h_i, void *key_i);
+
+/* lookup in the table, and extract the item if it exists
+ */
+void* oc_utl_rhtbl_extract(Oc_utl_rhtbl *h_i, void *key_i);
+
+/* The iterators have the same semantics as the oc_utl_htbl ones. [fun]
+ * may not access the table.
+ */
+void oc_utl_rhtbl_iter(Oc_utl_rhtbl *h_i,
+                       void (*fun)(void *elem, void *ctx),
+                       void *ctx);
+
+/* Same as above, but throw out any items that [fun] returns TRUE for.
+ */
+void oc_utl_rhtbl_iter_discard( Oc_utl_rhtbl *h_i,
+                                bool (*fun)(void *elem, void *data),
+                                void *additional_data );
+
+/* Same as above, but move the items into [list_pi]. The items have to
+ * start with an Ss_slist_node.
+ */
+void oc_utl_rhtbl_iter_mv_to_list( Oc_utl_rhtbl *h_i,
+                                   bool (*fun)(void *elem, void *data),
+                                   void *additional_data,
+                                   Ss_slist *list_pi );
+
+#endif 
@@ -129,6 +129,12 @@ void oc_utl_trk_crt_lock_read(Oc_wu *wu_p, Oc_crt_rw_lock *lock_p)
 void oc_utl_trk_crt_lock_write(Oc_wu *wu_p, Oc_crt_rw_lock *lock_p)
 {
     oc_utl_debugassert(wu_p->rm_p);
+#if OC_DEBUG
+    // the locks are not recursive, the work-unit would wait for itself
+    if (oc_utl_trk_is_held(wu_p, lock_p))
+        ERR(("a work-unit is waiting for a lock that it holds, lock=%p",
+             lock_p));
+#endif
     oc_crt_lock_write(lock_p);
     add_ref(wu_p, lock_p);
 }
@@ -140,6 +146,20 @@ void oc_utl_trk_crt_unlock(Oc_wu *wu_p, Oc_crt_rw_lock *lock_p)
     rmv_ref(wu_p, lock_p);
 }
 
+bool oc_utl_trk_is_held(Oc_wu *wu_p, Oc_crt_rw_lock *lock_p)
+{
+    Oc_utl_trk_ref_set *refs_p;
+    int i;
+
+    oc_utl_debugassert(wu_p->rm_p);
+    refs_p = &wu_p->rm_p->utl_rm.refs;
+
+    for (i=refs_p->cursor-1; i>=0; i--)
+        if (refs_p->locks[i] == lock_p)
+            return TRUE;
+    return FALSE;
+}
+
 // release the set of locks held by this work-unit
 void oc_utl_trk_abort(Oc_wu *wu_p)
 {
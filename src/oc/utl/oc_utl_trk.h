@@ -38,6 +38,9 @@ void oc_utl_trk_crt_lock_read(struct Oc_wu *wu_p, Oc_crt_rw_lock *lock_p);
 void oc_utl_trk_crt_lock_write(struct Oc_wu *wu_p, Oc_crt_rw_lock *lock_p);
 void oc_utl_trk_crt_unlock(struct Oc_wu *wu_p, Oc_crt_rw_lock *lock_p);
 
+// return TRUE if this work-unit holds the lock
+bool oc_utl_trk_is_held(struct Oc_wu *wu_p, Oc_crt_rw_lock *lock_p);
+
 // release the set of locks held by this work-unit
 void oc_utl_trk_abort(struct Oc_wu *wu_p);
 
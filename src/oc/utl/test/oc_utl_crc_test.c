@@ -0,0 +1,114 @@
+/**************************************************************/
+/*
+ * Copyright (c) 2014-2015, Ohad Rodeh, IBM Research
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer. 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution. 
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies, 
+ * either expressed or implied, of IBM Research.
+ * 
+ */
+/**************************************************************/
+/**************************************************************/
+/* 
+ * A self test for the CRC32C checksum
+ */
+#include <string.h>
+#include <stdlib.h>
+
+#include "pl_int.h"
+#include "oc_utl.h"
+
+/********************************************************************/
+
+#define BUF_SIZE (16 * 1024)
+#define NUM_ROUNDS (2000)
+
+static char buf[BUF_SIZE + 8];
+
+// published check values for CRC32C
+static void known_values(void)
+{
+    char zeros[32], ones[32], inc[32];
+    int i;
+
+    memset(zeros, 0, 32);
+    memset(ones, 0xff, 32);
+    for (i=0; i<32; i++)
+        inc[i] = i;
+
+    if (oc_utl_crc32c_update(oc_utl_crc32c_init(), "123456789", 9) != 0xE3069283 ||
+        oc_utl_crc32c_update(oc_utl_crc32c_init(), zeros, 32) != 0x8A9136AA ||
+        oc_utl_crc32c_update(oc_utl_crc32c_init(), ones, 32) != 0x62A8AB43 ||
+        oc_utl_crc32c_update(oc_utl_crc32c_init(), inc, 32) != 0x46DD794E)
+        ERR(("CRC32C does not match the known values"));
+    if (oc_utl_crc32c_update_sw(oc_utl_crc32c_init(), "123456789", 9) != 0xE3069283 ||
+        oc_utl_crc32c_update_sw(oc_utl_crc32c_init(), inc, 32) != 0x46DD794E)
+        ERR(("portable CRC32C does not match the known values"));
+}
+
+/* Checksum random pieces of the buffer, at random alignments, in one
+ * go and in two parts. All the variants should agree.
+ */
+static void random_pieces(void)
+{
+    int i, ofs, len, split;
+    uint32 crc, crc_sw, crc_split;
+
+    for (i=0; i<BUF_SIZE + 8; i++)
+        buf[i] = (char) rand();
+
+    for (i=0; i<NUM_ROUNDS; i++) {
+        ofs = rand() % 8;
+        len = rand() % BUF_SIZE;
+        split = (len > 0) ? rand() % len : 0;
+
+        crc = oc_utl_crc32c_update(oc_utl_crc32c_init(), &buf[ofs], len);
+        crc_sw = oc_utl_crc32c_update_sw(oc_utl_crc32c_init(), &buf[ofs], len);
+        crc_split = oc_utl_crc32c_update(oc_utl_crc32c_init(), &buf[ofs], split);
+        crc_split = oc_utl_crc32c_update(crc_split, &buf[ofs + split],
+                                         len - split);
+        if (crc != crc_sw || crc != crc_split)
+            ERR(("mismatch ofs=%d len=%d split=%d", ofs, len, split));
+
+        // flipping a bit has to be detected
+        if (len > 0) {
+            buf[ofs + split] ^= 1 << (rand() % 8);
+            if (oc_utl_crc32c_update(oc_utl_crc32c_init(), &buf[ofs], len) == crc)
+                ERR(("a bit flip was not detected, ofs=%d len=%d", ofs, len));
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    pl_init();
+
+    printf("// known values\n");
+    known_values();
+    printf("// random pieces\n");
+    random_pieces();
+
+    printf("// passed\n");
+    return 0;
+}
@@ -0,0 +1,131 @@
+/**************************************************************/
+/*
+ * Copyright (c) 2014-2015, Ohad Rodeh, IBM Research
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer. 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution. 
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies, 
+ * either expressed or implied, of IBM Research.
+ * 
+ */
+/**************************************************************/
+/**************************************************************/
+/* 
+ * A self test for the LZ compressor
+ */
+#include <string.h>
+#include <stdlib.h>
+
+#include "pl_int.h"
+#include "oc_utl.h"
+#include "oc_utl_lz.h"
+
+/********************************************************************/
+
+#define BUF_SIZE (8 * 1024)
+#define NUM_ROUNDS (2000)
+
+static char src[BUF_SIZE];
+static char cmp[BUF_SIZE + BUF_SIZE / 2];
+static char out[BUF_SIZE];
+static char work[OC_UTL_LZ_WORK_SIZE];
+
+/* Fill [len] bytes with data of a random kind: random bytes, a few
+ * distinct values, sorted integers, or zeros with a random prefix.
+ */
+static void fill(int len)
+{
+    int i, kind = rand() % 4;
+    unsigned int v = rand() % 1000;
+
+    for (i=0; i<len; i++) {
+        switch (kind) {
+        case 0:
+            src[i] = (char) rand();
+            break;
+        case 1:
+            src[i] = "abcd"[rand() % 4];
+            break;
+        case 2:
+            if (i % 4 == 0)
+                v += rand() % 16;
+            src[i] = (char) (v >> (8 * (i % 4)));
+            break;
+        case 3:
+            src[i] = (i < len / 4) ? (char) rand() : 0;
+            break;
+        }
+    }
+}
+
+static void round_trip(void)
+{
+    int i, len, clen;
+
+    for (i=0; i<NUM_ROUNDS; i++) {
+        len = rand() % BUF_SIZE;
+        fill(len);
+
+        clen = oc_utl_lz_compress(src, len, cmp, sizeof(cmp), work);
+        if (0 == clen)
+            ERR(("could not compress %d bytes", len));
+        if (!oc_utl_lz_decompress(cmp, clen, out, len) ||
+            memcmp(src, out, len) != 0)
+            ERR(("round trip failed, len=%d", len));
+
+        // a short destination either fits, or is refused
+        if (clen > 1 &&
+            oc_utl_lz_compress(src, len, cmp, clen - 1, work) != 0)
+            ERR(("compressed into a buffer that is too small"));
+    }
+}
+
+/* Decompressing damaged input has to stay within the buffers. It may
+ * fail, or produce wrong data.
+ */
+static void damaged_input(void)
+{
+    int i, len, clen;
+
+    for (i=0; i<NUM_ROUNDS; i++) {
+        len = 1 + rand() % (BUF_SIZE - 1);
+        fill(len);
+        clen = oc_utl_lz_compress(src, len, cmp, sizeof(cmp), work);
+        cmp[rand() % clen] ^= 1 << (rand() % 8);
+        (void) oc_utl_lz_decompress(cmp, clen, out, len);
+        (void) oc_utl_lz_decompress(cmp, rand() % clen, out, len);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    pl_init();
+
+    printf("// round trip\n");
+    round_trip();
+    printf("// damaged input\n");
+    damaged_input();
+
+    printf("// passed\n");
+    return 0;
+}
@@ -0,0 +1,238 @@
+/**************************************************************/
+/*
+ * Copyright (c) 2014-2015, Ohad Rodeh, IBM Research
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer. 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution. 
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies, 
+ * either expressed or implied, of IBM Research.
+ * 
+ */
+/**************************************************************/
+/* 
+ * A self test for the open-addressing hashtable module
+ */
+#include <memory.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "pl_int.h"
+#include "oc_utl_rhtbl.h"
+#include "oc_utl.h"
+
+/********************************************************************/
+typedef struct {
+    Ss_slist_node link;
+    uint64 key;
+} Elem ;
+
+#define NUM_ELEM     (20000)
+#define NUM_ROUNDS   (200000)
+#define NUM_THREADS  (4)
+
+static Elem elems[NUM_ELEM];
+static bool present[NUM_ELEM];
+static Oc_utl_rhtbl htbl;
+static volatile bool stop = FALSE;
+
+/********************************************************************/
+
+static uint64 key_hash(void *_key)
+{
+    return oc_utl_rhtbl_hash_u64(*(uint64*)_key);
+}
+
+// a weak hash, to check that long clusters work
+static uint64 key_hash_weak(void *_key)
+{
+    return (*(uint64*)_key) / 8;
+}
+
+static bool key_compare(void *_elem, void *_key)
+{
+    Elem *elem = (Elem*)_elem;
+
+    return (elem->key == *(uint64*)_key);
+}
+
+static void count_fun(void *_elem, void *ctx)
+{
+    int *cnt_p = (int*) ctx;
+
+    oc_utl_assert(present[((Elem*)_elem)->key]);
+    (*cnt_p)++;
+}
+
+static bool discard_odd(void *_elem, void *data)
+{
+    Elem *elem = (Elem*)_elem;
+
+    if (elem->key % 2 == 0)
+        return FALSE;
+    present[elem->key] = FALSE;
+    return TRUE;
+}
+
+/********************************************************************/
+// compare the table against a flag array while doing random operations
+
+static void check_all(void)
+{
+    uint64 i;
+    int cnt = 0, expected = 0;
+
+    for (i=0; i<NUM_ELEM; i++) {
+        Elem *elem_p = (Elem*) oc_utl_rhtbl_lookup(&htbl, &i);
+
+        if (present[i]) {
+            expected++;
+            if (elem_p != &elems[i])
+                ERR(("lookup(%lu) did not match", (unsigned long)i));
+        }
+        else if (elem_p != NULL)
+            ERR(("lookup(%lu) found a removed element", (unsigned long)i));
+    }
+
+    oc_utl_rhtbl_iter(&htbl, count_fun, &cnt);
+    if (cnt != expected || oc_utl_rhtbl_size(&htbl) != expected)
+        ERR(("iteration found %d elements, expected %d", cnt, expected));
+}
+
+static void random_ops(bool concurrent, Oc_utl_rhtbl_hash hash)
+{
+    int i;
+    uint64 key;
+
+    memset(present, 0, sizeof(present));
+    oc_utl_rhtbl_create(&htbl, 10, concurrent, hash, key_compare);
+
+    for (i=0; i<NUM_ROUNDS; i++) {
+        key = rand() % NUM_ELEM;
+
+        switch (rand () % 3) {
+        case 0:
+        case 1:
+            // insert
+            if (!present[key]) {
+                oc_utl_rhtbl_insert(&htbl, &key, &elems[key]);
+                present[key] = TRUE;
+            }
+            break;
+        case 2:
+            // extract
+            if (oc_utl_rhtbl_extract(&htbl, &key) != (present[key] ? &elems[key] : NULL))
+                ERR(("extract(%lu) did not match", (unsigned long)key));
+            present[key] = FALSE;
+            break;
+        }
+        if (i % (NUM_ROUNDS/10) == 0)
+            check_all();
+    }
+    check_all();
+
+    oc_utl_rhtbl_iter_discard(&htbl, discard_odd, NULL);
+    check_all();
+
+    oc_utl_rhtbl_free(&htbl);
+}
+
+/********************************************************************/
+/* Concurrent mode. Each writer owns a set of odd keys, and keeps
+ * inserting and removing them. The readers check that the even keys,
+ * which are never removed, can always be found.
+ */
+
+static void *writer_thread(void *arg)
+{
+    int id = (int)(long) arg;
+    int i;
+    uint64 key;
+
+    for (i=0; i<NUM_ROUNDS; i++) {
+        key = 2 * (id + NUM_THREADS * (rand() % (NUM_ELEM / NUM_THREADS / 2))) + 1;
+        if (oc_utl_rhtbl_extract(&htbl, &key) == NULL)
+            oc_utl_rhtbl_insert(&htbl, &key, &elems[key]);
+    }
+    return NULL;
+}
+
+static void *reader_thread(void *arg)
+{
+    uint64 key;
+
+    while (!stop) {
+        key = 2 * (rand() % (NUM_ELEM/2));
+        if (oc_utl_rhtbl_lookup(&htbl, &key) != &elems[key])
+            ERR(("concurrent lookup(%lu) failed", (unsigned long)key));
+    }
+    return NULL;
+}
+
+static void concurrent_ops(void)
+{
+    pthread_t writers[NUM_THREADS], readers[NUM_THREADS];
+    uint64 key;
+    long i;
+
+    // the even keys are inserted ahead of time, the writers never touch them
+    oc_utl_rhtbl_create(&htbl, 0, TRUE, key_hash, key_compare);
+    for (key=0; key<NUM_ELEM; key++)
+        if (key % 2 == 0)
+            oc_utl_rhtbl_insert(&htbl, &key, &elems[key]);
+
+    stop = FALSE;
+    for (i=0; i<NUM_THREADS; i++) {
+        pthread_create(&readers[i], NULL, reader_thread, NULL);
+        pthread_create(&writers[i], NULL, writer_thread, (void*)i);
+    }
+    for (i=0; i<NUM_THREADS; i++)
+        pthread_join(writers[i], NULL);
+    stop = TRUE;
+    for (i=0; i<NUM_THREADS; i++)
+        pthread_join(readers[i], NULL);
+
+    oc_utl_rhtbl_free(&htbl);
+}
+
+/********************************************************************/
+
+int main(int argc, char *argv[])
+{
+    uint64 i;
+
+    pl_init();
+    for (i=0; i<NUM_ELEM; i++)
+        elems[i].key = i;
+
+    printf("// single threaded test\n");
+    random_ops(FALSE, key_hash);
+    printf("// single threaded test, weak hash\n");
+    random_ops(FALSE, key_hash_weak);
+    printf("// sharded table, single thread\n");
+    random_ops(TRUE, key_hash);
+    printf("// concurrent test\n");
+    concurrent_ops();
+
+    printf("// passed\n");
+    return 0;
+}
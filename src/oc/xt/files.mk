@@ -32,12 +32,17 @@ XT_OBJECTS = \
 	${OBJDIR}/oc_xt.o \
 	${OBJDIR}/oc_xt_nd.o \
 	${OBJDIR}/oc_xt_utl.o \
+	${OBJDIR}/oc_xt_ext.o \
 	${OBJDIR}/oc_xt_op_validate.o \
+	${OBJDIR}/oc_xt_op_validate_clones.o \
 	${OBJDIR}/oc_xt_op_stat.o \
 	${OBJDIR}/oc_xt_op_delete.o \
 	${OBJDIR}/oc_xt_op_output_dot.o \
 	${OBJDIR}/oc_xt_op_lookup_range.o \
+	${OBJDIR}/oc_xt_op_cursor.o \
 	${OBJDIR}/oc_xt_op_insert_range.o \
+	${OBJDIR}/oc_xt_op_bulk_load.o \
 	${OBJDIR}/oc_xt_op_remove_range.o \
+	${OBJDIR}/oc_xt_op_find_gap.o \
 	${OBJDIR}/oc_xt_trace.o
 
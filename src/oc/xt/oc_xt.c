@@ -42,14 +42,20 @@
 #include "oc_xt_int.h"
 #include "oc_xt_nd.h"
 #include "oc_xt_trace.h"
+#include "oc_xt_utl.h"
+#include "oc_xt_ext.h"
 
 #include "oc_xt_op_delete.h"
 
 #include "oc_xt_op_lookup_range.h"
 #include "oc_xt_op_insert_range.h"
 #include "oc_xt_op_remove_range.h"
+#include "oc_xt_op_find_gap.h"
+#include "oc_xt_op_cursor.h"
+#include "oc_xt_op_bulk_load.h"
 
 #include "oc_xt_op_validate.h"
+#include "oc_xt_op_validate_clones.h"
 #include "oc_xt_op_output_dot.h"
 #include "oc_xt_op_stat.h"
 // needed for the query function
@@ -70,6 +76,7 @@ void oc_xt_init_state_b(struct Oc_wu *wu_pi, Oc_xt_state *state_po, Oc_xt_cfg *c
 {
     memset(state_po, 0, sizeof(Oc_xt_state));
     oc_crt_init_rw_lock(&state_po->lock);
+    ssslist_init(&state_po->detached);
     state_po->cfg_p = cfg_p;
 }
 
@@ -79,6 +86,9 @@ void oc_xt_destroy_state(struct Oc_wu *wu_pi, Oc_xt_state *s_p)
                         s_p->root_node_p);
     oc_utl_debugassert(s_p->root_node_p);
 
+    // the detached queue is not persistent, anything left in it is leaked
+    oc_utl_assert(ssslist_empty(&s_p->detached));
+
     // release the root node
     s_p->cfg_p->node_release(wu_pi, s_p->root_node_p);
     s_p->root_node_p = NULL;
@@ -90,13 +100,20 @@ void oc_xt_init_config(Oc_xt_cfg *cfg_p)
 {
     int max_num_ent_root_leaf_node, max_num_ent_root_index_node;
 
+    if (cfg_p->builtin_ext)
+        oc_xt_ext_setup_config(cfg_p);
+    
     oc_utl_assert(cfg_p->node_alloc);
     oc_utl_assert(cfg_p->node_dealloc);
-    oc_utl_assert(cfg_p->node_get);
+    oc_utl_assert(cfg_p->node_get_sl);
+    oc_utl_assert(cfg_p->node_get_xl);
     oc_utl_assert(cfg_p->node_release);
     oc_utl_assert(cfg_p->node_mark_dirty);
+    oc_utl_assert(cfg_p->fs_inc_refcount);
+    oc_utl_assert(cfg_p->fs_get_refcount);
     oc_utl_assert(cfg_p->key_compare);
     oc_utl_assert(cfg_p->key_inc);
+    oc_utl_assert(cfg_p->key_distance);
     oc_utl_assert(cfg_p->key_to_string);
     oc_utl_assert(cfg_p->rcrd_compare);
     oc_utl_assert(cfg_p->rcrd_compare0);
@@ -107,6 +124,7 @@ void oc_xt_init_config(Oc_xt_cfg *cfg_p)
     oc_utl_assert(cfg_p->rcrd_chop_top);
     oc_utl_assert(cfg_p->rcrd_length);
     oc_utl_assert(cfg_p->rcrd_release);
+    oc_utl_assert(cfg_p->rcrd_inc_refcount);
     oc_utl_assert(cfg_p->rcrd_to_string);
     oc_utl_assert(cfg_p->fs_query_alloc);
     oc_utl_assert(cfg_p->fs_query_dealloc);
@@ -126,7 +144,8 @@ void oc_xt_init_config(Oc_xt_cfg *cfg_p)
         ERR(("node size is too tmall. smaller then Oc_xt_nd_hdr_root"));
 
     cfg_p->leaf_ent_size = cfg_p->key_size + cfg_p->rcrd_size;
-    cfg_p->index_ent_size = sizeof(uint64) + cfg_p->key_size;
+    // an index entry holds a key, a child address, and a gap bound
+    cfg_p->index_ent_size = 2 * sizeof(uint64) + cfg_p->key_size;
     
     cfg_p->max_num_ent_leaf_node =
         (cfg_p->node_size - sizeof(Oc_xt_nd_hdr)) /
@@ -240,10 +259,18 @@ void oc_xt_delete_b(
     struct Oc_wu *wu_p,
     struct Oc_xt_state *s_p)
 {
+    uint64 addr;
+    
     oc_xt_trace_wu_lvl(2, OC_EV_XT_DELETE, wu_p, "");
     oc_utl_debugassert(s_p->cfg_p->initialized);
     
     oc_utl_trk_crt_lock_write(wu_p, &s_p->lock);
+    s_p->gen++;
+
+    // sub-trees detached by lazy remove-range are deleted first
+    while (oc_xt_utl_pop_detached(s_p, &addr))
+        oc_xt_utl_delete_subtree_b(wu_p, s_p,
+                                   s_p->cfg_p->node_get_xl(wu_p, addr));
     oc_xt_op_delete_b(wu_p, s_p);    
     oc_utl_trk_crt_unlock(wu_p, &s_p->lock);
 }
@@ -257,21 +284,23 @@ void oc_xt_cow_root_and_update_b(
     // Old address stored as data in father
     uint64 prev_addr = *((uint64*)father_data_p); 
     Oc_xt_node *node_p;   
+    int fs_refcnt;
     
     oc_xt_trace_wu_lvl(2, OC_EV_XT_COW_ROOT_AND_UPDATE, wu_p,
                        "addr of root as appers in father (before update):%Lu",
                        prev_addr);
     oc_utl_assert(NULL != s_p->root_node_p);
     oc_utl_trk_crt_lock_write(wu_p, &s_p->lock);
+    s_p->gen++;
 
-    node_p = s_p->cfg_p->node_get(wu_p, s_p->root_node_p->disk_addr);
+    node_p = s_p->cfg_p->node_get_xl(wu_p, s_p->root_node_p->disk_addr);
     oc_utl_debugassert(node_p == s_p->root_node_p);
 
-    // Dalit: may not be needed    
-    oc_utl_trk_crt_lock_write(wu_p, &s_p->root_node_p->lock);
 
-    
-    s_p->cfg_p->node_mark_dirty(wu_p, s_p->root_node_p);
+    fs_refcnt = s_p->cfg_p->fs_get_refcount(
+        wu_p,
+        s_p->root_node_p->disk_addr);
+    s_p->cfg_p->node_mark_dirty(wu_p, s_p->root_node_p, (fs_refcnt > 1));
     if (s_p->root_node_p->disk_addr != prev_addr)
     {
         uint64 new_addr = s_p->root_node_p->disk_addr;
@@ -376,6 +405,54 @@ void oc_xt_lookup_range_b(
     oc_utl_trk_crt_unlock(wu_p, &s_p->lock);
 }
 
+bool oc_xt_lookup_ofs_b(
+    struct Oc_wu *wu_p,
+    Oc_xt_state *s_p,
+    struct Oc_xt_key *key_p,
+    struct Oc_xt_key *key_po,
+    struct Oc_xt_rcrd *rcrd_po)
+{
+    bool rc;
+    
+    oc_xt_trace_wu_lvl(2, OC_EV_XT_LOOKUP_OFS, wu_p, "[%s]",
+                       oc_xt_nd_string_of_key(s_p, key_p));
+    oc_utl_debugassert(s_p->cfg_p->initialized);
+
+    oc_utl_trk_crt_lock_read(wu_p, &s_p->lock);
+    rc = oc_xt_op_lookup_ofs_b(wu_p, s_p, key_p, key_po, rcrd_po);
+    oc_utl_trk_crt_unlock(wu_p, &s_p->lock);
+    return rc;
+}
+void oc_xt_cursor_open_b(
+    struct Oc_wu *wu_p,
+    Oc_xt_state *s_p,
+    Oc_xt_cursor *cur_po,
+    struct Oc_xt_key *min_key_p,
+    struct Oc_xt_key *max_key_p)
+{
+    oc_xt_trace_wu_lvl(2, OC_EV_XT_CURSOR_OPEN, wu_p, "[%s]",
+                       oc_xt_nd_string_of_2key(s_p, min_key_p, max_key_p));
+    oc_utl_debugassert(s_p->cfg_p->initialized);
+
+    oc_xt_op_cursor_open_b(wu_p, s_p, cur_po, min_key_p, max_key_p);
+}
+
+bool oc_xt_cursor_next_b(
+    struct Oc_wu *wu_p,
+    Oc_xt_cursor *cur_p,
+    struct Oc_xt_key *key_po,
+    struct Oc_xt_rcrd *rcrd_po)
+{
+    return oc_xt_op_cursor_next_b(wu_p, cur_p, key_po, rcrd_po);
+}
+
+void oc_xt_cursor_close(
+    struct Oc_wu *wu_p,
+    Oc_xt_cursor *cur_p)
+{
+    oc_xt_trace_wu_lvl(2, OC_EV_XT_CURSOR_CLOSE, wu_p, "");
+    oc_xt_op_cursor_close(wu_p, cur_p);
+}
 
 uint64 oc_xt_insert_range_b(
     struct Oc_wu *wu_p,
@@ -401,6 +478,44 @@ uint64 oc_xt_insert_range_b(
     return rc;
 }
 
+uint64 oc_xt_insert_multi_b(
+    struct Oc_wu *wu_p,
+    Oc_xt_state *s_p,
+    int num,
+    struct Oc_xt_key *key_array,
+    struct Oc_xt_rcrd *rcrd_array)
+{
+    uint64 rc;
+    
+    oc_xt_trace_wu_lvl(2, OC_EV_XT_INSERT_MULTI, wu_p, "num=%d", num);
+    oc_utl_debugassert(s_p->cfg_p->initialized);
+
+    oc_utl_trk_crt_lock_read(wu_p, &s_p->lock);
+    rc = oc_xt_op_insert_multi_b(wu_p, s_p, num, key_array, rcrd_array);
+    oc_utl_trk_crt_unlock(wu_p, &s_p->lock);
+
+    oc_xt_trace_wu_lvl(3, OC_EV_XT_INSERT_MULTI, wu_p, "rc=%Lu", rc);
+    return rc;
+}
+
+void oc_xt_bulk_load_b(
+    struct Oc_wu *wu_p,
+    Oc_xt_state *s_p,
+    int num,
+    struct Oc_xt_key *key_array,
+    struct Oc_xt_rcrd *rcrd_array,
+    bool coalesce)
+{
+    oc_xt_trace_wu_lvl(2, OC_EV_XT_BULK_LOAD, wu_p, "num=%d coalesce=%s",
+                       num, coalesce ? "TRUE" : "FALSE");
+    oc_utl_debugassert(s_p->cfg_p->initialized);
+
+    oc_utl_trk_crt_lock_write(wu_p, &s_p->lock);
+    s_p->gen++;
+    oc_xt_op_bulk_load_b(wu_p, s_p, num, key_array, rcrd_array, coalesce);
+    oc_utl_trk_crt_unlock(wu_p, &s_p->lock);
+}
+
 uint64 oc_xt_remove_range_b(
     struct Oc_wu *wu_p,
     Oc_xt_state *s_p,
@@ -414,12 +529,94 @@ uint64 oc_xt_remove_range_b(
     oc_utl_debugassert(s_p->cfg_p->initialized);
     
     oc_utl_trk_crt_lock_write(wu_p, &s_p->lock);
+    s_p->gen++;
     rc = oc_xt_op_remove_range_b(wu_p, s_p, min_key_p, max_key_p);
     oc_utl_trk_crt_unlock(wu_p, &s_p->lock);
     
     return rc;
 }
 
+void oc_xt_remove_range_lazy_b(
+    struct Oc_wu *wu_p,
+    Oc_xt_state *s_p,
+    struct Oc_xt_key *min_key_p,
+    struct Oc_xt_key *max_key_p)
+{
+    oc_xt_trace_wu_lvl(2, OC_EV_XT_REMOVE_RANGE_LAZY, wu_p, "[%s]",
+                       oc_xt_nd_string_of_2key(s_p, min_key_p, max_key_p));
+    oc_utl_debugassert(s_p->cfg_p->initialized);
+    
+    oc_utl_trk_crt_lock_write(wu_p, &s_p->lock);
+    s_p->gen++;
+    oc_xt_op_remove_range_lazy_b(wu_p, s_p, min_key_p, max_key_p);
+    oc_utl_trk_crt_unlock(wu_p, &s_p->lock);
+}
+
+bool oc_xt_reclaim_b(
+    struct Oc_wu *wu_p,
+    Oc_xt_state *s_p)
+{
+    uint64 addr;
+    bool found;
+    
+    oc_utl_debugassert(s_p->cfg_p->initialized);
+    
+    oc_utl_trk_crt_lock_write(wu_p, &s_p->lock);
+    found = oc_xt_utl_pop_detached(s_p, &addr);
+    oc_utl_trk_crt_unlock(wu_p, &s_p->lock);
+    if (!found)
+        return FALSE;
+
+    oc_xt_trace_wu_lvl(2, OC_EV_XT_RECLAIM, wu_p, "addr=%Lu", addr);
+    oc_xt_utl_delete_subtree_b(wu_p, s_p, s_p->cfg_p->node_get_xl(wu_p, addr));
+    return TRUE;
+}
+
+void oc_xt_find_gap_b(
+    struct Oc_wu *wu_p,
+    Oc_xt_state *s_p,
+    struct Oc_xt_key *min_key_p,
+    uint64 len,
+    struct Oc_xt_key *result_key_po)
+{
+    oc_xt_trace_wu_lvl(2, OC_EV_XT_FIND_GAP, wu_p, "min_key=%s len=%Lu",
+                       oc_xt_nd_string_of_key(s_p, min_key_p), len);
+    oc_utl_debugassert(s_p->cfg_p->initialized);
+    oc_utl_debugassert(len > 0);
+    
+    oc_xt_op_find_gap_b(wu_p, s_p, min_key_p, len, result_key_po);
+}
+
+bool oc_xt_dbg_validate_clones_b(
+    struct Oc_wu *wu_p,
+    int n_clones,
+    Oc_xt_state *st_array[])
+{
+    bool rc;
+    int i;
+
+    oc_xt_trace_wu_lvl(2, OC_EV_XT_VALIDATE_CLONES, wu_p, "");
+
+    // lock all the clones
+    for (i=0; i<n_clones; i++) {
+        Oc_xt_state *s_p = st_array[i];
+
+        oc_utl_debugassert(s_p->cfg_p->initialized);
+        oc_utl_trk_crt_lock_write(wu_p, &s_p->lock);
+    }
+    
+    rc = oc_xt_op_validate_clones_b(wu_p, n_clones, st_array);
+
+    // unlock all the clones    
+    for (i=0; i<n_clones; i++) {
+        Oc_xt_state *s_p = st_array[i];        
+
+        oc_utl_trk_crt_unlock(wu_p, &s_p->lock);
+    }
+
+    return rc;
+}
+
 void oc_xt_swap_root_ref(Oc_xt_state *s_p,
                          Oc_wu *trg_wu_p,
                          Oc_wu *src_wu_p)
@@ -427,6 +624,30 @@ void oc_xt_swap_root_ref(Oc_xt_state *s_p,
     oc_xt_nd_swap_root_ref(s_p, trg_wu_p, src_wu_p);
 }
 
+/**********************************************************************/
+// snapshot and clone section
+
+uint64 oc_xt_clone_b(
+    struct Oc_wu *wu_p,
+    Oc_xt_state *src_p,
+    Oc_xt_state *trg_p)
+{
+    // make sure the configurations are equivalent
+    oc_utl_assert(trg_p->cfg_p == src_p->cfg_p);
+
+    oc_xt_trace_wu_lvl(2, OC_EV_XT_CLONE, wu_p,
+                       "root=%Lu", src_p->root_node_p->disk_addr);
+        
+    oc_utl_debugassert(src_p->cfg_p->initialized);
+    oc_utl_assert(NULL == trg_p->root_node_p);
+        
+    oc_utl_trk_crt_lock_write(wu_p, &src_p->lock);
+    oc_xt_nd_clone_root(wu_p, src_p, trg_p);
+    oc_utl_trk_crt_unlock(wu_p, &src_p->lock);
+
+    return trg_p->root_node_p->disk_addr;
+}
+
 /**********************************************************************/
 
 #define CASE(s) case s: return #s ; break
@@ -495,6 +716,16 @@ void oc_xt_query_b(
         r_p->pm_read_pages_i += 3;
         break;
 
+    case OC_XT_FN_LOOKUP_OFS:
+        // lock-coupling holds a page and its father
+        r_p->pm_read_pages_i += 2;
+        break;
+
+    case OC_XT_FN_CURSOR:
+        // The path to the current leaf is held
+        r_p->pm_read_pages_i += OC_XT_MAX_HEIGHT;
+        break;
+
     case OC_XT_FN_INSERT_RANGE:
         /* we always crawl on a single tree path. The possiblity for splits
          * increases the worst case from two to three modified pages. 
@@ -508,6 +739,18 @@ void oc_xt_query_b(
         cfg_p->fs_query_alloc(r_p, 1);
         break;
         
+    case OC_XT_FN_BULK_LOAD:
+        /* One node is written at a time, all the nodes are new except
+         * for the root.
+         */
+        r_p->pm_write_pages_i += 2;
+
+        // [param] is the number of extents
+        nkeys = *(int*)(void*) param;
+        r_p->fs_pages += 2 * (1 + nkeys / cfg_p->max_num_ent_leaf_node);
+        cfg_p->fs_query_alloc(r_p, 1);
+        break;
+        
     case OC_XT_FN_REMOVE_RANGE:
         // We might hold a page, its father, and its two siblings. 
         r_p->pm_write_pages_i += 4;
@@ -526,6 +769,34 @@ void oc_xt_query_b(
         // cfg_p->fs_query_alloc(r_p, 1);
         break;
         
+    case OC_XT_FN_REMOVE_RANGE_LAZY:
+        // As with remove-range. The covered sub-trees are not touched.
+        r_p->pm_write_pages_i += 4;
+        r_p->fs_pages += 4 * OC_XT_MAX_HEIGHT;
+        cfg_p->fs_query_dealloc(r_p, 1);
+        break;
+        
+    case OC_XT_FN_RECLAIM:
+        // A path in the detached sub-tree is kept in memory
+        r_p->pm_write_pages_i += OC_XT_MAX_HEIGHT;
+
+        // deallocation is performed one at a time
+        cfg_p->fs_query_dealloc(r_p, 1);
+        break;
+        
+    case OC_XT_FN_FIND_GAP:
+        /* A path is held for read while the subtrees to its right are
+         * searched. At most one more path is held, to find the
+         * extent that follows a leaf.
+         */
+        r_p->pm_read_pages_i += 2 * OC_XT_MAX_HEIGHT;
+
+        // lowering stale bounds modifies a path, which may be copied on write
+        r_p->pm_write_pages_i += OC_XT_MAX_HEIGHT;
+        r_p->fs_pages += OC_XT_MAX_HEIGHT;
+        cfg_p->fs_query_alloc(r_p, 1);
+        break;
+        
     case OC_XT_FN_GET_ATTR:
         // The root page is already held; therefore, no more resources are required
         break;
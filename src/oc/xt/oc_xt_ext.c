@@ -0,0 +1,300 @@
+/**************************************************************/
+/*
+ * Copyright (c) 2014-2015, Ohad Rodeh, IBM Research
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer. 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution. 
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies, 
+ * either expressed or implied, of IBM Research.
+ * 
+ */
+/**************************************************************/
+/******************************************************************/
+/* OC_XT_EXT.C
+ *
+ * The built-in extent type, as configuration functions.
+ */
+/******************************************************************/
+#include <stdio.h>
+
+#include "oc_utl.h"
+#include "oc_xt_ext.h"
+
+/******************************************************************/
+static int ext_key_compare(struct Oc_xt_key *key1_p,
+                           struct Oc_xt_key *key2_p)
+{
+    return oc_xt_ext_key_compare(key1_p, key2_p);
+}
+
+static void ext_key_inc(struct Oc_xt_key *key_p, struct Oc_xt_key *result_p)
+{
+    *(Oc_xt_ext_key*)result_p = oc_xt_ext_key(key_p) + 1;
+}
+
+static uint64 ext_key_distance(struct Oc_xt_key *key1_p,
+                               struct Oc_xt_key *key2_p)
+{
+    return oc_xt_ext_key(key2_p) - oc_xt_ext_key(key1_p);
+}
+
+static void ext_key_to_string(struct Oc_xt_key *key_p, char *str_p, int max_len)
+{
+    if (max_len < 2)
+        ERR(("key_to_string: %d is not enough", max_len));
+    snprintf(str_p, max_len, "%Lu", oc_xt_ext_key(key_p));
+}
+
+static Oc_xt_cmp ext_rcrd_compare(
+    struct Oc_xt_key *key1_p,
+    struct Oc_xt_rcrd *rcrd1_p,
+    struct Oc_xt_key *key2_p,
+    struct Oc_xt_rcrd *rcrd2_p)
+{
+    return oc_xt_ext_compare_bounds(oc_xt_ext_key(key1_p),
+                                    oc_xt_ext_end(key1_p, rcrd1_p),
+                                    oc_xt_ext_key(key2_p),
+                                    oc_xt_ext_end(key2_p, rcrd2_p));
+}
+
+static int ext_rcrd_compare0(
+    struct Oc_xt_key *key1_p,
+    struct Oc_xt_key *key2_p,
+    struct Oc_xt_rcrd *rcrd2_p)
+{
+    return oc_xt_ext_compare0(key1_p, key2_p, rcrd2_p);
+}
+
+// write the part [lo .. hi] of the extent into the target, if non-null
+static void ext_copy_sub(struct Oc_xt_key *key_p,
+                         struct Oc_xt_rcrd *rcrd_p,
+                         uint64 lo,
+                         uint64 hi,
+                         struct Oc_xt_key *trg_key_p,
+                         struct Oc_xt_rcrd *trg_rcrd_p)
+{
+    Oc_xt_ext_key key;
+    Oc_xt_ext_rcrd rcrd;
+
+    oc_utl_debugassert(hi >= lo);
+    oc_xt_ext_sub(key_p, rcrd_p, lo, hi,
+                  (struct Oc_xt_key*)&key, (struct Oc_xt_rcrd*)&rcrd);
+    if (trg_key_p != NULL)
+        *(Oc_xt_ext_key*)trg_key_p = key;
+    if (trg_rcrd_p != NULL)
+        *oc_xt_ext_rcrd(trg_rcrd_p) = rcrd;
+}
+
+/* Split extent [key_p, rcrd_p] by the boundaries [lo .. hi].
+ * Boundaries are inclusive.
+ */
+static Oc_xt_cmp ext_split_by_bounds(
+    struct Oc_xt_key *key_p,
+    struct Oc_xt_rcrd *rcrd_p,
+    uint64 lo,
+    uint64 hi,
+    struct Oc_xt_key *key_array_p[3],
+    struct Oc_xt_rcrd *rcrd_array_p[3])
+{
+    uint64 key = oc_xt_ext_key(key_p);
+    uint64 end = oc_xt_ext_end(key_p, rcrd_p);
+    Oc_xt_cmp rc;
+    bool has[3] = {FALSE, FALSE, FALSE};
+    int i;
+
+    rc = oc_xt_ext_compare_bounds(key, end, lo, hi);
+    switch (rc) {
+    case OC_XT_CMP_SML:
+        ext_copy_sub(key_p, rcrd_p, key, end, key_array_p[0], rcrd_array_p[0]);
+        has[0] = TRUE;
+        break;
+    case OC_XT_CMP_GRT:
+        ext_copy_sub(key_p, rcrd_p, key, end, key_array_p[2], rcrd_array_p[2]);
+        has[2] = TRUE;
+        break;
+    default:
+        // the extent overlaps the boundaries
+        if (key < lo) {
+            ext_copy_sub(key_p, rcrd_p, key, lo-1,
+                         key_array_p[0], rcrd_array_p[0]);
+            has[0] = TRUE;
+        }
+        ext_copy_sub(key_p, rcrd_p, MAX(key, lo), MIN(end, hi),
+                     key_array_p[1], rcrd_array_p[1]);
+        has[1] = TRUE;
+        if (end > hi) {
+            ext_copy_sub(key_p, rcrd_p, hi+1, end,
+                         key_array_p[2], rcrd_array_p[2]);
+            has[2] = TRUE;
+        }
+        break;
+    }
+
+    // parts that do not exist are marked with NULL
+    for (i=0; i<3; i++)
+        if (!has[i]) {
+            key_array_p[i] = NULL;
+            rcrd_array_p[i] = NULL;
+        }
+
+    return rc;
+}
+
+static Oc_xt_cmp ext_rcrd_bound_split(
+    struct Oc_xt_key *key_p,
+    struct Oc_xt_rcrd *rcrd_p,
+    struct Oc_xt_key *min_key_p,
+    struct Oc_xt_key *max_key_p,
+    struct Oc_xt_key *key_array_p[3],
+    struct Oc_xt_rcrd *rcrd_array_p[3])
+{
+    return ext_split_by_bounds(key_p, rcrd_p,
+                               oc_xt_ext_key(min_key_p),
+                               oc_xt_ext_key(max_key_p),
+                               key_array_p, rcrd_array_p);
+}
+
+static Oc_xt_cmp ext_rcrd_split(
+    struct Oc_xt_key *key1_p,
+    struct Oc_xt_rcrd *rcrd1_p,
+    struct Oc_xt_key *key2_p,
+    struct Oc_xt_rcrd *rcrd2_p,
+    struct Oc_xt_key *key_array_p[3],
+    struct Oc_xt_rcrd *rcrd_array_p[3])
+{
+    return ext_split_by_bounds(key1_p, rcrd1_p,
+                               oc_xt_ext_key(key2_p),
+                               oc_xt_ext_end(key2_p, rcrd2_p),
+                               key_array_p, rcrd_array_p);
+}
+
+static void ext_rcrd_end_offset(struct Oc_xt_key *key_p,
+                                struct Oc_xt_rcrd *rcrd_p,
+                                struct Oc_xt_key *end_key_po)
+{
+    oc_utl_debugassert(oc_xt_ext_rcrd(rcrd_p)->len > 0);
+    *(Oc_xt_ext_key*)end_key_po = oc_xt_ext_end(key_p, rcrd_p);
+}
+
+static void ext_rcrd_chop_length(struct Oc_xt_key *key_po,
+                                 struct Oc_xt_rcrd *rcrd_po,
+                                 uint64 len)
+{
+    *(Oc_xt_ext_key*)key_po += len;
+    oc_xt_ext_rcrd(rcrd_po)->len -= len;
+    oc_xt_ext_rcrd(rcrd_po)->addr += len;
+}
+
+static void ext_rcrd_chop_top(struct Oc_xt_key *key_po,
+                              struct Oc_xt_rcrd *rcrd_po,
+                              struct Oc_xt_key *hi_key_p)
+{
+    uint64 key = oc_xt_ext_key(key_po);
+    uint64 top_key = oc_xt_ext_key(hi_key_p);
+    Oc_xt_ext_rcrd *rcrd_p = oc_xt_ext_rcrd(rcrd_po);
+
+    oc_utl_assert(key < top_key);
+    rcrd_p->len = MIN(top_key - key, rcrd_p->len);
+}
+
+static void ext_rcrd_split_into_sub(struct Oc_xt_key *key_p,
+                                    struct Oc_xt_rcrd *rcrd_p,
+                                    int num,
+                                    struct Oc_xt_key *_key_array,
+                                    struct Oc_xt_rcrd *_rcrd_array)
+{
+    uint64 key = oc_xt_ext_key(key_p);
+    Oc_xt_ext_rcrd *r_p = oc_xt_ext_rcrd(rcrd_p);
+    Oc_xt_ext_key *key_array = (Oc_xt_ext_key*)_key_array;
+    Oc_xt_ext_rcrd *rcrd_array = (Oc_xt_ext_rcrd*)_rcrd_array;
+    uint64 sub_len;
+    int i;
+
+    oc_utl_assert(num > 1);
+    oc_utl_assert(r_p->len >= (uint64)num);
+
+    sub_len = r_p->len / num;
+    for (i=0; i<num; i++) {
+        key_array[i] = key + i * sub_len;
+        rcrd_array[i].addr = r_p->addr + i * sub_len;
+        if (i < num-1)
+            rcrd_array[i].len = sub_len;
+        else
+            rcrd_array[i].len = r_p->len - (num-1) * sub_len;
+    }
+}
+
+// merge two extents if they are contiguous on disk
+static bool ext_rcrd_try_merge(struct Oc_xt_key *key1_p,
+                               struct Oc_xt_rcrd *rcrd1_pio,
+                               struct Oc_xt_key *key2_p,
+                               struct Oc_xt_rcrd *rcrd2_p)
+{
+    Oc_xt_ext_rcrd *r1_p = oc_xt_ext_rcrd(rcrd1_pio);
+    Oc_xt_ext_rcrd *r2_p = oc_xt_ext_rcrd(rcrd2_p);
+
+    if (r1_p->addr + r1_p->len != r2_p->addr)
+        return FALSE;
+    r1_p->len += r2_p->len;
+    return TRUE;
+}
+
+static uint64 ext_rcrd_length(struct Oc_xt_key *key_p,
+                              struct Oc_xt_rcrd *rcrd_p)
+{
+    return oc_xt_ext_rcrd(rcrd_p)->len;
+}
+
+static void ext_rcrd_to_string(struct Oc_xt_key *key_p,
+                               struct Oc_xt_rcrd *rcrd_p,
+                               char *str_p,
+                               int max_len)
+{
+    snprintf(str_p, max_len, "%Lu-%Lu", oc_xt_ext_key(key_p),
+             oc_xt_ext_end(key_p, rcrd_p));
+}
+
+/******************************************************************/
+
+void oc_xt_ext_setup_config(Oc_xt_cfg *cfg_p)
+{
+    cfg_p->key_size = sizeof(Oc_xt_ext_key);
+    cfg_p->rcrd_size = sizeof(Oc_xt_ext_rcrd);
+    cfg_p->key_compare = ext_key_compare;
+    cfg_p->key_inc = ext_key_inc;
+    cfg_p->key_distance = ext_key_distance;
+    cfg_p->key_to_string = ext_key_to_string;
+    cfg_p->rcrd_compare = ext_rcrd_compare;
+    cfg_p->rcrd_compare0 = ext_rcrd_compare0;
+    cfg_p->rcrd_bound_split = ext_rcrd_bound_split;
+    cfg_p->rcrd_split = ext_rcrd_split;
+    cfg_p->rcrd_end_offset = ext_rcrd_end_offset;
+    cfg_p->rcrd_chop_length = ext_rcrd_chop_length;
+    cfg_p->rcrd_chop_top = ext_rcrd_chop_top;
+    cfg_p->rcrd_split_into_sub = ext_rcrd_split_into_sub;
+    cfg_p->rcrd_try_merge = ext_rcrd_try_merge;
+    cfg_p->rcrd_length = ext_rcrd_length;
+    cfg_p->rcrd_to_string = ext_rcrd_to_string;
+}
+
+/******************************************************************/
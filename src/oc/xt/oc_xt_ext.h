@@ -0,0 +1,148 @@
+/**************************************************************/
+/*
+ * Copyright (c) 2014-2015, Ohad Rodeh, IBM Research
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer. 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution. 
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies, 
+ * either expressed or implied, of IBM Research.
+ * 
+ */
+/**************************************************************/
+/******************************************************************/
+/* OC_XT_EXT.H
+ *
+ * A built-in extent type for the x-tree. A key is a uint64 offset,
+ * a record is a length and the physical address the extent starts
+ * at. Sub-extents map to the matching sub-range of the physical
+ * area.
+ *
+ * The operations are static inline so that the x-tree code can call
+ * them directly, instead of through the configuration, when the tree
+ * is set up with [builtin_ext].
+ */
+/******************************************************************/
+#ifndef OC_XT_EXT_H
+#define OC_XT_EXT_H
+
+#include "oc_xt_int.h"
+
+typedef uint64 Oc_xt_ext_key;
+
+typedef struct Oc_xt_ext_rcrd {
+    uint64 len;
+    uint64 addr;
+} Oc_xt_ext_rcrd;
+
+/******************************************************************/
+
+static inline uint64 oc_xt_ext_key(struct Oc_xt_key *key_p)
+{
+    return *(Oc_xt_ext_key*)key_p;
+}
+
+static inline Oc_xt_ext_rcrd *oc_xt_ext_rcrd(struct Oc_xt_rcrd *rcrd_p)
+{
+    return (Oc_xt_ext_rcrd*)rcrd_p;
+}
+
+// compare two keys, same as [key_compare]
+static inline int oc_xt_ext_key_compare(struct Oc_xt_key *key1_p,
+                                        struct Oc_xt_key *key2_p)
+{
+    uint64 key1 = oc_xt_ext_key(key1_p);
+    uint64 key2 = oc_xt_ext_key(key2_p);
+
+    if (key1 == key2) return 0;
+    else if (key1 > key2) return -1;
+    else return 1;
+}
+
+// the last offset covered by extent [key_p, rcrd_p]
+static inline uint64 oc_xt_ext_end(struct Oc_xt_key *key_p,
+                                   struct Oc_xt_rcrd *rcrd_p)
+{
+    return oc_xt_ext_key(key_p) + oc_xt_ext_rcrd(rcrd_p)->len - 1;
+}
+
+// compare extent [key1-end1] against extent [key2-end2]
+static inline Oc_xt_cmp oc_xt_ext_compare_bounds(uint64 key1, uint64 end1,
+                                                 uint64 key2, uint64 end2)
+{
+    if (end1 < key2)
+        return OC_XT_CMP_SML;
+    else if (key1 > end2)
+        return OC_XT_CMP_GRT;
+    else if (key1 == key2 && end1 == end2)
+        return OC_XT_CMP_EQUAL;
+    else if (key1 >= key2 && end1 <= end2)
+        return OC_XT_CMP_COVERED;
+    else if (key1 <= key2 && end1 >= end2)
+        return OC_XT_CMP_FULLY_COVERS;
+    else if (key1 < key2)
+        return OC_XT_CMP_PART_OVERLAP_SML;
+    else
+        return OC_XT_CMP_PART_OVERLAP_GRT;
+}
+
+/* compare key [key1_p] to extent [key2_p, rcrd2_p], same as
+ * [rcrd_compare0].
+ */
+static inline int oc_xt_ext_compare0(struct Oc_xt_key *key1_p,
+                                     struct Oc_xt_key *key2_p,
+                                     struct Oc_xt_rcrd *rcrd2_p)
+{
+    uint64 key1 = oc_xt_ext_key(key1_p);
+
+    if (key1 < oc_xt_ext_key(key2_p)) return 1;
+    else if (key1 > oc_xt_ext_end(key2_p, rcrd2_p)) return -1;
+    else return 0;
+}
+
+/* Write the part [lo-hi] of extent [key_p, rcrd_p] into
+ * [trg_key_po, trg_rcrd_po]. The range must be inside the extent.
+ */
+static inline void oc_xt_ext_sub(struct Oc_xt_key *key_p,
+                                 struct Oc_xt_rcrd *rcrd_p,
+                                 uint64 lo,
+                                 uint64 hi,
+                                 struct Oc_xt_key *trg_key_po,
+                                 struct Oc_xt_rcrd *trg_rcrd_po)
+{
+    uint64 addr = oc_xt_ext_rcrd(rcrd_p)->addr + (lo - oc_xt_ext_key(key_p));
+
+    *(Oc_xt_ext_key*)trg_key_po = lo;
+    oc_xt_ext_rcrd(trg_rcrd_po)->len = hi - lo + 1;
+    oc_xt_ext_rcrd(trg_rcrd_po)->addr = addr;
+}
+
+/******************************************************************/
+
+/* Set the key and record sizes in [cfg_p] and fill in the key and
+ * record functions with the built-in implementations. The
+ * [rcrd_release] and [rcrd_inc_refcount] functions are left to the
+ * caller, they manage the physical space.
+ */
+void oc_xt_ext_setup_config(Oc_xt_cfg *cfg_p);
+
+#endif
@@ -105,6 +105,14 @@ typedef enum Oc_xt_cmp {
 // A set of function pointers and data to initialize an x-tree
 typedef struct Oc_xt_cfg {
     bool initialized;
+
+    /* Use the built-in (offset, length, physical address) extent type
+     * of oc_xt_ext.h. The key and record sizes, and the key and record
+     * functions, are then filled in by [oc_xt_init_config]. Only
+     * [rcrd_release] and [rcrd_inc_refcount] have to be provided. The
+     * split and overlap code calls the built-in operations directly.
+     */
+    bool builtin_ext;
     
     // size of a key (in bytes)
     int key_size;                    
@@ -134,10 +142,34 @@ typedef struct Oc_xt_cfg {
     // working with nodes
     Oc_xt_node*  ((*node_alloc)(struct Oc_wu*));             
     Oc_xt_node*  ((*node_alloc_at)(struct Oc_wu*, uint64));             
+
+    /* Reduce the ref-count on a node address by one. The page is
+     * freed once the count drops to zero.
+     */
     void         ((*node_dealloc)(struct Oc_wu*, uint64));
-    Oc_xt_node*  ((*node_get)(struct Oc_wu*, uint64));
+
+    /* Take a reference to the node, and lock it with a Shared-lock.
+     * The node must still be at the requested address once the lock
+     * is held.
+     */
+    Oc_xt_node*  ((*node_get_sl)(struct Oc_wu*, uint64));
+
+    // Same as above, with an eXclusive-lock
+    Oc_xt_node*  ((*node_get_xl)(struct Oc_wu*, uint64));
+
+    // Drop a reference to a node. The node is unlocked. 
     void         ((*node_release)(struct Oc_wu*, Oc_xt_node*));   
-    void         ((*node_mark_dirty)(struct Oc_wu*, Oc_xt_node*));
+
+    /* Mark a node as dirty. If the last argument is TRUE then the
+     * node is shared with a clone. It has to be moved to a new
+     * address, leaving the old copy in place, and the ref-count on
+     * the old address reduced by one.
+     */
+    void         ((*node_mark_dirty)(struct Oc_wu*, Oc_xt_node*, bool));
+
+    // Free-support for ref-counting
+    void         ((*fs_inc_refcount)(struct Oc_wu*, uint64));
+    int          ((*fs_get_refcount)(struct Oc_wu*, uint64));
     
     /* compare keys [key1] and [key2].
      *  return 0 if keys are equal
@@ -150,6 +182,13 @@ typedef struct Oc_xt_cfg {
     // increment [key_p]. put the result in [result_p]
     void         ((*key_inc)(struct Oc_xt_key *key_p,
                              struct Oc_xt_key *result_p));
+
+    /* Return the number of units between [key1_p] and [key2_p], where
+     * [key1_p] is not larger than [key2_p]. Used to measure the free
+     * gaps between extents. 
+     */
+    uint64       ((*key_distance)(struct Oc_xt_key *key1_p,
+                                  struct Oc_xt_key *key2_p));
     
     // string representation of a key
     void         ((*key_to_string)(struct Oc_xt_key *key_p,
@@ -258,6 +297,19 @@ typedef struct Oc_xt_cfg {
                                            int num,
                                            struct Oc_xt_key *key_array,
                                            struct Oc_xt_rcrd *rcrd_array ));
+
+    /* Optional. Extent [key2_p, rcrd2_p] starts immediately after
+     * extent [key1_p, rcrd1_pio] ends. If the two are also physically
+     * contiguous then extend [rcrd1_pio] so that it covers both, and
+     * return TRUE. Otherwise, return FALSE and leave [rcrd1_pio] as is.
+     *
+     * Used by insert to coalesce adjacent extents. Can be NULL, in
+     * which case extents are never merged.
+     */
+    bool           ((*rcrd_try_merge)(struct Oc_xt_key *key1_p,
+                                      struct Oc_xt_rcrd *rcrd1_pio,
+                                      struct Oc_xt_key *key2_p,
+                                      struct Oc_xt_rcrd *rcrd2_p));
     
     // Return the length of the extent
     uint64         ((*rcrd_length)(struct Oc_xt_key *key_p,
@@ -267,6 +319,14 @@ typedef struct Oc_xt_cfg {
     void           ((*rcrd_release)(struct Oc_wu*,
                                     struct Oc_xt_key *key_p,
                                     struct Oc_xt_rcrd *rcrd_p));
+
+    /* Take another reference to a record. Called when a leaf shared
+     * between clones is copied, after which both copies point to the
+     * extent. Each reference is later dropped with [rcrd_release].
+     */
+    void           ((*rcrd_inc_refcount)(struct Oc_wu*,
+                                         struct Oc_xt_key *key_p,
+                                         struct Oc_xt_rcrd *rcrd_p));
     
     // string representation of an extent
     void           ((*rcrd_to_string)(struct Oc_xt_key *key_p,
@@ -346,6 +406,16 @@ bool oc_xt_dbg_validate_b(
     struct Oc_wu *wu_p,
     Oc_xt_state *s_p);
 
+/* Validate a set of clones. Each tree is validated separately, and
+ * then the ref-count of each node is checked against the number of
+ * times it is pointed to from the set.
+ * All the trees are locked during this operation.
+ */
+bool oc_xt_dbg_validate_clones_b(
+    struct Oc_wu *wu_p,
+    int n_clones,
+    Oc_xt_state *st_array[]);
+
 /* Computes statistics on the tree
  */
 void oc_xt_statistics_b(
@@ -373,6 +443,83 @@ void oc_xt_lookup_range_b(
     struct Oc_xt_rcrd *rcrd_array_po,
     int *n_found_po);
 
+/* Lookup the extent covering [key_p]. If there is one, copy it, whole,
+ * into [key_po, rcrd_po] and return TRUE. Otherwise, return FALSE.
+ *
+ * This is the cheap way to translate a single offset: a single path
+ * is descended, locked for read with lock-coupling, and nothing is
+ * split.
+ */
+bool oc_xt_lookup_ofs_b(
+    struct Oc_wu *wu_p,
+    Oc_xt_state *s_p,
+    struct Oc_xt_key *key_p,
+    struct Oc_xt_key *key_po,
+    struct Oc_xt_rcrd *rcrd_po);
+
+/* A cursor over the extents in a range. The fields are private to
+ * the x-tree.
+ */
+typedef struct Oc_xt_cursor {
+    struct Oc_xt_state *s_p;
+
+    // The part of the range not returned yet
+    struct Oc_xt_key *min_key_p;
+    struct Oc_xt_key *max_key_p;
+    bool done;
+
+    // The current leaf, locked for read, and the next entry in it
+    Oc_xt_node *leaf_p;
+    int loc;
+
+    // The generation of the tree when the leaf was reached
+    uint64 gen;
+
+    // The smallest key of the leaves to the right of the current one
+    bool has_next;
+    struct Oc_xt_key *next_key_p;
+
+    // A scratch key
+    struct Oc_xt_key *key_p;
+} Oc_xt_cursor;
+
+/* Open a cursor [cur_po] over range [min_key_p, max_key_p]. The
+ * extents in the range are returned, in order, by
+ * [oc_xt_cursor_next_b]. Extents that partially overlap the range are
+ * chopped, as with [oc_xt_lookup_range_b].
+ *
+ * Only the current leaf stays locked for read between calls; the tree
+ * is not locked. Writers that need the leaf wait until the cursor
+ * moves off it, or is closed. Each leaf is reached by a single descent
+ * with lock-coupling. An extent is returned at most once, even if the
+ * tree changes between calls; extents added or removed meanwhile may,
+ * or may not, be seen.
+ *
+ * The work-unit that owns the cursor must not modify the tree while
+ * the cursor is open, it would deadlock on the leaf it holds. Debug
+ * builds catch a work-unit that waits for a lock it holds.
+ */
+void oc_xt_cursor_open_b(
+    struct Oc_wu *wu_p,
+    Oc_xt_state *s_p,
+    Oc_xt_cursor *cur_po,
+    struct Oc_xt_key *min_key_p,
+    struct Oc_xt_key *max_key_p);
+
+/* Copy the next extent in the range into [key_po, rcrd_po], and return
+ * TRUE. Return FALSE once the range is exhausted.
+ */
+bool oc_xt_cursor_next_b(
+    struct Oc_wu *wu_p,
+    Oc_xt_cursor *cur_p,
+    struct Oc_xt_key *key_po,
+    struct Oc_xt_rcrd *rcrd_po);
+
+// Close a cursor. Can be called before the range is exhausted.
+void oc_xt_cursor_close(
+    struct Oc_wu *wu_p,
+    Oc_xt_cursor *cur_p);
+
 /* insert an extent into the tree. return the length
  * of overwrite. For example, if the inserted extent ovelaps an
  * existing extent for 1000 units then the return value will be 1000.
@@ -385,6 +532,62 @@ uint64 oc_xt_insert_range_b(
     struct Oc_xt_key *key_p,
     struct Oc_xt_rcrd *rcrd_p);
 
+/* Insert [num] extents, sorted by their start offset, into the tree.
+ * Equivalent to inserting them one by one, in array order, but each
+ * leaf is filled with all the extents that land in it before moving
+ * on. The cost is proportional to the number of leaves touched,
+ * rather than to the number of extents.
+ *
+ * Return the total length overwritten. 
+ */
+uint64 oc_xt_insert_multi_b(
+    struct Oc_wu *wu_p,
+    struct Oc_xt_state *s_p,
+    int num,
+    struct Oc_xt_key *key_array,
+    struct Oc_xt_rcrd *rcrd_array);
+
+/* Build the tree bottom-up from [num] extents, sorted by their start
+ * offset and not overlapping. The tree must be empty. Leaves are
+ * filled in a single pass, and index levels are built on top of
+ * them, so the nodes end up packed, instead of half full as after a
+ * series of inserts. If [coalesce] is TRUE then adjacent extents are
+ * merged with rcrd_try_merge on the way in.
+ *
+ * The whole tree is locked during this operation.
+ */
+void oc_xt_bulk_load_b(
+    struct Oc_wu *wu_p,
+    struct Oc_xt_state *s_p,
+    int num,
+    struct Oc_xt_key *key_array,
+    struct Oc_xt_rcrd *rcrd_array,
+    bool coalesce);
+
+/* Find the lowest free gap of [len] units that starts at, or
+ * above, [min_key_p]. A free gap is a range that is not covered by
+ * any extent. The start of the gap is returned in [result_key_po].
+ * There is always a gap after the last extent, so the search never
+ * fails.
+ *
+ * Index entries carry an upper bound on the largest gap in their
+ * subtree. Subtrees that cannot hold a large enough gap are skipped,
+ * so the cost is logarithmic in the size of the tree. Filling gaps
+ * leaves the bounds too large; a search that goes over such a subtree
+ * without a result recomputes its bound, so the cost is logarithmic
+ * when amortized over the searches.
+ *
+ * A partial path in the tree is locked for read. A gap that is being
+ * filled, or opened, by a concurrent insert may or may not be seen.
+ * When stale bounds are lowered, the tree is briefly locked for write.
+ */
+void oc_xt_find_gap_b(
+    struct Oc_wu *wu_p,
+    Oc_xt_state *s_p,
+    struct Oc_xt_key *min_key_p,
+    uint64 len,
+    struct Oc_xt_key *result_key_po);
+
 /* Remove a range from the tree.
  * The whole tree is locked during this operation.
  * Return the total length removed. 
@@ -395,6 +598,42 @@ uint64 oc_xt_remove_range_b(
     struct Oc_xt_key *min_key_p,
     struct Oc_xt_key *max_key_p);
 
+/* Remove a range from the tree, lazily. Used to truncate large objects.
+ *
+ * The whole tree is locked during this operation, as with
+ * [oc_xt_remove_range_b]. However, only the two paths to the edges of
+ * the range are visited. Sub-trees that lie in between are detached,
+ * and queued in the tree state. Their records are released, and their
+ * nodes deallocated, by [oc_xt_reclaim_b]. 
+ *
+ * The total length removed is not returned.
+ */
+void oc_xt_remove_range_lazy_b(
+    struct Oc_wu *wu_p,
+    Oc_xt_state *s_p,
+    struct Oc_xt_key *min_key_p,
+    struct Oc_xt_key *max_key_p);
+
+/* Delete a single sub-tree detached by [oc_xt_remove_range_lazy_b].
+ * Return FALSE if there is nothing left to reclaim.
+ *
+ * The tree is locked only while the sub-tree is taken off the
+ * queue. The sub-tree itself is not reachable from the tree, so readers
+ * and writers are not blocked while it is deleted. The caller is
+ * expected to run this from a background task, until it returns FALSE.
+ *
+ * The queue is held in memory. [oc_xt_delete_b] reclaims whatever is
+ * left in it; otherwise, it has to be drained before the state is
+ * destroyed, and [oc_xt_destroy_state] asserts that it is empty.
+ *
+ * Note that detached sub-trees are not recorded on disk. If the system
+ * crashes before the queue is drained, their nodes are leaked: they are
+ * no longer reachable from the root, and nothing frees them on recovery.
+ */
+bool oc_xt_reclaim_b(
+    struct Oc_wu *wu_p,
+    Oc_xt_state *s_p);
+
 /* swap references to the b-tree root between two work-units.
  * Used in order to work correctly with the strict accounting for
  * pages performed by the PM. 
@@ -406,6 +645,29 @@ void oc_xt_swap_root_ref(Oc_xt_state *s_p,
 // A string representation of the comparison return code
 const char *oc_xt_string_of_cmp_rc(Oc_xt_cmp rc);
 
+/******************************************************************/
+// snapshot and clone section
+
+/* clone x-tree [src_p] onto [trg_p]. This operation copies the root
+ * node onto a new location (anywhere on disk) and increments the
+ * ref-count on the immediate children. If the root is a leaf then
+ * the ref-count of its extents is incremented instead.
+ *
+ * Nodes shared between clones are copied on the first write, and
+ * records are released only when the last leaf pointing to them is
+ * deleted.
+ *
+ * Return the address on disk where the root of the clone is
+ * (initially) located.
+ *
+ * pre-requisit: a fresh x-tree state [trg_p] has to be created
+ *   and initialized. The source tree [src_p] has to be valid. 
+ */
+uint64 oc_xt_clone_b(
+    struct Oc_wu *wu_p,
+    struct Oc_xt_state *src_p,
+    struct Oc_xt_state *trg_p);
+
 /******************************************************************/
 // query section
 
@@ -419,8 +681,14 @@ typedef enum Oc_xt_fid {
     OC_XT_FN_DBG_OUTPUT,            
     OC_XT_FN_DBG_VALIDATE,          
     OC_XT_FN_LOOKUP_RANGE,          
-    OC_XT_FN_INSERT_RANGE,          
+    OC_XT_FN_LOOKUP_OFS,
+    OC_XT_FN_CURSOR,
+    OC_XT_FN_INSERT_RANGE,
+    OC_XT_FN_BULK_LOAD,          
     OC_XT_FN_REMOVE_RANGE,          
+    OC_XT_FN_REMOVE_RANGE_LAZY,
+    OC_XT_FN_RECLAIM,
+    OC_XT_FN_FIND_GAP,
     OC_XT_FN_GET_ATTR, 
     OC_XT_FN_SET_ATTR,
 } Oc_xt_fid;
@@ -40,6 +40,7 @@
 
 #include "oc_xt_int.h"
 #include "oc_xt_nd.h"
+#include "oc_xt_ext.h"
 #include "oc_xt_trace.h"
 #include "oc_utl_trk.h"
 /**********************************************************************/
@@ -52,6 +53,7 @@ typedef struct Nd_leaf_ent_ptrs {
 typedef struct Nd_index_ent_ptrs {
     struct Oc_xt_key *key_p;
     uint64 *addr_p;
+    uint64 *gap_p;
 } Nd_index_ent_ptrs;
 
 typedef enum Nd_search {
@@ -73,6 +75,9 @@ static inline int num_entries(Oc_xt_nd_hdr *hdr_p);
 static void oc_xt_nd_dealloc_node(struct Oc_wu *wu_p,
                                    struct Oc_xt_state *s_p,
                                    Oc_xt_node *node_p);
+static void oc_xt_nd_inc_children_refcnt(struct Oc_wu *wu_p,
+                                         struct Oc_xt_state *s_p,
+                                         Oc_xt_node *node_p);
 static int max_ent_in_hdr (struct Oc_xt_state *s_p, Oc_xt_nd_hdr *hdr_p);
 static struct Oc_xt_nd_array* get_start_array(struct Oc_xt_state *s_p,
                                                Oc_xt_node *node_p);
@@ -122,7 +127,8 @@ static void replace_index_entry(struct Oc_xt_state *s_p,
                                 struct Oc_xt_nd_array *arr_p,
                                 int idx,
                                 struct Oc_xt_key *key_p,
-                                uint64 *addr_p);
+                                uint64 *addr_p,
+                                uint64 gap);
 
 static void replace_index_entry_addr(struct Oc_xt_state *s_p,
                                      Oc_xt_nd_hdr *hdr_p,
@@ -141,7 +147,11 @@ static void alloc_new_index_entry(struct Oc_xt_state *s_p,
                                   Oc_xt_nd_hdr *hdr_p,
                                   struct Oc_xt_nd_array *arr_p,
                                   struct Oc_xt_key *key_p,
-                                  uint64 *addr_p);
+                                  uint64 *addr_p,
+                                  uint64 gap);
+static uint64 leaf_split_gap(struct Oc_xt_state *s_p,
+                             Oc_xt_node *left_p,
+                             Oc_xt_node *right_p);
 #if 0
 static bool pre_remove_verify_num_entries(struct Oc_xt_state *s_p,
                                           Oc_xt_node *node_p);
@@ -156,6 +166,10 @@ static void rebalance(
 static void init_root(
     struct Oc_wu *wu_p,
     Oc_xt_node *node_pi);
+static bool leaf_try_merge_kth(struct Oc_wu *wu_p,
+                               struct Oc_xt_state *s_p,
+                               Oc_xt_node *node_p,
+                               int k);
 static uint64 remove_part(
     Oc_wu *wu_p,
     Oc_xt_state *s_p,
@@ -192,11 +206,46 @@ Oc_xt_node *oc_xt_nd_get_for_read(
 {
     Oc_xt_node *node_p;
 
-    node_p = s_p->cfg_p->node_get(wu_p, addr);
-    oc_utl_trk_crt_lock_read(wu_p, &node_p->lock);
+    node_p = s_p->cfg_p->node_get_sl(wu_p, addr);
     return node_p;
 }
 
+/* increment the ref-count of the children of [node_p]. The children
+ * of a leaf are its extents.
+ *
+ * The node has to be locked in exclusive mode. This ensures
+ * that the address of the children cannot be modified. Other
+ * concurrent operation on the tree or its clones can modify
+ * the children or reduce their ref-count. However, the ref-count
+ * cannot drop below one.
+ */
+static void oc_xt_nd_inc_children_refcnt(struct Oc_wu *wu_p,
+                                         struct Oc_xt_state *s_p,
+                                         Oc_xt_node *node_p)
+{
+    Oc_xt_nd_hdr *hdr_p = get_hdr(node_p);
+    struct Oc_xt_nd_array *arr_p = get_start_array(s_p, node_p);
+    int i;
+
+    if (hdr_p->flags.leaf) {
+        Nd_leaf_ent_ptrs ent;
+
+        for (i=0; i<num_entries(hdr_p); i++) {
+            get_kth_leaf_entry(s_p, hdr_p, arr_p, &ent, i);
+            s_p->cfg_p->rcrd_inc_refcount(wu_p, ent.key_p, ent.rcrd_p);
+        }
+    }
+    else {
+        for (i=0; i<num_entries(hdr_p); i++) {
+            struct Oc_xt_key *dummy_key_p;
+            uint64 addr;
+
+            oc_xt_nd_index_get_kth(s_p, node_p, i, &dummy_key_p, &addr);
+            s_p->cfg_p->fs_inc_refcount(wu_p, addr);
+        }
+    }
+}
+
 /* grabs write lock; if child address has changed due to COW,
  * father's entr pointing to child is updated.
  */
@@ -210,10 +259,17 @@ Oc_xt_node *oc_xt_nd_get_for_write(
 {
     Oc_xt_node *node_p;
     uint64 new_addr;
+    int fs_refcnt;
 
-    node_p = s_p->cfg_p->node_get(wu_p, addr);
-    oc_utl_trk_crt_lock_write(wu_p, &node_p->lock);
-    s_p->cfg_p->node_mark_dirty(wu_p, node_p);
+    node_p = s_p->cfg_p->node_get_xl(wu_p, addr);
+
+    /* If the node is shared with a clone then the copy we are about
+     * to create takes a reference to all the children.
+     */
+    fs_refcnt = s_p->cfg_p->fs_get_refcount(wu_p, node_p->disk_addr);
+    if (fs_refcnt > 1)
+        oc_xt_nd_inc_children_refcnt(wu_p, s_p, node_p);
+    s_p->cfg_p->node_mark_dirty(wu_p, node_p, (fs_refcnt > 1));
 
     /* If node was just COWed, and we got a father node that points to it
      * then the address in the father should be updated.
@@ -396,6 +452,7 @@ static void get_kth_index_entry(struct Oc_xt_state *s_p,
 
     ent_ptrs_p->key_p = (struct Oc_xt_key*) p;
     ent_ptrs_p->addr_p = (uint64*) (p + s_p->cfg_p->key_size);
+    ent_ptrs_p->gap_p = (uint64*) (p + s_p->cfg_p->key_size + sizeof(uint64));
 }
 
 
@@ -449,10 +506,14 @@ static int generic_comparison(struct Oc_xt_state *s_p,
 
     if (hdr_p->flags.leaf) {
         get_kth_leaf_entry(s_p, hdr_p, arr_p, &ent, loc);
+        if (s_p->cfg_p->builtin_ext)
+            return oc_xt_ext_compare0(key_p, ent.key_p, ent.rcrd_p);
         return s_p->cfg_p->rcrd_compare0(key_p, ent.key_p, ent.rcrd_p);
     }
     else {
         in_key_p = get_kth_key(s_p, hdr_p, arr_p, loc);
+        if (s_p->cfg_p->builtin_ext)
+            return oc_xt_ext_key_compare(key_p, in_key_p);
         return s_p->cfg_p->key_compare(key_p, in_key_p);
     }
 }
@@ -690,7 +751,8 @@ static void replace_index_entry(struct Oc_xt_state *s_p,
                                 struct Oc_xt_nd_array *arr_p,
                                 int idx,
                                 struct Oc_xt_key *key_p,
-                                uint64 *addr_p)
+                                uint64 *addr_p,
+                                uint64 gap)
 {
     Nd_index_ent_ptrs ent;
 
@@ -698,6 +760,7 @@ static void replace_index_entry(struct Oc_xt_state *s_p,
     get_kth_index_entry(s_p, hdr_p, arr_p, &ent, idx);
     memcpy((char*)ent.key_p, key_p, s_p->cfg_p->key_size);
     memcpy((char*)ent.addr_p, addr_p, sizeof(uint64));
+    *ent.gap_p = gap;
 }
 
 static void replace_index_entry_addr(struct Oc_xt_state *s_p,
@@ -752,12 +815,13 @@ static void alloc_new_leaf_entry(struct Oc_wu *wu_p,
                         oc_xt_nd_string_of_rcrd(s_p, key_p, rcrd_p));
 }
 
-// find a free index and write the key,data pair into it
+// find a free index and write the key,addr,gap triple into it
 static void alloc_new_index_entry(struct Oc_xt_state *s_p,
                                  Oc_xt_nd_hdr *hdr_p,
                                  struct Oc_xt_nd_array *arr_p,
                                  struct Oc_xt_key *key_p,
-                                 uint64 *addr_p)
+                                 uint64 *addr_p,
+                                 uint64 gap)
 {
     Nd_index_ent_ptrs ent;
     int free_idx;
@@ -772,6 +836,7 @@ static void alloc_new_index_entry(struct Oc_xt_state *s_p,
     get_kth_index_entry(s_p, hdr_p, arr_p, &ent, free_idx);
     memcpy((char*)ent.key_p, key_p, s_p->cfg_p->key_size);
     memcpy((char*)ent.addr_p, addr_p, sizeof(uint64));
+    *ent.gap_p = gap;
 
     // update node state
     hdr_p->num_used_entries++;
@@ -984,11 +1049,14 @@ void oc_xt_nd_delete(
     Oc_xt_nd_hdr *hdr_p;
     struct Oc_xt_nd_array *arr_p;
     uint64 addr;
+    int fs_refcnt = s_p->cfg_p->fs_get_refcount(wu_p, node_p->disk_addr);
 
+    oc_utl_debugassert(fs_refcnt > 0);
     hdr_p = get_hdr(node_p);
     arr_p = get_start_array(s_p, node_p);
 
-    if (hdr_p->flags.leaf) {
+    // the records are released only by the last leaf pointing to them
+    if (1 == fs_refcnt && hdr_p->flags.leaf) {
         int i;
         Nd_leaf_ent_ptrs ent;
 
@@ -999,6 +1067,7 @@ void oc_xt_nd_delete(
         }
     }
 
+    // reduce the ref-count on the page and release it
     addr = node_p->disk_addr;
     s_p->cfg_p->node_release(wu_p, node_p);
     s_p->cfg_p->node_dealloc(wu_p, addr);
@@ -1137,7 +1206,9 @@ void oc_xt_nd_index_get_kth(
     *addr_po = *ent.addr_p;
 }
 
-// [node_p] is an index node. Set its kth pointer.
+/* [node_p] is an index node. Set its kth pointer. The gap bound of
+ * the entry is left as is.
+ */
 void oc_xt_nd_index_set_kth(
     struct Oc_xt_state *s_p,
     Oc_xt_node *node_p,
@@ -1210,6 +1281,161 @@ void oc_xt_nd_max_ofs(
     }
 }
 
+/**********************************************************************/
+/* Gap bounds.
+ *
+ * A gap is owned by the extent that precedes it. Each index entry
+ * holds an upper bound on the gaps owned by extents in its subtree.
+ * The gap following the last extent in the tree is infinite.
+ */
+
+uint64 oc_xt_nd_gap_between(
+    struct Oc_xt_state *s_p,
+    struct Oc_xt_key *end_key_p,
+    struct Oc_xt_key *start_key_p)
+{
+    struct Oc_xt_key *key_p;
+
+    key_p = (struct Oc_xt_key*) alloca(s_p->cfg_p->key_size);
+    s_p->cfg_p->key_inc(end_key_p, key_p);
+    return s_p->cfg_p->key_distance(key_p, start_key_p);
+}
+
+uint64 oc_xt_nd_leaf_inner_gap(
+    struct Oc_xt_state *s_p,
+    Oc_xt_node *node_p,
+    int *kth_po)
+{
+    Oc_xt_nd_hdr *hdr_p = get_hdr(node_p);
+    struct Oc_xt_nd_array *arr_p = get_start_array(s_p, node_p);
+    Nd_leaf_ent_ptrs ent, next;
+    struct Oc_xt_key *end_key_p;
+    uint64 gap, max_gap = 0;
+    int i;
+
+    oc_utl_debugassert(hdr_p->flags.leaf);
+    end_key_p = (struct Oc_xt_key*) alloca(s_p->cfg_p->key_size);
+    if (kth_po != NULL)
+        *kth_po = 0;
+
+    for (i=0; i < num_entries(hdr_p) - 1; i++) {
+        get_kth_leaf_entry(s_p, hdr_p, arr_p, &ent, i);
+        get_kth_leaf_entry(s_p, hdr_p, arr_p, &next, i+1);
+        s_p->cfg_p->rcrd_end_offset(ent.key_p, ent.rcrd_p, end_key_p);
+        gap = oc_xt_nd_gap_between(s_p, end_key_p, next.key_p);
+        if (gap > max_gap) {
+            max_gap = gap;
+            if (kth_po != NULL)
+                *kth_po = i;
+        }
+    }
+
+    return max_gap;
+}
+
+uint64 oc_xt_nd_index_max_gap(
+    struct Oc_xt_state *s_p,
+    Oc_xt_node *node_p)
+{
+    Oc_xt_nd_hdr *hdr_p = get_hdr(node_p);
+    struct Oc_xt_nd_array *arr_p = get_start_array(s_p, node_p);
+    Nd_index_ent_ptrs ent;
+    uint64 max_gap = 0;
+    int i;
+
+    oc_utl_debugassert(!hdr_p->flags.leaf);
+    for (i=0; i < num_entries(hdr_p); i++) {
+        get_kth_index_entry(s_p, hdr_p, arr_p, &ent, i);
+        max_gap = MAX(max_gap, *ent.gap_p);
+    }
+
+    return max_gap;
+}
+
+/* The largest gap owned by leaf [left_p], whose extents are followed
+ * by those of leaf [right_p].
+ */
+static uint64 leaf_split_gap(struct Oc_xt_state *s_p,
+                             Oc_xt_node *left_p,
+                             Oc_xt_node *right_p)
+{
+    struct Oc_xt_key *key_p, *end_key_p;
+    struct Oc_xt_rcrd *rcrd_p;
+    uint64 gap;
+
+    end_key_p = (struct Oc_xt_key*) alloca(s_p->cfg_p->key_size);
+    oc_xt_nd_leaf_get_kth(s_p, left_p, oc_xt_nd_num_entries(s_p, left_p) - 1,
+                          &key_p, &rcrd_p);
+    s_p->cfg_p->rcrd_end_offset(key_p, rcrd_p, end_key_p);
+    gap = oc_xt_nd_gap_between(s_p, end_key_p,
+                               oc_xt_nd_min_key(s_p, right_p));
+
+    return MAX(gap, oc_xt_nd_leaf_inner_gap(s_p, left_p, NULL));
+}
+
+uint64 oc_xt_nd_index_get_kth_gap(
+    struct Oc_xt_state *s_p,
+    Oc_xt_node *node_p,
+    int k)
+{
+    Oc_xt_nd_hdr *hdr_p= get_hdr(node_p);
+    Nd_index_ent_ptrs ent;
+
+    oc_utl_assert(k < num_entries(hdr_p));
+    oc_utl_debugassert(!hdr_p->flags.leaf);
+
+    get_kth_index_entry(s_p, hdr_p, get_start_array(s_p, node_p), &ent, k);
+    return *ent.gap_p;
+}
+
+bool oc_xt_nd_index_raise_kth_gap(
+    struct Oc_xt_state *s_p,
+    Oc_xt_node *node_p,
+    int k,
+    uint64 gap)
+{
+    Oc_xt_nd_hdr *hdr_p= get_hdr(node_p);
+    Nd_index_ent_ptrs ent;
+
+    oc_utl_assert(k < num_entries(hdr_p));
+    oc_utl_debugassert(!hdr_p->flags.leaf);
+
+    get_kth_index_entry(s_p, hdr_p, get_start_array(s_p, node_p), &ent, k);
+    if (*ent.gap_p >= gap)
+        return FALSE;
+    *ent.gap_p = gap;
+    return TRUE;
+}
+
+void oc_xt_nd_index_set_kth_gap(
+    struct Oc_xt_state *s_p,
+    Oc_xt_node *node_p,
+    int k,
+    uint64 gap)
+{
+    Oc_xt_nd_hdr *hdr_p= get_hdr(node_p);
+    Nd_index_ent_ptrs ent;
+
+    oc_utl_assert(k < num_entries(hdr_p));
+    oc_utl_debugassert(!hdr_p->flags.leaf);
+
+    get_kth_index_entry(s_p, hdr_p, get_start_array(s_p, node_p), &ent, k);
+    *ent.gap_p = gap;
+}
+
+void oc_xt_nd_index_merge_kth_gaps(
+    struct Oc_xt_state *s_p,
+    Oc_xt_node *node_p,
+    int k)
+{
+    uint64 gap;
+
+    gap = MAX(oc_xt_nd_index_get_kth_gap(s_p, node_p, k),
+              oc_xt_nd_index_get_kth_gap(s_p, node_p, k+1));
+    oc_xt_nd_index_raise_kth_gap(s_p, node_p, k, gap);
+    oc_xt_nd_index_raise_kth_gap(s_p, node_p, k+1, gap);
+}
+
 /**********************************************************************/
 /* in an index node [index_node_p] replace binding for index [k]
  * with two bindings for two nodes [left_node_p] and [right_node_p].
@@ -1225,23 +1451,39 @@ void oc_xt_nd_index_replace_w2(
     struct Oc_xt_nd_array *arr_p = get_start_array(s_p, index_node_p);
     Oc_xt_nd_hdr *hdr_p = get_hdr(index_node_p);
     uint64 left_addr, right_addr;
+    uint64 left_gap, right_gap;
+    Nd_index_ent_ptrs ent;
 
     oc_utl_debugassert(!hdr_p->flags.leaf);
 
     // The caller guaranties that the key is in the range of the index-node
     oc_utl_debugassert(k >= 0 && k <= num_entries(hdr_p));
 
+    /* Compute the gap bounds of the two halves. The gap after the last
+     * extent of a left leaf is known, it ends at the first extent of
+     * the right leaf. The gap after the last extent of a right leaf
+     * is not known; keep the bound of the original node.
+     */
+    if (oc_xt_nd_is_leaf(s_p, left_node_p)) {
+        get_kth_index_entry(s_p, hdr_p, arr_p, &ent, k);
+        left_gap = leaf_split_gap(s_p, left_node_p, right_node_p);
+        right_gap = *ent.gap_p;
+    } else {
+        left_gap = oc_xt_nd_index_max_gap(s_p, left_node_p);
+        right_gap = oc_xt_nd_index_max_gap(s_p, right_node_p);
+    }
+    
     // replace the original (key,addr) with the left-node (key,addr)
     left_addr = left_node_p->disk_addr;
     replace_index_entry(s_p, hdr_p, arr_p, k,
                         oc_xt_nd_min_key(s_p, left_node_p),
-                        &left_addr);
+                        &left_addr, left_gap);
 
     // add an additional binding for the (key,addr) of the right-node
     right_addr = right_node_p->disk_addr;
     alloc_new_index_entry(s_p, hdr_p, arr_p,
                           oc_xt_nd_min_key(s_p, right_node_p),
-                          &right_addr);
+                          &right_addr, right_gap);
     shuffle_insert_key(hdr_p, k+1);
 }
 
@@ -1282,7 +1524,7 @@ Oc_xt_node *oc_xt_nd_split(
     // 1. make a copy of [node_p], mark the two copies by L and R
     right_p = s_p->cfg_p->node_alloc(wu_p);
     oc_utl_trk_crt_lock_write(wu_p, &right_p->lock);
-    s_p->cfg_p->node_mark_dirty(wu_p, right_p);
+    s_p->cfg_p->node_mark_dirty(wu_p, right_p, FALSE);
     memcpy(right_p->data, node_p->data, s_p->cfg_p->node_size);
 
     // 2. decide on a division between L, and R: choose a number k
@@ -1338,6 +1580,7 @@ void oc_xt_nd_split_root(
     Oc_xt_node *left_p, *right_p;
     struct Oc_xt_nd_array *arr_p, *lt_arr_p;
     uint64 left_addr, right_addr;
+    uint64 left_gap, right_gap;
 
     oc_utl_debugassert(hdr_p->flags.root);
     oc_xt_trace_wu_lvl(3, OC_EV_XT_ROOT_SPLIT, wu_p, "");
@@ -1345,7 +1588,7 @@ void oc_xt_nd_split_root(
     //  1. copy the root node into a regular, non-root node. Mark this node by N.
     left_p = s_p->cfg_p->node_alloc(wu_p);
     oc_utl_trk_crt_lock_write(wu_p, &left_p->lock);
-    s_p->cfg_p->node_mark_dirty(wu_p, left_p);
+    s_p->cfg_p->node_mark_dirty(wu_p, left_p, FALSE);
 
     memcpy(left_p->data, root_node_p->data, sizeof(Oc_xt_nd_hdr));
     lt_hdr_p = get_hdr(left_p);
@@ -1359,6 +1602,17 @@ void oc_xt_nd_split_root(
     //  2. split L into R using [oc_xt_nd_split].
     right_p = oc_xt_nd_split(wu_p, s_p, left_p);
 
+    /* Compute the gap bounds. The right leaf holds the last extent
+     * in the tree, the gap following it is infinite.
+     */
+    if (lt_hdr_p->flags.leaf) {
+        left_gap = leaf_split_gap(s_p, left_p, right_p);
+        right_gap = OC_XT_ND_GAP_INF;
+    } else {
+        left_gap = oc_xt_nd_index_max_gap(s_p, left_p);
+        right_gap = oc_xt_nd_index_max_gap(s_p, right_p);
+    }
+
     //  3. Erase the entries from the original root node.
     hdr_p->num_used_entries = 0;
 
@@ -1371,18 +1625,87 @@ void oc_xt_nd_split_root(
                           hdr_p,
                           arr_p,
                           oc_xt_nd_min_key(s_p, left_p),
-                          &left_addr);
+                          &left_addr, left_gap);
     right_addr = right_p->disk_addr;
     alloc_new_index_entry(s_p,
                           hdr_p,
                           arr_p,
                           oc_xt_nd_min_key(s_p, right_p),
-                          &right_addr);
+                          &right_addr, right_gap);
 
     oc_xt_nd_release(wu_p, s_p, left_p);
     oc_xt_nd_release(wu_p, s_p, right_p);
 }
 
+/**********************************************************************/
+/* Building a tree bottom-up.
+ *
+ * Nodes are filled from left to right, each new entry is placed after
+ * the last entry in the node. No searching or shuffling is required.
+ */
+
+// allocate an empty non-root node. It is locked for write and dirty.
+Oc_xt_node *oc_xt_nd_alloc_empty(
+    struct Oc_wu *wu_p,
+    struct Oc_xt_state *s_p,
+    bool leaf)
+{
+    Oc_xt_node *node_p;
+    Oc_xt_nd_hdr *hdr_p;
+    int i;
+
+    node_p = s_p->cfg_p->node_alloc(wu_p);
+    oc_utl_trk_crt_lock_write(wu_p, &node_p->lock);
+    s_p->cfg_p->node_mark_dirty(wu_p, node_p, FALSE);
+
+    // erase the page except for the header
+    memset(node_p->data + sizeof(Oc_meta_data_page_hdr),
+           0,
+           s_p->cfg_p->node_size - sizeof(Oc_meta_data_page_hdr));
+    hdr_p = get_hdr(node_p);
+    hdr_p->flags.root = FALSE;
+    hdr_p->flags.leaf = leaf;
+    hdr_p->num_used_entries = 0;
+    for (i=0; i<256; i++)
+        hdr_p->entry_dir[i] = i;
+
+    return node_p;
+}
+
+void oc_xt_nd_set_index(
+    struct Oc_xt_state *s_p,
+    Oc_xt_node *node_p)
+{
+    Oc_xt_nd_hdr *hdr_p= get_hdr(node_p);
+
+    oc_utl_debugassert(0 == hdr_p->num_used_entries);
+    hdr_p->flags.leaf = FALSE;
+}
+
+void oc_xt_nd_leaf_append(
+    struct Oc_wu *wu_p,
+    struct Oc_xt_state *s_p,
+    Oc_xt_node *node_p,
+    struct Oc_xt_key *key_p,
+    struct Oc_xt_rcrd *rcrd_p)
+{
+    alloc_new_leaf_entry(wu_p, s_p, get_hdr(node_p),
+                         get_start_array(s_p, node_p),
+                         key_p, rcrd_p);
+}
+
+void oc_xt_nd_index_append(
+    struct Oc_xt_state *s_p,
+    Oc_xt_node *node_p,
+    struct Oc_xt_key *key_p,
+    uint64 addr,
+    uint64 gap)
+{
+    alloc_new_index_entry(s_p, get_hdr(node_p),
+                          get_start_array(s_p, node_p),
+                          key_p, &addr, gap);
+}
+
 /**********************************************************************/
 // used for remove-key
 
@@ -1463,7 +1786,8 @@ static void copy_n_entries(
             get_kth_index_entry(s_p, src_hdr_p, src_arr_p, &index_ent, k);
             alloc_new_index_entry(s_p, trg_hdr_p, trg_arr_p,
                                   index_ent.key_p,
-                                  index_ent.addr_p);
+                                  index_ent.addr_p,
+                                  *index_ent.gap_p);
         }
 
         /* move the entry to its correct place.
@@ -1499,6 +1823,12 @@ void oc_xt_nd_copy_into_root_and_dealloc(
                         node_hdr_p->num_used_entries,
                         node_hdr_p->flags.leaf);
 
+    /* If [node_p] is shared with a clone then it remains on disk after
+     * we let go of it, and the root takes another reference to its children.
+     */
+    if (s_p->cfg_p->fs_get_refcount(wu_p, node_p->disk_addr) > 1)
+        oc_xt_nd_inc_children_refcnt(wu_p, s_p, node_p);
+
     // erase the root node
     init_root(wu_p, root_node_p);
     root_hdr_p->flags.leaf = node_hdr_p->flags.leaf;
@@ -1619,6 +1949,104 @@ void oc_xt_nd_move_and_dealloc(
 }
 
 /**********************************************************************/
+/* Insert sub-extent [key_p, rcrd_p], the part left above a removed
+ * range, at location [k+1]. If there is no room in the node then it
+ * goes into [spill_p].
+ */
+static void insert_top_part(
+    Oc_wu *wu_p,
+    Oc_xt_state *s_p,
+    Oc_xt_nd_hdr *hdr_p,
+    struct Oc_xt_nd_array *arr_p,
+    int k,
+    Oc_xt_nd_spill *spill_p,
+    struct Oc_xt_key *key_p,
+    struct Oc_xt_rcrd *rcrd_p)
+{
+    if (num_entries(hdr_p) < max_ent_in_hdr(s_p, hdr_p))
+    {
+        // There is room in this node to insert E3
+        alloc_new_leaf_entry(wu_p, s_p, hdr_p, arr_p, key_p, rcrd_p);
+        shuffle_insert_key(hdr_p, k+1);
+    }
+    else {
+        /* There is no room. This case can only happen if
+         * the caller provides a spill-over option
+         */
+        oc_utl_assert(spill_p);
+        oc_utl_assert(!spill_p->flag);
+
+        spill_p->flag = TRUE;
+        copy_rcrd(s_p, spill_p->key_p, spill_p->rcrd_p, key_p, rcrd_p);
+    }
+}
+
+/* Same as [remove_part], for the built-in extent type. The extent is
+ * cut in place, without going through temporary key and record arrays.
+ */
+static uint64 remove_part_builtin(
+    Oc_wu *wu_p,
+    Oc_xt_state *s_p,
+    struct Oc_xt_key *min_key_p,
+    struct Oc_xt_key *max_key_p,
+    Oc_xt_nd_hdr *hdr_p,
+    struct Oc_xt_nd_array *arr_p,
+    int k,
+    bool one_subextent_at_most,
+    Oc_xt_nd_spill *spill_p)
+{
+    Oc_xt_ext_key mid_key, top_key;
+    Oc_xt_ext_rcrd mid_rcrd, top_rcrd;
+    uint64 key, end, lo, hi;
+    Nd_leaf_ent_ptrs ent;
+
+    get_kth_leaf_entry(s_p, hdr_p, arr_p, &ent, k);
+    oc_xt_trace_wu_lvl(3, OC_EV_XT_REMOVE_PART_1, wu_p,
+                       "range=[%s] ext=[%s]",
+                       oc_xt_nd_string_of_2key(s_p, min_key_p, max_key_p),
+                       oc_xt_nd_string_of_rcrd(s_p, ent.key_p, ent.rcrd_p));
+
+    key = oc_xt_ext_key(ent.key_p);
+    end = oc_xt_ext_end(ent.key_p, ent.rcrd_p);
+    lo = MAX(key, oc_xt_ext_key(min_key_p));
+    hi = MIN(end, oc_xt_ext_key(max_key_p));
+    oc_utl_debugassert(lo <= hi);
+
+    oc_xt_ext_sub(ent.key_p, ent.rcrd_p, lo, hi,
+                  (struct Oc_xt_key*)&mid_key, (struct Oc_xt_rcrd*)&mid_rcrd);
+    if (end > hi)
+        oc_xt_ext_sub(ent.key_p, ent.rcrd_p, hi+1, end,
+                      (struct Oc_xt_key*)&top_key,
+                      (struct Oc_xt_rcrd*)&top_rcrd);
+    s_p->cfg_p->rcrd_release(wu_p,
+                             (struct Oc_xt_key*)&mid_key,
+                             (struct Oc_xt_rcrd*)&mid_rcrd);
+
+    if (key < lo) {
+        // the bottom part stays at [k]
+        oc_xt_ext_rcrd(ent.rcrd_p)->len = lo - key;
+        if (end > hi) {
+            oc_utl_assert(!one_subextent_at_most);
+            insert_top_part(wu_p, s_p, hdr_p, arr_p, k, spill_p,
+                            (struct Oc_xt_key*)&top_key,
+                            (struct Oc_xt_rcrd*)&top_rcrd);
+        }
+    }
+    else if (end > hi) {
+        // only the top part is left, it overwrites [k]
+        *(Oc_xt_ext_key*)ent.key_p = top_key;
+        *oc_xt_ext_rcrd(ent.rcrd_p) = top_rcrd;
+    }
+    else {
+        // The whole extent at [k] was removed
+        shuffle_remove_key(hdr_p, k);
+    }
+
+    oc_xt_trace_wu_lvl(3, OC_EV_XT_REMOVE_PART_2, wu_p,
+                       "len=%lu", mid_rcrd.len);
+    return mid_rcrd.len;
+}
+
 /* Remove the beginning or the end of extent E located at [k]. The range to remove
  * is between [min_key_p] and [max_key_p]. E is split into
  * E1,E2,E3. Remove E and add {E1, E3} instead. It is possible that E1 or E3
@@ -1647,6 +2075,11 @@ static uint64 remove_part(
     int cnt=0, i;
     Nd_leaf_ent_ptrs ent;
 
+    if (s_p->cfg_p->builtin_ext)
+        return remove_part_builtin(wu_p, s_p, min_key_p, max_key_p,
+                                   hdr_p, arr_p, k,
+                                   one_subextent_at_most, spill_p);
+    
     get_kth_leaf_entry(s_p, hdr_p, arr_p, &ent, k);
     oc_xt_trace_wu_lvl(3, OC_EV_XT_REMOVE_PART_1, wu_p,
                        "range=[%s] ext=[%s]",
@@ -1701,26 +2134,8 @@ static uint64 remove_part(
 
         copy_rcrd(s_p, ent.key_p, ent.rcrd_p,
                   key_array_p[0], rcrd_array_p[0]);
-
-        if (num_entries(hdr_p) < max_ent_in_hdr(s_p, hdr_p))
-        {
-            // There is room in this node to insert E3
-            alloc_new_leaf_entry(wu_p, s_p, hdr_p, arr_p,
-                                 key_array_p[2], rcrd_array_p[2]);
-            shuffle_insert_key(hdr_p, k+1);
-        }
-        else {
-            /* There is no room. This case can only happen if
-             * the caller provides a spill-over option
-             */
-            oc_utl_assert(spill_p);
-            oc_utl_assert(!spill_p->flag);
-
-            spill_p->flag = TRUE;
-            copy_rcrd(s_p,
-                      spill_p->key_p, spill_p->rcrd_p,
-                      key_array_p[2], rcrd_array_p[2]);
-        }
+        insert_top_part(wu_p, s_p, hdr_p, arr_p, k, spill_p,
+                        key_array_p[2], rcrd_array_p[2]);
     }
 
     oc_xt_trace_wu_lvl(3, OC_EV_XT_REMOVE_PART_2, wu_p,
@@ -1871,6 +2286,7 @@ uint64 oc_xt_nd_insert_into_leaf(
     Oc_xt_nd_hdr *hdr_p = get_hdr(node_p);
     struct Oc_xt_nd_array *arr_p = get_start_array(s_p, node_p);
     int loc, insert_loc, rc=0;
+    int new_loc = -1;
     struct Oc_xt_key *tmp_key_p;
 
     oc_utl_debugassert(oc_xt_nd_is_leaf(s_p, node_p));
@@ -1909,7 +2325,8 @@ uint64 oc_xt_nd_insert_into_leaf(
         alloc_new_leaf_entry(wu_p, s_p, hdr_p,
                              arr_p,
                              key_p, rcrd_p);
-        goto done;
+        new_loc = num_entries(hdr_p) - 1;
+        goto merge;
     }
 
     // 3. Normal case, the new keys are inside the range
@@ -1928,6 +2345,7 @@ uint64 oc_xt_nd_insert_into_leaf(
         loc = search_for_key(s_p, node_p, key_p, &insert_loc, NULL);
         alloc_new_leaf_entry(wu_p, s_p, hdr_p, arr_p, key_p, rcrd_p);
         shuffle_insert_key(hdr_p, insert_loc);
+        new_loc = insert_loc;
     }
     else {
         // The remove-range operation has created underflow. We need
@@ -1959,6 +2377,17 @@ uint64 oc_xt_nd_insert_into_leaf(
         }
     }
 
+ merge:
+    /* 4. Coalesce the new extent with its neighbors, if they are
+     *    adjacent both logically and physically. This is skipped in
+     *    the underflow case, the sub-extents were created there
+     *    precisely to keep the node above the minimum.
+     */
+    if (s_p->cfg_p->rcrd_try_merge != NULL && new_loc >= 0) {
+        leaf_try_merge_kth(wu_p, s_p, node_p, new_loc);
+        leaf_try_merge_kth(wu_p, s_p, node_p, new_loc - 1);
+    }
+    
  done:
     oc_xt_trace_wu_lvl(
         3, OC_EV_XT_ND_INSERT_INTO_LEAF_DONE, wu_p,
@@ -1966,6 +2395,63 @@ uint64 oc_xt_nd_insert_into_leaf(
     return rc;
 }
 
+/**********************************************************************/
+/* Return TRUE if extent [key2_p] starts right after extent
+ * [key1_p, rcrd1_p] ends.
+ */
+bool oc_xt_nd_rcrd_is_adjacent(
+    struct Oc_xt_state *s_p,
+    struct Oc_xt_key *key1_p,
+    struct Oc_xt_rcrd *rcrd1_p,
+    struct Oc_xt_key *key2_p)
+{
+    struct Oc_xt_key *end_key_p;
+
+    if (s_p->cfg_p->builtin_ext)
+        return (oc_xt_ext_end(key1_p, rcrd1_p) + 1 == oc_xt_ext_key(key2_p));
+    
+    end_key_p = (struct Oc_xt_key*)alloca(s_p->cfg_p->key_size);
+    s_p->cfg_p->rcrd_end_offset(key1_p, rcrd1_p, end_key_p);
+    s_p->cfg_p->key_inc(end_key_p, end_key_p);
+    return (0 == s_p->cfg_p->key_compare(end_key_p, key2_p));
+}
+
+/* Try to merge entry [k+1] into entry [k] in leaf [node_p]. 
+ *
+ * The merge is performed only if it does not cause the node to
+ * underflow. The minimal key of the node does not change, so there
+ * is no need to update the father.
+ */
+static bool leaf_try_merge_kth(struct Oc_wu *wu_p,
+                               struct Oc_xt_state *s_p,
+                               Oc_xt_node *node_p,
+                               int k)
+{
+    Oc_xt_nd_hdr *hdr_p = get_hdr(node_p);
+    struct Oc_xt_key *key1_p, *key2_p;
+    struct Oc_xt_rcrd *rcrd1_p, *rcrd2_p;
+
+    if (k < 0 || k + 1 >= num_entries(hdr_p))
+        return FALSE;
+    if (!hdr_p->flags.root &&
+        num_entries(hdr_p) <= s_p->cfg_p->min_num_ent)
+        return FALSE;
+
+    oc_xt_nd_leaf_get_kth(s_p, node_p, k, &key1_p, &rcrd1_p);
+    oc_xt_nd_leaf_get_kth(s_p, node_p, k+1, &key2_p, &rcrd2_p);
+    if (!oc_xt_nd_rcrd_is_adjacent(s_p, key1_p, rcrd1_p, key2_p))
+        return FALSE;
+    if (!s_p->cfg_p->rcrd_try_merge(key1_p, rcrd1_p, key2_p, rcrd2_p))
+        return FALSE;
+
+    oc_xt_trace_wu_lvl(3, OC_EV_XT_ND_MERGE_ADJACENT, wu_p,
+                       "[%s] k=%d ext=%s",
+                       oc_xt_nd_string_of_node(s_p, node_p), k,
+                       oc_xt_nd_string_of_rcrd(s_p, key1_p, rcrd1_p));
+    shuffle_remove_key(hdr_p, k+1);
+    return TRUE;
+}
+
 /**********************************************************************/
 // used in remove-range
 
@@ -2012,13 +2498,15 @@ void oc_xt_nd_move_max_key(
     }
     else {
         struct Oc_xt_key *key_p;
-        uint64 addr;
+        uint64 addr, gap;
 
         // This is an index node
         // 1. record the largest entry (E) in [src_p]
         oc_xt_nd_index_get_kth(s_p, src_p,
                                 src_hdr_p->num_used_entries - 1,
                                 &key_p, &addr);
+        gap = oc_xt_nd_index_get_kth_gap(s_p, src_p,
+                                         src_hdr_p->num_used_entries - 1);
 
         oc_xt_trace_wu_lvl(3, OC_EV_XT_ND_MOVE_MAX_KEY, wu_p,
                             "key=%s", oc_xt_nd_string_of_key(s_p, key_p));
@@ -2026,7 +2514,7 @@ void oc_xt_nd_move_max_key(
         // 2. add E as the minimum in [trg_p]
         alloc_new_index_entry(s_p, trg_hdr_p,
                               get_start_array(s_p, trg_p),
-                              key_p, &addr);
+                              key_p, &addr, gap);
         shuffle_insert_key(trg_hdr_p, 0);
 
         // 3. remove E from [src_p]
@@ -2078,13 +2566,14 @@ void oc_xt_nd_move_min_key(
     }
     else {
         struct Oc_xt_key *key_p;
-        uint64 addr;
+        uint64 addr, gap;
 
         // This is an index node
         // 1. record the smallest entry (E) in [src_p]
         oc_xt_nd_index_get_kth(s_p, src_p,
                                 0,
                                 &key_p, &addr);
+        gap = oc_xt_nd_index_get_kth_gap(s_p, src_p, 0);
 
         oc_xt_trace_wu_lvl(3, OC_EV_XT_ND_MOVE_MIN_KEY, wu_p,
                             "key=%s", oc_xt_nd_string_of_key(s_p, key_p));
@@ -2092,7 +2581,7 @@ void oc_xt_nd_move_min_key(
         // 2. add E as the maximum in [trg_p]
         alloc_new_index_entry(s_p, trg_hdr_p,
                               get_start_array(s_p, trg_p),
-                              key_p, &addr);
+                              key_p, &addr, gap);
         shuffle_insert_key(trg_hdr_p, trg_hdr_p->num_used_entries-1);
 
         // 3. remove E from [src_p]
@@ -2107,10 +2596,38 @@ void oc_xt_nd_swap_root_ref(Oc_xt_state *s_p,
                           Oc_wu *src_wu_p)
 {
     uint64 root_addr = s_p->root_node_p->disk_addr;
+    Oc_xt_node *node_p;
 
-    // swap references between work-units
-    s_p->cfg_p->node_get(trg_wu_p, root_addr);
+    /* swap references between work-units. The root is held without a
+     * lock, drop the lock that comes with the new reference.
+     */
+    node_p = s_p->cfg_p->node_get_sl(trg_wu_p, root_addr);
+    oc_utl_trk_crt_unlock(trg_wu_p, &node_p->lock);
     s_p->cfg_p->node_release(src_wu_p, s_p->root_node_p);
 }
 
 /**********************************************************************/
+
+/* clone x-tree [src_p] onto [trg_p]. This operation copies the root
+ * node onto a new location (anywhere on disk) and increments the
+ * ref-count on the immediate children.
+ *
+ * pre-requisit: the source tree is locked for write. 
+ */
+void oc_xt_nd_clone_root(struct Oc_wu *wu_p,
+                         struct Oc_xt_state *src_p,
+                         struct Oc_xt_state *trg_p)
+{
+    oc_utl_debugassert(oc_xt_nd_is_root(src_p, src_p->root_node_p));
+
+    // replicate old root
+    trg_p->root_node_p = trg_p->cfg_p->node_alloc(wu_p);
+    memcpy(trg_p->root_node_p->data,
+           src_p->root_node_p->data,
+           src_p->cfg_p->node_size);
+
+    // The new root points to the same children, or extents
+    oc_xt_nd_inc_children_refcnt(wu_p, src_p, src_p->root_node_p);
+}
+
+/**********************************************************************/
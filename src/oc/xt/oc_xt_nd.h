@@ -62,7 +62,7 @@
 */
 /*
   A leaf node is an array of entries: (key,data)
-  An index node is an array of entries: (key,child_ptr = uint64)
+  An index node is an array of entries: (key,child_ptr = uint64,gap = uint64)
  */
 /**********************************************************************/
 
@@ -139,8 +139,8 @@ void oc_xt_nd_create_root(
     struct Oc_xt_state *s_p,
     Oc_xt_node *node_pi);
 
-/* Delete a node. Deallocate the node and also
- * call data_release for data in leaves.
+/* Delete a node. Reduce the ref-count on the node, and if this was
+ * the last reference, call rcrd_release for the records in leaves.
  *
  * assumption: the node is unlocked
  */
@@ -215,7 +215,9 @@ void oc_xt_nd_index_get_kth(
     struct Oc_xt_key **key_ppo,
     uint64 *addr_po);
 
-// [node_p] is an index node. Set its kth pointer. 
+/* [node_p] is an index node. Set its kth pointer. The gap bound of
+ * the entry is left as is.
+ */
 void oc_xt_nd_index_set_kth(
     struct Oc_xt_state *s_p,
     Oc_xt_node *node_p,
@@ -369,6 +371,72 @@ uint64 oc_xt_nd_index_lookup_min_key(
     struct Oc_xt_state *s_p,
     Oc_xt_node *node_p);
 
+/**********************************************************************/
+/* Gap bounds.
+ *
+ * A gap is owned by the extent that precedes it. Each index entry
+ * holds an upper bound on the gaps owned by the extents in its
+ * subtree. The gap following the last extent in the tree is
+ * infinite. The bounds are used by find-gap to skip subtrees.
+ */
+#define OC_XT_ND_GAP_INF (~((uint64)0))
+
+/* the length of the gap between an extent that ends at [end_key_p]
+ * (inclusive) and the next extent, that starts at [start_key_p]. 
+ */
+uint64 oc_xt_nd_gap_between(
+    struct Oc_xt_state *s_p,
+    struct Oc_xt_key *end_key_p,
+    struct Oc_xt_key *start_key_p);
+
+/* the largest gap between two consecutive extents in leaf [node_p].
+ * The index of the extent owning it is returned in [kth_po], if it
+ * is not NULL.
+ */
+uint64 oc_xt_nd_leaf_inner_gap(
+    struct Oc_xt_state *s_p,
+    Oc_xt_node *node_p,
+    int *kth_po);
+
+// [node_p] is an index node. Get the gap bound of its kth entry.
+uint64 oc_xt_nd_index_get_kth_gap(
+    struct Oc_xt_state *s_p,
+    Oc_xt_node *node_p,
+    int k);
+
+/* [node_p] is an index node. Raise the gap bound of its kth entry
+ * to [gap]. Return TRUE if the bound has changed.
+ */
+bool oc_xt_nd_index_raise_kth_gap(
+    struct Oc_xt_state *s_p,
+    Oc_xt_node *node_p,
+    int k,
+    uint64 gap);
+
+/* [node_p] is an index node. Set the gap bound of its kth entry to
+ * [gap]. The bound may only be lowered when it is known that no gap
+ * in the subtree is larger.
+ */
+void oc_xt_nd_index_set_kth_gap(
+    struct Oc_xt_state *s_p,
+    Oc_xt_node *node_p,
+    int k,
+    uint64 gap);
+
+// [node_p] is an index node. Get the largest gap bound of its entries.
+uint64 oc_xt_nd_index_max_gap(
+    struct Oc_xt_state *s_p,
+    Oc_xt_node *node_p);
+
+/* [node_p] is an index node. Entries have been moved between
+ * children [k] and [k+1], raise both gap bounds to the larger
+ * of the two.
+ */
+void oc_xt_nd_index_merge_kth_gaps(
+    struct Oc_xt_state *s_p,
+    Oc_xt_node *node_p,
+    int k);
+
 /**********************************************************************/
 // used for split
 
@@ -409,6 +477,36 @@ void oc_xt_nd_split_root(
     struct Oc_wu *wu_p,
     struct Oc_xt_state *s_p,
     Oc_xt_node *root_node_p );
+
+/**********************************************************************/
+/* Building a tree bottom-up. Entries are appended after the last
+ * entry in the node, the caller provides them in sorted order.
+ */
+
+// allocate an empty non-root node. It is locked for write and dirty.
+Oc_xt_node *oc_xt_nd_alloc_empty(
+    struct Oc_wu *wu_p,
+    struct Oc_xt_state *s_p,
+    bool leaf);
+
+// turn an empty root node into an index node
+void oc_xt_nd_set_index(
+    struct Oc_xt_state *s_p,
+    Oc_xt_node *node_p);
+
+void oc_xt_nd_leaf_append(
+    struct Oc_wu *wu_p,
+    struct Oc_xt_state *s_p,
+    Oc_xt_node *node_p,
+    struct Oc_xt_key *key_p,
+    struct Oc_xt_rcrd *rcrd_p);
+
+void oc_xt_nd_index_append(
+    struct Oc_xt_state *s_p,
+    Oc_xt_node *node_p,
+    struct Oc_xt_key *key_p,
+    uint64 addr,
+    uint64 gap);
 /**********************************************************************/
 // used for remove-key
 
@@ -446,7 +544,9 @@ void oc_xt_nd_rebalance_skewed(
 /**********************************************************************/
 // used for insert-range
 
-/* Insert an extent [key_p, rcrd_p] into a node. 
+/* Insert an extent [key_p, rcrd_p] into a node. If the configuration
+ * supplies [rcrd_try_merge] then the extent is merged with adjacent
+ * extents in the node, where possible.
  *
  * return:
  * - the length of the area overwritten
@@ -462,6 +562,15 @@ uint64 oc_xt_nd_insert_into_leaf(
     struct Oc_xt_key *key_p,
     struct Oc_xt_rcrd *rcrd_p);
 
+/* Return TRUE if extent [key2_p] starts right after extent
+ * [key1_p, rcrd1_p] ends.
+ */
+bool oc_xt_nd_rcrd_is_adjacent(
+    struct Oc_xt_state *s_p,
+    struct Oc_xt_key *key1_p,
+    struct Oc_xt_rcrd *rcrd1_p,
+    struct Oc_xt_key *key2_p);
+
 /**********************************************************************/
 // used by remove-range
 
@@ -498,6 +607,15 @@ void oc_xt_nd_move_min_key(
 void oc_xt_nd_swap_root_ref(Oc_xt_state *s_p,
                             struct Oc_wu *trg_wu_p,
                             struct Oc_wu *src_wu_p);
+
+/* This function is used only by the clone operation.
+ *
+ * Copy the root of [src_p] into a new root for [trg_p], and increment
+ * the ref-count on the children.
+ */
+void oc_xt_nd_clone_root(struct Oc_wu *wu_p,
+                         struct Oc_xt_state *src_p,
+                         struct Oc_xt_state *trg_p);
 /**********************************************************************/
 
 #endif
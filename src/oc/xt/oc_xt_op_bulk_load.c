@@ -0,0 +1,320 @@
+/**************************************************************/
+/*
+ * Copyright (c) 2014-2015, Ohad Rodeh, IBM Research
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer. 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution. 
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies, 
+ * either expressed or implied, of IBM Research.
+ * 
+ */
+/**************************************************************/
+/**********************************************************************/
+/* OC_XT_OP_BULK_LOAD.C
+ *
+ * Build an x-tree bottom-up from a sorted array of extents.
+ */
+/**********************************************************************/
+/* Inserting a large sorted set of extents one at a time descends the
+ * tree once per extent, and leaves most nodes half full after they
+ * split. Here, the leaves are written in a single pass, and each
+ * index level is built from the level below it, until the entries fit
+ * in the root. The entries of a level are spread evenly between its
+ * nodes, so that nodes are packed, and none of them falls below the
+ * minimal number of entries.
+ *
+ * Adjacent extents that are also contiguous on disk can be coalesced
+ * on the way in, using the rcrd_try_merge function.
+ */
+/**********************************************************************/
+#include <string.h>
+#include <alloca.h>
+
+#include "oc_utl.h"
+#include "oc_xt_int.h"
+#include "oc_xt_nd.h"
+#include "oc_xt_trace.h"
+#include "oc_xt_op_bulk_load.h"
+#include "pl_mm_int.h"
+/**********************************************************************/
+/* A level of the tree under construction. Entry k describes the kth
+ * node in the level: its minimal key, its address, and an upper bound
+ * on the gaps owned by its extents.
+ */
+typedef struct Bl_level {
+    int num;
+    struct Oc_xt_key *key_array;
+    uint64 *addr_array;
+    uint64 *gap_array;
+} Bl_level;
+
+static int coalesce_input(
+    struct Oc_wu *wu_p,
+    struct Oc_xt_state *s_p,
+    int num,
+    struct Oc_xt_key *key_array,
+    struct Oc_xt_rcrd *rcrd_array,
+    bool coalesce,
+    struct Oc_xt_key *key_array_po,
+    struct Oc_xt_rcrd *rcrd_array_po);
+static void build_leaves(
+    struct Oc_wu *wu_p,
+    struct Oc_xt_state *s_p,
+    int num,
+    struct Oc_xt_key *key_array,
+    struct Oc_xt_rcrd *rcrd_array,
+    Bl_level *lvl_po);
+static void build_index_level(
+    struct Oc_wu *wu_p,
+    struct Oc_xt_state *s_p,
+    Bl_level *lvl_pio);
+/**********************************************************************/
+
+// the number of nodes needed to hold [total] entries
+static int num_groups(int total, int max_ent)
+{
+    // a root index node has at least two children
+    return MAX(2, (total + max_ent - 1) / max_ent);
+}
+
+/* The number of entries in group [k], where [total] entries are spread
+ * evenly between [ngroups] groups.
+ */
+static int group_size(int total, int ngroups, int k)
+{
+    return total / ngroups + ((k < total % ngroups) ? 1 : 0);
+}
+
+/* Copy the extents into [key_array_po, rcrd_array_po], and merge
+ * adjacent extents if [coalesce] is set. Return the number of
+ * extents copied.
+ */
+static int coalesce_input(
+    struct Oc_wu *wu_p,
+    struct Oc_xt_state *s_p,
+    int num,
+    struct Oc_xt_key *key_array,
+    struct Oc_xt_rcrd *rcrd_array,
+    bool coalesce,
+    struct Oc_xt_key *key_array_po,
+    struct Oc_xt_rcrd *rcrd_array_po)
+{
+    struct Oc_xt_key *key_p, *prev_key_p, *end_key_p;
+    struct Oc_xt_rcrd *rcrd_p, *prev_rcrd_p;
+    int i, n = 0;
+
+    end_key_p = (struct Oc_xt_key*) alloca(s_p->cfg_p->key_size);
+    if (NULL == s_p->cfg_p->rcrd_try_merge)
+        coalesce = FALSE;
+
+    for (i=0; i<num; i++) {
+        key_p = oc_xt_nd_key_array_kth(s_p, key_array, i);
+        rcrd_p = oc_xt_nd_rcrd_array_kth(s_p, rcrd_array, i);
+
+        if (n > 0) {
+            prev_key_p = oc_xt_nd_key_array_kth(s_p, key_array_po, n-1);
+            prev_rcrd_p = oc_xt_nd_rcrd_array_kth(s_p, rcrd_array_po, n-1);
+            s_p->cfg_p->rcrd_end_offset(prev_key_p, prev_rcrd_p, end_key_p);
+            if (s_p->cfg_p->key_compare(end_key_p, key_p) != 1)
+                ERR(("extent [%s] is out of order, or overlaps its predecessor",
+                     oc_xt_nd_string_of_rcrd(s_p, key_p, rcrd_p)));
+
+            if (coalesce &&
+                oc_xt_nd_rcrd_is_adjacent(s_p, prev_key_p, prev_rcrd_p, key_p) &&
+                s_p->cfg_p->rcrd_try_merge(prev_key_p, prev_rcrd_p,
+                                           key_p, rcrd_p))
+                continue;
+        }
+
+        memcpy((char*)oc_xt_nd_key_array_kth(s_p, key_array_po, n),
+               key_p, s_p->cfg_p->key_size);
+        memcpy((char*)oc_xt_nd_rcrd_array_kth(s_p, rcrd_array_po, n),
+               rcrd_p, s_p->cfg_p->rcrd_size);
+        n++;
+    }
+
+    oc_xt_trace_wu_lvl(3, OC_EV_XT_BULK_LOAD, wu_p,
+                       "%d extents, %d after coalescing", num, n);
+    return n;
+}
+
+/* Write the extents into leaves, and describe the leaves in [lvl_po].
+ *
+ * A leaf owns the gap between its last extent and the first extent of
+ * the next leaf. The gap following the last leaf is infinite.
+ */
+static void build_leaves(
+    struct Oc_wu *wu_p,
+    struct Oc_xt_state *s_p,
+    int num,
+    struct Oc_xt_key *key_array,
+    struct Oc_xt_rcrd *rcrd_array,
+    Bl_level *lvl_po)
+{
+    Oc_xt_node *node_p;
+    struct Oc_xt_key *end_key_p;
+    uint64 gap;
+    int i, j, k, cnt;
+
+    end_key_p = (struct Oc_xt_key*) alloca(s_p->cfg_p->key_size);
+    lvl_po->num = num_groups(num, s_p->cfg_p->max_num_ent_leaf_node);
+
+    for (i=0, k=0; k < lvl_po->num; k++) {
+        cnt = group_size(num, lvl_po->num, k);
+        node_p = oc_xt_nd_alloc_empty(wu_p, s_p, TRUE);
+
+        memcpy((char*)oc_xt_nd_key_array_kth(s_p, lvl_po->key_array, k),
+               oc_xt_nd_key_array_kth(s_p, key_array, i),
+               s_p->cfg_p->key_size);
+        for (j=0; j<cnt; j++, i++)
+            oc_xt_nd_leaf_append(wu_p, s_p, node_p,
+                                 oc_xt_nd_key_array_kth(s_p, key_array, i),
+                                 oc_xt_nd_rcrd_array_kth(s_p, rcrd_array, i));
+
+        if (i == num)
+            gap = OC_XT_ND_GAP_INF;
+        else {
+            s_p->cfg_p->rcrd_end_offset(
+                oc_xt_nd_key_array_kth(s_p, key_array, i-1),
+                oc_xt_nd_rcrd_array_kth(s_p, rcrd_array, i-1),
+                end_key_p);
+            gap = oc_xt_nd_gap_between(
+                s_p, end_key_p, oc_xt_nd_key_array_kth(s_p, key_array, i));
+            gap = MAX(gap, oc_xt_nd_leaf_inner_gap(s_p, node_p, NULL));
+        }
+
+        lvl_po->addr_array[k] = node_p->disk_addr;
+        lvl_po->gap_array[k] = gap;
+        oc_xt_nd_release(wu_p, s_p, node_p);
+    }
+}
+
+/* Build the index level above [lvl_pio], and replace it. The new
+ * level has fewer entries, so it is built in place.
+ */
+static void build_index_level(
+    struct Oc_wu *wu_p,
+    struct Oc_xt_state *s_p,
+    Bl_level *lvl_pio)
+{
+    Oc_xt_node *node_p;
+    uint64 gap;
+    int i, j, k, cnt, ngroups;
+
+    ngroups = num_groups(lvl_pio->num, s_p->cfg_p->max_num_ent_index_node);
+
+    for (i=0, k=0; k < ngroups; k++) {
+        cnt = group_size(lvl_pio->num, ngroups, k);
+        node_p = oc_xt_nd_alloc_empty(wu_p, s_p, FALSE);
+
+        // entry [k] is overwritten only after entries [i..i+cnt) are read
+        memmove((char*)oc_xt_nd_key_array_kth(s_p, lvl_pio->key_array, k),
+                oc_xt_nd_key_array_kth(s_p, lvl_pio->key_array, i),
+                s_p->cfg_p->key_size);
+        gap = 0;
+        for (j=0; j<cnt; j++, i++) {
+            oc_xt_nd_index_append(
+                s_p, node_p,
+                oc_xt_nd_key_array_kth(s_p, lvl_pio->key_array, i),
+                lvl_pio->addr_array[i],
+                lvl_pio->gap_array[i]);
+            gap = MAX(gap, lvl_pio->gap_array[i]);
+        }
+
+        lvl_pio->addr_array[k] = node_p->disk_addr;
+        lvl_pio->gap_array[k] = gap;
+        oc_xt_nd_release(wu_p, s_p, node_p);
+    }
+
+    lvl_pio->num = ngroups;
+}
+
+/**********************************************************************/
+
+void oc_xt_op_bulk_load_b(
+    struct Oc_wu *wu_p,
+    struct Oc_xt_state *s_p,
+    int num,
+    struct Oc_xt_key *key_array,
+    struct Oc_xt_rcrd *rcrd_array,
+    bool coalesce)
+{
+    Oc_xt_node *root_p;
+    struct Oc_xt_key *ext_key_array;
+    struct Oc_xt_rcrd *ext_rcrd_array;
+    Bl_level lvl;
+    int i, n;
+
+    root_p = oc_xt_nd_get_for_write(wu_p, s_p, s_p->root_node_p->disk_addr,
+                                    NULL, 0);
+    if (oc_xt_nd_num_entries(s_p, root_p) > 0)
+        ERR(("bulk-load into a non-empty tree"));
+    if (0 == num) {
+        oc_xt_nd_release(wu_p, s_p, root_p);
+        return;
+    }
+
+    ext_key_array = (struct Oc_xt_key*)
+        pl_mm_malloc(num * s_p->cfg_p->key_size);
+    ext_rcrd_array = (struct Oc_xt_rcrd*)
+        pl_mm_malloc(num * s_p->cfg_p->rcrd_size);
+    n = coalesce_input(wu_p, s_p, num, key_array, rcrd_array, coalesce,
+                       ext_key_array, ext_rcrd_array);
+
+    if (n <= s_p->cfg_p->max_num_ent_root_node) {
+        // everything fits in the root
+        for (i=0; i<n; i++)
+            oc_xt_nd_leaf_append(
+                wu_p, s_p, root_p,
+                oc_xt_nd_key_array_kth(s_p, ext_key_array, i),
+                oc_xt_nd_rcrd_array_kth(s_p, ext_rcrd_array, i));
+    }
+    else {
+        lvl.key_array = (struct Oc_xt_key*)
+            pl_mm_malloc(n * s_p->cfg_p->key_size);
+        lvl.addr_array = (uint64*) pl_mm_malloc(n * sizeof(uint64));
+        lvl.gap_array = (uint64*) pl_mm_malloc(n * sizeof(uint64));
+
+        build_leaves(wu_p, s_p, n, ext_key_array, ext_rcrd_array, &lvl);
+        while (lvl.num > s_p->cfg_p->max_num_ent_root_node)
+            build_index_level(wu_p, s_p, &lvl);
+
+        oc_xt_nd_set_index(s_p, root_p);
+        for (i=0; i<lvl.num; i++)
+            oc_xt_nd_index_append(
+                s_p, root_p,
+                oc_xt_nd_key_array_kth(s_p, lvl.key_array, i),
+                lvl.addr_array[i],
+                lvl.gap_array[i]);
+
+        pl_mm_free(lvl.key_array);
+        pl_mm_free(lvl.addr_array);
+        pl_mm_free(lvl.gap_array);
+    }
+
+    oc_xt_nd_release(wu_p, s_p, root_p);
+    pl_mm_free(ext_key_array);
+    pl_mm_free(ext_rcrd_array);
+}
+
+/**********************************************************************/
@@ -0,0 +1,276 @@
+/**************************************************************/
+/*
+ * Copyright (c) 2014-2015, Ohad Rodeh, IBM Research
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer. 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution. 
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies, 
+ * either expressed or implied, of IBM Research.
+ * 
+ */
+/**************************************************************/
+/**********************************************************************/
+/* OC_XT_OP_CURSOR.C
+ *
+ * Iterate over the extents in a range, one at a time.
+ */
+/**********************************************************************/
+/* Between calls, the cursor holds only the current leaf, locked for
+ * read; the tree lock and the nodes above the leaf are released once
+ * the leaf is reached. Writers that do not need the leaf go on, and a
+ * writer that needs it waits only until the cursor moves off it.
+ *
+ * The lower bound of the range moves past each extent returned. When
+ * the leaf is exhausted, the cursor descends again, by the smallest key
+ * of the leaves to its right, which was noted on the way down. A writer
+ * that holds the tree lock for write can cut the leaf out of the tree
+ * without touching it, so such writers bump the generation of the
+ * tree. If it changed, the cursor drops its leaf, and descends by the
+ * lower bound of the range. A large range is therefore mapped with a
+ * single descent per leaf, and each leaf is visited once.
+ */
+/**********************************************************************/
+#include <string.h>
+
+#include "oc_utl.h"
+#include "oc_utl_trk.h"
+#include "oc_xt_int.h"
+#include "oc_xt_nd.h"
+#include "oc_xt_ext.h"
+#include "oc_xt_trace.h"
+#include "oc_xt_op_cursor.h"
+#include "pl_mm_int.h"
+/**********************************************************************/
+static void release_leaf(struct Oc_wu *wu_p, Oc_xt_cursor *cur_p);
+static void descend_b(struct Oc_wu *wu_p,
+                      Oc_xt_cursor *cur_p,
+                      struct Oc_xt_key *key_p);
+static void advance(Oc_xt_cursor *cur_p,
+                    struct Oc_xt_key *key_p,
+                    struct Oc_xt_rcrd *rcrd_p);
+/**********************************************************************/
+
+static void release_leaf(struct Oc_wu *wu_p, Oc_xt_cursor *cur_p)
+{
+    if (NULL == cur_p->leaf_p)
+        return;
+    oc_xt_nd_release(wu_p, cur_p->s_p, cur_p->leaf_p);
+    cur_p->leaf_p = NULL;
+}
+
+/* Descend, with lock-coupling, to the leaf that may hold an extent
+ * ending at, or after, [key_p], and make it the current leaf. Its
+ * location is set to the first extent that does not end before the
+ * range.
+ */
+static void descend_b(
+    struct Oc_wu *wu_p,
+    Oc_xt_cursor *cur_p,
+    struct Oc_xt_key *key_p)
+{
+    Oc_xt_state *s_p = cur_p->s_p;
+    Oc_xt_node *node_p, *child_p;
+    struct Oc_xt_key *ent_key_p;
+    struct Oc_xt_rcrd *rcrd_p;
+    uint64 addr;
+    int loc;
+
+    oc_utl_trk_crt_lock_read(wu_p, &s_p->lock);
+    cur_p->gen = s_p->gen;
+    cur_p->has_next = FALSE;
+    oc_xt_nd_get_for_read(wu_p, s_p, s_p->root_node_p->disk_addr);
+    node_p = s_p->root_node_p;
+
+    /* Follow the child with the largest key not above [key_p]. The
+     * extent covering [key_p], if any, is in its subtree. Extents
+     * that are above it are to the right, the deepest right sibling
+     * seen is where they start.
+     */
+    while (!oc_xt_nd_is_leaf(s_p, node_p)) {
+        loc = oc_xt_nd_index_lookup_le_key(wu_p, s_p, node_p, key_p);
+        loc = MAX(loc, 0);
+        if (loc + 1 < oc_xt_nd_num_entries(s_p, node_p)) {
+            oc_xt_nd_index_get_kth(s_p, node_p, loc + 1, &ent_key_p, &addr);
+            memcpy((char*)cur_p->next_key_p, (char*)ent_key_p,
+                   s_p->cfg_p->key_size);
+            cur_p->has_next = TRUE;
+        }
+        oc_xt_nd_index_get_kth(s_p, node_p, loc, &ent_key_p, &addr);
+        child_p = oc_xt_nd_get_for_read(wu_p, s_p, addr);
+        oc_xt_nd_release(wu_p, s_p, node_p);
+        node_p = child_p;
+    }
+    oc_utl_trk_crt_unlock(wu_p, &s_p->lock);
+
+    // skip the extent below the range, if it ends before it
+    loc = oc_xt_nd_leaf_lookup_le_key(wu_p, s_p, node_p, cur_p->min_key_p);
+    if (-1 == loc)
+        loc = 0;
+    else {
+        oc_xt_nd_leaf_get_kth(s_p, node_p, loc, &ent_key_p, &rcrd_p);
+        if (s_p->cfg_p->rcrd_compare0(cur_p->min_key_p,
+                                      ent_key_p, rcrd_p) == -1)
+            loc++;
+    }
+    cur_p->leaf_p = node_p;
+    cur_p->loc = loc;
+}
+
+/* Move the lower bound of the range past extent [key_p, rcrd_p]. The
+ * cursor is done if the extent reaches the top of the range.
+ */
+static void advance(
+    Oc_xt_cursor *cur_p,
+    struct Oc_xt_key *key_p,
+    struct Oc_xt_rcrd *rcrd_p)
+{
+    Oc_xt_cfg *cfg_p = cur_p->s_p->cfg_p;
+    uint64 end;
+
+    if (cfg_p->builtin_ext) {
+        end = oc_xt_ext_end(key_p, rcrd_p);
+        if (end >= oc_xt_ext_key(cur_p->max_key_p))
+            cur_p->done = TRUE;
+        else
+            *(Oc_xt_ext_key*)cur_p->min_key_p = end + 1;
+        return;
+    }
+
+    cfg_p->rcrd_end_offset(key_p, rcrd_p, cur_p->key_p);
+    if (cfg_p->key_compare(cur_p->key_p, cur_p->max_key_p) != 1)
+        cur_p->done = TRUE;
+    else
+        cfg_p->key_inc(cur_p->key_p, cur_p->min_key_p);
+}
+
+/**********************************************************************/
+
+void oc_xt_op_cursor_open_b(
+    struct Oc_wu *wu_p,
+    struct Oc_xt_state *s_p,
+    Oc_xt_cursor *cur_po,
+    struct Oc_xt_key *min_key_p,
+    struct Oc_xt_key *max_key_p)
+{
+    memset(cur_po, 0, sizeof(Oc_xt_cursor));
+    cur_po->s_p = s_p;
+    cur_po->min_key_p = (struct Oc_xt_key*) pl_mm_malloc(
+        4 * s_p->cfg_p->key_size);
+    cur_po->max_key_p = oc_xt_nd_key_array_kth(s_p, cur_po->min_key_p, 1);
+    cur_po->next_key_p = oc_xt_nd_key_array_kth(s_p, cur_po->min_key_p, 2);
+    cur_po->key_p = oc_xt_nd_key_array_kth(s_p, cur_po->min_key_p, 3);
+    memcpy((char*)cur_po->min_key_p, (char*)min_key_p, s_p->cfg_p->key_size);
+    memcpy((char*)cur_po->max_key_p, (char*)max_key_p, s_p->cfg_p->key_size);
+
+    // an empty range
+    if (s_p->cfg_p->key_compare(min_key_p, max_key_p) == -1) {
+        cur_po->done = TRUE;
+        return;
+    }
+
+    descend_b(wu_p, cur_po, cur_po->min_key_p);
+}
+
+bool oc_xt_op_cursor_next_b(
+    struct Oc_wu *wu_p,
+    Oc_xt_cursor *cur_p,
+    struct Oc_xt_key *key_po,
+    struct Oc_xt_rcrd *rcrd_po)
+{
+    Oc_xt_state *s_p = cur_p->s_p;
+    struct Oc_xt_key *key_p, *key_array_p[3];
+    struct Oc_xt_rcrd *rcrd_p, *rcrd_array_p[3];
+
+    while (1) {
+        if (cur_p->done)
+            return FALSE;
+
+        // the tree was changed under its write lock, the leaf may be gone
+        if (cur_p->leaf_p != NULL && cur_p->gen != s_p->gen)
+            release_leaf(wu_p, cur_p);
+        if (NULL == cur_p->leaf_p)
+            descend_b(wu_p, cur_p, cur_p->min_key_p);
+        if (cur_p->loc < oc_xt_nd_num_entries(s_p, cur_p->leaf_p))
+            break;
+
+        // the leaf is exhausted, go on to the leaves on its right
+        release_leaf(wu_p, cur_p);
+        if (!cur_p->has_next ||
+            s_p->cfg_p->key_compare(cur_p->next_key_p,
+                                    cur_p->max_key_p) == -1) {
+            cur_p->done = TRUE;
+            return FALSE;
+        }
+        memcpy((char*)cur_p->key_p, (char*)cur_p->next_key_p,
+               s_p->cfg_p->key_size);
+        descend_b(wu_p, cur_p, cur_p->key_p);
+    }
+
+    oc_xt_nd_leaf_get_kth(s_p, cur_p->leaf_p, cur_p->loc, &key_p, &rcrd_p);
+    if (s_p->cfg_p->key_compare(key_p, cur_p->max_key_p) == -1) {
+        // we are past the end of the range, no need to hold the leaf
+        release_leaf(wu_p, cur_p);
+        cur_p->done = TRUE;
+        return FALSE;
+    }
+    cur_p->loc++;
+
+    // clip the extent to the range
+    if (s_p->cfg_p->builtin_ext) {
+        oc_xt_ext_sub(
+            key_p, rcrd_p,
+            MAX(oc_xt_ext_key(key_p), oc_xt_ext_key(cur_p->min_key_p)),
+            MIN(oc_xt_ext_end(key_p, rcrd_p), oc_xt_ext_key(cur_p->max_key_p)),
+            key_po, rcrd_po);
+    }
+    else {
+        key_array_p[0] = NULL;
+        rcrd_array_p[0] = NULL;
+        key_array_p[1] = key_po;
+        rcrd_array_p[1] = rcrd_po;
+        key_array_p[2] = NULL;
+        rcrd_array_p[2] = NULL;
+        s_p->cfg_p->rcrd_bound_split(key_p, rcrd_p,
+                                     cur_p->min_key_p, cur_p->max_key_p,
+                                     key_array_p, rcrd_array_p);
+    }
+
+    advance(cur_p, key_p, rcrd_p);
+    if (cur_p->done)
+        release_leaf(wu_p, cur_p);
+    return TRUE;
+}
+
+void oc_xt_op_cursor_close(
+    struct Oc_wu *wu_p,
+    Oc_xt_cursor *cur_p)
+{
+    release_leaf(wu_p, cur_p);
+    pl_mm_free(cur_p->min_key_p);
+    cur_p->min_key_p = NULL;
+    cur_p->max_key_p = NULL;
+    cur_p->next_key_p = NULL;
+    cur_p->key_p = NULL;
+}
+
+/**********************************************************************/
@@ -40,6 +40,7 @@
  * internal nodes. 
  */
 /**********************************************************************/
+#include "oc_utl_trk.h"
 #include "oc_xt_int.h"
 #include "oc_xt_trace.h"
 #include "oc_xt_nd.h"
@@ -49,7 +50,10 @@ static void delete_b(
     struct Oc_xt_state *s_p,
     Oc_xt_node *node_p)
 {
-    if (!oc_xt_nd_is_leaf(s_p, node_p)) {
+    int fs_refcnt = s_p->cfg_p->fs_get_refcount(wu_p, node_p->disk_addr);
+
+    // a sub-tree shared with a clone is left in place
+    if (1 == fs_refcnt && !oc_xt_nd_is_leaf(s_p, node_p)) {
         // An index node, recurse through its children
         int i;
         int num_entries = oc_xt_nd_num_entries(s_p, node_p);
@@ -61,19 +65,21 @@ static void delete_b(
             oc_xt_nd_index_get_kth(s_p, node_p, i,
                                     &dummy_key_p,
                                     &child_addr);
-            child_node_p = s_p->cfg_p->node_get(wu_p, child_addr);
+            child_node_p = s_p->cfg_p->node_get_xl(wu_p, child_addr);
             delete_b(wu_p, s_p, child_node_p);
         }
     }
 
     // remove this node
-    oc_xt_nd_delete(wu_p, s_p, node_p);
+    oc_xt_nd_delete_locked(wu_p, s_p, node_p);
 }
  
 void oc_xt_op_delete_b(
     struct Oc_wu *wu_p,
     struct Oc_xt_state *s_p)
 {
+    // the root is held without a lock
+    oc_utl_trk_crt_lock_write(wu_p, &s_p->root_node_p->lock);
     delete_b(wu_p, s_p, s_p->root_node_p);
     s_p->root_node_p = NULL;
 }
@@ -0,0 +1,714 @@
+/**************************************************************/
+/*
+ * Copyright (c) 2014-2015, Ohad Rodeh, IBM Research
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer. 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution. 
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies, 
+ * either expressed or implied, of IBM Research.
+ * 
+ */
+/**************************************************************/
+/**********************************************************************/
+/* OC_XT_OP_FIND_GAP.C
+ *
+ * Search for free gaps between extents, and maintain the gap bounds
+ * held in index entries.
+ */
+/**********************************************************************/
+/* A gap is owned by the extent that precedes it. Each index entry
+ * holds an upper bound on the gaps owned by the extents in its
+ * subtree; the gap after the last extent in the tree is infinite.
+ *
+ * The bounds only need to be raised when a gap grows, or when a gap
+ * moves to a different subtree:
+ *  - An insert only shrinks gaps. However, an extent inserted into a
+ *    leaf may take over part of a gap owned by an extent in a different
+ *    leaf. The new gaps inside the leaf are checked against the bound
+ *    in the father, and if needed, the bounds on the path are raised.
+ *  - A remove-range opens a single gap, owned by the extent preceding
+ *    the range. The bounds on its path are raised.
+ *  - Entries moved between siblings carry their bounds with them. The
+ *    father raises the bounds of both siblings to the larger of the two.
+ *  - A split computes the bounds of the two halves from their contents.
+ *
+ * The search goes over the extents in order, starting at the lowest
+ * candidate, and skips subtrees whose bound is too small. The gap
+ * after the last extent of a leaf ends at the first extent of the
+ * next leaf; it is checked when that leaf is reached, or skipped.
+ *
+ * Inserts that fill gaps do not lower the bounds; with the tree locked
+ * for read, and the path lock-coupled, the other gaps in a subtree are
+ * not known. Instead, the search notes the subtrees that it went over
+ * in full without finding a large enough gap. Once the search is done,
+ * the tree is locked for write, and the bounds of those subtrees are
+ * recomputed from their contents. A stale bound costs one scan of its
+ * subtree; the following searches skip it.
+ */
+/**********************************************************************/
+#include <string.h>
+#include <alloca.h>
+
+#include "oc_utl.h"
+#include "oc_utl_trk.h"
+#include "oc_xt_int.h"
+#include "oc_xt_trace.h"
+#include "oc_xt_nd.h"
+#include "oc_xt_op_find_gap.h"
+
+/**********************************************************************/
+#define MAX_STALE (4)
+
+// a subtree whose gap bound is too large
+typedef struct Gap_stale {
+    struct Oc_xt_key *key_p;        // the index key of the subtree
+    int depth;                      // the depth of its father, the root is at zero
+} Gap_stale;
+
+typedef struct Gap_search {
+    uint64 len;                     // the length of the gap we are looking for
+    struct Oc_xt_key *lo_key_p;     // only extents starting here, or above, count
+    bool pending;                   // the gap after the last extent seen is open
+    struct Oc_xt_key *end_key_p;    // the end offset of the last extent seen
+    struct Oc_xt_key *result_key_po;
+
+    /* The subtrees searched in full, without a result. The gap after
+     * the last extent of the final ones is still pending; they are
+     * stale only once it has been found to be too small.
+     */
+    int num_stale;
+    int num_confirmed;
+    Gap_stale stale[MAX_STALE];
+} Gap_search;
+
+static bool find_le_b(
+    struct Oc_wu *wu_p,
+    struct Oc_xt_state *s_p,
+    Oc_xt_node *node_p,
+    struct Oc_xt_key *key_p,
+    struct Oc_xt_key *key_po,
+    struct Oc_xt_rcrd *rcrd_po);
+static bool find_ge_b(
+    struct Oc_wu *wu_p,
+    struct Oc_xt_state *s_p,
+    Oc_xt_node *node_p,
+    struct Oc_xt_key *key_p,
+    struct Oc_xt_key *key_po,
+    struct Oc_xt_rcrd *rcrd_po);
+static bool close_pending(
+    struct Oc_xt_state *s_p,
+    Gap_search *gs_p,
+    struct Oc_xt_key *key_p);
+static bool close_pending_with_min_b(
+    struct Oc_wu *wu_p,
+    struct Oc_xt_state *s_p,
+    Oc_xt_node *node_p,
+    Gap_search *gs_p);
+static void note_stale(
+    struct Oc_xt_state *s_p,
+    Gap_search *gs_p,
+    int base,
+    int depth,
+    struct Oc_xt_key *key_p);
+/* The subtree with index key [key_p], whose father is at [depth], was
+ * searched in full and holds no large enough gap. Its bound is too
+ * large. The subtrees noted inside it, from [base] onward, are
+ * replaced by it.
+ */
+static void note_stale(
+    struct Oc_xt_state *s_p,
+    Gap_search *gs_p,
+    int base,
+    int depth,
+    struct Oc_xt_key *key_p)
+{
+    Gap_stale *st_p;
+
+    if (s_p->cfg_p->key_compare(key_p, gs_p->lo_key_p) == 1)
+        // extents below the search range were not checked
+        return;
+
+    gs_p->num_stale = base;
+    gs_p->num_confirmed = MIN(gs_p->num_confirmed, base);
+    if (MAX_STALE == base)
+        return;
+    st_p = &gs_p->stale[gs_p->num_stale++];
+    memcpy((char*)st_p->key_p, (char*)key_p, s_p->cfg_p->key_size);
+    st_p->depth = depth;
+}
+
+static bool search_leaf(
+    struct Oc_xt_state *s_p,
+    Oc_xt_node *node_p,
+    Gap_search *gs_p);
+static bool search_node_b(
+    struct Oc_wu *wu_p,
+    struct Oc_xt_state *s_p,
+    Oc_xt_node *node_p,
+    int depth,
+    Gap_search *gs_p);
+static void search_b(
+    struct Oc_wu *wu_p,
+    struct Oc_xt_state *s_p,
+    struct Oc_xt_key *min_key_p,
+    Gap_search *gs_p);
+static void min_key_b(
+    struct Oc_wu *wu_p,
+    struct Oc_xt_state *s_p,
+    Oc_xt_node *node_p,
+    struct Oc_xt_key *key_po);
+static uint64 subtree_max_gap_b(
+    struct Oc_wu *wu_p,
+    struct Oc_xt_state *s_p,
+    Oc_xt_node *node_p,
+    struct Oc_xt_key *next_key_p);
+static void tighten_b(
+    struct Oc_wu *wu_p,
+    struct Oc_xt_state *s_p,
+    Gap_stale *st_p);
+/**********************************************************************/
+
+/* Find the extent with the largest start offset that is smaller or
+ * equal to [key_p] in the subtree of [node_p]. Copy it into
+ * [key_po, rcrd_po]. Return FALSE if there is no such extent.
+ *
+ * The index keys are only lower bounds on the keys in the children.
+ * If the child found has no matching extent, its left sibling holds
+ * the answer.
+ */
+static bool find_le_b(
+    struct Oc_wu *wu_p,
+    struct Oc_xt_state *s_p,
+    Oc_xt_node *node_p,
+    struct Oc_xt_key *key_p,
+    struct Oc_xt_key *key_po,
+    struct Oc_xt_rcrd *rcrd_po)
+{
+    struct Oc_xt_key *k_p;
+    struct Oc_xt_rcrd *r_p;
+    Oc_xt_node *child_p;
+    uint64 addr;
+    bool found;
+    int k;
+
+    if (oc_xt_nd_is_leaf(s_p, node_p)) {
+        k = oc_xt_nd_leaf_lookup_le_key(wu_p, s_p, node_p, key_p);
+        if (-1 == k)
+            return FALSE;
+        oc_xt_nd_leaf_get_kth(s_p, node_p, k, &k_p, &r_p);
+        memcpy((char*)key_po, (char*)k_p, s_p->cfg_p->key_size);
+        memcpy((char*)rcrd_po, (char*)r_p, s_p->cfg_p->rcrd_size);
+        return TRUE;
+    }
+
+    for (k = oc_xt_nd_index_lookup_le_key(wu_p, s_p, node_p, key_p);
+         k >= 0;
+         k--) {
+        oc_xt_nd_index_get_kth(s_p, node_p, k, &k_p, &addr);
+        child_p = oc_xt_nd_get_for_read(wu_p, s_p, addr);
+        found = find_le_b(wu_p, s_p, child_p, key_p, key_po, rcrd_po);
+        oc_xt_nd_release(wu_p, s_p, child_p);
+        if (found)
+            return TRUE;
+    }
+    return FALSE;
+}
+
+/* Find the extent with the smallest start offset that is larger or
+ * equal to [key_p] in the subtree of [node_p]. Copy it into
+ * [key_po, rcrd_po]. Return FALSE if there is no such extent.
+ */
+static bool find_ge_b(
+    struct Oc_wu *wu_p,
+    struct Oc_xt_state *s_p,
+    Oc_xt_node *node_p,
+    struct Oc_xt_key *key_p,
+    struct Oc_xt_key *key_po,
+    struct Oc_xt_rcrd *rcrd_po)
+{
+    struct Oc_xt_key *k_p;
+    struct Oc_xt_rcrd *r_p;
+    Oc_xt_node *child_p;
+    uint64 addr;
+    bool found;
+    int k;
+
+    if (oc_xt_nd_is_leaf(s_p, node_p)) {
+        k = oc_xt_nd_leaf_lookup_ge_key(wu_p, s_p, node_p, key_p);
+        if (-1 == k)
+            return FALSE;
+        oc_xt_nd_leaf_get_kth(s_p, node_p, k, &k_p, &r_p);
+        memcpy((char*)key_po, (char*)k_p, s_p->cfg_p->key_size);
+        memcpy((char*)rcrd_po, (char*)r_p, s_p->cfg_p->rcrd_size);
+        return TRUE;
+    }
+
+    k = oc_xt_nd_index_lookup_le_key(wu_p, s_p, node_p, key_p);
+    if (-1 == k)
+        k = 0;
+    for (; k < oc_xt_nd_num_entries(s_p, node_p); k++) {
+        oc_xt_nd_index_get_kth(s_p, node_p, k, &k_p, &addr);
+        child_p = oc_xt_nd_get_for_read(wu_p, s_p, addr);
+        found = find_ge_b(wu_p, s_p, child_p, key_p, key_po, rcrd_po);
+        oc_xt_nd_release(wu_p, s_p, child_p);
+        if (found)
+            return TRUE;
+    }
+    return FALSE;
+}
+
+/**********************************************************************/
+
+/* An extent starting at [key_p] follows the last extent seen. If the
+ * gap between them is large enough, it is the result.
+ */
+static bool close_pending(
+    struct Oc_xt_state *s_p,
+    Gap_search *gs_p,
+    struct Oc_xt_key *key_p)
+{
+    if (!gs_p->pending)
+        return FALSE;
+    gs_p->pending = FALSE;
+    
+    if (oc_xt_nd_gap_between(s_p, gs_p->end_key_p, key_p) < gs_p->len) {
+        gs_p->num_confirmed = gs_p->num_stale;
+        return FALSE;
+    }
+
+    // the subtrees ending with this extent hold the result, they are not stale
+    gs_p->num_stale = gs_p->num_confirmed;
+    s_p->cfg_p->key_inc(gs_p->end_key_p, gs_p->result_key_po);
+    return TRUE;
+}
+
+// close the pending gap with the first extent in the subtree of [node_p]
+static bool close_pending_with_min_b(
+    struct Oc_wu *wu_p,
+    struct Oc_xt_state *s_p,
+    Oc_xt_node *node_p,
+    Gap_search *gs_p)
+{
+    Oc_xt_node *child_p;
+    bool rc;
+
+    if (oc_xt_nd_is_leaf(s_p, node_p))
+        return close_pending(s_p, gs_p, oc_xt_nd_min_key(s_p, node_p));
+
+    child_p = oc_xt_nd_get_for_read(
+        wu_p, s_p, oc_xt_nd_index_lookup_min_key(wu_p, s_p, node_p));
+    rc = close_pending_with_min_b(wu_p, s_p, child_p, gs_p);
+    oc_xt_nd_release(wu_p, s_p, child_p);
+    return rc;
+}
+
+static bool search_leaf(
+    struct Oc_xt_state *s_p,
+    Oc_xt_node *node_p,
+    Gap_search *gs_p)
+{
+    struct Oc_xt_key *key_p;
+    struct Oc_xt_rcrd *rcrd_p;
+    int i;
+
+    for (i=0; i < oc_xt_nd_num_entries(s_p, node_p); i++) {
+        oc_xt_nd_leaf_get_kth(s_p, node_p, i, &key_p, &rcrd_p);
+        if (close_pending(s_p, gs_p, key_p))
+            return TRUE;
+        if (s_p->cfg_p->key_compare(key_p, gs_p->lo_key_p) == 1)
+            // this extent is below the search range
+            continue;
+
+        // the gap after this extent is checked against the next one
+        s_p->cfg_p->rcrd_end_offset(key_p, rcrd_p, gs_p->end_key_p);
+        gs_p->pending = TRUE;
+    }
+
+    return FALSE;
+}
+
+/* Search the subtree of [node_p], in order, for the first extent that
+ * owns a large enough gap. Skip the children whose gap bound is too
+ * small.
+ */
+static bool search_node_b(
+    struct Oc_wu *wu_p,
+    struct Oc_xt_state *s_p,
+    Oc_xt_node *node_p,
+    int depth,
+    Gap_search *gs_p)
+{
+    struct Oc_xt_key *key_p;
+    Oc_xt_node *child_p;
+    uint64 addr;
+    bool rc;
+    int k, base;
+    
+    if (oc_xt_nd_is_leaf(s_p, node_p))
+        return search_leaf(s_p, node_p, gs_p);
+
+    k = oc_xt_nd_index_lookup_le_key(wu_p, s_p, node_p, gs_p->lo_key_p);
+    if (-1 == k)
+        k = 0;
+    for (; k < oc_xt_nd_num_entries(s_p, node_p); k++) {
+        if (oc_xt_nd_index_get_kth_gap(s_p, node_p, k) < gs_p->len &&
+            !gs_p->pending)
+            // no gap in this subtree is large enough
+            continue;
+
+        oc_xt_nd_index_get_kth(s_p, node_p, k, &key_p, &addr);
+        child_p = oc_xt_nd_get_for_read(wu_p, s_p, addr);
+        if (oc_xt_nd_index_get_kth_gap(s_p, node_p, k) < gs_p->len)
+            // only the gap leading into this subtree needs checking
+            rc = close_pending_with_min_b(wu_p, s_p, child_p, gs_p);
+        else {
+            base = gs_p->num_stale;
+            rc = search_node_b(wu_p, s_p, child_p, depth+1, gs_p);
+            if (!rc)
+                note_stale(s_p, gs_p, base, depth, key_p);
+        }
+        oc_xt_nd_release(wu_p, s_p, child_p);
+        
+        if (rc)
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+/* Search for the gap, with the tree locked for read. The subtrees with
+ * stale bounds are noted in [gs_p].
+ */
+static void search_b(
+    struct Oc_wu *wu_p,
+    struct Oc_xt_state *s_p,
+    struct Oc_xt_key *min_key_p,
+    Gap_search *gs_p)
+{
+    Oc_xt_node *root_p;
+    struct Oc_xt_key *key_p;
+    struct Oc_xt_rcrd *rcrd_p;
+    
+    key_p = (struct Oc_xt_key*) alloca(s_p->cfg_p->key_size);
+    rcrd_p = (struct Oc_xt_rcrd*) alloca(s_p->cfg_p->rcrd_size);
+    memcpy((char*)gs_p->result_key_po, (char*)min_key_p, s_p->cfg_p->key_size);
+
+    root_p = oc_xt_nd_get_for_read(wu_p, s_p, s_p->root_node_p->disk_addr);
+    if (oc_xt_nd_num_entries(s_p, root_p) == 0) {
+        // an empty tree
+        oc_xt_nd_release(wu_p, s_p, root_p);
+        return;
+    }
+    
+    /* 1. The lowest candidate is [min_key_p] itself. If an extent covers
+     *    it, the candidate is the offset right after that extent.
+     */
+    if (find_le_b(wu_p, s_p, root_p, min_key_p, key_p, rcrd_p)) {
+        s_p->cfg_p->rcrd_end_offset(key_p, rcrd_p, gs_p->end_key_p);
+        if (s_p->cfg_p->key_compare(min_key_p, gs_p->end_key_p) != -1)
+            s_p->cfg_p->key_inc(gs_p->end_key_p, gs_p->result_key_po);
+    }
+
+    // 2. Check the gap between the candidate and the following extent
+    if (!find_ge_b(wu_p, s_p, root_p, gs_p->result_key_po, key_p, rcrd_p) ||
+        s_p->cfg_p->key_distance(gs_p->result_key_po, key_p) >= gs_p->len) {
+        oc_xt_nd_release(wu_p, s_p, root_p);
+        return;
+    }
+
+    /* 3. Search for the first extent, starting at [key_p], that is
+     *    followed by a large enough gap.
+     */
+    gs_p->lo_key_p = key_p;
+    gs_p->pending = FALSE;
+    if (!search_node_b(wu_p, s_p, root_p, 0, gs_p)) {
+        /* The gap after the last extent in the tree is infinite. The
+         * bounds on the path to it are never too small.
+         */
+        oc_utl_assert(gs_p->pending);
+        gs_p->num_stale = gs_p->num_confirmed;
+        s_p->cfg_p->key_inc(gs_p->end_key_p, gs_p->result_key_po);
+    }
+    oc_xt_nd_release(wu_p, s_p, root_p);
+}
+
+void oc_xt_op_find_gap_b(
+    struct Oc_wu *wu_p,
+    struct Oc_xt_state *s_p,
+    struct Oc_xt_key *min_key_p,
+    uint64 len,
+    struct Oc_xt_key *result_key_po)
+{
+    Gap_search gs;
+    int i;
+    
+    memset(&gs, 0, sizeof(gs));
+    gs.len = len;
+    gs.end_key_p = (struct Oc_xt_key*) alloca(s_p->cfg_p->key_size);
+    gs.result_key_po = result_key_po;
+    for (i=0; i < MAX_STALE; i++)
+        gs.stale[i].key_p = (struct Oc_xt_key*) alloca(s_p->cfg_p->key_size);
+    
+    oc_utl_trk_crt_lock_read(wu_p, &s_p->lock);
+    search_b(wu_p, s_p, min_key_p, &gs);
+    oc_utl_trk_crt_unlock(wu_p, &s_p->lock);
+
+    oc_xt_trace_wu_lvl(3, OC_EV_XT_FIND_GAP, wu_p, "result=%s stale=%d",
+                       oc_xt_nd_string_of_key(s_p, result_key_po),
+                       gs.num_stale);
+    if (0 == gs.num_stale)
+        return;
+
+    /* The tree may have changed in between. This is fine, the bounds
+     * are recomputed from the contents of the tree.
+     */
+    oc_utl_trk_crt_lock_write(wu_p, &s_p->lock);
+    for (i=0; i < gs.num_stale; i++)
+        tighten_b(wu_p, s_p, &gs.stale[i]);
+    oc_utl_trk_crt_unlock(wu_p, &s_p->lock);
+}
+
+/**********************************************************************/
+
+void oc_xt_op_find_gap_raise_b(
+    struct Oc_wu *wu_p,
+    struct Oc_xt_state *s_p,
+    struct Oc_xt_key *key_p,
+    uint64 gap)
+{
+    Oc_xt_node *father_p, *child_p;
+    struct Oc_xt_key *dummy_key_p;
+    uint64 addr;
+    int k;
+
+    oc_xt_trace_wu_lvl(3, OC_EV_XT_RAISE_GAP, wu_p, "key=%s gap=%Lu",
+                       oc_xt_nd_string_of_key(s_p, key_p), gap);
+    
+    oc_xt_nd_get_for_write(wu_p, s_p, s_p->root_node_p->disk_addr,
+                           NULL/*no father to update on cow*/,0);
+    father_p = s_p->root_node_p;
+
+    // Descend with lock-coupling. The leaves hold no bounds, stop above them.
+    while (!oc_xt_nd_is_leaf(s_p, father_p)) {
+        k = oc_xt_nd_index_lookup_le_key(wu_p, s_p, father_p, key_p);
+        if (-1 == k)
+            k = 0;
+        oc_xt_nd_index_raise_kth_gap(s_p, father_p, k, gap);
+
+        oc_xt_nd_index_get_kth(s_p, father_p, k, &dummy_key_p, &addr);
+        child_p = oc_xt_nd_get_for_read(wu_p, s_p, addr);
+        if (oc_xt_nd_is_leaf(s_p, child_p)) {
+            oc_xt_nd_release(wu_p, s_p, child_p);
+            break;
+        }
+        oc_xt_nd_release(wu_p, s_p, child_p);
+
+        child_p = oc_xt_nd_get_for_write(wu_p, s_p, addr, father_p, k);
+        oc_xt_nd_release(wu_p, s_p, father_p);
+        father_p = child_p;
+    }
+    oc_xt_nd_release(wu_p, s_p, father_p);
+}
+
+void oc_xt_op_find_gap_note_hole_b(
+    struct Oc_wu *wu_p,
+    struct Oc_xt_state *s_p,
+    struct Oc_xt_key *key_p)
+{
+    struct Oc_xt_key *pred_key_p, *succ_key_p, *end_key_p;
+    struct Oc_xt_rcrd *rcrd_p;
+    Oc_xt_node *root_p;
+    uint64 gap = OC_XT_ND_GAP_INF;
+    bool found;
+    
+    pred_key_p = (struct Oc_xt_key*) alloca(s_p->cfg_p->key_size);
+    succ_key_p = (struct Oc_xt_key*) alloca(s_p->cfg_p->key_size);
+    end_key_p = (struct Oc_xt_key*) alloca(s_p->cfg_p->key_size);
+    rcrd_p = (struct Oc_xt_rcrd*) alloca(s_p->cfg_p->rcrd_size);
+
+    root_p = oc_xt_nd_get_for_read(wu_p, s_p, s_p->root_node_p->disk_addr);
+    if (oc_xt_nd_is_leaf(s_p, root_p)) {
+        // there are no bounds to update
+        oc_xt_nd_release(wu_p, s_p, root_p);
+        return;
+    }
+    
+    // find the extent preceding the hole, it owns the gap
+    found = find_le_b(wu_p, s_p, root_p, key_p, pred_key_p, rcrd_p);
+    if (found) {
+        s_p->cfg_p->rcrd_end_offset(pred_key_p, rcrd_p, end_key_p);
+        
+        // the gap extends up to the next extent, if there is one
+        if (find_ge_b(wu_p, s_p, root_p, key_p, succ_key_p, rcrd_p))
+            gap = oc_xt_nd_gap_between(s_p, end_key_p, succ_key_p);
+    }
+    oc_xt_nd_release(wu_p, s_p, root_p);
+
+    if (found)
+        oc_xt_op_find_gap_raise_b(wu_p, s_p, pred_key_p, gap);
+}
+
+/**********************************************************************/
+
+// copy the first key in the subtree of [node_p] into [key_po]
+static void min_key_b(
+    struct Oc_wu *wu_p,
+    struct Oc_xt_state *s_p,
+    Oc_xt_node *node_p,
+    struct Oc_xt_key *key_po)
+{
+    Oc_xt_node *child_p;
+
+    if (oc_xt_nd_is_leaf(s_p, node_p)) {
+        memcpy((char*)key_po, (char*)oc_xt_nd_min_key(s_p, node_p),
+               s_p->cfg_p->key_size);
+        return;
+    }
+
+    child_p = oc_xt_nd_get_for_read(
+        wu_p, s_p, oc_xt_nd_index_lookup_min_key(wu_p, s_p, node_p));
+    min_key_b(wu_p, s_p, child_p, key_po);
+    oc_xt_nd_release(wu_p, s_p, child_p);
+}
+
+/* The largest gap owned by the extents in the subtree of [node_p].
+ * The extents in the subtree are followed by an extent starting at
+ * [next_key_p]; if it is NULL, there is none.
+ *
+ * The children are gone over from right to left, so that the first
+ * key of a child ends the gap owned by its left sibling.
+ */
+static uint64 subtree_max_gap_b(
+    struct Oc_wu *wu_p,
+    struct Oc_xt_state *s_p,
+    Oc_xt_node *node_p,
+    struct Oc_xt_key *next_key_p)
+{
+    struct Oc_xt_key *key_p, *end_key_p, *child_next_key_p;
+    struct Oc_xt_rcrd *rcrd_p;
+    Oc_xt_node *child_p;
+    uint64 addr, max_gap;
+    int k, n;
+
+    n = oc_xt_nd_num_entries(s_p, node_p);
+    if (oc_xt_nd_is_leaf(s_p, node_p)) {
+        if (NULL == next_key_p)
+            return OC_XT_ND_GAP_INF;
+        end_key_p = (struct Oc_xt_key*) alloca(s_p->cfg_p->key_size);
+        oc_xt_nd_leaf_get_kth(s_p, node_p, n-1, &key_p, &rcrd_p);
+        s_p->cfg_p->rcrd_end_offset(key_p, rcrd_p, end_key_p);
+        return MAX(oc_xt_nd_gap_between(s_p, end_key_p, next_key_p),
+                   oc_xt_nd_leaf_inner_gap(s_p, node_p, NULL));
+    }
+
+    child_next_key_p = NULL;
+    max_gap = 0;
+    for (k = n-1; k >= 0; k--) {
+        oc_xt_nd_index_get_kth(s_p, node_p, k, &key_p, &addr);
+        child_p = oc_xt_nd_get_for_read(wu_p, s_p, addr);
+        max_gap = MAX(max_gap, subtree_max_gap_b(wu_p, s_p, child_p,
+                                                 k == n-1 ? next_key_p
+                                                 : child_next_key_p));
+        if (NULL == child_next_key_p)
+            child_next_key_p = (struct Oc_xt_key*) alloca(s_p->cfg_p->key_size);
+        min_key_b(wu_p, s_p, child_p, child_next_key_p);
+        oc_xt_nd_release(wu_p, s_p, child_p);
+    }
+
+    return max_gap;
+}
+
+/* Recompute the gap bound of the stale subtree [st_p], and lower the
+ * bounds above it accordingly.
+ *
+ * The path from the root is locked for write, the subtree itself is
+ * only read.
+ *
+ * assumption: the tree is locked for write
+ */
+static void tighten_b(
+    struct Oc_wu *wu_p,
+    struct Oc_xt_state *s_p,
+    Gap_stale *st_p)
+{
+    Oc_xt_node *path[OC_XT_MAX_HEIGHT], *child_p;
+    int loc[OC_XT_MAX_HEIGHT];
+    struct Oc_xt_key *dummy_key_p, *next_key_p = NULL;
+    uint64 addr, gap;
+    int i, d;
+
+    oc_xt_nd_get_for_write(wu_p, s_p, s_p->root_node_p->disk_addr,
+                           NULL/*no father to update on cow*/,0);
+    path[0] = s_p->root_node_p;
+
+    // 1. Descend to the father of the subtree
+    for (d=0; ; d++) {
+        if (oc_xt_nd_is_leaf(s_p, path[d])) {
+            // the tree has changed, and the subtree is gone
+            for (i=d; i >= 0; i--)
+                oc_xt_nd_release(wu_p, s_p, path[i]);
+            return;
+        }
+        loc[d] = oc_xt_nd_index_lookup_le_key(wu_p, s_p, path[d], st_p->key_p);
+        if (-1 == loc[d])
+            loc[d] = 0;
+        if (d == st_p->depth)
+            break;
+        oc_xt_nd_index_get_kth(s_p, path[d], loc[d], &dummy_key_p, &addr);
+        path[d+1] = oc_xt_nd_get_for_write(wu_p, s_p, addr, path[d], loc[d]);
+    }
+
+    // 2. The extents of the subtree are followed by those of the next one
+    for (i=d; i >= 0; i--)
+        if (loc[i] + 1 < oc_xt_nd_num_entries(s_p, path[i])) {
+            next_key_p = (struct Oc_xt_key*) alloca(s_p->cfg_p->key_size);
+            oc_xt_nd_index_get_kth(s_p, path[i], loc[i]+1, &dummy_key_p, &addr);
+            child_p = oc_xt_nd_get_for_read(wu_p, s_p, addr);
+            min_key_b(wu_p, s_p, child_p, next_key_p);
+            oc_xt_nd_release(wu_p, s_p, child_p);
+            break;
+        }
+
+    // 3. Compute the exact bound of the subtree
+    oc_xt_nd_index_get_kth(s_p, path[d], loc[d], &dummy_key_p, &addr);
+    child_p = oc_xt_nd_get_for_read(wu_p, s_p, addr);
+    gap = subtree_max_gap_b(wu_p, s_p, child_p, next_key_p);
+    oc_xt_nd_release(wu_p, s_p, child_p);
+
+    oc_xt_trace_wu_lvl(3, OC_EV_XT_TIGHTEN_GAP, wu_p, "key=%s depth=%d gap=%Lu->%Lu",
+                       oc_xt_nd_string_of_key(s_p, st_p->key_p), d,
+                       oc_xt_nd_index_get_kth_gap(s_p, path[d], loc[d]), gap);
+    oc_utl_debugassert(gap <= oc_xt_nd_index_get_kth_gap(s_p, path[d], loc[d]));
+    oc_xt_nd_index_set_kth_gap(s_p, path[d], loc[d], gap);
+    
+    // 4. An ancestor's bound need not be larger than those of its children
+    for (i=d-1; i >= 0; i--) {
+        gap = MIN(oc_xt_nd_index_get_kth_gap(s_p, path[i], loc[i]),
+                  oc_xt_nd_index_max_gap(s_p, path[i+1]));
+        oc_xt_nd_index_set_kth_gap(s_p, path[i], loc[i], gap);
+        oc_xt_nd_release(wu_p, s_p, path[i+1]);
+    }
+    oc_xt_nd_release(wu_p, s_p, path[0]);
+}
+
+/**********************************************************************/
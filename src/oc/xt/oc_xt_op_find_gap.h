@@ -0,0 +1,74 @@
+/**************************************************************/
+/*
+ * Copyright (c) 2014-2015, Ohad Rodeh, IBM Research
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer. 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution. 
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies, 
+ * either expressed or implied, of IBM Research.
+ * 
+ */
+/**************************************************************/
+/**********************************************************************/
+/* OC_XT_OP_FIND_GAP.H
+ *
+ * Search for free gaps between extents, and maintain the gap bounds
+ * held in index entries.
+ */
+/**********************************************************************/
+#ifndef OC_XT_OP_FIND_GAP_H
+#define OC_XT_OP_FIND_GAP_H
+
+#include "oc_xt_int.h"
+
+/* Search for a gap with the tree locked for read. If stale bounds were
+ * found on the way, they are lowered afterwards, with the tree locked
+ * for write.
+ */
+void oc_xt_op_find_gap_b(
+    struct Oc_wu *wu_p,
+    struct Oc_xt_state *s_p,
+    struct Oc_xt_key *min_key_p,
+    uint64 len,
+    struct Oc_xt_key *result_key_po);
+
+/* Raise the gap bounds on the path to the extent starting at [key_p]
+ * so that they are at least [gap].
+ */
+void oc_xt_op_find_gap_raise_b(
+    struct Oc_wu *wu_p,
+    struct Oc_xt_state *s_p,
+    struct Oc_xt_key *key_p,
+    uint64 gap);
+
+/* A range starting at [key_p] has just been removed. The extent
+ * preceding it now owns a larger gap; raise the bounds on its path.
+ *
+ * assumption: the tree is locked for write
+ */
+void oc_xt_op_find_gap_note_hole_b(
+    struct Oc_wu *wu_p,
+    struct Oc_xt_state *s_p,
+    struct Oc_xt_key *key_p);
+
+#endif
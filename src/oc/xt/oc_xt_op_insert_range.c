@@ -58,6 +58,7 @@
 #include "oc_xt_trace.h"
 #include "oc_xt_nd.h"
 #include "oc_xt_op_insert_range.h"
+#include "oc_xt_op_find_gap.h"
 
 /**********************************************************************/
 // prototypes
@@ -77,12 +78,56 @@ static void update_hi_key(
     struct Oc_xt_state *s_p,
     Oc_xt_node *node_p,
     struct Oc_xt_key *hi_key_p);
+/* A sorted array of extents waiting to be inserted. Used by
+ * insert-multi to fill a leaf with several extents at once.
+ */
+typedef struct Insert_batch {
+    int num;                        // number of extents in the array
+    int next;                       // the next extent to insert
+    struct Oc_xt_key *key_array;
+    struct Oc_xt_rcrd *rcrd_array;
+    struct Oc_xt_key *max_end_key_p; // the highest end-offset+1 in the array
+    uint64 rc;                      // length overwritten by batched extents
+} Insert_batch;
+
+/* A gap bound that has been raised in the father of a leaf, and needs
+ * to be raised on the rest of the path as well.
+ */
+typedef struct Gap_raise {
+    bool needed;
+    uint64 gap;
+    struct Oc_xt_key *key_p;        // the extent that owns the gap
+} Gap_raise;
+
+static void update_leaf_gap(
+    struct Oc_wu *wu_p,
+    Oc_xt_state *s_p,
+    Oc_xt_node *father_p,
+    int idx,
+    Oc_xt_node *leaf_p,
+    Gap_raise *raise_p);
+
+static void merge_with_siblings_b(
+    struct Oc_wu *wu_p,
+    Oc_xt_state *s_p,
+    Oc_xt_node *father_p,
+    int idx,
+    Oc_xt_node *child_p,
+    struct Oc_xt_key *key_p);
+static void fill_from_batch(
+    struct Oc_wu *wu_p,
+    Oc_xt_state *s_p,
+    Oc_xt_node *leaf_p,
+    struct Oc_xt_key *lo_bound_key_p,
+    struct Oc_xt_key *hi_bound_key_p,
+    Insert_batch *batch_p);
 static uint64 fill_single_leaf_b(
     struct Oc_wu *wu_p,
     Oc_xt_state *s_p,
     struct Oc_xt_key *key_p,
     struct Oc_xt_rcrd *rcrd_p,
-    uint64 *len_inserted_po);
+    uint64 *len_inserted_po,
+    Insert_batch *batch_p);
 /**********************************************************************/
 
 static Oc_xt_node *lookup_key_in_index_node(
@@ -155,6 +200,214 @@ static void update_hi_key(
     }
 }
 
+/* Extents have just been inserted into leaf [leaf_p], the [idx] child
+ * of [father_p]. An inserted extent may take over the tail of a gap
+ * whose owner is in a different leaf. If the largest gap inside the
+ * leaf exceeds its bound, raise the bound in [father_p].
+ *
+ * The ancestors of [father_p] are locked no longer; record the raise
+ * in [raise_p], it is applied once the locks are released.
+ *
+ * note: the gap after the last extent of the leaf can only shrink.
+ *
+ * Assumptions:
+ *  - [father_p] and [leaf_p] are locked for write
+ */
+static void update_leaf_gap(
+    struct Oc_wu *wu_p,
+    Oc_xt_state *s_p,
+    Oc_xt_node *father_p,
+    int idx,
+    Oc_xt_node *leaf_p,
+    Gap_raise *raise_p)
+{
+    uint64 gap;
+    int k;
+
+    gap = oc_xt_nd_leaf_inner_gap(s_p, leaf_p, &k);
+    if (!oc_xt_nd_index_raise_kth_gap(s_p, father_p, idx, gap))
+        return;
+    
+    oc_xt_trace_wu_lvl(3, OC_EV_XT_RAISE_GAP, wu_p, "[%s] idx=%d gap=%Lu",
+                       oc_xt_nd_string_of_node(s_p, father_p), idx, gap);
+    if (oc_xt_nd_is_root(s_p, father_p))
+        return;
+    raise_p->needed = TRUE;
+    raise_p->gap = gap;
+    memcpy((char*)raise_p->key_p, (char*)oc_xt_nd_get_kth_key(s_p, leaf_p, k),
+           s_p->cfg_p->key_size);
+}
+
+/* An extent [key_p] has just been inserted into leaf [child_p], the
+ * [idx] child of [father_p]. If the extent has landed on the edge of the
+ * leaf, try to merge it with the neighboring extent in the adjacent
+ * sibling.
+ *
+ * Only siblings that share the same father are considered. This way,
+ * the only separator key that changes is in [father_p], which is
+ * locked for write. The leaf that gives up an entry must not underflow.
+ *
+ * Assumptions:
+ *  - [father_p] and [child_p] are locked for write
+ */
+static void merge_with_siblings_b(
+    struct Oc_wu *wu_p,
+    Oc_xt_state *s_p,
+    Oc_xt_node *father_p,
+    int idx,
+    Oc_xt_node *child_p,
+    struct Oc_xt_key *key_p)
+{
+    Oc_xt_node *sib_p;
+    struct Oc_xt_key *sep_key_p, *sib_key_p, *ch_key_p, *end_key_p;
+    struct Oc_xt_rcrd *sib_rcrd_p, *ch_rcrd_p;
+    uint64 sib_addr;
+    int n;
+
+    n = oc_xt_nd_num_entries(s_p, child_p);
+    if (n <= s_p->cfg_p->min_num_ent)
+        return;
+
+    // 1. The extent is the minimum of [child_p], merge with the left sibling
+    if (idx > 0 &&
+        0 == s_p->cfg_p->key_compare(key_p, oc_xt_nd_min_key(s_p, child_p)))
+    {
+        oc_xt_nd_index_get_kth(s_p, father_p, idx-1, &sep_key_p, &sib_addr);
+        sib_p = oc_xt_nd_get_for_write(wu_p, s_p, sib_addr, father_p, idx-1);
+        oc_xt_nd_leaf_get_kth(s_p, sib_p,
+                              oc_xt_nd_num_entries(s_p, sib_p) - 1,
+                              &sib_key_p, &sib_rcrd_p);
+        oc_xt_nd_leaf_get_kth(s_p, child_p, 0, &ch_key_p, &ch_rcrd_p);
+        
+        if (oc_xt_nd_rcrd_is_adjacent(s_p, sib_key_p, sib_rcrd_p, ch_key_p) &&
+            s_p->cfg_p->rcrd_try_merge(sib_key_p, sib_rcrd_p,
+                                       ch_key_p, ch_rcrd_p))
+        {
+            oc_xt_trace_wu_lvl(3, OC_EV_XT_MERGE_WITH_SIBLING, wu_p,
+                               "left [%s] ext=%s",
+                               oc_xt_nd_string_of_node(s_p, sib_p),
+                               oc_xt_nd_string_of_rcrd(s_p, sib_key_p,
+                                                        sib_rcrd_p));
+            
+            /* the minimum of [child_p] has moved up, update the father.
+             * The merged extent now owns the gap that follows it. 
+             */
+            oc_xt_nd_remove_kth(s_p, child_p, 0);
+            oc_xt_nd_index_set_kth(s_p, father_p, idx,
+                                   oc_xt_nd_min_key(s_p, child_p),
+                                   child_p->disk_addr);
+            end_key_p = (struct Oc_xt_key*)alloca(s_p->cfg_p->key_size);
+            s_p->cfg_p->rcrd_end_offset(sib_key_p, sib_rcrd_p, end_key_p);
+            oc_xt_nd_index_raise_kth_gap(
+                s_p, father_p, idx-1,
+                oc_xt_nd_gap_between(s_p, end_key_p,
+                                     oc_xt_nd_min_key(s_p, child_p)));
+        }
+        oc_xt_nd_release(wu_p, s_p, sib_p);
+        return;
+    }
+
+    // 2. The maximum of [child_p] may be merged with the right sibling
+    if (idx < oc_xt_nd_num_entries(s_p, father_p) - 1) {
+        struct Oc_xt_key *tmp_key_p;
+        struct Oc_xt_rcrd *tmp_rcrd_p;
+        
+        oc_xt_nd_leaf_get_kth(s_p, child_p, n-1, &ch_key_p, &ch_rcrd_p);
+
+        /* The separator key is a lower bound on the minimum of the
+         * sibling. Check it first, to avoid fetching the sibling
+         * needlessly.
+         */
+        oc_xt_nd_index_get_kth(s_p, father_p, idx+1, &sep_key_p, &sib_addr);
+        if (!oc_xt_nd_rcrd_is_adjacent(s_p, ch_key_p, ch_rcrd_p, sep_key_p))
+            return;
+        
+        sib_p = oc_xt_nd_get_for_write(wu_p, s_p, sib_addr, father_p, idx+1);
+        oc_xt_nd_leaf_get_kth(s_p, sib_p, 0, &sib_key_p, &sib_rcrd_p);
+
+        tmp_key_p = (struct Oc_xt_key*)alloca(s_p->cfg_p->key_size);
+        tmp_rcrd_p = (struct Oc_xt_rcrd*)alloca(s_p->cfg_p->rcrd_size);
+        memcpy((char*)tmp_key_p, (char*)ch_key_p, s_p->cfg_p->key_size);
+        memcpy((char*)tmp_rcrd_p, (char*)ch_rcrd_p, s_p->cfg_p->rcrd_size);
+        
+        if (0 == s_p->cfg_p->key_compare(sep_key_p, sib_key_p) &&
+            s_p->cfg_p->rcrd_try_merge(tmp_key_p, tmp_rcrd_p,
+                                       sib_key_p, sib_rcrd_p))
+        {
+            oc_xt_trace_wu_lvl(3, OC_EV_XT_MERGE_WITH_SIBLING, wu_p,
+                               "right [%s] ext=%s",
+                               oc_xt_nd_string_of_node(s_p, sib_p),
+                               oc_xt_nd_string_of_rcrd(s_p, tmp_key_p,
+                                                        tmp_rcrd_p));
+
+            /* The merged extent replaces the minimum of the sibling,
+             * the minimum has moved down, update the father.
+             */
+            memcpy((char*)sib_key_p, (char*)tmp_key_p, s_p->cfg_p->key_size);
+            memcpy((char*)sib_rcrd_p, (char*)tmp_rcrd_p, s_p->cfg_p->rcrd_size);
+            oc_xt_nd_remove_kth(s_p, child_p, n-1);
+            oc_xt_nd_index_set_kth(s_p, father_p, idx+1,
+                                   tmp_key_p, sib_p->disk_addr);
+        }
+        oc_xt_nd_release(wu_p, s_p, sib_p);
+    }
+}
+
+/* Leaf [leaf_p] has just received an extent starting at
+ * [lo_bound_key_p], and it has been inserted completely. Add to it
+ * the following extents in [batch_p], as long as there is room left
+ * and they fall, in their entirety, inside
+ * [lo_bound_key_p, hi_bound_key_p).
+ *
+ * The low bound matters when the last extent was the tail of a longer
+ * extent; the extents that follow it in the array may start before it.
+ * 
+ * An extent that crosses a bound ends the batch. It is inserted later
+ * on, with a fresh descent. This preserves the
+ * order of insertion, so overlapping extents behave as if they were
+ * inserted one by one.
+ *
+ * Assumptions:
+ *  - [leaf_p] is locked for write
+ */
+static void fill_from_batch(
+    struct Oc_wu *wu_p,
+    Oc_xt_state *s_p,
+    Oc_xt_node *leaf_p,
+    struct Oc_xt_key *lo_bound_key_p,
+    struct Oc_xt_key *hi_bound_key_p,
+    Insert_batch *batch_p)
+{
+    struct Oc_xt_key *key_p, *end_key_p;
+    struct Oc_xt_rcrd *rcrd_p;
+
+    end_key_p = (struct Oc_xt_key*)alloca(s_p->cfg_p->key_size);
+    
+    while (batch_p->next < batch_p->num &&
+           !oc_xt_nd_is_full_for_insert(s_p, leaf_p))
+    {
+        key_p = oc_xt_nd_key_array_kth(s_p, batch_p->key_array,
+                                       batch_p->next);
+        rcrd_p = oc_xt_nd_rcrd_array_kth(s_p, batch_p->rcrd_array,
+                                         batch_p->next);
+        if (s_p->cfg_p->key_compare(key_p, lo_bound_key_p) == 1)
+            // the extent starts below the low bound
+            return;
+        s_p->cfg_p->rcrd_end_offset(key_p, rcrd_p, end_key_p);
+        if (s_p->cfg_p->key_compare(end_key_p, hi_bound_key_p) != 1)
+            // the extent does not fit below the high bound
+            return;
+        
+        oc_xt_trace_wu_lvl(
+            3, OC_EV_XT_FILL_FROM_BATCH, wu_p, "[%s] ext=%s",
+            oc_xt_nd_string_of_node(s_p, leaf_p),
+            oc_xt_nd_string_of_rcrd(s_p, key_p, rcrd_p));
+        batch_p->rc += oc_xt_nd_insert_into_leaf(wu_p, s_p, leaf_p,
+                                                 key_p, rcrd_p);
+        batch_p->next++;
+    }
+}
+
 /* A bounded insert that fills up a single leaf.
  *
  * The algorithm is like inserting a single entry. Descend through the
@@ -169,6 +422,10 @@ static void update_hi_key(
  *  3. set [len_inserted_po] to the length, out of the extent
  *     [key_p, rcrd_p], that has actually been inserted. 
  *
+ * If [batch_p] is not NULL, and the extent has been inserted
+ * completely, then the leaf is also filled with following extents
+ * from the batch. 
+ *
  * note: it is possible that the function will be not be able to
  *   complete the insertion of a single extent into a node. This
  *   can happen if the extent is larger than what can fit into this
@@ -179,10 +436,13 @@ static uint64 fill_single_leaf_b(
     Oc_xt_state *s_p,
     struct Oc_xt_key *key_p,
     struct Oc_xt_rcrd *rcrd_p,
-    uint64 *len_inserted_po)
+    uint64 *len_inserted_po,
+    Insert_batch *batch_p)
 {
     Oc_xt_node *father_p, *child_p;
-    struct Oc_xt_key *hi_bound_key_p;
+    struct Oc_xt_key *hi_bound_key_p, *first_key_p;
+    Gap_raise raise;
+    uint64 ext_len;
     int level = 0, rc=0;
     
     oc_xt_trace_wu_lvl(
@@ -198,6 +458,14 @@ static uint64 fill_single_leaf_b(
     hi_bound_key_p = (struct Oc_xt_key*)alloca(s_p->cfg_p->key_size);
     s_p->cfg_p->rcrd_end_offset(key_p, rcrd_p, hi_bound_key_p); 
     s_p->cfg_p->key_inc(hi_bound_key_p, hi_bound_key_p);
+    if (batch_p != NULL &&
+        s_p->cfg_p->key_compare(hi_bound_key_p, batch_p->max_end_key_p) == 1)
+        memcpy((char*)hi_bound_key_p, batch_p->max_end_key_p,
+               s_p->cfg_p->key_size);
+    ext_len = s_p->cfg_p->rcrd_length(key_p, rcrd_p);
+
+    memset(&raise, 0, sizeof(raise));
+    raise.key_p = (struct Oc_xt_key*)alloca(s_p->cfg_p->key_size);
     
     if (oc_xt_nd_is_full_for_insert(s_p, s_p->root_node_p)) {
         // the root is full, split it and continue
@@ -212,10 +480,13 @@ static uint64 fill_single_leaf_b(
             wu_p, s_p,
             s_p->root_node_p,
             key_p, rcrd_p);
+        if (batch_p != NULL)
+            fill_from_batch(wu_p, s_p, s_p->root_node_p,
+                            key_p, hi_bound_key_p, batch_p);
         
         oc_xt_nd_release(wu_p, s_p, s_p->root_node_p);
 
-        *len_inserted_po = s_p->cfg_p->rcrd_length(key_p, rcrd_p);
+        *len_inserted_po = ext_len;
         return rc;
     }
     
@@ -257,10 +528,25 @@ static uint64 fill_single_leaf_b(
                     wu_p, s_p,
                     child_p,
                     key_p, rcrd_p);
+                if (batch_p != NULL && *len_inserted_po == ext_len) {
+                    /* Merging with siblings may move the separator keys,
+                     * so remember the first key now. 
+                     */
+                    first_key_p = (struct Oc_xt_key*)alloca(
+                        s_p->cfg_p->key_size);
+                    memcpy((char*)first_key_p, key_p, s_p->cfg_p->key_size);
+                    fill_from_batch(wu_p, s_p, child_p,
+                                    first_key_p, hi_bound_key_p, batch_p);
+                    key_p = first_key_p;
+                }
+                update_leaf_gap(wu_p, s_p, father_p, idx, child_p, &raise);
+                if (s_p->cfg_p->rcrd_try_merge != NULL)
+                    merge_with_siblings_b(wu_p, s_p, father_p, idx,
+                                          child_p, key_p);
                 
                 oc_xt_nd_release(wu_p, s_p, father_p);
                 oc_xt_nd_release(wu_p, s_p, child_p);        
-                return rc;
+                break;
             }
             else {
                 // Leaf node with no room to spare, split and insert
@@ -292,6 +578,14 @@ static uint64 fill_single_leaf_b(
                     wu_p, s_p,
                     trg_p,
                     key_p, rcrd_p);
+                if (batch_p != NULL && *len_inserted_po == ext_len)
+                    fill_from_batch(wu_p, s_p, trg_p,
+                                    key_p, hi_bound_key_p, batch_p);
+
+                /* The old binding still covers both halves; raise its
+                 * bound before it is split.
+                 */
+                update_leaf_gap(wu_p, s_p, father_p, idx, trg_p, &raise);
                 
                 // replace the old binding for [idx] with bindings: 
                 //   * min(L) -> child_p
@@ -303,7 +597,7 @@ static uint64 fill_single_leaf_b(
                 oc_xt_nd_release(wu_p, s_p, father_p);
                 oc_xt_nd_release(wu_p, s_p, child_p);
                 oc_xt_nd_release(wu_p, s_p, right_p);
-                return rc;
+                break;
             }
         }
 
@@ -344,6 +638,11 @@ static uint64 fill_single_leaf_b(
         oc_xt_nd_release(wu_p, s_p, father_p);
         father_p = child_p;
     }
+
+    // all locks have been released, raise the gap bounds on the path
+    if (raise.needed)
+        oc_xt_op_find_gap_raise_b(wu_p, s_p, raise.key_p, raise.gap);
+    return rc;
 }
 
 /**********************************************************************/
@@ -372,7 +671,7 @@ uint64 oc_xt_op_insert_range_b(
         rc += fill_single_leaf_b(
             wu_p, s_p,
             crnt_key_p, crnt_rcrd_p,
-            &len_inserted);
+            &len_inserted, NULL);
         
         tot_len += len_inserted;
         oc_utl_debugassert(len_inserted <= tot_len);
@@ -389,3 +688,86 @@ uint64 oc_xt_op_insert_range_b(
     }
 }
 
+
+uint64 oc_xt_op_insert_multi_b(
+    struct Oc_wu *wu_p,
+    struct Oc_xt_state *s_p,
+    int num,
+    struct Oc_xt_key *key_array,
+    struct Oc_xt_rcrd *rcrd_array)
+{
+    uint64 rc, ext_len, tot_len, len_inserted;
+    struct Oc_xt_key *key_p, *crnt_key_p, *end_key_p;
+    struct Oc_xt_rcrd *rcrd_p, *crnt_rcrd_p;
+    Insert_batch batch;
+    int i;
+
+    if (0 == num)
+        return 0;
+    
+    crnt_key_p = (struct Oc_xt_key*)alloca(s_p->cfg_p->key_size);
+    crnt_rcrd_p = (struct Oc_xt_rcrd*)alloca(s_p->cfg_p->rcrd_size);
+    end_key_p = (struct Oc_xt_key*)alloca(s_p->cfg_p->key_size);
+    
+    memset(&batch, 0, sizeof(batch));
+    batch.num = num;
+    batch.key_array = key_array;
+    batch.rcrd_array = rcrd_array;
+    batch.max_end_key_p = (struct Oc_xt_key*)alloca(s_p->cfg_p->key_size);
+
+    /* compute the highest end-offset in the array. It serves as the
+     * initial high bound, instead of the end of the first extent.
+     */
+    for (i=0; i<num; i++) {
+        key_p = oc_xt_nd_key_array_kth(s_p, key_array, i);
+        rcrd_p = oc_xt_nd_rcrd_array_kth(s_p, rcrd_array, i);
+        if (i > 0)
+            oc_utl_debugassert(
+                s_p->cfg_p->key_compare(
+                    oc_xt_nd_key_array_kth(s_p, key_array, i-1),
+                    key_p) != -1);
+        s_p->cfg_p->rcrd_end_offset(key_p, rcrd_p, end_key_p);
+        s_p->cfg_p->key_inc(end_key_p, end_key_p);
+        if (0 == i ||
+            s_p->cfg_p->key_compare(batch.max_end_key_p, end_key_p) == 1)
+            memcpy((char*)batch.max_end_key_p, end_key_p,
+                   s_p->cfg_p->key_size);
+    }
+
+    rc = 0;
+    while (batch.next < num) {
+        // take the next extent out of the batch
+        key_p = oc_xt_nd_key_array_kth(s_p, key_array, batch.next);
+        rcrd_p = oc_xt_nd_rcrd_array_kth(s_p, rcrd_array, batch.next);
+        batch.next++;
+        
+        memcpy((char*)crnt_key_p,  key_p, s_p->cfg_p->key_size);
+        memcpy((char*)crnt_rcrd_p,  rcrd_p, s_p->cfg_p->rcrd_size);
+        ext_len = s_p->cfg_p->rcrd_length(key_p, rcrd_p);
+        
+        /* Insert it, one leaf at a time. Once it has been inserted
+         * completely, the leaf it ended up in is filled with the
+         * extents that follow it.
+         */
+        tot_len = 0;
+        while (1) {
+            rc += fill_single_leaf_b(
+                wu_p, s_p,
+                crnt_key_p, crnt_rcrd_p,
+                &len_inserted, &batch);
+            
+            tot_len += len_inserted;
+            oc_xt_trace_wu_lvl(3, OC_EV_XT_INSERT_RNG_LEN, wu_p,
+                               "len=%Lu", len_inserted);
+            if (tot_len == ext_len)
+                break;
+            
+            // move cursor up
+            memcpy((char*)crnt_key_p,  key_p, s_p->cfg_p->key_size);
+            memcpy((char*)crnt_rcrd_p,  rcrd_p, s_p->cfg_p->rcrd_size);
+            s_p->cfg_p->rcrd_chop_length(crnt_key_p, crnt_rcrd_p, tot_len);
+        }
+    }
+
+    return rc + batch.rc;
+}
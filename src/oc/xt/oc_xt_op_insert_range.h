@@ -44,6 +44,13 @@ uint64 oc_xt_op_insert_range_b(
     struct Oc_xt_key *key_p,
     struct Oc_xt_rcrd *rcrd_p);
 
+uint64 oc_xt_op_insert_multi_b(
+    struct Oc_wu *wu_p,
+    Oc_xt_state *s_p,
+    int num,
+    struct Oc_xt_key *key_array,
+    struct Oc_xt_rcrd *rcrd_array);
+
 #endif
 
 
@@ -57,6 +57,7 @@
 #include "oc_xt_int.h"
 #include "oc_xt_trace.h"
 #include "oc_xt_nd.h"
+#include "oc_xt_ext.h"
 #include "oc_xt_op_lookup_range.h"
 /**********************************************************************/
 static bool check_in_bounds(Oc_xt_state *s_p,
@@ -97,6 +98,20 @@ static void copy_partial_ext(
     // make sure there is room to copy into 
     if (*(lkr_p->nx_found_po) == lkr_p->max_num_keys_i) return;
 
+    if (s_p->cfg_p->builtin_ext) {
+        // copy the intersection directly into the output arrays
+        oc_xt_ext_sub(
+            key_p, rcrd_p,
+            MAX(oc_xt_ext_key(key_p), oc_xt_ext_key(min_key_p)),
+            MIN(oc_xt_ext_end(key_p, rcrd_p), oc_xt_ext_key(max_key_p)),
+            oc_xt_nd_key_array_kth(s_p, lkr_p->key_array_po,
+                                   *(lkr_p->nx_found_po)),
+            oc_xt_nd_rcrd_array_kth(s_p, lkr_p->rcrd_array_po,
+                                    *(lkr_p->nx_found_po)));
+        *lkr_p->nx_found_po = *lkr_p->nx_found_po + 1;
+        return;
+    }
+
     /* setup space for returned values; we are going to split extent
      * [key_p, rcrd_p]
      */
@@ -448,4 +463,57 @@ void oc_xt_op_lookup_range_b(
     }
 }
 
+/**********************************************************************/
+/* A single descent with lock-coupling. Index keys are lower bounds on
+ * the extents in their subtrees, and an extent ends before the key of
+ * the next subtree. The extent covering [key_p] can therefore only be
+ * in the subtree with the largest key that is not larger than [key_p].
+ */
+bool oc_xt_op_lookup_ofs_b(
+    struct Oc_wu *wu_p,
+    Oc_xt_state *s_p,
+    struct Oc_xt_key *key_p,
+    struct Oc_xt_key *key_po,
+    struct Oc_xt_rcrd *rcrd_po)
+{
+    Oc_xt_node *father_p, *child_p;
+    struct Oc_xt_key *ext_key_p;
+    struct Oc_xt_rcrd *ext_rcrd_p;
+    uint64 addr;
+    int loc;
+    bool rc = FALSE;
+    
+    oc_xt_nd_get_for_read(wu_p, s_p, s_p->root_node_p->disk_addr);
+    father_p = s_p->root_node_p;
+
+    while (!oc_xt_nd_is_leaf(s_p, father_p)) {
+        addr = oc_xt_nd_index_lookup_key(wu_p, s_p, father_p, key_p,
+                                         NULL, NULL);
+        if (0 == addr) {
+            // [key_p] is smaller than all the extents in the tree
+            oc_xt_nd_release(wu_p, s_p, father_p);
+            return FALSE;
+        }
+        child_p = oc_xt_nd_get_for_read(wu_p, s_p, addr);
+        oc_xt_nd_release(wu_p, s_p, father_p);
+        father_p = child_p;
+    }
 
+    loc = oc_xt_nd_leaf_lookup_le_key(wu_p, s_p, father_p, key_p);
+    if (loc != -1) {
+        oc_xt_nd_leaf_get_kth(s_p, father_p, loc, &ext_key_p, &ext_rcrd_p);
+        if (s_p->cfg_p->builtin_ext)
+            rc = (0 == oc_xt_ext_compare0(key_p, ext_key_p, ext_rcrd_p));
+        else
+            rc = (0 == s_p->cfg_p->rcrd_compare0(key_p, ext_key_p, ext_rcrd_p));
+        if (rc) {
+            memcpy((char*)key_po, (char*)ext_key_p, s_p->cfg_p->key_size);
+            memcpy((char*)rcrd_po, (char*)ext_rcrd_p, s_p->cfg_p->rcrd_size);
+        }
+    }
+    
+    oc_xt_nd_release(wu_p, s_p, father_p);
+    return rc;
+}
+
+/**********************************************************************/
@@ -55,6 +55,16 @@ void oc_xt_op_lookup_range_b(
     Oc_xt_state *s_p,
     Oc_xt_op_lookup_range *lkr_p );
 
+/* Find the extent covering [key_p]. Copy it into [key_po, rcrd_po] and
+ * return TRUE. Return FALSE if [key_p] is not covered.
+ */
+bool oc_xt_op_lookup_ofs_b(
+    struct Oc_wu *wu_p,
+    Oc_xt_state *s_p,
+    struct Oc_xt_key *key_p,
+    struct Oc_xt_key *key_po,
+    struct Oc_xt_rcrd *rcrd_po);
+
 #endif
 
 
@@ -99,13 +99,13 @@ static void output_b(
             uint64 addr;
             
             oc_xt_nd_index_get_kth(s_p, node_p, i, &dummy_key_p, &addr); 
-            child_p = s_p->cfg_p->node_get(wu_p, addr);
+            child_p = oc_xt_nd_get_for_read(wu_p, s_p, addr);
             
             output_b(wu_p, s_p,
                      child_p,
                      tag_p, level+1,
                      out_p);
-            s_p->cfg_p->node_release(wu_p, child_p);
+            oc_xt_nd_release(wu_p, s_p, child_p);
         }
     }
     
@@ -118,14 +118,14 @@ static void output_b(
             uint64 addr;
             
             oc_xt_nd_index_get_kth(s_p, node_p, i, &dummy_key_p, &addr); 
-            child_p = s_p->cfg_p->node_get(wu_p, addr);
+            child_p = oc_xt_nd_get_for_read(wu_p, s_p, addr);
             
             key_p = oc_xt_nd_min_key(s_p, child_p);
             s_p->cfg_p->key_to_string(key_p, buf, 20);
             fprintf(out_p, "    %s_%d_%s -> %s_%d_%s;\n",
                     tag_p, level, min_key_buf,
                     tag_p, level+1, buf );
-            s_p->cfg_p->node_release(wu_p, child_p);            
+            oc_xt_nd_release(wu_p, s_p, child_p);
         }
     }
 }
@@ -79,6 +79,12 @@
  * In order to simplify the computation of the in-danger state we define
  * a node on the edge as in-danger if it has less than b+2 entries. 
  * 
+ * The lazy variant does not descend into sub-trees that lie between
+ * the two edges. They are detached from the tree and queued in the tree
+ * state; their nodes and records are deleted later by the
+ * reclaimer. The first phase then visits only the two edge paths. The
+ * length removed is not computed, as this requires visiting all the
+ * leaves.
  */
 /**********************************************************************/
 #include <string.h>
@@ -89,6 +95,7 @@
 #include "oc_xt_int.h"
 #include "oc_xt_op_remove_range.h"
 #include "oc_xt_op_insert_range.h"
+#include "oc_xt_op_find_gap.h"
 #include "oc_xt_op_output_dot.h"
 #include "oc_xt_nd.h"
 #include "oc_xt_trace.h"
@@ -98,6 +105,9 @@ typedef struct Oc_xt_remove {
     struct Oc_xt_key *max_key_p;
 
     Oc_xt_nd_spill spill_area;
+
+    bool lazy;          // detach covered sub-trees instead of deleting them
+    int n_detached;     // the number of sub-trees detached
 } Oc_xt_remove;
 
 typedef struct Oc_xt_children {
@@ -251,6 +261,16 @@ static int remove_phase_b(
             uint64 child_addr;
             Oc_xt_node *child_p;
             bool rmv_child = FALSE;
+
+            if (rmv_p->lazy && min_loc < i && i < max_loc) {
+                /* The child lies strictly between the two edges, it
+                 * is covered by the range. Do not descend into it.
+                 */
+                if (-1 == del_idx_start)
+                    del_idx_start = i;
+                del_idx_end = i;
+                continue;
+            }
             
             oc_xt_nd_index_get_kth(s_p, node_p, i, &dummy_key_p, &child_addr);
             child_p = oc_xt_nd_get_for_write(wu_p, s_p, child_addr,
@@ -290,7 +310,12 @@ static int remove_phase_b(
                 oc_xt_nd_index_get_kth(s_p, node_p,
                                         i,
                                         &dummy_key_p, &child_addr);
-                child_p = s_p->cfg_p->node_get(wu_p, child_addr);
+                if (rmv_p->lazy) {
+                    oc_xt_utl_detach_subtree(s_p, child_addr);
+                    rmv_p->n_detached++;
+                    continue;
+                }
+                child_p = s_p->cfg_p->node_get_xl(wu_p, child_addr);
                 oc_xt_utl_delete_subtree_b(wu_p, s_p, child_p);
             }
             
@@ -414,6 +439,7 @@ static void fix_b(
     {
         // move entries into [child_node_p] so as to have at least b+2
         oc_xt_nd_rebalance_skewed(wu_p, s_p, child_p, left_p);
+        oc_xt_nd_index_merge_kth_gaps(s_p, father_p, kth-1);
 
         // correct the pointer to [child_p]
         oc_xt_nd_index_set_kth(s_p, father_p, kth,
@@ -428,6 +454,7 @@ static void fix_b(
     {        
         // move entries into [child_node_p] so as to have at least b+2
         oc_xt_nd_rebalance_skewed(wu_p, s_p, child_p, right_p);
+        oc_xt_nd_index_merge_kth_gaps(s_p, father_p, kth);
 
         // correct the pointer to [right_p]
         oc_xt_nd_index_set_kth(s_p, father_p, kth+1,
@@ -444,6 +471,7 @@ static void fix_b(
      */
     if (left_p != NULL) {
         oc_xt_nd_move_and_dealloc(wu_p, s_p, child_p, left_p);
+        oc_xt_nd_index_merge_kth_gaps(s_p, father_p, kth-1);
         left_p = NULL;
         
         // fix the pointer to [child_p]
@@ -456,6 +484,7 @@ static void fix_b(
         goto done;
     } else {
         oc_xt_nd_move_and_dealloc(wu_p, s_p, child_p, right_p);
+        oc_xt_nd_index_merge_kth_gaps(s_p, father_p, kth);
         right_p = NULL;
         
         // fix the pointer to [child_p]
@@ -699,6 +728,7 @@ static Oc_xt_num combine_problematic_children(
         
         // 1. merge the two nodes together into [left_p]
         oc_xt_nd_move_and_dealloc(wu_p, s_p, left_p, right_p);
+        oc_xt_nd_index_merge_kth_gaps(s_p, father_p, kth);
         
         // fix the pointer to [left_p], not strictly necessary
         oc_xt_nd_index_set_kth(s_p, father_p, kth,
@@ -725,6 +755,7 @@ static Oc_xt_num combine_problematic_children(
         
         // 2. merge the edge keys to the node with less entries
         oc_xt_nd_move_min_key(wu_p, s_p, left_p, right_p);
+        oc_xt_nd_index_merge_kth_gaps(s_p, father_p, kth);
         
         // update the pointer to the larger node
         oc_xt_nd_index_set_kth(s_p, father_p, 
@@ -739,6 +770,7 @@ static Oc_xt_num combine_problematic_children(
     } else {
         // 2. merge the edge keys on the smaller node
         oc_xt_nd_move_max_key(wu_p, s_p, right_p, left_p);
+        oc_xt_nd_index_merge_kth_gaps(s_p, father_p, kth);
         
         // update the pointer to the smaller node
         oc_xt_nd_index_set_kth(s_p, father_p, 
@@ -806,7 +838,13 @@ static Oc_xt_num restore_root_b(
             } else {
                 // the child does not fit inside the root
                 // split the child in two
-                Oc_xt_node *right_p = oc_xt_nd_split(wu_p, s_p, child_p);
+                Oc_xt_node *right_p;
+
+                // the child is modified, COW it
+                oc_xt_nd_release(wu_p, s_p, child_p);
+                child_p = oc_xt_nd_get_for_write(wu_p, s_p, child_addr,
+                                                 s_p->root_node_p, 0);
+                right_p = oc_xt_nd_split(wu_p, s_p, child_p);
             
                 oc_xt_nd_index_replace_w2(wu_p, s_p, s_p->root_node_p,
                                           0,  // the minimal index is at zero
@@ -1021,11 +1059,12 @@ static void restore_b(
 
 
 /**********************************************************************/
-int oc_xt_op_remove_range_b(
+static int remove_range_b(
     struct Oc_wu *wu_p,
     Oc_xt_state *s_p,
     struct Oc_xt_key *min_key_p,
-    struct Oc_xt_key *max_key_p)
+    struct Oc_xt_key *max_key_p,
+    bool lazy)
 {
     int rc;
     Oc_xt_remove rmv;
@@ -1037,6 +1076,7 @@ int oc_xt_op_remove_range_b(
     memset(&rmv, 0, sizeof(rmv));
     rmv.min_key_p = min_key_p;
     rmv.max_key_p = max_key_p;
+    rmv.lazy = lazy;
     rmv.spill_area.flag = FALSE;
     rmv.spill_area.key_p = (struct Oc_xt_key*) alloca(s_p->cfg_p->key_size);
     rmv.spill_area.rcrd_p = (struct Oc_xt_rcrd*) alloca(s_p->cfg_p->rcrd_size);
@@ -1062,14 +1102,17 @@ int oc_xt_op_remove_range_b(
         // phase 1: remove entries
         rc = remove_phase_b(wu_p, s_p, &rmv, s_p->root_node_p, &rmv_all);
         
-        if (0 == rc) {
+        if (0 == rc && 0 == rmv.n_detached && !rmv_all) {
             // Nothing was removed from the tree
             // we are done
             oc_xt_nd_release(wu_p, s_p, s_p->root_node_p);
         }
         else if (rmv_all) {
             // We need to remove all the keys in the tree
-            oc_xt_utl_delete_all_b(wu_p, s_p);
+            if (lazy)
+                oc_xt_utl_detach_all(wu_p, s_p);
+            else
+                oc_xt_utl_delete_all_b(wu_p, s_p);
             oc_xt_nd_set_leaf(s_p, s_p->root_node_p);
             oc_xt_nd_release(wu_p, s_p, s_p->root_node_p);            
         }
@@ -1092,6 +1135,9 @@ int oc_xt_op_remove_range_b(
 
             // restore the edges
             restore_b(wu_p, s_p, &rmv);
+
+            // The extent preceding the range now owns a larger gap
+            oc_xt_op_find_gap_note_hole_b(wu_p, s_p, rmv.min_key_p);
         }
     }
 
@@ -1106,3 +1152,22 @@ int oc_xt_op_remove_range_b(
     return rc;
 }
 
+int oc_xt_op_remove_range_b(
+    struct Oc_wu *wu_p,
+    Oc_xt_state *s_p,
+    struct Oc_xt_key *min_key_p,
+    struct Oc_xt_key *max_key_p)
+{
+    return remove_range_b(wu_p, s_p, min_key_p, max_key_p, FALSE);
+}
+
+void oc_xt_op_remove_range_lazy_b(
+    struct Oc_wu *wu_p,
+    Oc_xt_state *s_p,
+    struct Oc_xt_key *min_key_p,
+    struct Oc_xt_key *max_key_p)
+{
+    remove_range_b(wu_p, s_p, min_key_p, max_key_p, TRUE);
+}
+
+/**********************************************************************/
@@ -44,4 +44,14 @@ int oc_xt_op_remove_range_b(
     struct Oc_xt_key *min_key_p,
     struct Oc_xt_key *max_key_p);
 
+/* Like [oc_xt_op_remove_range_b], but sub-trees that are fully covered
+ * by the range are detached and queued for deletion. Only the two edge
+ * paths are visited.
+ */
+void oc_xt_op_remove_range_lazy_b(
+    struct Oc_wu *wu_p,
+    Oc_xt_state *s_p,
+    struct Oc_xt_key *min_key_p,
+    struct Oc_xt_key *max_key_p);
+
 #endif
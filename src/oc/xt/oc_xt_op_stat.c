@@ -113,9 +113,9 @@ static void collect_statistics(
             oc_xt_nd_index_get_kth(s_p, node_p, i,
                                     &tmp_key,
                                     &child_addr);
-            child_node_p = s_p->cfg_p->node_get(wu_p, child_addr);
+            child_node_p = oc_xt_nd_get_for_read(wu_p, s_p, child_addr);
             collect_statistics (wu_p, s_p, stat_p, child_node_p);
-            s_p->cfg_p->node_release(wu_p, child_node_p);
+            oc_xt_nd_release(wu_p, s_p, child_node_p);
 
 // asserting that the tree is balanced 
             oc_utl_debugassert ((local_depth == 0) || (local_depth == stat_p->tmp_depth+1));
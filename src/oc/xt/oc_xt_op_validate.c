@@ -38,11 +38,16 @@
 /* The algorithm is: decend through the tree and very range invariants.
  * If an index node has key K pointing to a subnode N then N must include
  * keys only between K and the key after it. 
+ *
+ * A second, in-order, pass checks the gap bounds. The gap following an
+ * extent must not exceed any bound on the path to that extent. The
+ * gap following the last extent is infinite.
  */
 /**********************************************************************/
 #include <string.h>
 #include <alloca.h>
 
+#include "oc_utl.h"
 #include "oc_xt_int.h"
 #include "oc_xt_op_validate.h"
 #include "oc_xt_nd.h"
@@ -51,6 +56,12 @@ typedef struct Range {
     struct Oc_xt_key *lo_p, *hi_p; // place to store the keys
 } Range;
 
+typedef struct Gap_check {
+    bool seen;                      // has an extent been seen yet
+    struct Oc_xt_key *end_key_p;    // the end offset of the previous extent
+    uint64 bound;                   // the bound on the gap that follows it
+} Gap_check;
+
 
 /**********************************************************************/
 // validate the internal structure of a node
@@ -174,9 +185,64 @@ static bool validate_node(
                                         &dummy);
             }
             
-            child_node_p = s_p->cfg_p->node_get(wu_p, child_addr);
+            child_node_p = oc_xt_nd_get_for_read(wu_p, s_p, child_addr);
             rc = validate_node(wu_p, s_p, child_node_p, &child_range);
-            s_p->cfg_p->node_release(wu_p, child_node_p);
+            oc_xt_nd_release(wu_p, s_p, child_node_p);
+            if (FALSE == rc)
+                return rc;
+        }
+        return TRUE;
+    }
+}
+
+// check the gap bounds of the subtree of [node_p], [bound] is the bound above it
+static bool validate_gaps(
+    struct Oc_wu *wu_p,
+    Oc_xt_state *s_p,
+    Oc_xt_node *node_p,
+    uint64 bound,
+    Gap_check *gc_p)
+{
+    int i;
+    int num_entries = oc_xt_nd_num_entries(s_p, node_p);
+    
+    if (oc_xt_nd_is_leaf(s_p, node_p)) {
+        struct Oc_xt_key *key_p;
+        struct Oc_xt_rcrd *rcrd_p;
+        uint64 gap;
+        
+        for (i=0; i< num_entries; i++) {
+            oc_xt_nd_leaf_get_kth(s_p, node_p, i, &key_p, &rcrd_p);
+            if (gc_p->seen) {
+                gap = oc_xt_nd_gap_between(s_p, gc_p->end_key_p, key_p);
+                if (gap > gc_p->bound) {
+                    printf("    // gap violation gap=%Lu > bound=%Lu before %s\n",
+                           gap, gc_p->bound,
+                           oc_xt_nd_string_of_key(s_p, key_p));
+                    return FALSE;
+                }
+            }
+            s_p->cfg_p->rcrd_end_offset(key_p, rcrd_p, gc_p->end_key_p);
+            gc_p->bound = bound;
+            gc_p->seen = TRUE;
+        }
+        return TRUE;
+    }
+    else {
+        struct Oc_xt_key *dummy_key_p;
+        uint64 child_addr;
+        Oc_xt_node *child_node_p;
+        bool rc;
+        
+        for (i=0; i< num_entries; i++) {
+            oc_xt_nd_index_get_kth(s_p, node_p, i, &dummy_key_p, &child_addr);
+
+            child_node_p = oc_xt_nd_get_for_read(wu_p, s_p, child_addr);
+            rc = validate_gaps(wu_p, s_p, child_node_p,
+                               MIN(bound,
+                                   oc_xt_nd_index_get_kth_gap(s_p, node_p, i)),
+                               gc_p);
+            oc_xt_nd_release(wu_p, s_p, child_node_p);
             if (FALSE == rc)
                 return rc;
         }
@@ -189,6 +255,7 @@ bool oc_xt_op_validate_b(
     Oc_xt_state *s_p)
 {
     Range r;
+    Gap_check gc;
     bool rc;
     
     if (oc_xt_nd_num_entries(s_p, s_p->root_node_p) == 0) {
@@ -198,6 +265,18 @@ bool oc_xt_op_validate_b(
         r.lo_p = oc_xt_nd_min_key(s_p, s_p->root_node_p);
         r.hi_p = NULL;
         rc = validate_node(wu_p, s_p, s_p->root_node_p, &r);
+
+        if (rc) {
+            memset(&gc, 0, sizeof(gc));
+            gc.end_key_p = (struct Oc_xt_key *) alloca(s_p->cfg_p->key_size);
+            rc = validate_gaps(wu_p, s_p, s_p->root_node_p,
+                               OC_XT_ND_GAP_INF, &gc);
+            if (rc && gc.bound != OC_XT_ND_GAP_INF) {
+                printf("    // gap violation, the last gap is bounded by %Lu\n",
+                       gc.bound);
+                rc = FALSE;
+            }
+        }
     }
 
     return rc;
@@ -0,0 +1,218 @@
+/**************************************************************/
+/*
+ * Copyright (c) 2014-2015, Ohad Rodeh, IBM Research
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer. 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution. 
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies, 
+ * either expressed or implied, of IBM Research.
+ * 
+ */
+/**************************************************************/
+/**********************************************************************/
+/* OC_XT_OP_VALIDATE_CLONES.C  
+ *
+ * Validate that a set of clones of an x-tree are correct. 
+ */
+/**********************************************************************/
+/* Validate each tree separately and then check that the free-space
+ * counts are correct. A table maps each node address to the number of
+ * times the node is pointed-to from the set of trees.
+ */
+/**********************************************************************/
+#include <string.h>
+#include <stdlib.h>
+
+#include "oc_utl.h"
+#include "oc_utl_rhtbl.h"
+#include "oc_xt_int.h"
+#include "oc_xt_op_validate.h"
+#include "oc_xt_op_validate_clones.h"
+#include "oc_xt_nd.h"
+
+/**********************************************************************/
+typedef struct Label {
+    uint64 addr;
+    int cnt;
+} Label;
+
+static Oc_utl_rhtbl label_htbl;
+
+static uint64 label_hash(void *_key);
+static bool label_compare(void *_elem, void *_key);
+static bool label_free(void *_elem, void *_data);
+static void inc_b(struct Oc_wu *wu_p,
+                  struct Oc_xt_state *s_p,
+                  Oc_xt_node *node_p);
+static bool compare_b(struct Oc_wu *wu_p,
+                      struct Oc_xt_state *s_p,
+                      Oc_xt_node *node_p);
+
+/**********************************************************************/
+
+static uint64 label_hash(void *_key)
+{
+    return oc_utl_rhtbl_hash_u64(*((uint64*) _key));
+}
+
+static bool label_compare(void *_elem, void *_key)
+{
+    return (((Label*)_elem)->addr == *((uint64*) _key));
+}
+
+static bool label_free(void *_elem, void *_data)
+{
+    free(_elem);
+    return TRUE;
+}
+
+/* count how many times a node is pointed-to.
+ * Recurse through a tree.
+ * Perform:
+ *    - if a node has no label, then set it to one
+ *      and recurse into it.
+ *    - if a node already has a label, then
+ *      increment it and do not recurse.
+ */
+static void inc_b(struct Oc_wu *wu_p,
+                  struct Oc_xt_state *s_p,
+                  Oc_xt_node *node_p)
+{
+    Label *label_p;
+    int num_entries, i;
+    
+    label_p = (Label*) oc_utl_rhtbl_lookup(&label_htbl,
+                                           (void*)&node_p->disk_addr);
+    if (label_p != NULL) {
+        /* This node has already been labeled.
+         * increment the counter by one. 
+         */
+        label_p->cnt++;
+        return;
+    }
+
+    // This is the first time anyone has reached this node
+    label_p = (Label*) malloc(sizeof(Label));
+    oc_utl_assert(label_p);
+    label_p->addr = node_p->disk_addr;
+    label_p->cnt = 1;
+    oc_utl_rhtbl_insert(&label_htbl, (void*)&label_p->addr, (void*)label_p);
+
+    // if it is an index node then recurse down
+    if (!oc_xt_nd_is_leaf(s_p, node_p))
+    {
+        num_entries = oc_xt_nd_num_entries(s_p, node_p);
+        for (i=0; i<num_entries; i++) {
+            Oc_xt_node *child_p;
+            struct Oc_xt_key *dummy_key_p;
+            uint64 addr;
+            
+            oc_xt_nd_index_get_kth(s_p, node_p, i, &dummy_key_p, &addr); 
+            child_p = oc_xt_nd_get_for_read(wu_p, s_p, addr);
+            inc_b(wu_p, s_p, child_p);
+            oc_xt_nd_release(wu_p, s_p, child_p);
+        }
+    }
+}    
+
+// Compare the computed ref-count with the free-space count
+static bool compare_b(struct Oc_wu *wu_p,
+                      struct Oc_xt_state *s_p,
+                      Oc_xt_node *node_p)
+{
+    int i;
+    int fs_refcount;
+    Label *label_p;
+
+    // Check if the count for this node is correct
+    label_p = (Label*) oc_utl_rhtbl_lookup(&label_htbl,
+                                           (void*)&node_p->disk_addr);
+    oc_utl_assert(label_p);
+    fs_refcount = s_p->cfg_p->fs_get_refcount(wu_p, node_p->disk_addr);    
+    if (label_p->cnt != fs_refcount) {
+        printf("node=%Lu label=%d  fs_refcount=%d\n",
+               node_p->disk_addr, label_p->cnt, fs_refcount); 
+        return FALSE;
+    }
+
+    // If it is an index node then recurse into the childern
+    if (!oc_xt_nd_is_leaf(s_p, node_p))
+    {
+        int num_entries = oc_xt_nd_num_entries(s_p, node_p);
+        for (i=0; i<num_entries; i++)
+        {
+            Oc_xt_node *child_p;
+            struct Oc_xt_key *dummy_key_p;
+            uint64 addr;
+            bool rc;
+            
+            oc_xt_nd_index_get_kth(s_p, node_p, i, &dummy_key_p, &addr); 
+            child_p = oc_xt_nd_get_for_read(wu_p, s_p, addr);
+            rc = compare_b(wu_p, s_p, child_p);
+            oc_xt_nd_release(wu_p, s_p, child_p);
+
+            if (!rc)
+                return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+/**********************************************************************/
+
+bool oc_xt_op_validate_clones_b(
+    struct Oc_wu *wu_p,
+    int n_clones,
+    struct Oc_xt_state *st_array[])
+{
+    int i;
+    bool rc = TRUE;
+    
+    // First validate each tree seperately
+    for (i=0; i<n_clones; i++) {
+        rc = oc_xt_op_validate_b(wu_p, st_array[i]);
+        if (!rc) return FALSE;
+    }
+
+    /* now check the free-space counts
+     * phase 1: count how many times a node is pointed-to.
+     * phase 2: traverse all the trees and check that the
+     *       label is equal to the free-space count.
+     *       if not, print-out the incorrect case. 
+     */
+    oc_utl_rhtbl_create(&label_htbl, 1024, FALSE, label_hash, label_compare);
+
+    for (i=0; i < n_clones; i++)
+        inc_b(wu_p, st_array[i], st_array[i]->root_node_p);
+    
+    for (i=0; i < n_clones && rc; i++)
+        rc = compare_b(wu_p, st_array[i], st_array[i]->root_node_p);
+
+    oc_utl_rhtbl_iter_discard(&label_htbl, label_free, NULL);
+    oc_utl_rhtbl_free(&label_htbl);
+
+    return rc;
+}
+
+/**********************************************************************/
@@ -48,8 +48,16 @@ const char *oc_xt_string_of_trace_event(int ev_i)
         CASE(OC_EV_XT_DELETE);
         CASE(OC_EV_XT_COW_ROOT_AND_UPDATE);        
         CASE(OC_EV_XT_LOOKUP_RANGE);
+        CASE(OC_EV_XT_LOOKUP_OFS);
+        CASE(OC_EV_XT_CURSOR_OPEN);
+        CASE(OC_EV_XT_CURSOR_CLOSE);
         CASE(OC_EV_XT_INSERT_RANGE);
+        CASE(OC_EV_XT_INSERT_MULTI);
+        CASE(OC_EV_XT_BULK_LOAD);
         CASE(OC_EV_XT_REMOVE_RANGE);
+        CASE(OC_EV_XT_REMOVE_RANGE_LAZY);
+        CASE(OC_EV_XT_RECLAIM);
+        CASE(OC_EV_XT_FIND_GAP);
         CASE(OC_EV_XT_ATTR_GET);
         CASE(OC_EV_XT_ATTR_SET);
         
@@ -57,6 +65,8 @@ const char *oc_xt_string_of_trace_event(int ev_i)
         CASE(OC_EV_XT_QUERY);
         CASE(OC_EV_XT_INIT_CFG);
         CASE(OC_EV_XT_DESTROY_STATE);
+        CASE(OC_EV_XT_CLONE);
+        CASE(OC_EV_XT_VALIDATE_CLONES);
         
         CASE(OC_EV_XT_LEAF_SPLIT);
         CASE(OC_EV_XT_ROOT_SPLIT);
@@ -94,6 +104,11 @@ const char *oc_xt_string_of_trace_event(int ev_i)
         CASE(OC_EV_XT_FILL_SINGLE_LEAF_1);
         CASE(OC_EV_XT_FILL_SINGLE_LEAF_2);
         CASE(OC_EV_XT_FILL_SINGLE_LEAF_3);
+        CASE(OC_EV_XT_ND_MERGE_ADJACENT);
+        CASE(OC_EV_XT_MERGE_WITH_SIBLING);
+        CASE(OC_EV_XT_FILL_FROM_BATCH);
+        CASE(OC_EV_XT_RAISE_GAP);
+        CASE(OC_EV_XT_TIGHTEN_GAP);
 
         CASE(OC_EV_XT_REMOVE_RNG);
     default:
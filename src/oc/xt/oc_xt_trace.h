@@ -39,13 +39,23 @@ typedef enum Oc_xt_trace_event {
     OC_EV_XT_DELETE,
     OC_EV_XT_COW_ROOT_AND_UPDATE,    
     OC_EV_XT_LOOKUP_RANGE,
+    OC_EV_XT_LOOKUP_OFS,
+    OC_EV_XT_CURSOR_OPEN,
+    OC_EV_XT_CURSOR_CLOSE,
     OC_EV_XT_INSERT_RANGE,
+    OC_EV_XT_INSERT_MULTI,
+    OC_EV_XT_BULK_LOAD,
     OC_EV_XT_REMOVE_RANGE,
+    OC_EV_XT_REMOVE_RANGE_LAZY,
+    OC_EV_XT_RECLAIM,
+    OC_EV_XT_FIND_GAP,
     OC_EV_XT_ATTR_GET,
     OC_EV_XT_ATTR_SET,       
     OC_EV_XT_QUERY,
     OC_EV_XT_INIT_CFG,
     OC_EV_XT_DESTROY_STATE,
+    OC_EV_XT_CLONE,
+    OC_EV_XT_VALIDATE_CLONES,
     
     OC_EV_XT_LEAF_SPLIT,
     OC_EV_XT_ROOT_SPLIT,
@@ -83,6 +93,11 @@ typedef enum Oc_xt_trace_event {
     OC_EV_XT_FILL_SINGLE_LEAF_1,
     OC_EV_XT_FILL_SINGLE_LEAF_2,
     OC_EV_XT_FILL_SINGLE_LEAF_3,
+    OC_EV_XT_ND_MERGE_ADJACENT,
+    OC_EV_XT_MERGE_WITH_SIBLING,
+    OC_EV_XT_FILL_FROM_BATCH,
+    OC_EV_XT_RAISE_GAP,
+    OC_EV_XT_TIGHTEN_GAP,
 
     OC_EV_XT_REMOVE_RNG,
 } Oc_xt_trace_event;
@@ -41,6 +41,14 @@
 #include "oc_utl.h"
 #include "oc_xt_utl.h"
 #include "oc_xt_nd.h"
+#include "pl_mm_int.h"
+/**********************************************************************/
+// A sub-tree waiting for deletion
+typedef struct Oc_xt_detached {
+    Ss_slist_node node;
+    uint64 addr;
+} Oc_xt_detached;
+
 /**********************************************************************/
 
 // Check if a node is fully covered by the range [min_key_p] .. [max_key_p]
@@ -65,17 +73,23 @@ bool oc_xt_utl_covered(
 /* Delete a sub-tree rooted at [addr].
  * 
  * Recursive decent through the tree. Remove the leaves and perform
- * the user-defined "data_release" function for all data. Deallocate all
- * internal nodes. 
+ * the user-defined "rcrd_release" function for all records. Deallocate all
+ * internal nodes. Nodes shared with a clone only have their ref-count
+ * reduced.
  */
 void oc_xt_utl_delete_subtree_b(
     struct Oc_wu *wu_p,
     struct Oc_xt_state *s_p,
     Oc_xt_node *node_p)
 {
-    /* recurse down and then delete it on the way back up.
+    int fs_refcnt = s_p->cfg_p->fs_get_refcount(wu_p, node_p->disk_addr);
+
+    oc_utl_debugassert(fs_refcnt > 0);
+
+    /* If this node is referenced from a single clone only, 
+     * Then recurse down and then delete it on the way back up.
      */
-    if (!oc_xt_nd_is_leaf(s_p, node_p)) {
+    if (1 == fs_refcnt && !oc_xt_nd_is_leaf(s_p, node_p)) {
         // An index node, recurse through its children
         int i;
         int num_entries = oc_xt_nd_num_entries(s_p, node_p);
@@ -87,13 +101,13 @@ void oc_xt_utl_delete_subtree_b(
             oc_xt_nd_index_get_kth(s_p, node_p, i,
                                     &dummy_key_p,
                                     &child_addr);
-            child_node_p = s_p->cfg_p->node_get(wu_p, child_addr);
+            child_node_p = s_p->cfg_p->node_get_xl(wu_p, child_addr);
             oc_xt_utl_delete_subtree_b(wu_p, s_p, child_node_p);
         }
     }
     
-    // Delete this node
-    oc_xt_nd_delete(wu_p, s_p, node_p);
+    // reduce the ref-count on this node
+    oc_xt_nd_delete_locked(wu_p, s_p, node_p);
 }
 
 /* Delete all the key-value pairs in the tree. 
@@ -116,7 +130,7 @@ void oc_xt_utl_delete_all_b(
             oc_xt_nd_index_get_kth(s_p, s_p->root_node_p, i,
                                     &dummy_key_p,
                                    &child_addr);
-            child_node_p = s_p->cfg_p->node_get(wu_p, child_addr);
+            child_node_p = s_p->cfg_p->node_get_xl(wu_p, child_addr);
             oc_xt_utl_delete_subtree_b(wu_p, s_p, child_node_p);
         }
     }
@@ -129,3 +143,56 @@ void oc_xt_utl_delete_all_b(
 
 /**********************************************************************/
 
+void oc_xt_utl_detach_subtree(
+    struct Oc_xt_state *s_p,
+    uint64 addr)
+{
+    Oc_xt_detached *det_p;
+
+    det_p = (Oc_xt_detached*) pl_mm_malloc(sizeof(Oc_xt_detached));
+    memset(det_p, 0, sizeof(Oc_xt_detached));
+    det_p->addr = addr;
+    ssslist_add_tail(&s_p->detached, &det_p->node);
+}
+
+void oc_xt_utl_detach_all(
+    struct Oc_wu *wu_p,
+    struct Oc_xt_state *s_p)
+{
+    int num_entries = oc_xt_nd_num_entries(s_p, s_p->root_node_p);
+
+    if (!oc_xt_nd_is_leaf(s_p, s_p->root_node_p)) {
+        int i;
+        struct Oc_xt_key *dummy_key_p;
+        uint64 child_addr;
+        
+        for (i=0; i< num_entries; i++) {
+            oc_xt_nd_index_get_kth(s_p, s_p->root_node_p, i,
+                                   &dummy_key_p,
+                                   &child_addr);
+            oc_xt_utl_detach_subtree(s_p, child_addr);
+        }
+    }
+    
+    // Remove all the entries from the root node
+    oc_xt_nd_remove_range_of_entries(wu_p, s_p,
+                                     s_p->root_node_p,
+                                     0, num_entries - 1);
+}
+
+bool oc_xt_utl_pop_detached(
+    struct Oc_xt_state *s_p,
+    uint64 *addr_po)
+{
+    Oc_xt_detached *det_p;
+    
+    det_p = (Oc_xt_detached*) ssslist_remove_head(&s_p->detached);
+    if (NULL == det_p)
+        return FALSE;
+
+    *addr_po = det_p->addr;
+    pl_mm_free(det_p);
+    return TRUE;
+}
+
+/**********************************************************************/
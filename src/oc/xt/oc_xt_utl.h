@@ -52,7 +52,7 @@ bool oc_xt_utl_covered(
 /* Delete a sub-tree rooted at [node_p].
  *
  * assumptions:
- *  - [node_p] is unlocked
+ *  - [node_p] is locked for write
  *  - The whole tree is locked
  *
  * [node_p] is released after the operation.
@@ -76,4 +76,33 @@ void oc_xt_utl_delete_all_b(
     struct Oc_wu *wu_p,
     struct Oc_xt_state *s_p);
 
+/* Detach the sub-tree rooted at [addr] from the tree. The sub-tree is
+ * queued in the tree state, it is deleted later by
+ * [oc_xt_utl_reclaim_b]. The caller must remove the entry pointing
+ * to it.
+ *
+ * assumptions:
+ *  - The whole tree is locked
+ */
+void oc_xt_utl_detach_subtree(
+    struct Oc_xt_state *s_p,
+    uint64 addr);
+
+/* Like [oc_xt_utl_delete_all_b], but the sub-trees of the root are
+ * detached instead of deleted.
+ */
+void oc_xt_utl_detach_all(
+    struct Oc_wu *wu_p,
+    struct Oc_xt_state *s_p);
+
+/* Take the oldest detached sub-tree off the queue, return its
+ * address in [addr_po]. Return FALSE if the queue is empty.
+ *
+ * assumptions:
+ *  - The whole tree is locked
+ */
+bool oc_xt_utl_pop_detached(
+    struct Oc_xt_state *s_p,
+    uint64 *addr_po);
+
 #endif
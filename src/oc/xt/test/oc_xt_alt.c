@@ -470,3 +470,38 @@ uint64 oc_xt_alt_insert_b(
     return tot_len;
 }
 
+
+/******************************************************************/
+
+// find the first free gap of length [len] at, or above, [min_key_p]
+void oc_xt_alt_find_gap_b(
+    struct Oc_wu *wu_p,
+    Oc_xt_alt_state *s_p,
+    struct Oc_xt_key *min_key_p,
+    uint64 len,
+    struct Oc_xt_key *result_key_po)
+{
+    Oc_xt_alt_ext *crnt_p;
+    struct Oc_xt_key *end_key_p;
+
+    end_key_p = (struct Oc_xt_key*) alloca(s_p->cfg_p->key_size);
+    memcpy(result_key_po, min_key_p, s_p->cfg_p->key_size);
+    
+    for (crnt_p = (Oc_xt_alt_ext*)ssdlist_head(&s_p->list);
+         crnt_p != NULL;
+         crnt_p = (Oc_xt_alt_ext*)ssdlist_next(&crnt_p->link))
+    {
+        s_p->cfg_p->rcrd_end_offset(crnt_p->key_p, crnt_p->rcrd_p, end_key_p);
+        if (s_p->cfg_p->key_compare(end_key_p, result_key_po) == 1)
+            // the extent is below the candidate
+            continue;
+
+        if (s_p->cfg_p->key_compare(result_key_po, crnt_p->key_p) == 1 &&
+            s_p->cfg_p->key_distance(result_key_po, crnt_p->key_p) >= len)
+            // the gap before this extent is large enough
+            return;
+
+        // move the candidate past this extent
+        s_p->cfg_p->key_inc(end_key_p, result_key_po);
+    }
+}
@@ -88,4 +88,11 @@ uint64 oc_xt_alt_remove_range_b(
     struct Oc_xt_key *min_key_p,
     struct Oc_xt_key *max_key_p);
 
+void oc_xt_alt_find_gap_b(
+    struct Oc_wu *wu_p,
+    Oc_xt_alt_state *s_p,
+    struct Oc_xt_key *min_key_p,
+    uint64 len,
+    struct Oc_xt_key *result_key_po);
+
 #endif
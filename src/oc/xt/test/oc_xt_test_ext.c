@@ -0,0 +1,471 @@
+/**************************************************************/
+/*
+ * Copyright (c) 2014-2015, Ohad Rodeh, IBM Research
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer. 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution. 
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies, 
+ * either expressed or implied, of IBM Research.
+ * 
+ */
+/**************************************************************/
+/**********************************************************************/
+/* OC_XT_TEST_EXT.C
+ *
+ * Test the x-tree with the built-in extent type. The tree is checked
+ * against a model, an array that holds the physical address of each
+ * offset. The tree may split and merge extents in its own way, so
+ * extents are compared with the model one offset at a time.
+ *
+ * Physical space comes from two free-space instances, one for the
+ * tree and one for the model. They start out the same, and allocate
+ * the same addresses as long as the tree releases exactly the units
+ * that the model drops.
+ */
+/**********************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "oc_utl.h"
+#include "oc_xt_int.h"
+#include "oc_xt_ext.h"
+#include "oc_xt_test_fs.h"
+#include "oc_xt_test_nd.h"
+#include "oc_xt_test_utl.h"
+#include "oc_xt_test_ext.h"
+
+/**********************************************************************/
+// the longest extent inserted by the tests, and the most looked up
+#define EXT_MAX_LEN (20)
+#define EXT_MAX_FOUND (30)
+
+// an offset that is not mapped in the model
+#define EXT_HOLE ((uint32)-1)
+
+static Oc_xt_cfg cfg;
+static Oc_xt_state state;
+
+static struct Oc_xt_test_fs_ctx *fs_ctx_p, *fs_model_p;
+
+// the physical address of each offset, EXT_HOLE if it is not mapped
+static uint32 *model;
+static uint32 model_len;
+
+/**********************************************************************/
+
+static void ext_rcrd_release(Oc_wu *wu_p,
+                             struct Oc_xt_key *key_p,
+                             struct Oc_xt_rcrd *rcrd_p)
+{
+    Oc_xt_ext_rcrd *r_p = oc_xt_ext_rcrd(rcrd_p);
+
+    oc_xt_test_fs_dealloc(fs_ctx_p, (uint32) r_p->addr, (uint32) r_p->len);
+}
+
+static void ext_rcrd_inc_refcount(Oc_wu *wu_p,
+                                  struct Oc_xt_key *key_p,
+                                  struct Oc_xt_rcrd *rcrd_p)
+{
+    Oc_xt_ext_rcrd *r_p = oc_xt_ext_rcrd(rcrd_p);
+
+    oc_xt_test_fs_inc_refcount(fs_ctx_p, (uint32) r_p->addr, (uint32) r_p->len);
+}
+
+static void fs_query_alloc( struct Oc_rm_resource *r_p, int n_pages)
+{
+    return;
+}
+
+static void fs_query_dealloc( struct Oc_rm_resource *r_p, int n_pages)
+{
+    return;
+}
+
+/**********************************************************************/
+
+static uint32 model_get(uint64 ofs)
+{
+    if (ofs >= model_len)
+        return EXT_HOLE;
+    return model[ofs];
+}
+
+// Unmap [lo_key, hi_key] in the model, return how many offsets were mapped
+static uint64 model_unmap(uint64 lo_key, uint64 hi_key)
+{
+    uint64 ofs, n = 0;
+
+    for (ofs = lo_key; ofs <= hi_key && ofs < model_len; ofs++) {
+        if (model[ofs] != EXT_HOLE) {
+            oc_xt_test_fs_dealloc(fs_model_p, model[ofs], 1);
+            model[ofs] = EXT_HOLE;
+            n++;
+        }
+    }
+    return n;
+}
+
+static void display(Oc_wu *wu_p)
+{
+    oc_xt_dbg_output_b(wu_p, &state, (struct Oc_utl_file*)stdout, "Tree_ext");
+    oc_xt_dbg_output_end((struct Oc_utl_file*)stdout);
+}
+
+// Check that the tree is valid, and holds the same blocks as the model
+static void check_tree(Oc_wu *wu_p, char *op_p, uint32 lo_key, uint32 hi_key)
+{
+    if (!oc_xt_dbg_validate_b(wu_p, &state)) {
+        display(wu_p);
+        ERR(("invalid b-tree after %s(%lu, %lu)", op_p, lo_key, hi_key));
+    }
+    if (!oc_xt_test_fs_compare(fs_ctx_p, fs_model_p)) {
+        display(wu_p);
+        ERR(("the tree and the model hold different blocks after %s(%lu, %lu)",
+             op_p, lo_key, hi_key));
+    }
+}
+
+/* Check that the [num] extents in [key_array, rcrd_array] are sorted,
+ * lie inside [lo_key, hi_key], and map each offset as the model
+ * does. If [complete] is TRUE they must cover all the mapped offsets
+ * in the range; otherwise, those up to the end of the last extent.
+ */
+static bool ext_array_check(uint64 lo_key,
+                            uint64 hi_key,
+                            int num,
+                            Oc_xt_ext_key *key_array,
+                            Oc_xt_ext_rcrd *rcrd_array,
+                            bool complete)
+{
+    uint64 ofs = lo_key, j;
+    int i;
+
+    for (i=0; i<num; i++) {
+        if (0 == rcrd_array[i].len ||
+            key_array[i] < ofs ||
+            key_array[i] + rcrd_array[i].len - 1 > hi_key)
+            return FALSE;
+
+        // the gap before the extent is not mapped
+        for (; ofs < key_array[i]; ofs++)
+            if (model_get(ofs) != EXT_HOLE)
+                return FALSE;
+        for (j=0; j<rcrd_array[i].len; j++, ofs++)
+            if (model_get(ofs) != rcrd_array[i].addr + j)
+                return FALSE;
+    }
+
+    if (complete)
+        for (; ofs <= hi_key && ofs < model_len; ofs++)
+            if (model_get(ofs) != EXT_HOLE)
+                return FALSE;
+    return TRUE;
+}
+
+static void print_ext_array(int num,
+                            Oc_xt_ext_key *key_array,
+                            Oc_xt_ext_rcrd *rcrd_array)
+{
+    int i;
+
+    for (i=0; i<num; i++)
+        printf("  // xt] ext=%Lu-%Lu addr=%Lu\n",
+               key_array[i], key_array[i] + rcrd_array[i].len - 1,
+               rcrd_array[i].addr);
+}
+
+/**********************************************************************/
+
+void oc_xt_test_ext_init_module(void)
+{
+    fs_ctx_p = oc_xt_test_fs_create("ext", verbose);
+    fs_model_p = oc_xt_test_fs_create("ext-model", verbose);
+
+    // the key and record functions are filled in by the x-tree
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.builtin_ext = TRUE;
+    cfg.node_size = OC_XT_TEST_ND_SIZE;
+    cfg.root_fanout = max_root_fanout;
+    cfg.non_root_fanout = max_non_root_fanout;
+    cfg.min_num_ent = min_fanout;
+    cfg.node_alloc = oc_xt_test_nd_alloc;
+    cfg.node_dealloc = oc_xt_test_nd_dealloc;
+    cfg.node_get_sl = oc_xt_test_nd_get_sl;
+    cfg.node_get_xl = oc_xt_test_nd_get_xl;
+    cfg.node_release = oc_xt_test_nd_release;
+    cfg.node_mark_dirty = oc_xt_test_nd_mark_dirty;
+    cfg.fs_inc_refcount = oc_xt_test_nd_fs_inc_refcount;
+    cfg.fs_get_refcount = oc_xt_test_nd_fs_get_refcount;
+    cfg.rcrd_release = ext_rcrd_release;
+    cfg.rcrd_inc_refcount = ext_rcrd_inc_refcount;
+    cfg.fs_query_alloc = fs_query_alloc;
+    cfg.fs_query_dealloc = fs_query_dealloc;
+
+    oc_xt_init_config(&cfg);
+}
+
+void oc_xt_test_ext_create(Oc_wu *wu_p)
+{
+    uint32 i;
+
+    if (verbose) {
+        printf("// btree create (built-in extents)\n");
+        fflush(stdout);
+    }
+    model_len = max_int + 2 * EXT_MAX_LEN;
+    model = (uint32*) malloc(model_len * sizeof(uint32));
+    oc_utl_assert(model);
+    for (i=0; i<model_len; i++)
+        model[i] = EXT_HOLE;
+
+    oc_xt_init_state_b(NULL, &state, &cfg);
+    oc_xt_create_b(wu_p, &state);
+}
+
+void oc_xt_test_ext_delete(Oc_wu *wu_p)
+{
+    if (verbose) {
+        printf("// btree delete (built-in extents)\n");
+        fflush(stdout);
+    }
+    oc_xt_delete_b(wu_p, &state);
+    model_unmap(0, model_len - 1);
+    if (!oc_xt_test_fs_compare(fs_ctx_p, fs_model_p))
+        ERR(("the tree did not release all its blocks"));
+
+    free(model);
+    model = NULL;
+    model_len = 0;
+}
+
+/* Walk the whole tree, in windows that fit in a lookup, and compare
+ * it with the model.
+ */
+void oc_xt_test_ext_verify(Oc_wu *wu_p)
+{
+    Oc_xt_ext_key lo_key = 0, hi_key = model_len - 1;
+    Oc_xt_ext_key key_array[EXT_MAX_FOUND];
+    Oc_xt_ext_rcrd rcrd_array[EXT_MAX_FOUND];
+    int nkeys_found;
+
+    if (verbose) {
+        printf("// verify (built-in extents)\n");
+        fflush(stdout);
+    }
+    check_tree(wu_p, "verify", 0, hi_key);
+
+    while (1) {
+        oc_xt_lookup_range_b(wu_p, &state,
+                             (struct Oc_xt_key*)&lo_key,
+                             (struct Oc_xt_key*)&hi_key,
+                             EXT_MAX_FOUND,
+                             (struct Oc_xt_key*)key_array,
+                             (struct Oc_xt_rcrd*)rcrd_array,
+                             &nkeys_found);
+        if (!ext_array_check(lo_key, hi_key, nkeys_found,
+                             key_array, rcrd_array,
+                             nkeys_found < EXT_MAX_FOUND)) {
+            print_ext_array(nkeys_found, key_array, rcrd_array);
+            display(wu_p);
+            ERR(("the tree differs from the model, from offset %Lu", lo_key));
+        }
+        if (nkeys_found < EXT_MAX_FOUND)
+            break;
+        lo_key = key_array[nkeys_found-1] + rcrd_array[nkeys_found-1].len;
+    }
+}
+
+void oc_xt_test_ext_insert(Oc_wu *wu_p, uint32 key, uint32 len, bool check)
+{
+    Oc_xt_ext_key key64 = key;
+    Oc_xt_ext_rcrd rcrd;
+    uint64 rc1, rc2;
+    uint32 addr, i;
+
+    total_ops++;
+    oc_utl_assert(len > 0 && len <= EXT_MAX_LEN);
+    oc_utl_assert(key + len <= model_len);
+    if (verbose) {
+        printf("// insert_range (built-in) key=%lu len=%lu\n", key, len);
+        fflush(stdout);
+    }
+
+    addr = oc_xt_test_fs_alloc(fs_ctx_p, len);
+    if (oc_xt_test_fs_alloc(fs_model_p, len) != addr)
+        ERR(("the tree and the model allocated different blocks"));
+
+    rcrd.len = len;
+    rcrd.addr = addr;
+    rc1 = oc_xt_insert_range_b(wu_p, &state,
+                               (struct Oc_xt_key*)&key64,
+                               (struct Oc_xt_rcrd*)&rcrd);
+
+    rc2 = model_unmap(key, key + len - 1);
+    for (i=0; i<len; i++)
+        model[key + i] = addr + i;
+
+    if (!check) return;
+    check_tree(wu_p, "insert_range", key, key + len - 1);
+    if (rc1 != rc2) {
+        display(wu_p);
+        ERR(("mismatch in insert_range key=%lu len=%lu, rc1=%Lu rc2=%Lu",
+             key, len, rc1, rc2));
+    }
+}
+
+void oc_xt_test_ext_remove_range(Oc_wu *wu_p,
+                                 uint32 lo_key,
+                                 uint32 hi_key,
+                                 bool check)
+{
+    Oc_xt_ext_key lo64 = lo_key, hi64 = hi_key;
+    uint64 rc1, rc2;
+
+    total_ops++;
+    if (verbose) {
+        printf("// remove_range (built-in) lo_key=%lu hi_key=%lu\n",
+               lo_key, hi_key);
+        fflush(stdout);
+    }
+
+    rc1 = oc_xt_remove_range_b(wu_p, &state,
+                               (struct Oc_xt_key*)&lo64,
+                               (struct Oc_xt_key*)&hi64);
+    rc2 = model_unmap(lo_key, hi_key);
+
+    if (!check) return;
+    check_tree(wu_p, "remove_range", lo_key, hi_key);
+    if (rc1 != rc2) {
+        display(wu_p);
+        ERR(("mismatch in remove_range lo_key=%lu hi_key=%lu, rc1=%Lu rc2=%Lu",
+             lo_key, hi_key, rc1, rc2));
+    }
+}
+
+void oc_xt_test_ext_lookup_range(Oc_wu *wu_p,
+                                 uint32 lo_key,
+                                 uint32 hi_key,
+                                 bool check)
+{
+    Oc_xt_ext_key lo64 = lo_key, hi64 = hi_key;
+    Oc_xt_ext_key key_array[EXT_MAX_FOUND];
+    Oc_xt_ext_rcrd rcrd_array[EXT_MAX_FOUND];
+    int nkeys_found;
+
+    total_ops++;
+    if (verbose) {
+        printf("// lookup_range (built-in) [lo_key=%lu, hi_key=%lu]\n",
+               lo_key, hi_key);
+        fflush(stdout);
+    }
+
+    oc_xt_lookup_range_b(wu_p, &state,
+                         (struct Oc_xt_key*)&lo64,
+                         (struct Oc_xt_key*)&hi64,
+                         EXT_MAX_FOUND,
+                         (struct Oc_xt_key*)key_array,
+                         (struct Oc_xt_rcrd*)rcrd_array,
+                         &nkeys_found);
+
+    if (!check) return;
+    if (!ext_array_check(lo_key, hi_key, nkeys_found, key_array, rcrd_array,
+                         nkeys_found < EXT_MAX_FOUND)) {
+        print_ext_array(nkeys_found, key_array, rcrd_array);
+        display(wu_p);
+        ERR(("mismatch in lookup_range(%lu, %lu)", lo_key, hi_key));
+    }
+}
+
+void oc_xt_test_ext_lookup_ofs(Oc_wu *wu_p, uint32 key, bool check)
+{
+    Oc_xt_ext_key key64 = key, ext_key;
+    Oc_xt_ext_rcrd rcrd;
+    bool found;
+
+    total_ops++;
+    if (verbose) {
+        printf("// lookup_ofs (built-in) [key=%lu]\n", key);
+        fflush(stdout);
+    }
+
+    found = oc_xt_lookup_ofs_b(wu_p, &state,
+                               (struct Oc_xt_key*)&key64,
+                               (struct Oc_xt_key*)&ext_key,
+                               (struct Oc_xt_rcrd*)&rcrd);
+
+    if (!check) return;
+    if (found != (model_get(key) != EXT_HOLE) ||
+        (found &&
+         (key < ext_key ||
+          key > ext_key + rcrd.len - 1 ||
+          !ext_array_check(ext_key, ext_key + rcrd.len - 1, 1,
+                           &ext_key, &rcrd, TRUE)))) {
+        display(wu_p);
+        ERR(("mismatch in lookup_ofs(%lu) tree=%s model=%s",
+             key, found ? "hit" : "miss",
+             model_get(key) != EXT_HOLE ? "hit" : "miss"));
+    }
+}
+
+/* Read up to EXT_MAX_FOUND extents with a cursor. The cursor is closed
+ * before the range is exhausted if there are more.
+ */
+void oc_xt_test_ext_cursor(Oc_wu *wu_p,
+                           uint32 lo_key,
+                           uint32 hi_key,
+                           bool check)
+{
+    Oc_xt_ext_key lo64 = lo_key, hi64 = hi_key;
+    Oc_xt_ext_key key_array[EXT_MAX_FOUND];
+    Oc_xt_ext_rcrd rcrd_array[EXT_MAX_FOUND];
+    Oc_xt_cursor cur;
+    int nkeys_found = 0;
+
+    total_ops++;
+    if (verbose) {
+        printf("// cursor (built-in) [lo_key=%lu, hi_key=%lu]\n",
+               lo_key, hi_key);
+        fflush(stdout);
+    }
+
+    oc_xt_cursor_open_b(wu_p, &state, &cur,
+                        (struct Oc_xt_key*)&lo64,
+                        (struct Oc_xt_key*)&hi64);
+    while (nkeys_found < EXT_MAX_FOUND &&
+           oc_xt_cursor_next_b(wu_p, &cur,
+                               (struct Oc_xt_key*)&key_array[nkeys_found],
+                               (struct Oc_xt_rcrd*)&rcrd_array[nkeys_found]))
+        nkeys_found++;
+    oc_xt_cursor_close(wu_p, &cur);
+
+    if (!check) return;
+    if (!ext_array_check(lo_key, hi_key, nkeys_found, key_array, rcrd_array,
+                         nkeys_found < EXT_MAX_FOUND)) {
+        print_ext_array(nkeys_found, key_array, rcrd_array);
+        display(wu_p);
+        ERR(("mismatch in cursor(%lu, %lu)", lo_key, hi_key));
+    }
+}
+
+/**********************************************************************/
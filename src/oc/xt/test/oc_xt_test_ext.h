@@ -0,0 +1,67 @@
+/**************************************************************/
+/*
+ * Copyright (c) 2014-2015, Ohad Rodeh, IBM Research
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer. 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution. 
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies, 
+ * either expressed or implied, of IBM Research.
+ * 
+ */
+/**************************************************************/
+/**********************************************************************/
+/* OC_XT_TEST_EXT.H
+ *
+ * Test the x-tree with the built-in extent type. The tree is checked
+ * against a model, an array that holds the physical address of each
+ * offset.
+ */
+/**********************************************************************/
+#ifndef OC_XT_TEST_EXT_H
+#define OC_XT_TEST_EXT_H
+
+#include "pl_base.h"
+#include "oc_rm_s.h"
+#include "oc_wu_s.h"
+
+// setup, called once after oc_xt_test_utl_init_module
+void oc_xt_test_ext_init_module(void);
+
+void oc_xt_test_ext_create(struct Oc_wu *wu_p);
+void oc_xt_test_ext_delete(struct Oc_wu *wu_p);
+
+// Check the whole tree against the model
+void oc_xt_test_ext_verify(struct Oc_wu *wu_p);
+
+// Insert an extent of [len] newly allocated units at [key]
+void oc_xt_test_ext_insert(Oc_wu *wu_p, uint32 key, uint32 len, bool check);
+
+void oc_xt_test_ext_remove_range(Oc_wu *wu_p, uint32 lo_key, uint32 hi_key,
+                                 bool check);
+void oc_xt_test_ext_lookup_range(Oc_wu *wu_p, uint32 lo_key, uint32 hi_key,
+                                 bool check);
+void oc_xt_test_ext_lookup_ofs(Oc_wu *wu_p, uint32 key, bool check);
+void oc_xt_test_ext_cursor(Oc_wu *wu_p, uint32 lo_key, uint32 hi_key,
+                           bool check);
+
+#endif
@@ -50,7 +50,9 @@ struct Oc_xt_test_fs_ctx {
     // the length of [fs_array]
     int len;
 
-    // An array of bytes, a single byte for each allocation unit
+    /* An array of bytes, a single byte for each allocation unit. It
+     * holds the ref-count of the unit.
+     */
     char *fs_array;
 
     // how many units have been allocated
@@ -153,16 +155,35 @@ void oc_xt_test_fs_dealloc(struct Oc_xt_test_fs_ctx *ctx_p,
         fflush(stdout);
     }
     
-    // set to FALSE the state of all the units in the range
+    // reduce the ref-count of all the units in the range
     for (i=ofs; i<ofs+len; i++) {
-        oc_utl_assert(ctx_p->fs_array[i]);
-        ctx_p->fs_array[i] = FALSE;
+        oc_utl_assert(ctx_p->fs_array[i] > 0);
+        ctx_p->fs_array[i]--;
+        if (0 == ctx_p->fs_array[i])
+            ctx_p->tot_alloc--;
     }
 
-    ctx_p->tot_alloc -= len;
     oc_utl_assert(ctx_p->tot_alloc >= 0);
 }
 
+// increase the ref-count of an extent of [len] units in free-space [ctx_p]
+void oc_xt_test_fs_inc_refcount(struct Oc_xt_test_fs_ctx *ctx_p,
+                                uint32 ofs,
+                                uint32 len)
+{
+    uint32 i;
+
+    if (ctx_p->verbose) {
+        printf("// inc_refcount [%s] (ofs=%lu, len=%lu)\n", ctx_p->desc, ofs, len);
+        fflush(stdout);
+    }
+    
+    for (i=ofs; i<ofs+len; i++) {
+        oc_utl_assert(ctx_p->fs_array[i] > 0);
+        ctx_p->fs_array[i]++;
+    }
+}
+
 
 // return TRUE if [ctx_p] is unallocated starting at offset [len]
 static bool make_sure_is_unallocated(
@@ -197,10 +218,13 @@ bool oc_xt_test_fs_compare(struct Oc_xt_test_fs_ctx *ctx1_p,
     if (ctx1_p->tot_alloc != ctx2_p->tot_alloc)
         return FALSE;
         
-    // the two free-space instance may have different length.
-    // we are only interested in comparing the allocated areas.
-    for (i=0; i<ctx1_p->len; i++) {
-        if (ctx1_p->fs_array[i] != ctx2_p->fs_array[i])
+    /* the two free-space instance may have different length.
+     * we are only interested in comparing the allocated areas.
+     * The ref-counts may differ, because an extent shared
+     * between clones is referenced once per leaf.
+     */
+    for (i=0; i<ctx1_p->len && i<ctx2_p->len; i++) {
+        if ((0 == ctx1_p->fs_array[i]) != (0 == ctx2_p->fs_array[i]))
             return FALSE;
     }
 
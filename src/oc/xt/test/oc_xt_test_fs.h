@@ -62,6 +62,11 @@ void oc_xt_test_fs_dealloc(struct Oc_xt_test_fs_ctx *ctx_p,
                            uint32 ofs,
                            uint32 len);
 
+// increase the ref-count of an extent of [len] units in free-space [ctx_p]
+void oc_xt_test_fs_inc_refcount(struct Oc_xt_test_fs_ctx *ctx_p,
+                                uint32 ofs,
+                                uint32 len);
+
 /* compare two free-space instances. Return TRUE if they are equal, FALSE
  * otherwise.
  */
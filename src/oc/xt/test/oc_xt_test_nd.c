@@ -41,24 +41,27 @@
 
 #include "pl_dstru.h"
 #include "oc_utl.h"
-#include "oc_utl_htbl.h"
+#include "oc_utl_rhtbl.h"
+#include "oc_utl_trk.h"
 #include "oc_crt_int.h"
 #include "oc_xt_nd.h"
 #include "oc_xt_test_nd.h"
 
 #define MAGIC (2718)
 
-static Oc_utl_htbl vd_htbl;
+static Oc_utl_rhtbl vd_htbl;
 static int g_refcnt = 0;
+static int g_num_gets = 0;
 
 typedef struct Oc_xt_test_node {
     Ss_slist_node link;       // link inside the hash-table    
     Oc_xt_node node;
     int    magic;             // magic number, for testing purposes
+    int    fs_refcnt;         // the number of clones sharing the page
 } Oc_xt_test_node;
 
 // virtual-disk section
-static uint32 vd_hash(void *_key, int num_buckets, int dummy);
+static uint64 vd_hash(void *_key);
 static bool vd_compare(void *_elem, void *_key);
 static void vd_create(void);
 static void vd_node_remove(uint64 addr);
@@ -80,11 +83,9 @@ static uint32 random_choose(uint32 top);
  *   [Oc_xt_test_node]
  */
 
-static uint32 vd_hash(void *_key, int num_buckets, int dummy)
+static uint64 vd_hash(void *_key)
 {
-    uint64 disk_addr = *((uint64*) _key);
-
-    return (disk_addr * 1069597 + 1066133) & (num_buckets-1);
+    return oc_utl_rhtbl_hash_u64(*((uint64*) _key));
 }
 
 static bool vd_compare(void *_elem, void *_key)
@@ -98,10 +99,10 @@ static bool vd_compare(void *_elem, void *_key)
 // create a hashtable
 static void vd_create(void)
 {
-    oc_utl_htbl_create(
+    oc_utl_rhtbl_create(
         &vd_htbl,
         2048,
-        NULL,
+        FALSE,
         vd_hash,
         vd_compare);
 }
@@ -111,19 +112,19 @@ static void vd_node_remove(uint64 addr)
 {
     bool rc;
 
-    rc = oc_utl_htbl_remove(&vd_htbl, (void*)&addr);
+    rc = oc_utl_rhtbl_remove(&vd_htbl, (void*)&addr);
     oc_utl_assert(rc);
 }
 
 // insert a node
 static void vd_node_insert(Oc_xt_test_node *tnode_p)
 {
-    oc_utl_htbl_insert(&vd_htbl, (void*)&tnode_p->node.disk_addr, (void*)tnode_p);
+    oc_utl_rhtbl_insert(&vd_htbl, (void*)&tnode_p->node.disk_addr, (void*)tnode_p);
 }
 
 static Oc_xt_test_node *vd_node_lookup(uint64 addr)
 {
-    return (Oc_xt_test_node*)oc_utl_htbl_lookup(&vd_htbl, (void*)&addr);
+    return (Oc_xt_test_node*)oc_utl_rhtbl_lookup(&vd_htbl, (void*)&addr);
 }
 
 /**********************************************************************/
@@ -171,6 +172,7 @@ Oc_xt_node* oc_xt_test_nd_alloc(Oc_wu *wu_p)
     tnode_p->node.data = (char*) wrap_malloc(OC_XT_TEST_ND_SIZE);
     tnode_p->node.disk_addr = fs_alloc();
     tnode_p->magic = MAGIC;
+    tnode_p->fs_refcnt = 1;
 
     // add the node into the virtual-disk
     vd_node_insert(tnode_p);
@@ -189,11 +191,17 @@ void oc_xt_test_nd_dealloc(Oc_wu *wu_p, uint64 addr)
 
     // extract the node fromt the table prior to removal
     tnode_p = vd_node_lookup(addr);
+    oc_utl_assert(tnode_p);
+    oc_utl_assert(tnode_p->fs_refcnt > 0);
+
+    // Free the page only if its ref-count drops to zero
+    tnode_p->fs_refcnt--;
+    if (tnode_p->fs_refcnt > 0)
+        return;
     
     // remove the node from the virtual-disk
     vd_node_remove(addr);
 
-    oc_utl_assert(tnode_p);
     oc_utl_assert(tnode_p->node.data);
     oc_utl_assert(tnode_p->magic == MAGIC);
 
@@ -207,7 +215,7 @@ void oc_xt_test_nd_dealloc(Oc_wu *wu_p, uint64 addr)
     free(tnode_p);
 }
 
-Oc_xt_node* oc_xt_test_nd_get(Oc_wu *wu_p, uint64 addr)
+static Oc_xt_node* nd_get(Oc_wu *wu_p, uint64 addr)
 {
     Oc_xt_test_node *tnode_p;
     
@@ -218,6 +226,7 @@ Oc_xt_node* oc_xt_test_nd_get(Oc_wu *wu_p, uint64 addr)
             oc_crt_yield_task();
 
     g_refcnt++;
+    g_num_gets++;
     tnode_p = vd_node_lookup(addr);
     if (NULL == tnode_p) {
         printf("error, did not find a b-tree node at address=%Lu po=%lu\n",
@@ -228,17 +237,99 @@ Oc_xt_node* oc_xt_test_nd_get(Oc_wu *wu_p, uint64 addr)
     return &tnode_p->node;
 }
 
+/* The node may be moved by mark-dirty while we are waiting for the
+ * lock. In that case, try again.
+ */
+Oc_xt_node* oc_xt_test_nd_get_sl(Oc_wu *wu_p, uint64 addr)
+{
+    Oc_xt_node *node_p;
+
+    while (1) {
+        node_p = nd_get(wu_p, addr);
+        oc_utl_trk_crt_lock_read(wu_p, &node_p->lock);
+        if (node_p->disk_addr == addr)
+            break;
+        oc_utl_trk_crt_unlock(wu_p, &node_p->lock);
+        oc_xt_test_nd_release(wu_p, node_p);
+    }
+
+    return node_p;
+}
+
+Oc_xt_node* oc_xt_test_nd_get_xl(Oc_wu *wu_p, uint64 addr)
+{
+    Oc_xt_node *node_p;
+
+    while (1) {
+        node_p = nd_get(wu_p, addr);
+        oc_utl_trk_crt_lock_write(wu_p, &node_p->lock);
+        if (node_p->disk_addr == addr)
+            break;
+        oc_utl_trk_crt_unlock(wu_p, &node_p->lock);
+        oc_xt_test_nd_release(wu_p, node_p);
+    }
+
+    return node_p;
+}
+
 void oc_xt_test_nd_release(Oc_wu *wu_p, Oc_xt_node *node_p)
 {
     g_refcnt--;
     oc_utl_assert(g_refcnt>=0);
 }
 
-void oc_xt_test_nd_mark_dirty(Oc_wu *wu_p, Oc_xt_node *node_p)
+// create a copy of a node, at the same address
+static Oc_xt_test_node *tnode_clone(Oc_xt_test_node *tnode_p)
+{
+    Oc_xt_test_node *new_tnode_p;
+
+    new_tnode_p =
+        (Oc_xt_test_node *) wrap_malloc(sizeof(Oc_xt_test_node));
+
+    memset(new_tnode_p, 0, sizeof(Oc_xt_test_node));
+    new_tnode_p->node.disk_addr = tnode_p->node.disk_addr;
+    new_tnode_p->node.data = wrap_malloc(OC_XT_TEST_ND_SIZE);
+    memcpy(new_tnode_p->node.data, tnode_p->node.data, OC_XT_TEST_ND_SIZE);
+    oc_crt_init_rw_lock(&new_tnode_p->node.lock);
+    new_tnode_p->magic = MAGIC;
+    new_tnode_p->fs_refcnt = tnode_p->fs_refcnt;
+
+    return new_tnode_p;
+}
+
+void oc_xt_test_nd_mark_dirty(Oc_wu *wu_p,
+                              Oc_xt_node *node_p,
+                              bool multi_refs)
 {
     Oc_xt_test_node *tnode_p;
     uint64 new_addr;
     
+    if (multi_refs) {
+        /* This page is referenced by multiple clones. We
+         * can't move it; we need to leave the old page where
+         * it was.
+         */
+        Oc_xt_test_node *old_tnode_p;
+
+        oc_utl_assert(!oc_xt_nd_is_root(NULL, node_p));
+        tnode_p = vd_node_lookup(node_p->disk_addr);
+        old_tnode_p = tnode_clone(tnode_p);
+
+        // move the page to a new address
+        vd_node_remove(tnode_p->node.disk_addr);
+        tnode_p->node.disk_addr = fs_alloc();
+        tnode_p->fs_refcnt = 1;
+        vd_node_insert(tnode_p);
+
+        // Place a copy of the page in the old disk-address
+        vd_node_insert(old_tnode_p);
+
+        // reduce the ref-count on the old address.
+        old_tnode_p->fs_refcnt--;
+        oc_utl_assert(old_tnode_p->fs_refcnt > 0);
+        return;
+    }
+
     if (random_choose(4) != 0)
         return;
 
@@ -268,6 +359,28 @@ int  oc_xt_test_nd_get_refcount(void)
     return g_refcnt;
 }
 
+int oc_xt_test_nd_get_count(void)
+{
+    return g_num_gets;
+}
+
+void oc_xt_test_nd_fs_inc_refcount(Oc_wu *wu_p, uint64 addr)
+{
+    Oc_xt_test_node *tnode_p = vd_node_lookup(addr);
+
+    oc_utl_assert(tnode_p);
+    oc_utl_assert(tnode_p->fs_refcnt > 0);
+    tnode_p->fs_refcnt++;
+}
+
+int oc_xt_test_nd_fs_get_refcount(Oc_wu *wu_p, uint64 addr)
+{
+    Oc_xt_test_node *tnode_p = vd_node_lookup(addr);
+
+    oc_utl_assert(tnode_p);
+    return tnode_p->fs_refcnt;
+}
+
 /**********************************************************************/
 
 void oc_xt_test_nd_init(void)
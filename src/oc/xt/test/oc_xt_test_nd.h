@@ -45,11 +45,21 @@
 
 Oc_xt_node* oc_xt_test_nd_alloc(struct Oc_wu *wu_p);
 void oc_xt_test_nd_dealloc(struct Oc_wu *wu_p, uint64 addr);
-Oc_xt_node* oc_xt_test_nd_get(struct Oc_wu *wu_p, uint64 addr);
+Oc_xt_node* oc_xt_test_nd_get_sl(struct Oc_wu *wu_p, uint64 addr);
+Oc_xt_node* oc_xt_test_nd_get_xl(struct Oc_wu *wu_p, uint64 addr);
 void oc_xt_test_nd_release(struct Oc_wu *wu_p, Oc_xt_node *node_p);
-void oc_xt_test_nd_mark_dirty(struct Oc_wu *wu_p, Oc_xt_node *node_p);
+void oc_xt_test_nd_mark_dirty(struct Oc_wu *wu_p,
+                              Oc_xt_node *node_p,
+                              bool multi_refs);
 
 int  oc_xt_test_nd_get_refcount(void);
 
+// the number of times a node has been fetched, used to measure searches
+int oc_xt_test_nd_get_count(void);
+
+// ref-counts on node addresses, used when the tree is cloned
+void oc_xt_test_nd_fs_inc_refcount(struct Oc_wu *wu_p, uint64 addr);
+int  oc_xt_test_nd_fs_get_refcount(struct Oc_wu *wu_p, uint64 addr);
+
 void oc_xt_test_nd_init(void);
 #endif
@@ -43,6 +43,8 @@
 #include "pl_trace_base.h"
 #include "oc_xt_int.h"
 #include "oc_xt_test_utl.h"
+#include "oc_xt_test_nd.h"
+#include "oc_xt_test_ext.h"
 
 /******************************************************************/
 static void test_init_fun(void);
@@ -51,6 +53,13 @@ static void large_trees (void);
 static void small_trees (void);
 static void small_trees_w_ranges (void);
 static void small_trees_mixed (void);
+static void sequential (void);
+static void clones (void);
+static void find_gap (void);
+static void find_gap_refill (struct Oc_wu *wu_p);
+static void lazy_truncate (void);
+static void bulk_load (void);
+static void builtin_ext (void);
 
 /******************************************************************/
 static void small_trees (void)
@@ -91,6 +100,8 @@ static void small_trees (void)
                 &wu,
                 oc_xt_test_utl_random_number(200),
                 oc_xt_test_utl_random_number(30), TRUE);
+            oc_xt_test_utl_lookup_ofs(
+                &wu, oc_xt_test_utl_random_number(240), TRUE);
             oc_xt_test_utl_finalize(1);
         }
         
@@ -183,6 +194,7 @@ static void small_trees_mixed (void)
                     start, 
                     start + 1 + oc_xt_test_utl_random_number(10),
                     TRUE);
+                oc_xt_test_utl_lookup_ofs(&wu, start, TRUE);
                 break;
             case 2:
                 start = oc_xt_test_utl_random_number(max_int);
@@ -228,7 +240,7 @@ static void small_trees_mixed (void)
 
 static void large_trees (void)
 {
-    int i, k, start;
+    int i, k, start, end;
     struct Oc_wu wu;
     bool small_tree;
     Oc_rm_ticket rm;
@@ -243,7 +255,7 @@ static void large_trees (void)
         
         for (i=0; i<num_rounds; i++)
         {
-            switch (oc_xt_test_utl_random_number(5)) {
+            switch (oc_xt_test_utl_random_number(6)) {
             case 0:
                 oc_xt_test_utl_insert(
                     &wu,
@@ -258,6 +270,14 @@ static void large_trees (void)
                     start, 
                     start + 1 + oc_xt_test_utl_random_number(10),
                     TRUE);
+                oc_xt_test_utl_lookup_ofs(&wu, start, TRUE);
+                break;
+            case 5:
+                // a scatter-gather write
+                oc_xt_test_utl_insert_multi_random(
+                    &wu,
+                    oc_xt_test_utl_random_number(max_int),
+                    TRUE);
                 break;
             case 2:
                 start = oc_xt_test_utl_random_number(max_int);
@@ -281,13 +301,11 @@ static void large_trees (void)
                 }
                 break;
             case 4:
-                // long lookup-range
+                // long lookup-range, and a cursor over the same range
                 start = oc_xt_test_utl_random_number(max_int);
-                oc_xt_test_utl_lookup_range(
-                    &wu,
-                    start,
-                    start + 1 + oc_xt_test_utl_random_number(max_int/3),
-                    TRUE);
+                end = start + 1 + oc_xt_test_utl_random_number(max_int/3);
+                oc_xt_test_utl_lookup_range(&wu, start, end, TRUE);
+                oc_xt_test_utl_cursor(&wu, start, end, TRUE);
                 break;
             }
 
@@ -305,11 +323,466 @@ static void large_trees (void)
     printf ("done large_trees test\n"); fflush(stdout);
 }
 
+/* Write the tree front to back. Consecutive extents are allocated
+ * back to back on disk, which exercises merging of adjacent extents,
+ * both inside a leaf and across leaves.
+ */
+static void sequential (void)
+{
+    int i, k, start, len;
+    struct Oc_wu wu;
+    Oc_rm_ticket rm;
+    
+    oc_xt_test_utl_setup_wu(&wu, &rm);
+    oc_xt_test_utl_init(&wu);        
+    printf ("// running sequential test\n");
+    
+    for (k=0; k<10; k++) {
+        oc_xt_test_utl_create(&wu);
+
+        for (start=0; start < max_int; start += len) {
+            len = 1 + oc_xt_test_utl_random_number(10);
+            oc_xt_test_utl_insert(&wu, start, len, TRUE);
+            oc_xt_test_utl_finalize(1);            
+
+            if (oc_xt_test_utl_random_number(10) == 0) {
+                // punch a hole, and then fill it up
+                i = oc_xt_test_utl_random_number(start + len);
+                oc_xt_test_utl_remove_range(&wu, i, i + 5, TRUE);
+                oc_xt_test_utl_insert(&wu, i, 6, TRUE);
+                oc_xt_test_utl_finalize(1);            
+            }
+        }
+
+        // overwrite parts of the tree with scatter-gather writes
+        for (i=0; i<5; i++) {
+            oc_xt_test_utl_insert_multi_random(
+                &wu, oc_xt_test_utl_random_number(max_int), TRUE);
+            oc_xt_test_utl_finalize(1);            
+        }
+        
+        for (i=0; i<20; i++) {
+            start = oc_xt_test_utl_random_number(max_int);
+            oc_xt_test_utl_lookup_range(
+                &wu,
+                start,
+                start + 1 + oc_xt_test_utl_random_number(max_int/3),
+                TRUE);
+            oc_xt_test_utl_finalize(1);            
+        }
+        
+        oc_xt_test_utl_compare_and_verify(&wu, max_int);
+        
+        if (statistics) oc_xt_test_utl_statistics();        
+        oc_xt_test_utl_delete(&wu);
+        oc_xt_test_utl_finalize(0);
+    }
+
+    printf ("done sequential test\n"); fflush(stdout);
+}
+
+/* Take clones of the tree while it is being modified. Writes to the
+ * tree must copy the nodes it shares with the clones, and the clones
+ * must remain as they were when taken.
+ */
+static void clones (void)
+{
+    int i, j, k, start;
+    struct Oc_wu wu;
+    Oc_rm_ticket rm;
+    
+    oc_xt_test_utl_setup_wu(&wu, &rm);
+    printf ("// running clones test\n");
+    
+    for (k=0; k<5; k++) {
+        oc_xt_test_utl_init(&wu);        
+        oc_xt_test_utl_create(&wu);
+
+        for (j=0; j<=OC_XT_TEST_UTL_MAX_CLONES; j++) {
+            for (i=0; i<num_rounds; i++) {
+                start = oc_xt_test_utl_random_number(max_int);
+                switch (oc_xt_test_utl_random_number(4)) {
+                case 0:
+                case 1:
+                    oc_xt_test_utl_insert(
+                        &wu, start, 1 + oc_xt_test_utl_random_number(10),
+                        TRUE);
+                    break;
+                case 2:
+                    oc_xt_test_utl_insert_multi_random(&wu, start, TRUE);
+                    break;
+                case 3:
+                    oc_xt_test_utl_remove_range(
+                        &wu,
+                        start,
+                        start + 1 + oc_xt_test_utl_random_number(max_int/10),
+                        TRUE);
+                    break;
+                }
+                oc_xt_test_utl_finalize(1 + j);
+            }
+
+            oc_xt_test_utl_clones_verify(&wu);
+            if (j < OC_XT_TEST_UTL_MAX_CLONES) {
+                oc_xt_test_utl_clone(&wu);
+                oc_xt_test_utl_clones_verify(&wu);
+                oc_xt_test_utl_finalize(2 + j);
+            }
+        }
+
+        // delete the tree first, the clones still hold most of its nodes
+        oc_xt_test_utl_delete(&wu);
+        oc_xt_test_utl_clones_delete(&wu);
+        oc_xt_test_utl_finalize(0);
+    }
+
+    printf ("done clones test\n"); fflush(stdout);
+}
+
+/* Search for free gaps in a sparse tree. Punching holes and filling
+ * them up moves the gaps around, the search must keep track.
+ */
+static void find_gap (void)
+{
+    int i, k, start;
+    struct Oc_wu wu;
+    Oc_rm_ticket rm;
+    
+    oc_xt_test_utl_setup_wu(&wu, &rm);
+    printf ("// running find_gap test\n");
+    
+    for (k=0; k<5; k++) {
+        oc_xt_test_utl_init(&wu);        
+        oc_xt_test_utl_create(&wu);
+
+        for (i=0; i<num_rounds; i++) {
+            start = oc_xt_test_utl_random_number(max_int);
+            switch (oc_xt_test_utl_random_number(4)) {
+            case 0:
+            case 1:
+                oc_xt_test_utl_insert(
+                    &wu, start, 1 + oc_xt_test_utl_random_number(10), TRUE);
+                break;
+            case 2:
+                oc_xt_test_utl_remove_range(
+                    &wu,
+                    start,
+                    start + oc_xt_test_utl_random_number(max_int/20),
+                    TRUE);
+                break;
+            case 3:
+                oc_xt_test_utl_insert_multi_random(&wu, start, TRUE);
+                break;
+            }
+            oc_xt_test_utl_finalize(1);            
+
+            oc_xt_test_utl_find_gap(
+                &wu,
+                oc_xt_test_utl_random_number(max_int),
+                1 + oc_xt_test_utl_random_number(20),
+                TRUE);
+        }
+
+        oc_xt_test_utl_compare_and_verify(&wu, max_int);
+        oc_xt_test_utl_delete(&wu);
+        oc_xt_test_utl_finalize(0);
+    }
+    find_gap_refill(&wu);
+
+    printf ("done find_gap test\n"); fflush(stdout);
+}
+
+/* Punch a hole near the start of a tree whose gaps are all of length
+ * one, and fill it up again. The bounds on the path to the hole are
+ * left too large. A search must lower them, and the following search
+ * must skip the subtree.
+ *
+ * The extents start at odd offsets, so that the search covers the first
+ * subtree in full.
+ */
+static void find_gap_refill (struct Oc_wu *wu_p)
+{
+    uint32 i, owner = 7;
+    int n_gets1, n_gets2;
+
+    printf ("// running find_gap_refill test\n");
+    oc_xt_test_utl_init(wu_p);
+    oc_xt_test_utl_create(wu_p);
+
+    for (i=1; i < (uint32)max_int; i += 2)
+        oc_xt_test_utl_insert(wu_p, i, 1, TRUE);
+
+    // open a gap of five after [owner], and fill it up
+    oc_xt_test_utl_remove_range(wu_p, owner+1, owner+5, TRUE);
+    oc_xt_test_utl_insert(wu_p, owner+2, 3, TRUE);
+    oc_xt_test_utl_finalize(1);
+    if (oc_xt_test_utl_root_gap(wu_p, owner) < 2)
+        ERR(("the gap bound was expected to be stale"));
+
+    n_gets1 = oc_xt_test_nd_get_count();
+    oc_xt_test_utl_find_gap(wu_p, 0, 2, TRUE);
+    n_gets1 = oc_xt_test_nd_get_count() - n_gets1;
+    if (oc_xt_test_utl_root_gap(wu_p, owner) >= 2)
+        ERR(("the stale gap bound was not lowered, bound=%Lu",
+             oc_xt_test_utl_root_gap(wu_p, owner)));
+
+    n_gets2 = oc_xt_test_nd_get_count();
+    oc_xt_test_utl_find_gap(wu_p, 0, 2, TRUE);
+    n_gets2 = oc_xt_test_nd_get_count() - n_gets2;
+    printf ("    // nodes fetched: stale=%d tightened=%d\n", n_gets1, n_gets2);
+    if (n_gets2 >= n_gets1)
+        ERR(("the search did not skip the subtree with the lowered bound"));
+
+    oc_xt_test_utl_finalize(1);
+    oc_xt_test_utl_compare_and_verify(wu_p, max_int);
+    oc_xt_test_utl_delete(wu_p);
+    oc_xt_test_utl_finalize(0);
+}
+
+/* Remove large ranges lazily, and truncate the tree. The detached
+ * sub-trees are reclaimed a few at a time, in between removals and
+ * lookups, and while a clone shares some of them.
+ */
+static void lazy_truncate (void)
+{
+    int i, k, start;
+    struct Oc_wu wu;
+    Oc_rm_ticket rm;
+    
+    oc_xt_test_utl_setup_wu(&wu, &rm);
+    printf ("// running truncate test\n");
+    
+    for (k=0; k<5; k++) {
+        oc_xt_test_utl_init(&wu);        
+        oc_xt_test_utl_create(&wu);
+        if (k % 2)
+            oc_xt_test_utl_clone(&wu);
+
+        for (i=0; i<num_rounds; i++) {
+            start = oc_xt_test_utl_random_number(max_int);
+            switch (oc_xt_test_utl_random_number(8)) {
+            case 0:
+            case 1:
+            case 2:
+                /* The linked-list has already released the removed
+                 * extents. Reclaim first, so that both free-spaces
+                 * allocate the same blocks.
+                 */
+                oc_xt_test_utl_reclaim(&wu, -1, TRUE);
+                oc_xt_test_utl_insert(
+                    &wu, start, 1 + oc_xt_test_utl_random_number(10), TRUE);
+                break;
+            case 3:
+            case 4:
+                oc_xt_test_utl_reclaim(&wu, -1, TRUE);
+                oc_xt_test_utl_insert_multi_random(&wu, start, TRUE);
+                break;
+            case 5:
+                oc_xt_test_utl_remove_range_lazy(
+                    &wu,
+                    start,
+                    start + oc_xt_test_utl_random_number(max_int/2),
+                    TRUE);
+                break;
+            case 6:
+                // truncate
+                oc_xt_test_utl_remove_range_lazy(&wu, start, 2*max_int, TRUE);
+                break;
+            case 7:
+                oc_xt_test_utl_reclaim(
+                    &wu, 1 + oc_xt_test_utl_random_number(5), TRUE);
+                break;
+            }
+            oc_xt_test_utl_finalize(1 + k % 2);            
+
+            if (oc_xt_test_utl_random_number(20) == 0) {
+                start = oc_xt_test_utl_random_number(max_int);
+                oc_xt_test_utl_lookup_range(
+                    &wu,
+                    start,
+                    start + 1 + oc_xt_test_utl_random_number(max_int/3),
+                    TRUE);
+            }
+
+            if (k % 2 && i == num_rounds/2) {
+                oc_xt_test_utl_reclaim(&wu, -1, TRUE);
+                oc_xt_test_utl_clones_verify(&wu);
+            }
+        }
+
+        oc_xt_test_utl_reclaim(&wu, -1, TRUE);
+        if (k % 2)
+            oc_xt_test_utl_clones_verify(&wu);
+        
+        // leave some sub-trees for the delete to reclaim
+        oc_xt_test_utl_remove_range_lazy(&wu, 0, max_int/2, TRUE);
+        oc_xt_test_utl_delete(&wu);
+        if (k % 2)
+            oc_xt_test_utl_clones_delete(&wu);
+        oc_xt_test_utl_finalize(0);
+    }
+
+    printf ("done truncate test\n"); fflush(stdout);
+}
+
+/* Build trees of various sizes bottom-up, and then modify them. The
+ * packed nodes split and merge as usual.
+ */
+static void bulk_load (void)
+{
+    int i, k, start;
+    struct Oc_wu wu;
+    Oc_rm_ticket rm;
+    
+    oc_xt_test_utl_setup_wu(&wu, &rm);
+    printf ("// running bulk_load test\n");
+    
+    for (k=0; k<8; k++) {
+        oc_xt_test_utl_init(&wu);        
+        oc_xt_test_utl_create(&wu);
+
+        // an extent takes up 10 offsets on average
+        oc_xt_test_utl_bulk_load(
+            &wu,
+            oc_xt_test_utl_random_number(max_int/10 + 1),
+            oc_xt_test_utl_random_number(20),
+            k % 2,
+            TRUE);
+        oc_xt_test_utl_finalize(1);
+
+        // walk the whole tree, in windows that fit in a lookup
+        for (start=0; start < 2*max_int; start += 20)
+            oc_xt_test_utl_lookup_range(&wu, start, start + 19, TRUE);
+        oc_xt_test_utl_finalize(1);
+
+        for (i=0; i<num_rounds; i++) {
+            start = oc_xt_test_utl_random_number(max_int);
+            switch (oc_xt_test_utl_random_number(4)) {
+            case 0:
+                oc_xt_test_utl_insert(
+                    &wu, start, 1 + oc_xt_test_utl_random_number(10), TRUE);
+                break;
+            case 1:
+                oc_xt_test_utl_remove_range(
+                    &wu,
+                    start,
+                    start + oc_xt_test_utl_random_number(max_int/10),
+                    TRUE);
+                break;
+            case 2:
+                oc_xt_test_utl_lookup_range(
+                    &wu,
+                    start,
+                    start + 1 + oc_xt_test_utl_random_number(max_int/3),
+                    TRUE);
+                break;
+            case 3:
+                oc_xt_test_utl_find_gap(
+                    &wu, start, 1 + oc_xt_test_utl_random_number(20), TRUE);
+                break;
+            }
+            oc_xt_test_utl_finalize(1);            
+        }
+
+        oc_xt_test_utl_compare_and_verify(&wu, 2*max_int);
+        oc_xt_test_utl_delete(&wu);
+        oc_xt_test_utl_finalize(0);
+    }
+
+    printf ("done bulk_load test\n"); fflush(stdout);
+}
+
+/* Run a tree with the built-in extent type against a model. The tree
+ * is first written front to back, with blocks allocated back to back,
+ * so that adjacent extents merge. Removals then cut extents in the
+ * middle, and lookups and cursors chop them at the edges of their
+ * range.
+ */
+static void builtin_ext (void)
+{
+    int i, k, start, len;
+    uint32 next = 0;
+    struct Oc_wu wu;
+    Oc_rm_ticket rm;
+    
+    oc_xt_test_utl_setup_wu(&wu, &rm);
+    printf ("// running builtin_ext test\n");
+    
+    for (k=0; k<10; k++) {
+        oc_xt_test_ext_create(&wu);
+
+        for (start=0; start < max_int; start += len) {
+            len = 1 + oc_xt_test_utl_random_number(10);
+            oc_xt_test_ext_insert(&wu, start, len, TRUE);
+            oc_xt_test_utl_finalize(1);
+        }
+        oc_xt_test_ext_verify(&wu);
+
+        for (i=0; i<num_rounds; i++) {
+            start = oc_xt_test_utl_random_number(max_int);
+            switch (oc_xt_test_utl_random_number(8)) {
+            case 0:
+                len = 1 + oc_xt_test_utl_random_number(10);
+                oc_xt_test_ext_insert(&wu, start, len, TRUE);
+                next = start + len;
+                break;
+            case 1:
+                // continue the previous insert
+                if (next >= (uint32)max_int)
+                    next = 0;
+                len = 1 + oc_xt_test_utl_random_number(10);
+                oc_xt_test_ext_insert(&wu, next, len, TRUE);
+                next += len;
+                break;
+            case 2:
+            case 3:
+                oc_xt_test_ext_remove_range(
+                    &wu, start, start + oc_xt_test_utl_random_number(10),
+                    TRUE);
+                break;
+            case 4:
+                if (oc_xt_test_utl_random_number(4) == 0)
+                    oc_xt_test_ext_remove_range(
+                        &wu,
+                        start,
+                        start + oc_xt_test_utl_random_number(max_int/3),
+                        TRUE);
+                break;
+            case 5:
+                oc_xt_test_ext_lookup_range(
+                    &wu,
+                    start,
+                    start + oc_xt_test_utl_random_number(max_int/3),
+                    TRUE);
+                break;
+            case 6:
+                oc_xt_test_ext_lookup_ofs(&wu, start, TRUE);
+                break;
+            case 7:
+                oc_xt_test_ext_cursor(
+                    &wu,
+                    start,
+                    start + oc_xt_test_utl_random_number(max_int/3),
+                    TRUE);
+                break;
+            }
+            oc_xt_test_utl_finalize(1);
+        }
+
+        oc_xt_test_ext_verify(&wu);
+        oc_xt_test_ext_delete(&wu);
+        oc_xt_test_utl_finalize(0);
+    }
+
+    printf ("done builtin_ext test\n"); fflush(stdout);
+}
+
 /******************************************************************/
 
 static void test_init_fun(void)
 {
     oc_xt_test_utl_init_module();
+    oc_xt_test_ext_init_module();
     
     // Open a task to run all the tests
     oc_xt_dbg_output_init((struct Oc_utl_file*)stdout);
@@ -321,6 +794,12 @@ static void test_init_fun(void)
         small_trees();
         small_trees_w_ranges();
         small_trees_mixed();
+        sequential();
+        clones();
+        find_gap();
+        lazy_truncate();
+        bulk_load();
+        builtin_ext();
         break;
     case OC_XT_TEST_UTL_LARGE_TREES:
         large_trees();
@@ -334,6 +813,24 @@ static void test_init_fun(void)
     case OC_XT_TEST_UTL_SMALL_TREES_MIXED:
         small_trees_mixed();
         break;
+    case OC_XT_TEST_UTL_SEQUENTIAL:
+        sequential();
+        break;
+    case OC_XT_TEST_UTL_CLONES:
+        clones();
+        break;
+    case OC_XT_TEST_UTL_FIND_GAP:
+        find_gap();
+        break;
+    case OC_XT_TEST_UTL_TRUNCATE:
+        lazy_truncate();
+        break;
+    case OC_XT_TEST_UTL_BULK_LOAD:
+        bulk_load();
+        break;
+    case OC_XT_TEST_UTL_BUILTIN_EXT:
+        builtin_ext();
+        break;
     }
 
     printf("   // total_ops=%d\n", total_ops);
@@ -43,7 +43,10 @@
 #include "pl_trace_base.h"
 #include "oc_utl.h"
 #include "oc_crt_int.h"
+#include "oc_utl_trk.h"
+#include "oc_rm_s.h"
 #include "oc_xt_int.h"
+#include "oc_xt_nd.h"
 #include "oc_xt_alt.h"
 #include "oc_xt_test_fs.h"
 #include "oc_xt_test_nd.h"
@@ -72,6 +75,8 @@ typedef struct Oc_xt_test_rcrd {
 static int key_compare(struct Oc_xt_key *key1_p,
                        struct Oc_xt_key *key2_p);
 static void key_inc(struct Oc_xt_key *_key_p, struct Oc_xt_key *_result_p);
+static uint64 key_distance(struct Oc_xt_key *_key1_p,
+                           struct Oc_xt_key *_key2_p);
 static void key_to_string(struct Oc_xt_key *key_p, char *str_p, int max_len);
 
 static Oc_xt_cmp rcrd_compare(
@@ -133,10 +138,17 @@ static void rcrd_end_offset(struct Oc_xt_key *key_p,
                               // returned key 
                               struct Oc_xt_key *end_key_po);
 static uint64 rcrd_length(struct Oc_xt_key *key_p, struct Oc_xt_rcrd *rcrd_pi);
+static bool rcrd_try_merge(struct Oc_xt_key *key1_p,
+                           struct Oc_xt_rcrd *rcrd1_pio,
+                           struct Oc_xt_key *key2_p,
+                           struct Oc_xt_rcrd *rcrd2_p);
 
 static void rcrd_release(struct Oc_wu *wu_p,
                          struct Oc_xt_key *key_p,
                          struct Oc_xt_rcrd *rcrd_p);
+static void rcrd_inc_refcount(struct Oc_wu *wu_p,
+                              struct Oc_xt_key *key_p,
+                              struct Oc_xt_rcrd *rcrd_p);
 static void rcrd_to_string(struct Oc_xt_key *key_p,
                            struct Oc_xt_rcrd *rcrd_p,
                            char *str_p,
@@ -144,15 +156,6 @@ static void rcrd_to_string(struct Oc_xt_key *key_p,
 static void fs_query_dealloc( struct Oc_rm_resource *r_p, int n_pages);
 static void fs_query_alloc( struct Oc_rm_resource *r_p, int n_pages);
 
-static bool ext_array_compare(
-    int nkeys_found_A,
-    struct Oc_xt_key *key_array_A,
-    struct Oc_xt_rcrd *rcrd_array_A, 
-    int nkeys_found_B,
-    struct Oc_xt_key *key_array_B,
-    struct Oc_xt_rcrd *rcrd_array_B,
-    bool allow_partial_match);
-
 static void create_rcrd_from_start_and_end_ofs(
     uint32 key,
     uint32 end_key,
@@ -177,6 +180,19 @@ static Oc_xt_alt_state alt_state;
  */
 static struct Oc_xt_test_fs_ctx *fs_ctx_p, *fs_ctx_alt_p;
 
+/* A clone of the tree, and a copy of the extents it held
+ * when it was taken.
+ */
+typedef struct Clone {
+    Oc_xt_state state;
+    int num;
+    uint32 *key_array;
+    Oc_xt_test_rcrd *rcrd_array;
+} Clone;
+
+static Clone clone_array[OC_XT_TEST_UTL_MAX_CLONES];
+static int n_clones = 0;
+
 typedef uint32 Oc_xt_test_key;
 
 int num_rounds = 100;
@@ -187,6 +203,7 @@ bool statistics = FALSE;
 int max_root_fanout = 5;
 int max_non_root_fanout = 5;
 int min_fanout = 2;
+bool no_merge = FALSE;
 int total_ops = 0;
 Oc_xt_test_utl_type test_type = OC_XT_TEST_UTL_ANY;
 
@@ -230,6 +247,16 @@ static void key_inc(struct Oc_xt_key *_key_p, struct Oc_xt_key *_result_p)
     (*result_p)++;
 }
 
+static uint64 key_distance(struct Oc_xt_key *_key1_p,
+                           struct Oc_xt_key *_key2_p)
+{
+    Oc_xt_test_key *key1_p = (uint32*) _key1_p;
+    Oc_xt_test_key *key2_p = (uint32*) _key2_p;
+
+    oc_utl_assert(*key1_p <= *key2_p);
+    return *key2_p - *key1_p;
+}
+
 
 static void key_to_string(struct Oc_xt_key *key_p, char *str_p, int max_len)
 {
@@ -659,6 +686,24 @@ static uint64 rcrd_length(struct Oc_xt_key *key_p, struct Oc_xt_rcrd *rcrd_pi)
     return rcrd_p->len;
 }
 
+// merge two extents if they are contiguous on disk
+static bool rcrd_try_merge(struct Oc_xt_key *key1_p,
+                           struct Oc_xt_rcrd *_rcrd1_pio,
+                           struct Oc_xt_key *key2_p,
+                           struct Oc_xt_rcrd *_rcrd2_p)
+{
+    Oc_xt_test_rcrd *rcrd1_p = (Oc_xt_test_rcrd*) _rcrd1_pio;
+    Oc_xt_test_rcrd *rcrd2_p = (Oc_xt_test_rcrd*) _rcrd2_p;
+
+    oc_utl_assert(*(uint32*)key1_p + rcrd1_p->len == *(uint32*)key2_p);
+    if (rcrd1_p->fs_impl != rcrd2_p->fs_impl ||
+        rcrd1_p->data + rcrd1_p->len != rcrd2_p->data)
+        return FALSE;
+
+    rcrd1_p->len += rcrd2_p->len;
+    return TRUE;
+}
+
 static void rcrd_release(Oc_wu *wu_p,
                          struct Oc_xt_key *_key_p,
                          struct Oc_xt_rcrd *_rcrd_p)
@@ -687,6 +732,24 @@ static void rcrd_release(Oc_wu *wu_p,
     oc_xt_test_fs_dealloc(fs_p, rcrd_p->data, rcrd_p->len);
 }
 
+static void rcrd_inc_refcount(Oc_wu *wu_p,
+                              struct Oc_xt_key *_key_p,
+                              struct Oc_xt_rcrd *_rcrd_p)
+{
+    Oc_xt_test_rcrd *rcrd_p = (Oc_xt_test_rcrd *) _rcrd_p;
+
+    switch (rcrd_p->fs_impl) {
+    case FS_REAL:
+        oc_xt_test_fs_inc_refcount(fs_ctx_p, rcrd_p->data, rcrd_p->len);
+        break;
+    case FS_ALT:
+        oc_xt_test_fs_inc_refcount(fs_ctx_alt_p, rcrd_p->data, rcrd_p->len);
+        break;
+    default:
+        ERR(("sanity, fs-class=%d", rcrd_p->fs_impl));
+    }
+}
+
 static void rcrd_to_string(struct Oc_xt_key *key_pi,
                            struct Oc_xt_rcrd *rcrd_pi,
                            char *str_p,
@@ -777,7 +840,10 @@ bool oc_xt_test_utl_validate(void)
     
     rc1 = oc_xt_dbg_validate_b(&utl_wu, &state);
     rc2 = oc_xt_alt_dbg_validate_b(&utl_wu, &alt_state);
-    rc3 = oc_xt_test_fs_compare(fs_ctx_alt_p, fs_ctx_p);
+
+    // extents in detached sub-trees have not been released yet
+    rc3 = !ssslist_empty(&state.detached) ||
+        oc_xt_test_fs_compare(fs_ctx_alt_p, fs_ctx_p);
     
     return rc1 && rc2 && rc3;
 }
@@ -804,147 +870,53 @@ uint32 oc_xt_test_utl_random_number(uint32 top)
     return (uint32) (rand() % top);
 }
 
-/* Compare between two extent arrays, check if they are
- * equivalent.
- *
- * if [allow_partial_match] is TRUE then allow the case
- * where the array-A is a sub-match for array-B.
+/* Normalize the [num] extents in [key_array, rcrd_array], sorted by
+ * offset. Extents that start above [top_key] are dropped, and the
+ * extent that crosses it is chopped. Extents that are adjacent both
+ * logically and on disk are merged, whether or not the tree merged
+ * them. Return the number of extents left.
  */
-static bool ext_array_compare(
-    int nkeys_found_A,
-    struct Oc_xt_key *key_array_A,
-    struct Oc_xt_rcrd *rcrd_array_A, 
-    int nkeys_found_B,
-    struct Oc_xt_key *key_array_B,
-    struct Oc_xt_rcrd *rcrd_array_B,
-    bool allow_partial_match)
+static int ext_array_normalize(int num,
+                               uint32 *key_array,
+                               Oc_xt_test_rcrd *rcrd_array,
+                               uint32 top_key)
 {
-    int i,j,k;
-    Oc_xt_cmp rc;
-    struct Oc_xt_key *res_key_array;
-    struct Oc_xt_rcrd *res_rcrd_array;
-    struct Oc_xt_key *res_key_array_p[3];
-    struct Oc_xt_rcrd *res_rcrd_array_p[3];
-    struct Oc_xt_key *keyA, *keyB;
-    struct Oc_xt_rcrd *rcrdA, *rcrdB;
-    uint64 len;
-
-    // corner case: there are no extents
-    if (nkeys_found_B == nkeys_found_A &&
-        nkeys_found_A == 0)
-        return TRUE;
-
-    // an array to store split results
-    res_key_array = (struct Oc_xt_key *)alloca(state.cfg_p->key_size * 3);
-    res_rcrd_array = (struct Oc_xt_rcrd *)alloca(state.cfg_p->rcrd_size * 3);
-
-    keyA = (struct Oc_xt_key*) alloca(state.cfg_p->key_size);
-    keyB = (struct Oc_xt_key*) alloca(state.cfg_p->key_size);    
-    rcrdA = (struct Oc_xt_rcrd*) alloca(state.cfg_p->rcrd_size);
-    rcrdB = (struct Oc_xt_rcrd*) alloca(state.cfg_p->rcrd_size);   
-    copy_ext( keyA, rcrdA,
-              key_array_kth(&state, key_array_A, 0),
-              rcrd_array_kth(&state, rcrd_array_A, 0));
-    copy_ext( keyB, rcrdB,
-              key_array_kth(&state, key_array_B,0),
-              rcrd_array_kth(&state, rcrd_array_B,0));
-    
-    i=0, j=0;
-    while (1) 
-    {
-        oc_utl_assert (i <= nkeys_found_A);
-        oc_utl_assert (j <= nkeys_found_B);
-                
-        // setup a place to receive extent-split results
-        for (k=0; k<3; k++) {
-            res_key_array_p[k] = key_array_kth(&state, res_key_array,k);
-            res_rcrd_array_p[k] =rcrd_array_kth(&state, res_rcrd_array,k);
-        }
-        
-        rc = rcrd_split(
-            // record+key to chop
-            keyA, rcrdA,
-
-            // record to provide boundary keys
-            keyB, rcrdB,
-            
-            // resulting sub-extents
-            res_key_array_p,
-            res_rcrd_array_p);
-        
-        //printf("comparison, rc=%s\n", oc_xt_string_of_cmp_rc(rc));
-        //fflush(stdout);
-        
-        switch (rc) {
-        case OC_XT_CMP_SML:
-        case OC_XT_CMP_GRT:
-            return FALSE;
-
-        case OC_XT_CMP_EQUAL:
-            i++;
-            j++;
-            if (i == nkeys_found_A && j == nkeys_found_B) {
-                // we are done
-                return TRUE;
-            }
-            else if (i < nkeys_found_A && j < nkeys_found_B) {
-                copy_ext( keyA, rcrdA,
-                          key_array_kth(&state, key_array_A, i),
-                          rcrd_array_kth(&state, rcrd_array_A, i));
-                copy_ext( keyB, rcrdB,
-                          key_array_kth(&state, key_array_B, j),
-                          rcrd_array_kth(&state, rcrd_array_B, j));
-            }
-            else {
-                // the extent-arrays only partially match
-                if (allow_partial_match &&
-                    i == nkeys_found_A &&
-                    j < nkeys_found_B)
-                    return TRUE;
-                else
-                    return FALSE;
-            }
-            break;
+    int i, n = 0;
 
-        case OC_XT_CMP_COVERED:
-            len = state.cfg_p->rcrd_length(keyA, rcrdA);
-            state.cfg_p->rcrd_chop_length(keyB, rcrdB, len);
-            i++;
-            if (i == nkeys_found_A) {
-                if (allow_partial_match)
-                    return TRUE;
-                else
-                    return FALSE;
-            }
-            copy_ext( keyA, rcrdA,
-                      key_array_kth(&state, key_array_A, i),
-                      rcrd_array_kth(&state, rcrd_array_A, i));
-            break;
-            
-        case OC_XT_CMP_FULLY_COVERS:
-            /* Remove the beginning of extent1 and continue with rest
-             * of it.
-             */
-            if (res_key_array_p[0] != NULL)
-                return FALSE;
-            copy_ext(keyA, rcrdA, res_key_array_p[2], res_rcrd_array_p[2]);
-            j++;
-            if (j == nkeys_found_B)
-                return FALSE;
-            copy_ext( keyB, rcrdB,
-                      key_array_kth(&state, key_array_B, j),
-                      rcrd_array_kth(&state, rcrd_array_B, j));
-            break;
-            
-        case OC_XT_CMP_PART_OVERLAP_SML:
-        case OC_XT_CMP_PART_OVERLAP_GRT:
-            return FALSE;
+    for (i=0; i<num && key_array[i] <= top_key; i++) {
+        if (key_array[i] + rcrd_array[i].len - 1 > top_key)
+            rcrd_array[i].len = top_key - key_array[i] + 1;
 
-        default:
-            ERR(("sanity"));
+        if (n > 0 &&
+            key_array[n-1] + rcrd_array[n-1].len == key_array[i] &&
+            rcrd_array[n-1].data + rcrd_array[n-1].len == rcrd_array[i].data) {
+            rcrd_array[n-1].len += rcrd_array[i].len;
+            continue;
         }
+        key_array[n] = key_array[i];
+        rcrd_array[n] = rcrd_array[i];
+        n++;
     }
+    return n;
+}
+
+// Compare two normalized extent arrays, ignoring the free-space they came from
+static bool ext_array_equal(int n1,
+                            uint32 *key_array1,
+                            Oc_xt_test_rcrd *rcrd_array1,
+                            int n2,
+                            uint32 *key_array2,
+                            Oc_xt_test_rcrd *rcrd_array2)
+{
+    int i;
 
+    if (n1 != n2)
+        return FALSE;
+    for (i=0; i<n1; i++)
+        if (key_array1[i] != key_array2[i] ||
+            rcrd_array1[i].len != rcrd_array2[i].len ||
+            rcrd_array1[i].data != rcrd_array2[i].data)
+            return FALSE;
     return TRUE;
 }
 
@@ -957,7 +929,7 @@ void oc_xt_test_utl_lookup_range(Oc_wu *wu_p,
     uint32 key_array1[30], key_array2[30];
     Oc_xt_test_rcrd rcrd_array1[30], rcrd_array2[30];
     int nkeys_found1, nkeys_found2;
-    bool allow_sub_match = FALSE;
+    uint32 top_key = hi_key;
     
     total_ops++;
     if (verbose) {
@@ -985,14 +957,23 @@ void oc_xt_test_utl_lookup_range(Oc_wu *wu_p,
         (struct Oc_xt_rcrd*)rcrd_array2, 
         &nkeys_found2);
 
+    /* The tree merges adjacent extents, and splits them differently
+     * from the linked-list. A lookup that fills up the array covers
+     * the range only up to the end of its last extent. Compare the
+     * normalized results up to where both are complete.
+     */
     if (30 == nkeys_found1)
-        allow_sub_match = TRUE;
-    if (ext_array_compare(
-            nkeys_found1,
-            (struct Oc_xt_key*)key_array1, (struct Oc_xt_rcrd*)rcrd_array1, 
-            nkeys_found2,
-            (struct Oc_xt_key*)key_array2, (struct Oc_xt_rcrd*)rcrd_array2,
-            allow_sub_match))
+        top_key = MIN(top_key,
+                      key_array1[29] + rcrd_array1[29].len - 1);
+    if (30 == nkeys_found2)
+        top_key = MIN(top_key,
+                      key_array2[29] + rcrd_array2[29].len - 1);
+    nkeys_found1 = ext_array_normalize(nkeys_found1, key_array1, rcrd_array1,
+                                       top_key);
+    nkeys_found2 = ext_array_normalize(nkeys_found2, key_array2, rcrd_array2,
+                                       top_key);
+    if (ext_array_equal(nkeys_found1, key_array1, rcrd_array1,
+                        nkeys_found2, key_array2, rcrd_array2))
         return;
 
     // error case
@@ -1024,6 +1005,118 @@ void oc_xt_test_utl_lookup_range(Oc_wu *wu_p,
     if (verbose) oc_xt_test_utl_display(FALSE);
 }
 
+void oc_xt_test_utl_lookup_ofs(Oc_wu *wu_p, uint32 key, bool check)
+{
+    uint32 key1, key2;
+    Oc_xt_test_rcrd rcrd1, rcrd2;
+    int nkeys_found2;
+    bool found1;
+    
+    total_ops++;
+    if (verbose) {
+        printf("// lookup_ofs [key=%lu]\n", key);
+        fflush(stdout);
+    }
+
+    found1 = oc_xt_lookup_ofs_b(wu_p, &state,
+                                (struct Oc_xt_key*)&key,
+                                (struct Oc_xt_key*)&key1,
+                                (struct Oc_xt_rcrd*)&rcrd1);
+    if (!check) return;
+
+    /* The linked-list chops the extent to [key-key]. The tree returns
+     * the whole extent, which may also be merged with its neighbors,
+     * compare the data at [key] only.
+     */
+    oc_xt_alt_lookup_range_b(
+        wu_p, &alt_state,
+        (struct Oc_xt_key*)&key,
+        (struct Oc_xt_key*)&key,
+        1,
+        (struct Oc_xt_key*)&key2,
+        (struct Oc_xt_rcrd*)&rcrd2, 
+        &nkeys_found2);
+
+    if (found1 != (1 == nkeys_found2) ||
+        (found1 &&
+         (0 != rcrd_compare0((struct Oc_xt_key*)&key,
+                             (struct Oc_xt_key*)&key1,
+                             (struct Oc_xt_rcrd*)&rcrd1) ||
+          rcrd1.data + (key - key1) != rcrd2.data)))
+    {
+        oc_xt_test_utl_display(TRUE);
+        oc_xt_dbg_output_end((struct Oc_utl_file*)stdout);
+        ERR(("mismatch in lookup_ofs(%lu) tree=%s list=%s",
+             key, found1 ? "hit" : "miss", nkeys_found2 ? "hit" : "miss"));
+    }
+}
+
+/* The cursor has to return the same extents as lookup-range, which is
+ * checked against the linked-list elsewhere. Up to 30 extents are read;
+ * the cursor is closed before the range is exhausted if there are
+ * more.
+ *
+ * Between calls, the cursor may hold its leaf and nothing else. Now and
+ * then the generation of the tree is bumped, as by a writer that holds
+ * the tree lock, which makes the cursor descend again.
+ */
+void oc_xt_test_utl_cursor(Oc_wu *wu_p,
+                           uint32 lo_key,
+                           uint32 hi_key,
+                           bool check)
+{
+    Oc_xt_cursor cur;
+    uint32 key_array1[30], key_array2[30];
+    Oc_xt_test_rcrd rcrd_array1[30], rcrd_array2[30];
+    int nkeys_found1 = 0, nkeys_found2, j;
+
+    total_ops++;
+    if (verbose) {
+        printf("// cursor [lo_key=%lu, hi_key=%lu]\n", lo_key, hi_key);
+        fflush(stdout);
+    }
+    
+    oc_xt_cursor_open_b(wu_p, &state,
+                        &cur,
+                        (struct Oc_xt_key*)&lo_key,
+                        (struct Oc_xt_key*)&hi_key);
+    while (nkeys_found1 < 30 &&
+           oc_xt_cursor_next_b(wu_p, &cur,
+                               (struct Oc_xt_key*)&key_array1[nkeys_found1],
+                               (struct Oc_xt_rcrd*)&rcrd_array1[nkeys_found1])) {
+        nkeys_found1++;
+        if (oc_utl_trk_is_held(wu_p, &state.lock) ||
+            wu_p->rm_p->utl_rm.refs.sum > 1)
+            ERR(("the cursor holds %d locks between calls",
+                 wu_p->rm_p->utl_rm.refs.sum));
+        if (0 == oc_xt_test_utl_random_number(4))
+            state.gen++;
+    }
+    oc_xt_cursor_close(wu_p, &cur);
+    if (wu_p->rm_p->utl_rm.refs.sum != 0)
+        ERR(("a closed cursor holds %d locks", wu_p->rm_p->utl_rm.refs.sum));
+    
+    if (!check) return;
+    
+    oc_xt_lookup_range_b(
+        wu_p, &state,
+        (struct Oc_xt_key*)&lo_key,
+        (struct Oc_xt_key*)&hi_key,
+        30,
+        (struct Oc_xt_key*)key_array2,
+        (struct Oc_xt_rcrd*)rcrd_array2, 
+        &nkeys_found2);
+
+    if (nkeys_found1 != nkeys_found2)
+        ERR(("mismatch in cursor(%lu, %lu), #entries cursor=%d lookup-range=%d",
+             lo_key, hi_key, nkeys_found1, nkeys_found2));
+    for (j=0; j<nkeys_found1; j++)
+        if (key_array1[j] != key_array2[j] ||
+            rcrd_array1[j].len != rcrd_array2[j].len ||
+            rcrd_array1[j].data != rcrd_array2[j].data)
+            ERR(("mismatch in cursor(%lu, %lu), entry %d", lo_key, hi_key, j));
+}
+
 void oc_xt_test_utl_insert( Oc_wu *wu_p,
                             uint32 key,
                             uint32 length,
@@ -1073,6 +1166,166 @@ void oc_xt_test_utl_insert( Oc_wu *wu_p,
     if (verbose) oc_xt_test_utl_display(FALSE);
 }
 
+void oc_xt_test_utl_insert_multi(Oc_wu *wu_p,
+                                 int num,
+                                 uint32 *key_array,
+                                 uint32 *len_array,
+                                 bool check)
+{
+    uint64 rc1, rc2;
+    Oc_xt_test_rcrd rcrd_array1[OC_XT_TEST_UTL_MAX_MULTI];
+    Oc_xt_test_rcrd rcrd_array2[OC_XT_TEST_UTL_MAX_MULTI];
+    int i;
+    
+    total_ops++;
+    oc_utl_assert(num <= OC_XT_TEST_UTL_MAX_MULTI);
+    if (verbose) {
+        printf("// insert_multi num=%d [%lu-%lu]\n", num,
+               key_array[0], key_array[num-1] + len_array[num-1] - 1);
+        fflush(stdout);
+    }
+
+    for (i=0; i<num; i++) {
+        oc_utl_assert(len_array[i] > 0);
+        rcrd_array1[i].len = len_array[i];
+        rcrd_array1[i].data = oc_xt_test_fs_alloc(fs_ctx_p, len_array[i]);
+        rcrd_array1[i].fs_impl = FS_REAL;
+    }
+    
+    /* Allocate all the space up front for the linked-list too, so that
+     * both free-spaces end up with the same layout.
+     */
+    for (i=0; i<num; i++) {
+        rcrd_array2[i].len = len_array[i];
+        rcrd_array2[i].data = oc_xt_test_fs_alloc(fs_ctx_alt_p, len_array[i]);
+        rcrd_array2[i].fs_impl = FS_ALT;
+    }
+    
+    rc1 = oc_xt_insert_multi_b(wu_p, &state, num,
+                               (struct Oc_xt_key*)key_array,
+                               (struct Oc_xt_rcrd*)rcrd_array1); 
+
+    // the linked-list gets the extents one by one
+    rc2 = 0;
+    for (i=0; i<num; i++)
+        rc2 += oc_xt_alt_insert_b(wu_p, &alt_state, 
+                                  (struct Oc_xt_key*)&key_array[i],
+                                  (struct Oc_xt_rcrd*)&rcrd_array2[i]);
+    
+    if (check) {
+        if (!oc_xt_test_utl_validate()) {
+            printf("    // invalid b-tree\n");
+            oc_xt_test_utl_display(TRUE);
+            oc_xt_dbg_output_end( (struct Oc_utl_file*)stdout );
+            exit(1);
+        }
+        if (rc1 != rc2) {
+            oc_xt_test_utl_display(TRUE);
+            oc_xt_dbg_output_end( (struct Oc_utl_file*)stdout );
+            ERR(("mismatch in insert_multi num=%d, rc1=%Lu rc2=%Lu\n",
+                 num, rc1, rc2));
+        }
+    }
+    
+    if (verbose) oc_xt_test_utl_display(FALSE);
+}
+
+void oc_xt_test_utl_insert_multi_random(Oc_wu *wu_p,
+                                        uint32 lo_key,
+                                        bool check)
+{
+    uint32 key_array[OC_XT_TEST_UTL_MAX_MULTI];
+    uint32 len_array[OC_XT_TEST_UTL_MAX_MULTI];
+    uint32 key = lo_key;
+    int i, num;
+
+    /* A sorted array of extents, with random gaps between them. An
+     * extent may also overlap its predecessor.
+     */
+    num = 1 + oc_xt_test_utl_random_number(OC_XT_TEST_UTL_MAX_MULTI);
+    for (i=0; i<num; i++) {
+        key_array[i] = key;
+        len_array[i] = 1 + oc_xt_test_utl_random_number(10);
+        switch (oc_xt_test_utl_random_number(4)) {
+        case 0:
+            // overlap with the next extent
+            key += oc_xt_test_utl_random_number(len_array[i]);
+            break;
+        default:
+            key += len_array[i] + oc_xt_test_utl_random_number(20);
+            break;
+        }
+    }
+
+    oc_xt_test_utl_insert_multi(wu_p, num, key_array, len_array, check);
+}
+
+void oc_xt_test_utl_bulk_load(Oc_wu *wu_p, int num, uint32 lo_key,
+                              bool coalesce, bool check)
+{
+    uint32 *key_array;
+    Oc_xt_test_rcrd *rcrd_array1, *rcrd_array2;
+    uint32 key = lo_key;
+    int i;
+    
+    total_ops++;
+    if (verbose) {
+        printf("// bulk_load num=%d lo_key=%lu coalesce=%s\n",
+               num, lo_key, coalesce ? "TRUE" : "FALSE");
+        fflush(stdout);
+    }
+
+    key_array = (uint32*) malloc(num * sizeof(uint32));
+    rcrd_array1 = (Oc_xt_test_rcrd*) malloc(num * sizeof(Oc_xt_test_rcrd));
+    rcrd_array2 = (Oc_xt_test_rcrd*) malloc(num * sizeof(Oc_xt_test_rcrd));
+
+    /* A sorted array of extents. Some of them are adjacent to their
+     * predecessor, and contiguous with it on disk, so they can be
+     * coalesced.
+     */
+    for (i=0; i<num; i++) {
+        key_array[i] = key;
+        rcrd_array1[i].len = 1 + oc_xt_test_utl_random_number(10);
+        rcrd_array1[i].data = oc_xt_test_fs_alloc(fs_ctx_p, rcrd_array1[i].len);
+        rcrd_array1[i].fs_impl = FS_REAL;
+        key += rcrd_array1[i].len;
+        if (oc_xt_test_utl_random_number(2))
+            key += oc_xt_test_utl_random_number(20);
+    }
+    for (i=0; i<num; i++) {
+        rcrd_array2[i].len = rcrd_array1[i].len;
+        rcrd_array2[i].data = oc_xt_test_fs_alloc(fs_ctx_alt_p,
+                                                  rcrd_array2[i].len);
+        rcrd_array2[i].fs_impl = FS_ALT;
+    }
+
+    oc_xt_bulk_load_b(wu_p, &state, num,
+                      (struct Oc_xt_key*)key_array,
+                      (struct Oc_xt_rcrd*)rcrd_array1,
+                      coalesce);
+
+    // the linked-list gets the extents one by one
+    for (i=0; i<num; i++)
+        oc_xt_alt_insert_b(wu_p, &alt_state, 
+                           (struct Oc_xt_key*)&key_array[i],
+                           (struct Oc_xt_rcrd*)&rcrd_array2[i]);
+    
+    free(key_array);
+    free(rcrd_array1);
+    free(rcrd_array2);
+
+    if (check) {
+        if (!oc_xt_test_utl_validate()) {
+            printf("    // invalid b-tree\n");
+            oc_xt_test_utl_display(TRUE);
+            oc_xt_dbg_output_end( (struct Oc_utl_file*)stdout );
+            exit(1);
+        }
+    }
+    
+    if (verbose) oc_xt_test_utl_display(FALSE);
+}
+
 void oc_xt_test_utl_remove_range(Oc_wu *wu_p, uint32 lo_key, uint32 hi_key,
                                  bool check)
 {
@@ -1108,6 +1361,235 @@ void oc_xt_test_utl_remove_range(Oc_wu *wu_p, uint32 lo_key, uint32 hi_key,
     if (verbose) oc_xt_test_utl_display(FALSE);
 }
 
+void oc_xt_test_utl_remove_range_lazy(Oc_wu *wu_p,
+                                      uint32 lo_key, uint32 hi_key,
+                                      bool check)
+{
+    total_ops++;
+    if (verbose) {
+        printf("// remove_range_lazy lo_key=%lu hi_key=%lu\n", lo_key, hi_key);
+        fflush(stdout);
+    }
+    
+    oc_xt_remove_range_lazy_b(wu_p, &state,
+                              (struct Oc_xt_key*)&lo_key, 
+                              (struct Oc_xt_key*)&hi_key); 
+    oc_xt_alt_remove_range_b(wu_p, &alt_state, 
+                             (struct Oc_xt_key*)&lo_key, 
+                             (struct Oc_xt_key*)&hi_key);
+    
+    if (check && !oc_xt_test_utl_validate()) {
+        printf("    // invalid b-tree\n");
+        oc_xt_test_utl_display(TRUE);
+        oc_xt_dbg_output_end((struct Oc_utl_file*)stdout);
+        exit(1);
+    }
+    
+    if (verbose) oc_xt_test_utl_display(FALSE);
+}
+
+void oc_xt_test_utl_reclaim(Oc_wu *wu_p, int num, bool check)
+{
+    int i;
+    
+    if (verbose) {
+        printf("// reclaim num=%d\n", num);
+        fflush(stdout);
+    }
+    
+    for (i=0; i != num; i++)
+        if (!oc_xt_reclaim_b(wu_p, &state))
+            break;
+
+    if (check && !oc_xt_test_utl_validate()) {
+        printf("    // invalid b-tree, or free-space mismatch\n");
+        oc_xt_test_utl_display(TRUE);
+        oc_xt_dbg_output_end((struct Oc_utl_file*)stdout);
+        exit(1);
+    }
+}
+
+void oc_xt_test_utl_find_gap(Oc_wu *wu_p, uint32 lo_key, uint32 len,
+                             bool check)
+{
+    uint32 key1, key2;
+    
+    total_ops++;
+    if (verbose) {
+        printf("// find_gap lo_key=%lu len=%lu\n", lo_key, len);
+        fflush(stdout);
+    }
+    
+    oc_xt_find_gap_b(wu_p, &state, (struct Oc_xt_key*)&lo_key, len,
+                     (struct Oc_xt_key*)&key1);
+    if (!check) return;
+    
+    oc_xt_alt_find_gap_b(wu_p, &alt_state, (struct Oc_xt_key*)&lo_key, len,
+                         (struct Oc_xt_key*)&key2);
+    if (key1 != key2) {
+        oc_xt_test_utl_display(TRUE);
+        oc_xt_dbg_output_end((struct Oc_utl_file*)stdout);
+        ERR(("mismatch in find_gap lo_key=%lu len=%lu  tree=%lu list=%lu",
+             lo_key, len, key1, key2));
+    }
+}
+
+uint64 oc_xt_test_utl_root_gap(Oc_wu *wu_p, uint32 key)
+{
+    Oc_xt_node *root_p;
+    uint64 gap;
+    int k;
+
+    root_p = oc_xt_nd_get_for_read(wu_p, &state, state.root_node_p->disk_addr);
+    if (oc_xt_nd_is_leaf(&state, root_p))
+        ERR(("the root is a leaf, it holds no gap bounds"));
+    k = oc_xt_nd_index_lookup_le_key(wu_p, &state, root_p,
+                                     (struct Oc_xt_key*)&key);
+    if (-1 == k)
+        k = 0;
+    gap = oc_xt_nd_index_get_kth_gap(&state, root_p, k);
+    oc_xt_nd_release(wu_p, &state, root_p);
+    return gap;
+}
+
+/**********************************************************************/
+
+/* Read all the extents in tree [s_p] into [clone_p], the arrays are
+ * allocated here.
+ */
+static void read_all(Oc_wu *wu_p, Oc_xt_state *s_p, Clone *clone_p)
+{
+    uint32 lo_key = 0, hi_key = 0xFFFFFFF0;
+    int nkeys_found, max_num = 30;
+
+    clone_p->num = 0;
+    clone_p->key_array = (uint32*) malloc(max_num * sizeof(uint32));
+    clone_p->rcrd_array = (Oc_xt_test_rcrd*) malloc(max_num * sizeof(Oc_xt_test_rcrd));
+
+    do {
+        if (clone_p->num + 30 > max_num) {
+            max_num *= 2;
+            clone_p->key_array = (uint32*)
+                realloc(clone_p->key_array, max_num * sizeof(uint32));
+            clone_p->rcrd_array = (Oc_xt_test_rcrd*)
+                realloc(clone_p->rcrd_array, max_num * sizeof(Oc_xt_test_rcrd));
+        }
+        oc_utl_assert(clone_p->key_array && clone_p->rcrd_array);
+
+        oc_xt_lookup_range_b(
+            wu_p, s_p,
+            (struct Oc_xt_key*)&lo_key,
+            (struct Oc_xt_key*)&hi_key,
+            30,
+            (struct Oc_xt_key*)&clone_p->key_array[clone_p->num],
+            (struct Oc_xt_rcrd*)&clone_p->rcrd_array[clone_p->num],
+            &nkeys_found);
+        clone_p->num += nkeys_found;
+        if (nkeys_found > 0)
+            lo_key = clone_p->key_array[clone_p->num-1] +
+                clone_p->rcrd_array[clone_p->num-1].len;
+    } while (30 == nkeys_found);
+}
+
+static void clone_free(Clone *clone_p)
+{
+    free(clone_p->key_array);
+    free(clone_p->rcrd_array);
+    memset(clone_p, 0, sizeof(Clone));
+}
+
+void oc_xt_test_utl_clone(Oc_wu *wu_p)
+{
+    Clone *clone_p;
+    int i;
+
+    oc_utl_assert(n_clones < OC_XT_TEST_UTL_MAX_CLONES);
+    if (verbose) {
+        printf("// clone %d\n", n_clones);
+        fflush(stdout);
+    }
+    
+    clone_p = &clone_array[n_clones++];
+    oc_xt_init_state_b(NULL, &clone_p->state, &cfg);
+    oc_xt_clone_b(wu_p, &state, &clone_p->state);
+    read_all(wu_p, &clone_p->state, clone_p);
+
+    /* The linked-list does not share extents with the clone. Both
+     * free-spaces have the same layout, so account for the extents
+     * held by the clone directly.
+     */
+    for (i=0; i<clone_p->num; i++)
+        oc_xt_test_fs_inc_refcount(fs_ctx_alt_p,
+                                   clone_p->rcrd_array[i].data,
+                                   clone_p->rcrd_array[i].len);
+}
+
+void oc_xt_test_utl_clones_verify(Oc_wu *wu_p)
+{
+    Oc_xt_state *st_array[OC_XT_TEST_UTL_MAX_CLONES + 1];
+    Clone tmp;
+    int i, j;
+
+    st_array[0] = &state;
+    for (i=0; i<n_clones; i++)
+        st_array[i+1] = &clone_array[i].state;
+    
+    if (!oc_xt_dbg_validate_clones_b(wu_p, n_clones + 1, st_array)) {
+        oc_xt_test_utl_display(FALSE);
+        for (i=0; i<n_clones; i++)
+            oc_xt_dbg_output_b(wu_p, &clone_array[i].state,
+                               (struct Oc_utl_file*)stdout, "Clone");
+        oc_xt_dbg_output_end((struct Oc_utl_file*)stdout);
+        ERR(("invalid set of clones"));
+    }
+    
+    // The clones must not change when the tree is modified
+    for (i=0; i<n_clones; i++) {
+        Clone *clone_p = &clone_array[i];
+        
+        read_all(wu_p, &clone_p->state, &tmp);
+        if (tmp.num != clone_p->num)
+            ERR(("clone %d has changed, #extents=%d, expected=%d",
+                 i, tmp.num, clone_p->num));
+        for (j=0; j<tmp.num; j++)
+            if (tmp.key_array[j] != clone_p->key_array[j] ||
+                tmp.rcrd_array[j].len != clone_p->rcrd_array[j].len ||
+                tmp.rcrd_array[j].data != clone_p->rcrd_array[j].data ||
+                tmp.rcrd_array[j].fs_impl != clone_p->rcrd_array[j].fs_impl)
+                ERR(("clone %d has changed at extent %d", i, j));
+        clone_free(&tmp);
+    }
+
+    if (!oc_xt_test_fs_compare(fs_ctx_alt_p, fs_ctx_p))
+        ERR(("free-space mismatch with %d clones", n_clones));
+}
+
+void oc_xt_test_utl_clones_delete(Oc_wu *wu_p)
+{
+    int i, j;
+    
+    for (i=0; i<n_clones; i++) {
+        Clone *clone_p = &clone_array[i];
+
+        if (verbose) {
+            printf("// delete clone %d\n", i);
+            fflush(stdout);
+        }
+        oc_xt_delete_b(wu_p, &clone_p->state);
+        for (j=0; j<clone_p->num; j++)
+            oc_xt_test_fs_dealloc(fs_ctx_alt_p,
+                                  clone_p->rcrd_array[j].data,
+                                  clone_p->rcrd_array[j].len);
+        clone_free(clone_p);
+
+        if (!oc_xt_test_fs_compare(fs_ctx_alt_p, fs_ctx_p))
+            ERR(("free-space mismatch after deleting clone %d", i));
+    }
+    n_clones = 0;
+}
+
+/**********************************************************************/
+
 void oc_xt_test_utl_compare_and_verify(Oc_wu *wu_p, int max_int)
 {
     // TODO: need to reimplement this
@@ -1151,11 +1633,15 @@ void oc_xt_test_utl_init_module(void)
     cfg.min_num_ent = min_fanout;
     cfg.node_alloc = oc_xt_test_nd_alloc;
     cfg.node_dealloc = oc_xt_test_nd_dealloc;
-    cfg.node_get = oc_xt_test_nd_get;
+    cfg.node_get_sl = oc_xt_test_nd_get_sl;
+    cfg.node_get_xl = oc_xt_test_nd_get_xl;
     cfg.node_release = oc_xt_test_nd_release;
     cfg.node_mark_dirty = oc_xt_test_nd_mark_dirty;
+    cfg.fs_inc_refcount = oc_xt_test_nd_fs_inc_refcount;
+    cfg.fs_get_refcount = oc_xt_test_nd_fs_get_refcount;
     cfg.key_compare = key_compare;
     cfg.key_inc = key_inc;
+    cfg.key_distance = key_distance;
     cfg.key_to_string = key_to_string;
     cfg.rcrd_compare = rcrd_compare;
     cfg.rcrd_compare0 = rcrd_compare0;
@@ -1165,8 +1651,10 @@ void oc_xt_test_utl_init_module(void)
     cfg.rcrd_chop_top = rcrd_chop_top;
     cfg.rcrd_end_offset = rcrd_end_offset;
     cfg.rcrd_split_into_sub = rcrd_split_into_sub;
+    cfg.rcrd_try_merge = no_merge ? NULL : rcrd_try_merge;
     cfg.rcrd_length = rcrd_length;
     cfg.rcrd_release = rcrd_release;
+    cfg.rcrd_inc_refcount = rcrd_inc_refcount;
     cfg.rcrd_to_string = rcrd_to_string;
     cfg.fs_query_alloc = fs_query_alloc;
     cfg.fs_query_dealloc = fs_query_dealloc;
@@ -1199,6 +1687,9 @@ bool oc_xt_test_utl_parse_cmd_line(int argc, char *argv[])
         else if (strcmp(argv[i], "-stat") == 0) {
             statistics = TRUE;
         }       
+        else if (strcmp(argv[i], "-no_merge") == 0) {
+            no_merge = TRUE;
+        }
         else if (strcmp(argv[i], "-max_int") == 0) {
 	    if (++i >= argc)
                 return FALSE;
@@ -1240,8 +1731,20 @@ bool oc_xt_test_utl_parse_cmd_line(int argc, char *argv[])
                 test_type = OC_XT_TEST_UTL_SMALL_TREES_W_RANGES;
             else if (strcmp(argv[i], "small_trees_mixed") == 0)
                 test_type = OC_XT_TEST_UTL_SMALL_TREES_MIXED;
+            else if (strcmp(argv[i], "sequential") == 0)
+                test_type = OC_XT_TEST_UTL_SEQUENTIAL;
+            else if (strcmp(argv[i], "clones") == 0)
+                test_type = OC_XT_TEST_UTL_CLONES;
+            else if (strcmp(argv[i], "find_gap") == 0)
+                test_type = OC_XT_TEST_UTL_FIND_GAP;
+            else if (strcmp(argv[i], "truncate") == 0)
+                test_type = OC_XT_TEST_UTL_TRUNCATE;
+            else if (strcmp(argv[i], "bulk_load") == 0)
+                test_type = OC_XT_TEST_UTL_BULK_LOAD;
+            else if (strcmp(argv[i], "builtin_ext") == 0)
+                test_type = OC_XT_TEST_UTL_BUILTIN_EXT;
             else
-                ERR(("no such test. valid tests={large_trees,small_trees,small_trees_w_ranges,small_trees_mixed}"));
+                ERR(("no such test. valid tests={large_trees,small_trees,small_trees_w_ranges,small_trees_mixed,sequential,clones,find_gap,truncate,bulk_load,builtin_ext}"));
         } 
         else
             return FALSE;
@@ -1267,7 +1770,8 @@ void oc_xt_test_utl_help_msg (void)
            min_fanout);
     printf("\t -verbose\n");
     printf("\t -stat\n");
-    printf("\t -test <small_trees|large_trees|small_trees_w_ranges|small_trees_mixed>\n");    
+    printf("\t -no_merge\n");
+    printf("\t -test <small_trees|large_trees|small_trees_w_ranges|small_trees_mixed|sequential|clones|find_gap|truncate|bulk_load|builtin_ext>\n");    
     exit(1);
 }
 
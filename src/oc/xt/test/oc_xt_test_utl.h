@@ -51,6 +51,7 @@ extern bool statistics;
 extern int max_root_fanout;
 extern int max_non_root_fanout;
 extern int min_fanout;
+extern bool no_merge;
 extern int total_ops;
 
 typedef enum Oc_xt_test_utl_type {
@@ -59,6 +60,12 @@ typedef enum Oc_xt_test_utl_type {
     OC_XT_TEST_UTL_SMALL_TREES_W_RANGES,
     OC_XT_TEST_UTL_SMALL_TREES_MIXED,
     OC_XT_TEST_UTL_LARGE_TREES,
+    OC_XT_TEST_UTL_SEQUENTIAL,
+    OC_XT_TEST_UTL_CLONES,
+    OC_XT_TEST_UTL_FIND_GAP,
+    OC_XT_TEST_UTL_TRUNCATE,
+    OC_XT_TEST_UTL_BULK_LOAD,
+    OC_XT_TEST_UTL_BUILTIN_EXT,
 } Oc_xt_test_utl_type;
 
 extern Oc_xt_test_utl_type test_type;
@@ -84,15 +91,66 @@ void oc_xt_test_utl_statistics(void);
 void oc_xt_test_utl_lookup_range(Oc_wu *wu_p, uint32 lo_key, uint32 hi_key,
                                         bool check);
 
+// Lookup the extent covering [key]
+void oc_xt_test_utl_lookup_ofs(Oc_wu *wu_p, uint32 key, bool check);
+
+// Iterate over [lo_key, hi_key] with a cursor
+void oc_xt_test_utl_cursor(Oc_wu *wu_p, uint32 lo_key, uint32 hi_key,
+                           bool check);
+
 // Insert an extent into the tree
 void oc_xt_test_utl_insert(Oc_wu *wu_p, uint32 lo_key, uint32 len,
                            bool check);
 
+// Insert an array of extents, sorted by start offset, into the tree
+#define OC_XT_TEST_UTL_MAX_MULTI (64)
+void oc_xt_test_utl_insert_multi(Oc_wu *wu_p, int num,
+                                 uint32 *key_array, uint32 *len_array,
+                                 bool check);
+
+// Insert a random array of extents, starting at [lo_key]
+void oc_xt_test_utl_insert_multi_random(Oc_wu *wu_p, uint32 lo_key,
+                                        bool check);
+
+/* Bulk-load [num] random extents, starting at [lo_key], into an empty
+ * tree. Adjacent extents are coalesced if [coalesce] is TRUE.
+ */
+void oc_xt_test_utl_bulk_load(Oc_wu *wu_p, int num, uint32 lo_key,
+                              bool coalesce, bool check);
+
 void oc_xt_test_utl_remove_range(Oc_wu *wu_p, uint32 lo_key, uint32 hi_key,
                                         bool check);
 
+/* Remove a range lazily. The linked-list removes the range
+ * immediately; the free-spaces match again once the tree has
+ * reclaimed all the detached sub-trees.
+ */
+void oc_xt_test_utl_remove_range_lazy(Oc_wu *wu_p,
+                                      uint32 lo_key, uint32 hi_key,
+                                      bool check);
+
+// Reclaim up to [num] detached sub-trees, all of them if [num] is -1
+void oc_xt_test_utl_reclaim(Oc_wu *wu_p, int num, bool check);
+
+// Find the first free gap of length [len] at, or above, [lo_key]
+void oc_xt_test_utl_find_gap(Oc_wu *wu_p, uint32 lo_key, uint32 len,
+                             bool check);
+
+/* The gap bound of the root entry leading to [key]. The root must be
+ * an index node.
+ */
+uint64 oc_xt_test_utl_root_gap(Oc_wu *wu_p, uint32 key);
+
 void oc_xt_test_utl_finalize(int refcnt);
 
+/* Clones of the tree. The clones are not modified; each one is checked
+ * against a copy of the extents it held when it was taken.
+ */
+#define OC_XT_TEST_UTL_MAX_CLONES (4)
+void oc_xt_test_utl_clone(Oc_wu *wu_p);
+void oc_xt_test_utl_clones_verify(Oc_wu *wu_p);
+void oc_xt_test_utl_clones_delete(Oc_wu *wu_p);
+
 void oc_xt_test_utl_setup_wu(Oc_wu *wu_p, struct Oc_rm_ticket *rm_ticket_p);
 uint32 oc_xt_test_utl_random_number(uint32 top);
 
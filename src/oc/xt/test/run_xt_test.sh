@@ -16,13 +16,21 @@ then
 fi
 
 #-----------------------------------------------------------------
-# running the test with various error-injection parameters
+# running the test with various error-injection parameters. Every
+# other run is without merging of adjacent extents.
 
+merge_flags=""
 for fanout in 5 11 19
   do
   for max_int in 100 1000 2000
     do
-    exec_flags="-max_int $max_int -max_non_root_fanout $fanout -max_root_fanout 5  -test small_trees $flags"
+    if test -z "$merge_flags"
+    then
+	merge_flags="-no_merge"
+    else
+	merge_flags=""
+    fi
+    exec_flags="-max_int $max_int -max_non_root_fanout $fanout -max_root_fanout 5 $merge_flags -test small_trees $flags"
     echo "Running $oc_xt_test_st $exec_flags"
     $oc_xt_test_st  $exec_flags
 
@@ -34,7 +42,79 @@ for fanout in 5 11 19
 	exit 1
     fi
 
-    exec_flags="-max_int $max_int -max_non_root_fanout $fanout -max_root_fanout 5  -test small_trees_w_ranges $flags"
+    exec_flags="-max_int $max_int -max_non_root_fanout $fanout -max_root_fanout 5 $merge_flags -test small_trees_w_ranges $flags"
+    echo "Running $oc_xt_test_st $exec_flags"
+    $oc_xt_test_st $exec_flags
+
+    if test $? -ne 0
+	then
+	echo "-----------------------------------------------"
+	echo "Failure of test: $oc_xt_test_st $exec_flags"
+	echo "-----------------------------------------------"
+	exit 1
+    fi
+
+    exec_flags="-max_int $max_int -max_non_root_fanout $fanout -max_root_fanout 5 $merge_flags -test small_trees_mixed $flags"
+    echo "Running $oc_xt_test_st $exec_flags"
+    $oc_xt_test_st $exec_flags
+
+    if test $? -ne 0
+	then
+	echo "-----------------------------------------------"
+	echo "Failure of test: $oc_xt_test_st $exec_flags"
+	echo "-----------------------------------------------"
+	exit 1
+    fi
+
+    exec_flags="-max_int $max_int -max_non_root_fanout $fanout -max_root_fanout 5 $merge_flags -test sequential $flags"
+    echo "Running $oc_xt_test_st $exec_flags"
+    $oc_xt_test_st $exec_flags
+
+    if test $? -ne 0
+	then
+	echo "-----------------------------------------------"
+	echo "Failure of test: $oc_xt_test_st $exec_flags"
+	echo "-----------------------------------------------"
+	exit 1
+    fi
+
+    exec_flags="-max_int $max_int -max_non_root_fanout $fanout -max_root_fanout 5 $merge_flags -test clones $flags"
+    echo "Running $oc_xt_test_st $exec_flags"
+    $oc_xt_test_st $exec_flags
+
+    if test $? -ne 0
+	then
+	echo "-----------------------------------------------"
+	echo "Failure of test: $oc_xt_test_st $exec_flags"
+	echo "-----------------------------------------------"
+	exit 1
+    fi
+
+    exec_flags="-max_int $max_int -max_non_root_fanout $fanout -max_root_fanout 5 $merge_flags -test find_gap $flags"
+    echo "Running $oc_xt_test_st $exec_flags"
+    $oc_xt_test_st $exec_flags
+
+    if test $? -ne 0
+	then
+	echo "-----------------------------------------------"
+	echo "Failure of test: $oc_xt_test_st $exec_flags"
+	echo "-----------------------------------------------"
+	exit 1
+    fi
+
+    exec_flags="-max_int $max_int -max_non_root_fanout $fanout -max_root_fanout 5 $merge_flags -test truncate $flags"
+    echo "Running $oc_xt_test_st $exec_flags"
+    $oc_xt_test_st $exec_flags
+
+    if test $? -ne 0
+	then
+	echo "-----------------------------------------------"
+	echo "Failure of test: $oc_xt_test_st $exec_flags"
+	echo "-----------------------------------------------"
+	exit 1
+    fi
+
+    exec_flags="-max_int $max_int -max_non_root_fanout $fanout -max_root_fanout 5 $merge_flags -test bulk_load $flags"
     echo "Running $oc_xt_test_st $exec_flags"
     $oc_xt_test_st $exec_flags
 
@@ -46,7 +126,7 @@ for fanout in 5 11 19
 	exit 1
     fi
 
-    exec_flags="-max_int $max_int -max_non_root_fanout $fanout -max_root_fanout 5  -test small_trees_mixed $flags"
+    exec_flags="-max_int $max_int -max_non_root_fanout $fanout -max_root_fanout 5  -test builtin_ext $flags"
     echo "Running $oc_xt_test_st $exec_flags"
     $oc_xt_test_st $exec_flags
 
@@ -60,7 +140,7 @@ for fanout in 5 11 19
 
     for num_rounds in 100 1000 2000
       do
-      exec_flags="-max_int $max_int -num_rounds $num_rounds -max_non_root_fanout $fanout -max_root_fanout 5 -test large_trees $flags "
+      exec_flags="-max_int $max_int -num_rounds $num_rounds -max_non_root_fanout $fanout -max_root_fanout 5 $merge_flags -test large_trees $flags "
       echo "Running $oc_xt_test_st $exec_flags"
       $oc_xt_test_st $exec_flags
 
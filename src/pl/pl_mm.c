@@ -30,18 +30,38 @@
  */
 /**************************************************************/
 /***************************************************************************/
+/*
+ * Object pools are carved out of large, contiguous, slabs. Each pool
+ * has a central depot of free objects, protected by a mutex, and each
+ * thread keeps a small magazine of free objects per pool. Allocation
+ * and release go through the calling thread's magazine and do not
+ * take any lock. The depot is touched only to refill an empty
+ * magazine, or to drain a full one, half a magazine at a time.
+ *
+ * A magazine is held, with an atomic flag, by its owner for the
+ * duration of an operation. When the depot runs dry, the thread
+ * refilling it steals the contents of the magazines of other threads
+ * that are not held at the moment. A pool of pages grows by a slab
+ * instead of failing.
+ */
+/***************************************************************************/
 #include <pthread.h>
 #include <sys/mman.h>
 #include <string.h>
+#include <stdlib.h>
 #include <malloc.h>
 
-#include "pl_base.h"
 #include "pl_base.h"
 #include "pl_dstru.h"
 #include "pl_trace.h"
 #include "pl_mm_int.h"
 
 /***************************************************************************/
+#define PL_MM_SLAB_SIZE   (256 * 1024)       // target size of a slab
+#define PL_MM_HUGE_SIZE   (2 * 1024 * 1024)  // size, and alignment, of a huge page
+#define PL_MM_MAG_SIZE    (32)               // objects in a magazine
+#define PL_MM_MAX_POOLS   (64)               // pools that can have magazines
+
 static int align (int size, Pl_mm_alignment_t align);
 
 /***************************************************************************/
@@ -56,6 +76,18 @@ void* pl_mm_malloc (int size)
     return ptr;
 }
 
+void* pl_mm_malloc_aligned (int size, Pl_mm_alignment_t align_i)
+{
+    void *ptr;
+
+    if (align_i < sizeof(void*))
+        align_i = sizeof(void*);
+    if (posix_memalign(&ptr, align_i, size) != 0)
+       ERR(("out of memory"));
+
+    return ptr;
+}
+
 void pl_mm_free(void *ptr)
 {
     free(ptr);
@@ -67,17 +99,44 @@ void pl_mm_init(void)
 {
 }
 
-
 /***************************************************************************/
 // object-pools
 
+typedef struct Pl_mm_mag {
+    uint32 pool_id;      // the pool this magazine caches objects for
+    volatile int held;   // taken by the owner, or by a thread stealing from it
+    struct Pl_mm_mag *next;  // in the list of the magazines of the pool
+    int count;
+    void *objs[PL_MM_MAG_SIZE];
+} Pl_mm_mag;
+
 typedef struct Pl_mm_op_s {
-    int size;   // object size
-    int number; // num of objects in pool
-    Ss_slist free_list;   /* A pointer to the head of the free list */
-    void** all_objects_pp;
+    uint32 id;          // unique, never reused
+    int slot;           // index of the per-thread magazine, -1 if none
+    int size;           // object size
+    int aligned_size;   // distance between objects in a slab
+    int number;         // num of objects in pool
+    bool grow;          // add a slab when the pool runs out
+    bool huge;          // slabs are backed by huge pages
+    void (*init_object)(void *object);
+    pthread_mutex_t depot_lock;
+    Ss_slist free_list; // the depot, a list of free objects
+    Pl_mm_mag *mags_p;  // the magazines of the threads, under [depot_lock]
+    int num_slabs;
+    int max_slabs;      // the length of [slabs_pp]
+    int objs_per_slab;
+    size_t slab_size;
+    char **slabs_pp;
 } Pl_mm_op_s;
 
+static pthread_mutex_t pools_lock = PTHREAD_MUTEX_INITIALIZER;
+static Pl_mm_op *pools[PL_MM_MAX_POOLS];
+static uint32 next_pool_id = 1;
+
+static pthread_once_t mag_once = PTHREAD_ONCE_INIT;
+static pthread_key_t mag_key;
+static __thread Pl_mm_mag *mags[PL_MM_MAX_POOLS];
+
 /* Align [size] by [align].
  *
  * For example,
@@ -89,9 +148,231 @@ static int align (int size, Pl_mm_alignment_t align)
 {
     if (1 == align) return size;
 
-    return ((size+align)/align) * align;
+    return ((size + align - 1)/align) * align;
+}
+
+static bool mag_try_hold(Pl_mm_mag *mag_p)
+{
+    return (0 == __sync_lock_test_and_set(&mag_p->held, 1));
+}
+
+static void mag_release(Pl_mm_mag *mag_p)
+{
+    __sync_lock_release(&mag_p->held);
+}
+
+// Allocate a slab, aligned and advised for huge pages if [huge]
+static char *slab_alloc(size_t slab_size, bool huge)
+{
+    char *map_p, *slab_p;
+    size_t map_size = slab_size;
+
+    if (huge)
+        map_size += PL_MM_HUGE_SIZE;
+    map_p = (char*) mmap(NULL, map_size, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED == map_p)
+        ERR(("out of memory"));
+    if (!huge)
+        return map_p;
+
+    // trim the mapping down to an aligned slab
+    slab_p = (char*) (((unsigned long) map_p + PL_MM_HUGE_SIZE - 1) &
+                      ~((unsigned long) PL_MM_HUGE_SIZE - 1));
+    if (slab_p > map_p)
+        munmap(map_p, slab_p - map_p);
+    if (map_p + map_size > slab_p + slab_size)
+        munmap(slab_p + slab_size, (map_p + map_size) - (slab_p + slab_size));
+#ifdef MADV_HUGEPAGE
+    (void) madvise(slab_p, slab_size, MADV_HUGEPAGE);
+#endif
+    return slab_p;
+}
+
+/* Add a slab to [pool_p], and carve up to [n] objects out of it into
+ * the depot.
+ *
+ * assumption: the depot is locked, or the pool is not in use yet
+ */
+static void slab_add(Pl_mm_op *pool_p, int n)
+{
+    char **slabs_pp, *slab_p, *obj;
+    int k;
+
+    if (pool_p->num_slabs == pool_p->max_slabs) {
+        pool_p->max_slabs = 2 * pool_p->max_slabs + 1;
+        slabs_pp = (char**) pl_mm_malloc(sizeof(char*) * pool_p->max_slabs);
+        if (pool_p->num_slabs > 0) {
+            memcpy(slabs_pp, pool_p->slabs_pp, sizeof(char*) * pool_p->num_slabs);
+            pl_mm_free(pool_p->slabs_pp);
+        }
+        pool_p->slabs_pp = slabs_pp;
+    }
+
+    slab_p = slab_alloc(pool_p->slab_size, pool_p->huge);
+    pool_p->slabs_pp[pool_p->num_slabs++] = slab_p;
+    for (k=0; k<pool_p->objs_per_slab && k<n; k++) {
+        obj = slab_p + k * pool_p->aligned_size;
+        if (NULL != pool_p->init_object)
+            (*pool_p->init_object)(obj);
+        ssslist_add_tail(&pool_p->free_list, (Ss_slist_node*)obj);
+    }
+    pool_p->number += k;
+}
+
+/* The depot of [pool_p] is empty. Steal the objects cached in the
+ * magazines of other threads, except for [self_p]. Failing that, grow
+ * the pool if it can.
+ *
+ * assumption: the depot is locked
+ */
+static void depot_refill(Pl_mm_op *pool_p, Pl_mm_mag *self_p)
+{
+    Pl_mm_mag *mag_p;
+
+    for (mag_p = pool_p->mags_p; mag_p != NULL; mag_p = mag_p->next) {
+        if (mag_p == self_p || 0 == mag_p->count || !mag_try_hold(mag_p))
+            continue;
+        while (mag_p->count > 0)
+            ssslist_add_head(&pool_p->free_list,
+                             (Ss_slist_node*) mag_p->objs[--mag_p->count]);
+        mag_release(mag_p);
+    }
+
+    if (ssslist_empty(&pool_p->free_list) && pool_p->grow)
+        slab_add(pool_p, pool_p->objs_per_slab);
+}
+
+// move up to [n] objects from the depot of [pool_p] into [mag_p]
+static void depot_get(Pl_mm_op *pool_p, Pl_mm_mag *mag_p, int n)
+{
+    pthread_mutex_lock(&pool_p->depot_lock);
+    if (ssslist_empty(&pool_p->free_list))
+        depot_refill(pool_p, mag_p);
+    while (n-- > 0 && !ssslist_empty(&pool_p->free_list))
+        mag_p->objs[mag_p->count++] =
+            (void*) ssslist_remove_head(&pool_p->free_list);
+    pthread_mutex_unlock(&pool_p->depot_lock);
+}
+
+// move [n] objects from [mag_p] back into the depot of [pool_p]
+static void depot_put(Pl_mm_op *pool_p, Pl_mm_mag *mag_p, int n)
+{
+    pthread_mutex_lock(&pool_p->depot_lock);
+    while (n-- > 0 && mag_p->count > 0)
+        ssslist_add_head(&pool_p->free_list,
+                         (Ss_slist_node*) mag_p->objs[--mag_p->count]);
+    pthread_mutex_unlock(&pool_p->depot_lock);
 }
 
+// return the magazines of an exiting thread to their depots
+static void mag_thread_exit(void *dummy)
+{
+    Pl_mm_mag **mags_pp = (Pl_mm_mag**) dummy;
+    Pl_mm_mag **link_pp;
+    Pl_mm_op *pool_p;
+    int i;
+
+    pthread_mutex_lock(&pools_lock);
+    for (i=0; i<PL_MM_MAX_POOLS; i++) {
+        if (NULL == mags_pp[i])
+            continue;
+        pool_p = pools[i];
+        if (pool_p && pool_p->id == mags_pp[i]->pool_id) {
+            depot_put(pool_p, mags_pp[i], mags_pp[i]->count);
+
+            // no one steals from the magazine while the depot is locked
+            pthread_mutex_lock(&pool_p->depot_lock);
+            for (link_pp = &pool_p->mags_p; *link_pp != NULL;
+                 link_pp = &(*link_pp)->next)
+                if (*link_pp == mags_pp[i]) {
+                    *link_pp = mags_pp[i]->next;
+                    break;
+                }
+            pthread_mutex_unlock(&pool_p->depot_lock);
+        }
+        free(mags_pp[i]);
+        mags_pp[i] = NULL;
+    }
+    pthread_mutex_unlock(&pools_lock);
+}
+
+static void mag_key_create(void)
+{
+    if (pthread_key_create(&mag_key, mag_thread_exit) != 0)
+        ERR(("could not create a thread key for the object pools"));
+}
+
+/* Return the calling thread's magazine for [pool_p], held. Return NULL
+ * if the pool does not use magazines, or if another thread is stealing
+ * from the magazine.
+ */
+static Pl_mm_mag *mag_get(Pl_mm_op *pool_p)
+{
+    Pl_mm_mag *mag_p;
+
+    if (pool_p->slot < 0)
+        return NULL;
+
+    mag_p = mags[pool_p->slot];
+    if (mag_p && mag_p->pool_id == pool_p->id)
+        return mag_try_hold(mag_p) ? mag_p : NULL;
+
+    // first use of the slot by this thread, or a left-over from a deleted pool
+    if (NULL == mag_p) {
+        pthread_once(&mag_once, mag_key_create);
+        pthread_setspecific(mag_key, mags);
+        mag_p = (Pl_mm_mag*) pl_mm_malloc(sizeof(Pl_mm_mag));
+        mags[pool_p->slot] = mag_p;
+    }
+    mag_p->pool_id = pool_p->id;
+    mag_p->count = 0;
+    mag_p->held = 1;
+
+    pthread_mutex_lock(&pool_p->depot_lock);
+    mag_p->next = pool_p->mags_p;
+    pool_p->mags_p = mag_p;
+    pthread_mutex_unlock(&pool_p->depot_lock);
+
+    return mag_p;
+}
+
+static Pl_mm_op *pool_new(uint32 size_i,
+                          Pl_mm_alignment_t align_i,
+                          size_t slab_size,
+                          bool huge)
+{
+    Pl_mm_op *new_pool ;
+    int j;
+
+    new_pool = (Pl_mm_op*) pl_mm_malloc(sizeof(Pl_mm_op_s));
+    memset(new_pool, 0, sizeof(Pl_mm_op_s));
+    new_pool->size = size_i;
+    new_pool->aligned_size = align(size_i, align_i);
+    new_pool->huge = huge;
+    pthread_mutex_init(&new_pool->depot_lock, NULL);
+    ssslist_init(&new_pool->free_list);
+
+    new_pool->objs_per_slab = slab_size / new_pool->aligned_size;
+    if (0 == new_pool->objs_per_slab)
+        new_pool->objs_per_slab = 1;
+    new_pool->slab_size = align(new_pool->objs_per_slab * new_pool->aligned_size,
+                                huge ? PL_MM_HUGE_SIZE : PL_MM_ALIGN_PAGE);
+
+    // register the pool, so it can have per-thread magazines
+    pthread_mutex_lock(&pools_lock);
+    new_pool->id = next_pool_id++;
+    new_pool->slot = -1;
+    for (j=0; j<PL_MM_MAX_POOLS; j++)
+        if (NULL == pools[j]) {
+            pools[j] = new_pool;
+            new_pool->slot = j;
+            break;
+        }
+    pthread_mutex_unlock(&pools_lock);
+
+    return new_pool;
+}
 
 /*
   [Allon 11/1/06] added a member called all_objects_pp which saves
@@ -99,6 +380,9 @@ static int align (int size, Pl_mm_alignment_t align)
   memory overhead could be reduced if we allocate many objects in one malloc.
   (I didn't want to allocated them all at once because it may be a very
   large malloc)
+
+  Objects are now allocated in slabs of about PL_MM_SLAB_SIZE bytes,
+  the slabs are kept so they can be released on pool delete.
  */
 bool pl_mm_pool_create( uint32 size_i,
                         Pl_mm_alignment_t align_i,
@@ -107,85 +391,115 @@ bool pl_mm_pool_create( uint32 size_i,
                         Pl_mm_op **pool_o )
 {
     Pl_mm_op *new_pool ;
-    uint32 i;
-    char *obj;
-    int aligned_size;
 
     if (size_i < sizeof(int))
         ERR(("can't create a memory pool for objects smaller than an integer"));
     if (size_i < sizeof(void*))
         ERR(("can't create a memory pool for objects smaller than a pointer"));
+    if (align_i < sizeof(void*))
+        align_i = sizeof(void*);
 
-    new_pool = (Pl_mm_op*) pl_mm_malloc(sizeof(Pl_mm_op_s));
-
-    memset(new_pool, 0, sizeof(Pl_mm_op_s));
-    new_pool->size = size_i;
-    new_pool->number = number_i;
-    new_pool->all_objects_pp =
-        (void**) pl_mm_malloc( sizeof(void*) * number_i );
-    memset( new_pool->all_objects_pp, 0, sizeof(void*) * number_i );
-    *pool_o = new_pool;
-    ssslist_init(&new_pool->free_list);
+    new_pool = pool_new(size_i, align_i, PL_MM_SLAB_SIZE, FALSE);
+    new_pool->init_object = init_object_i;
+    if (number_i > 0 && new_pool->objs_per_slab > (int) number_i) {
+        // a small pool, do not waste a whole slab on it
+        new_pool->objs_per_slab = number_i;
+        new_pool->slab_size = align(number_i * new_pool->aligned_size,
+                                    PL_MM_ALIGN_PAGE);
+    }
 
-    aligned_size = align(size_i, align_i);
-    for (i=0; i<number_i ; i++) {
-	obj = (char*) pl_mm_malloc (aligned_size);
-	memset(obj, 0, aligned_size);
-        new_pool->all_objects_pp[i] = (void*)obj;
+    // carve the objects out of the slabs
+    while (new_pool->number < (int) number_i)
+        slab_add(new_pool, number_i - new_pool->number);
 
-	if (NULL != init_object_i)
-	    (*init_object_i)(obj);
-	ssslist_add_tail(&new_pool->free_list, (Ss_slist_node*)obj);
-    }
+    *pool_o = new_pool;
     return TRUE;
 }
 
+void pl_mm_pool_create_pages( uint32 page_size_i,
+                              bool huge_i,
+                              Pl_mm_op **pool_o )
+{
+    Pl_mm_op *new_pool ;
+
+    new_pool = pool_new(page_size_i, PL_MM_ALIGN_PAGE,
+                        huge_i ? PL_MM_HUGE_SIZE : PL_MM_SLAB_SIZE,
+                        huge_i);
+    new_pool->grow = TRUE;
+    *pool_o = new_pool;
+}
 
 // destroy all objects in pool and release pool resources
 void pl_mm_pool_delete( Pl_mm_op *pool_p,
                         void (*destroy_object_fun)( void *object_fun ) )
 {
-    int i;
-    char *obj;
+    int i, j;
 
     assert(pool_p);
-    assert(pool_p->all_objects_pp);
-    for (i=0;i<pool_p->number;i++) {
-        obj = (char*)pool_p->all_objects_pp[i];
 
-        assert(obj);
+    pthread_mutex_lock(&pools_lock);
+    if (pool_p->slot >= 0)
+        pools[pool_p->slot] = NULL;
+    pthread_mutex_unlock(&pools_lock);
 
-        if (destroy_object_fun) {
-            destroy_object_fun(obj);
-        }
+    for (i=0, j=0; j<pool_p->num_slabs; j++) {
+        int k;
+
+        for (k=0; k<pool_p->objs_per_slab && i<pool_p->number; k++, i++)
+            if (destroy_object_fun)
+                destroy_object_fun(pool_p->slabs_pp[j] + k * pool_p->aligned_size);
 
-        pl_mm_free(obj);
-        pool_p->all_objects_pp[i]=NULL;
+        munmap(pool_p->slabs_pp[j], pool_p->slab_size);
+        pool_p->slabs_pp[j] = NULL;
     }
 
-    pl_mm_free(pool_p->all_objects_pp);
+    pthread_mutex_destroy(&pool_p->depot_lock);
+    if (pool_p->slabs_pp != NULL)
+        pl_mm_free(pool_p->slabs_pp);
     pl_mm_free(pool_p);
 }
 
 bool pl_mm_pool_alloc( Pl_mm_op *pool_i,
                        void **object_o )
 {
-    bool rc = FALSE;
+    Pl_mm_mag *mag_p = mag_get(pool_i);
 
-    if (ssslist_get_length(&pool_i->free_list) > 0) {
-	*object_o = (void*) ssslist_remove_head(&pool_i->free_list);
-	rc = TRUE;
-    } else {
-	*object_o = NULL;
-        rc = FALSE;
+    if (NULL == mag_p) {
+        // no magazine, go directly to the depot
+        pthread_mutex_lock(&pool_i->depot_lock);
+        if (ssslist_empty(&pool_i->free_list))
+            depot_refill(pool_i, NULL);
+        *object_o = (void*) ssslist_remove_head(&pool_i->free_list);
+        pthread_mutex_unlock(&pool_i->depot_lock);
+        return (NULL != *object_o);
     }
-    return rc;
+
+    if (0 == mag_p->count)
+        depot_get(pool_i, mag_p, PL_MM_MAG_SIZE/2);
+
+    if (mag_p->count > 0)
+	*object_o = mag_p->objs[--mag_p->count];
+    else
+	*object_o = NULL;
+    mag_release(mag_p);
+    return (NULL != *object_o);
 }
 
 void pl_mm_pool_free( Pl_mm_op *pool_i, void *object_i )
 {
-    ssslist_add_head(&pool_i->free_list,
-                     (Ss_slist_node*) object_i);
+    Pl_mm_mag *mag_p = mag_get(pool_i);
+
+    if (NULL == mag_p) {
+        pthread_mutex_lock(&pool_i->depot_lock);
+        ssslist_add_head(&pool_i->free_list, (Ss_slist_node*) object_i);
+        pthread_mutex_unlock(&pool_i->depot_lock);
+        return;
+    }
+
+    if (PL_MM_MAG_SIZE == mag_p->count)
+        depot_put(pool_i, mag_p, PL_MM_MAG_SIZE/2);
+    mag_p->objs[mag_p->count++] = object_i;
+    mag_release(mag_p);
 }
 
 /***************************************************************************/
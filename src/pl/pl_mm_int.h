@@ -53,7 +53,11 @@ void* pl_mm_malloc (int size);
 void  pl_mm_free(void *ptr);
 
 /***************************************************************************/
-/* Functions to create and delete object pools
+/* Functions to create and delete object pools.
+ *
+ * Objects are carved out of large slabs. Allocation and release go
+ * through a per-thread cache, and do not take a lock in the common case.
+ * Objects cached by other threads are taken back when the pool runs out.
  */
 
 typedef enum {
@@ -68,14 +72,29 @@ typedef enum {
   PL_MM_ALIGN_32BYTES   = 32,
   PL_MM_ALIGN_CACHELINE = 32,
   PL_MM_ALIGN_DEFAULT   = 4,
+  PL_MM_ALIGN_PAGE      = 4096,
 } Pl_mm_alignment_t;
 
+/* Raw allocation aligned by [align_i], for example, I/O buffers
+ * aligned to PL_MM_ALIGN_PAGE. Release with pl_mm_free.
+ */
+void* pl_mm_malloc_aligned (int size, Pl_mm_alignment_t align_i);
+
 bool pl_mm_pool_create( uint32 size_i,
                         Pl_mm_alignment_t align_i,
                         uint32 number_i,
                         void (*init_object_i)( void *object_i ),
                         Pl_mm_op **pool_o );
 
+/* A pool of pages of [page_size_i] bytes, aligned to PL_MM_ALIGN_PAGE,
+ * for example, node buffers. The pool starts empty, and grows a slab
+ * at a time, so allocation never fails. With [huge_i], a slab is a
+ * whole huge page, and the system is asked to back it with one.
+ */
+void pl_mm_pool_create_pages( uint32 page_size_i,
+                              bool huge_i,
+                              Pl_mm_op **pool_o );
+
 // destroy all objects in pool and release pool resources
 void pl_mm_pool_delete( Pl_mm_op *pool_p,
                         void (*destroy_object_fun)( void *object_fun ) );
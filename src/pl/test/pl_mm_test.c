@@ -0,0 +1,255 @@
+/**************************************************************/
+/*
+ * Copyright (c) 2014-2015, Ohad Rodeh, IBM Research
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer. 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution. 
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies, 
+ * either expressed or implied, of IBM Research.
+ * 
+ */
+/**************************************************************/
+/* 
+ * A self test for the object pools
+ */
+#include <memory.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+
+#include "pl_int.h"
+
+/********************************************************************/
+#define OBJ_SIZE     (40)
+#define NUM_OBJS     (20000)    // spans several slabs
+#define NUM_ROUNDS   (200000)
+#define NUM_THREADS  (12)
+#define PAGE_SIZE    (4096)
+#define NUM_PAGES    (1000)     // spans several slabs, even huge ones
+
+static Pl_mm_op *pool_p;
+static void *objs[NUM_OBJS];
+static int num_init = 0, num_destroy = 0;
+static pthread_barrier_t barrier;
+
+/********************************************************************/
+
+static void init_object(void *obj_p)
+{
+    memset(obj_p, 0, OBJ_SIZE);
+    num_init++;
+}
+
+static void destroy_object(void *obj_p)
+{
+    num_destroy++;
+}
+
+static int compare_ptr(const void *_p1, const void *_p2)
+{
+    char *p1 = *(char**)_p1;
+    char *p2 = *(char**)_p2;
+
+    if (p1 == p2) return 0;
+    return (p1 < p2) ? -1 : 1;
+}
+
+static void obj_alloc(void **obj_po, uint8 stamp)
+{
+    if (!pl_mm_pool_alloc(pool_p, obj_po))
+        ERR(("the pool ran out of objects"));
+    if ((unsigned long)*obj_po % PL_MM_ALIGN_8BYTES != 0)
+        ERR(("object %p is not aligned", *obj_po));
+    memset(*obj_po, stamp, OBJ_SIZE);
+}
+
+static void obj_check(void *obj_p, uint8 stamp)
+{
+    if (pl_memtest(obj_p, stamp, OBJ_SIZE) != 0)
+        ERR(("object %p was overwritten", obj_p));
+}
+
+/* Allocate every object in the pool, and check that no two of them
+ * overlap.
+ */
+static void alloc_all(void)
+{
+    int i;
+
+    for (i=0; i<NUM_OBJS; i++)
+        obj_alloc(&objs[i], (uint8) i);
+    for (i=0; i<NUM_OBJS; i++)
+        obj_check(objs[i], (uint8) i);
+
+    qsort(objs, NUM_OBJS, sizeof(void*), compare_ptr);
+    for (i=0; i+1<NUM_OBJS; i++)
+        if ((char*)objs[i] + OBJ_SIZE > (char*)objs[i+1])
+            ERR(("objects %p and %p overlap", objs[i], objs[i+1]));
+}
+
+static void free_all(void)
+{
+    int i;
+
+    for (i=0; i<NUM_OBJS; i++)
+        pl_mm_pool_free(pool_p, objs[i]);
+}
+
+/********************************************************************/
+/* Random allocations and releases, from a single thread. The magazine
+ * is refilled from, and drained into, the depot many times over.
+ */
+static void random_ops(void **arr, int max, int num_rounds, uint32 *seed_p)
+{
+    int i, k, n = 0;
+
+    for (i=0; i<num_rounds; i++) {
+        if (n < max && (0 == n || pl_rand_uint32_r(seed_p, 2) == 0)) {
+            obj_alloc(&arr[n], (uint8) n);
+            n++;
+        }
+        else {
+            // release a random object, move the last one into its place
+            k = pl_rand_uint32_r(seed_p, n);
+            obj_check(arr[k], (uint8) k);
+            pl_mm_pool_free(pool_p, arr[k]);
+            n--;
+            if (k < n) {
+                obj_check(arr[n], (uint8) n);
+                arr[k] = arr[n];
+                memset(arr[k], (uint8) k, OBJ_SIZE);
+            }
+        }
+    }
+    while (n > 0)
+        pl_mm_pool_free(pool_p, arr[--n]);
+}
+
+/********************************************************************/
+/* Each thread works on its own share of the pool, and then releases
+ * everything. Objects are left behind in the magazines, and the main
+ * thread must still be able to allocate the whole pool; it steals them
+ * back.
+ */
+static void *worker_thread(void *arg)
+{
+    int id = (int)(long) arg;
+    uint32 seed = id + 1;
+    int share = NUM_OBJS / NUM_THREADS;
+
+    random_ops(&objs[id * share], share, NUM_ROUNDS / NUM_THREADS, &seed);
+
+    // the main thread allocates the whole pool before we exit
+    pthread_barrier_wait(&barrier);
+    pthread_barrier_wait(&barrier);
+    return NULL;
+}
+
+static void concurrent_ops(void)
+{
+    pthread_t threads[NUM_THREADS];
+    long i;
+
+    pthread_barrier_init(&barrier, NULL, NUM_THREADS + 1);
+    for (i=0; i<NUM_THREADS; i++)
+        pthread_create(&threads[i], NULL, worker_thread, (void*)i);
+
+    pthread_barrier_wait(&barrier);
+    alloc_all();
+    free_all();
+    pthread_barrier_wait(&barrier);
+
+    for (i=0; i<NUM_THREADS; i++)
+        pthread_join(threads[i], NULL);
+    pthread_barrier_destroy(&barrier);
+
+    // the magazines of the exited threads went back to the depot
+    alloc_all();
+    free_all();
+}
+
+/********************************************************************/
+/* A pool of pages starts empty and grows. The pages must be aligned,
+ * and must not overlap.
+ */
+static void page_pool(bool huge)
+{
+    static void *pages[NUM_PAGES];
+    Pl_mm_op *pages_p;
+    int i, k;
+
+    pl_mm_pool_create_pages(PAGE_SIZE, huge, &pages_p);
+    for (k=0; k<2; k++) {
+        for (i=0; i<NUM_PAGES; i++) {
+            if (!pl_mm_pool_alloc(pages_p, &pages[i]))
+                ERR(("a pool of pages failed to grow"));
+            if ((unsigned long)pages[i] % PL_MM_ALIGN_PAGE != 0)
+                ERR(("page %p is not aligned", pages[i]));
+            memset(pages[i], (uint8) i, PAGE_SIZE);
+        }
+        for (i=0; i<NUM_PAGES; i++)
+            if (pl_memtest(pages[i], (uint8) i, PAGE_SIZE) != 0)
+                ERR(("page %p was overwritten", pages[i]));
+        for (i=0; i<NUM_PAGES; i++)
+            pl_mm_pool_free(pages_p, pages[i]);
+    }
+    pl_mm_pool_delete(pages_p, NULL);
+}
+
+/********************************************************************/
+
+int main(int argc, char *argv[])
+{
+    uint32 seed = 1;
+
+    pl_init();
+    if (!pl_mm_pool_create(OBJ_SIZE, PL_MM_ALIGN_8BYTES, NUM_OBJS,
+                           init_object, &pool_p))
+        ERR(("failed to create the pool"));
+    if (num_init < NUM_OBJS)
+        ERR(("only %d objects were initialized", num_init));
+
+    printf("// slabs\n");
+    alloc_all();
+    free_all();
+    alloc_all();
+    free_all();
+
+    printf("// magazine and depot, single thread\n");
+    random_ops(objs, NUM_OBJS, NUM_ROUNDS, &seed);
+
+    printf("// magazines, concurrent\n");
+    concurrent_ops();
+
+    pl_mm_pool_delete(pool_p, destroy_object);
+    if (num_destroy != num_init)
+        ERR(("%d objects were destroyed, %d were created",
+             num_destroy, num_init));
+
+    printf("// pages\n");
+    page_pool(FALSE);
+    page_pool(TRUE);
+
+    printf("// passed\n");
+    return 0;
+}